@@ -34,11 +34,14 @@
 #include "hashmap.h"
 #include "locale-util.h"
 #include "log.h"
+#include "logs-show.h"
 #include "pager.h"
 #include "parse-util.h"
+#include "process-util.h"
 #ifdef HAVE_SECCOMP
 #include "seccomp-util.h"
 #endif
+#include "signal-util.h"
 #include "special.h"
 #include "strv.h"
 #include "strxcpyx.h"
@@ -80,6 +83,36 @@ static char *arg_host = NULL;
 static bool arg_user = false;
 static bool arg_man = true;
 
+struct unit_load_times {
+        usec_t load_time;
+        uint64_t cache_hits;
+        uint64_t cache_misses;
+};
+
+struct gc_stats {
+        uint64_t runs;
+        uint64_t units_visited;
+        uint64_t units_collected;
+        usec_t total_time;
+        usec_t last_time;
+        usec_t max_time;
+};
+
+struct start_job_stats {
+        unsigned max_concurrent;
+        unsigned running;
+        uint64_t jobs;
+        uint64_t throttled;
+        usec_t wait_time;
+        usec_t max_wait_time;
+        usec_t throttle_time;
+};
+
+struct trace_info {
+        unsigned buffer_size;
+        uint64_t dropped;
+};
+
 struct boot_times {
         usec_t firmware_time;
         usec_t loader_time;
@@ -115,6 +148,7 @@ struct unit_times {
         usec_t deactivated;
         usec_t deactivating;
         usec_t time;
+        char **after; /* only acquired for critical-chain */
 };
 
 struct host_info {
@@ -127,33 +161,6 @@ struct host_info {
         char *architecture;
 };
 
-static int bus_get_uint64_property(sd_bus *bus, const char *path, const char *interface, const char *property, uint64_t *val) {
-        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
-        int r;
-
-        assert(bus);
-        assert(path);
-        assert(interface);
-        assert(property);
-        assert(val);
-
-        r = sd_bus_get_property_trivial(
-                        bus,
-                        "org.freedesktop.systemd1",
-                        path,
-                        interface,
-                        property,
-                        &error,
-                        't', val);
-
-        if (r < 0) {
-                log_error("Failed to parse reply: %s", bus_error_message(&error, -r));
-                return r;
-        }
-
-        return 0;
-}
-
 static int bus_get_unit_property_strv(sd_bus *bus, const char *path, const char *property, char ***strv) {
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         int r;
@@ -192,8 +199,10 @@ static int compare_unit_start(const void *a, const void *b) {
 static void free_unit_times(struct unit_times *t, unsigned n) {
         struct unit_times *p;
 
-        for (p = t; p < t + n; p++)
+        for (p = t; p < t + n; p++) {
                 free(p->name);
+                strv_free(p->after);
+        }
 
         free(t);
 }
@@ -208,75 +217,40 @@ static void subtract_timestamp(usec_t *a, usec_t b) {
 }
 
 static int acquire_boot_times(sd_bus *bus, struct boot_times **bt) {
+        static const struct bus_properties_map boot_times_map[] = {
+                { "FirmwareTimestampMonotonic",         "t", NULL, offsetof(struct boot_times, firmware_time)          },
+                { "LoaderTimestampMonotonic",           "t", NULL, offsetof(struct boot_times, loader_time)            },
+                { "KernelTimestamp",                    "t", NULL, offsetof(struct boot_times, kernel_time)            },
+                { "InitRDTimestampMonotonic",           "t", NULL, offsetof(struct boot_times, initrd_time)            },
+                { "UserspaceTimestampMonotonic",        "t", NULL, offsetof(struct boot_times, userspace_time)         },
+                { "FinishTimestampMonotonic",           "t", NULL, offsetof(struct boot_times, finish_time)            },
+                { "SecurityStartTimestampMonotonic",    "t", NULL, offsetof(struct boot_times, security_start_time)    },
+                { "SecurityFinishTimestampMonotonic",   "t", NULL, offsetof(struct boot_times, security_finish_time)   },
+                { "GeneratorsStartTimestampMonotonic",  "t", NULL, offsetof(struct boot_times, generators_start_time)  },
+                { "GeneratorsFinishTimestampMonotonic", "t", NULL, offsetof(struct boot_times, generators_finish_time) },
+                { "UnitsLoadStartTimestampMonotonic",   "t", NULL, offsetof(struct boot_times, unitsload_start_time)   },
+                { "UnitsLoadFinishTimestampMonotonic",  "t", NULL, offsetof(struct boot_times, unitsload_finish_time)  },
+                {}
+        };
+
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         static struct boot_times times;
         static bool cached = false;
+        int r;
 
         if (cached)
                 goto finish;
 
         assert_cc(sizeof(usec_t) == sizeof(uint64_t));
 
-        if (bus_get_uint64_property(bus,
-                                    "/org/freedesktop/systemd1",
-                                    "org.freedesktop.systemd1.Manager",
-                                    "FirmwareTimestampMonotonic",
-                                    &times.firmware_time) < 0 ||
-            bus_get_uint64_property(bus,
-                                    "/org/freedesktop/systemd1",
-                                    "org.freedesktop.systemd1.Manager",
-                                    "LoaderTimestampMonotonic",
-                                    &times.loader_time) < 0 ||
-            bus_get_uint64_property(bus,
-                                    "/org/freedesktop/systemd1",
-                                    "org.freedesktop.systemd1.Manager",
-                                    "KernelTimestamp",
-                                    &times.kernel_time) < 0 ||
-            bus_get_uint64_property(bus,
-                                    "/org/freedesktop/systemd1",
-                                    "org.freedesktop.systemd1.Manager",
-                                    "InitRDTimestampMonotonic",
-                                    &times.initrd_time) < 0 ||
-            bus_get_uint64_property(bus,
-                                    "/org/freedesktop/systemd1",
-                                    "org.freedesktop.systemd1.Manager",
-                                    "UserspaceTimestampMonotonic",
-                                    &times.userspace_time) < 0 ||
-            bus_get_uint64_property(bus,
-                                    "/org/freedesktop/systemd1",
-                                    "org.freedesktop.systemd1.Manager",
-                                    "FinishTimestampMonotonic",
-                                    &times.finish_time) < 0 ||
-            bus_get_uint64_property(bus,
-                                    "/org/freedesktop/systemd1",
-                                    "org.freedesktop.systemd1.Manager",
-                                    "SecurityStartTimestampMonotonic",
-                                    &times.security_start_time) < 0 ||
-            bus_get_uint64_property(bus,
-                                    "/org/freedesktop/systemd1",
-                                    "org.freedesktop.systemd1.Manager",
-                                    "SecurityFinishTimestampMonotonic",
-                                    &times.security_finish_time) < 0 ||
-            bus_get_uint64_property(bus,
-                                    "/org/freedesktop/systemd1",
-                                    "org.freedesktop.systemd1.Manager",
-                                    "GeneratorsStartTimestampMonotonic",
-                                    &times.generators_start_time) < 0 ||
-            bus_get_uint64_property(bus,
-                                    "/org/freedesktop/systemd1",
-                                    "org.freedesktop.systemd1.Manager",
-                                    "GeneratorsFinishTimestampMonotonic",
-                                    &times.generators_finish_time) < 0 ||
-            bus_get_uint64_property(bus,
-                                    "/org/freedesktop/systemd1",
-                                    "org.freedesktop.systemd1.Manager",
-                                    "UnitsLoadStartTimestampMonotonic",
-                                    &times.unitsload_start_time) < 0 ||
-            bus_get_uint64_property(bus,
-                                    "/org/freedesktop/systemd1",
-                                    "org.freedesktop.systemd1.Manager",
-                                    "UnitsLoadFinishTimestampMonotonic",
-                                    &times.unitsload_finish_time) < 0)
-                return -EIO;
+        r = bus_map_all_properties(bus,
+                                   "org.freedesktop.systemd1",
+                                   "/org/freedesktop/systemd1",
+                                   boot_times_map,
+                                   &error,
+                                   &times);
+        if (r < 0)
+                return log_error_errno(r, "Failed to get timestamp properties: %s", bus_error_message(&error, r));
 
         if (times.finish_time <= 0) {
                 log_error("Bootup is not yet finished. Please try again later.");
@@ -332,18 +306,25 @@ static void free_host_info(struct host_info *hi) {
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(struct host_info*, free_host_info);
 
-static int acquire_time_data(sd_bus *bus, struct unit_times **out) {
+typedef int (*unit_properties_handler_t)(const char *id, sd_bus_message *m, void *userdata);
+
+static int foreach_unit_properties_pipelined(
+                sd_bus *bus,
+                unit_properties_handler_t handler,
+                void *userdata) {
+
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
-        int r, c = 0;
-        struct boot_times *boot_times = NULL;
-        struct unit_times *unit_times = NULL;
-        size_t size = 0;
+        _cleanup_strv_free_ char **ids = NULL, **paths = NULL;
+        sd_bus_message **replies = NULL;
+        unsigned n, i;
         UnitInfo u;
+        int r;
 
-        r = acquire_boot_times(bus, &boot_times);
-        if (r < 0)
-                goto fail;
+        /* Fallback for managers that do not implement
+         * ListUnitsProperties(): list the units, then get their
+         * properties with GetAll calls that are sent out without
+         * waiting for the previous reply */
 
         r = sd_bus_call_method(
                         bus,
@@ -353,84 +334,222 @@ static int acquire_time_data(sd_bus *bus, struct unit_times **out) {
                         "ListUnits",
                         &error, &reply,
                         NULL);
-        if (r < 0) {
-                log_error("Failed to list units: %s", bus_error_message(&error, -r));
-                goto fail;
-        }
+        if (r < 0)
+                return log_error_errno(r, "Failed to list units: %s", bus_error_message(&error, r));
 
         r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "(ssssssouso)");
-        if (r < 0) {
-                bus_log_parse_error(r);
-                goto fail;
-        }
+        if (r < 0)
+                return bus_log_parse_error(r);
 
         while ((r = bus_parse_unit_info(reply, &u)) > 0) {
-                struct unit_times *t;
+                if (strv_extend(&ids, u.id) < 0 ||
+                    strv_extend(&paths, u.unit_path) < 0)
+                        return log_oom();
+        }
+        if (r < 0)
+                return bus_log_parse_error(r);
 
-                if (!GREEDY_REALLOC(unit_times, size, c+1)) {
-                        r = log_oom();
-                        goto fail;
-                }
+        n = strv_length(ids);
+        if (n == 0)
+                return 0;
+
+        replies = new0(sd_bus_message*, n);
+        if (!replies)
+                return log_oom();
+
+        r = bus_get_all_properties_pipelined(bus, "org.freedesktop.systemd1", paths, "org.freedesktop.systemd1.Unit", replies);
+        if (r < 0) {
+                log_error_errno(r, "Failed to get unit properties: %m");
+                goto finish;
+        }
 
-                t = unit_times+c;
-                t->name = NULL;
-
-                assert_cc(sizeof(usec_t) == sizeof(uint64_t));
-
-                if (bus_get_uint64_property(bus, u.unit_path,
-                                            "org.freedesktop.systemd1.Unit",
-                                            "InactiveExitTimestampMonotonic",
-                                            &t->activating) < 0 ||
-                    bus_get_uint64_property(bus, u.unit_path,
-                                            "org.freedesktop.systemd1.Unit",
-                                            "ActiveEnterTimestampMonotonic",
-                                            &t->activated) < 0 ||
-                    bus_get_uint64_property(bus, u.unit_path,
-                                            "org.freedesktop.systemd1.Unit",
-                                            "ActiveExitTimestampMonotonic",
-                                            &t->deactivating) < 0 ||
-                    bus_get_uint64_property(bus, u.unit_path,
-                                            "org.freedesktop.systemd1.Unit",
-                                            "InactiveEnterTimestampMonotonic",
-                                            &t->deactivated) < 0) {
+        for (i = 0; i < n; i++) {
+                if (!replies[i]) {
+                        log_error("Failed to get properties of %s.", ids[i]);
                         r = -EIO;
-                        goto fail;
+                        goto finish;
                 }
 
-                subtract_timestamp(&t->activating, boot_times->reverse_offset);
-                subtract_timestamp(&t->activated, boot_times->reverse_offset);
-                subtract_timestamp(&t->deactivating, boot_times->reverse_offset);
-                subtract_timestamp(&t->deactivated, boot_times->reverse_offset);
+                r = handler(ids[i], replies[i], userdata);
+                if (r < 0)
+                        goto finish;
+        }
 
-                if (t->activated >= t->activating)
-                        t->time = t->activated - t->activating;
-                else if (t->deactivated >= t->activating)
-                        t->time = t->deactivated - t->activating;
-                else
-                        t->time = 0;
+        r = 0;
 
-                if (t->activating == 0)
-                        continue;
+finish:
+        for (i = 0; i < n; i++)
+                sd_bus_message_unref(replies[i]);
+        free(replies);
 
-                t->name = strdup(u.id);
-                if (t->name == NULL) {
-                        r = log_oom();
-                        goto fail;
-                }
-                c++;
+        return r;
+}
+
+static int foreach_unit_properties(
+                sd_bus *bus,
+                char **properties,
+                unit_properties_handler_t handler,
+                void *userdata) {
+
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        int r;
+
+        assert(bus);
+        assert(handler);
+
+        /* Calls handler for each loaded unit, with a message
+         * positioned at an array of the selected properties of the
+         * unit. The manager returns them for all units in one go. */
+
+        r = sd_bus_message_new_method_call(
+                        bus,
+                        &m,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "ListUnitsProperties");
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        r = sd_bus_message_append_strv(m, NULL);
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        r = sd_bus_message_append_strv(m, properties);
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        r = sd_bus_call(bus, m, 0, &error, &reply);
+        if (r < 0 && sd_bus_error_has_name(&error, SD_BUS_ERROR_UNKNOWN_METHOD))
+                return foreach_unit_properties_pipelined(bus, handler, userdata);
+        if (r < 0)
+                return log_error_errno(r, "Failed to get unit properties: %s", bus_error_message(&error, r));
+
+        r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "(sa{sv})");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        while ((r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_STRUCT, "sa{sv}")) > 0) {
+                const char *id;
+
+                r = sd_bus_message_read(reply, "s", &id);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+
+                r = handler(id, reply, userdata);
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_exit_container(reply);
+                if (r < 0)
+                        return bus_log_parse_error(r);
         }
-        if (r < 0) {
-                bus_log_parse_error(r);
-                goto fail;
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        return 0;
+}
+
+struct unit_times_data {
+        const struct boot_times *boot_times;
+        struct unit_times *unit_times;
+        size_t size;
+        int c;
+};
+
+static int add_unit_times(const char *id, sd_bus_message *m, void *userdata) {
+        static const struct bus_properties_map unit_times_map[] = {
+                { "InactiveExitTimestampMonotonic",  "t", NULL, offsetof(struct unit_times, activating)   },
+                { "ActiveEnterTimestampMonotonic",   "t", NULL, offsetof(struct unit_times, activated)    },
+                { "ActiveExitTimestampMonotonic",    "t", NULL, offsetof(struct unit_times, deactivating) },
+                { "InactiveEnterTimestampMonotonic", "t", NULL, offsetof(struct unit_times, deactivated)  },
+                { "After",                           "as", NULL, offsetof(struct unit_times, after)       },
+                {}
+        };
+
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        struct unit_times_data *d = userdata;
+        struct unit_times *t;
+        int r;
+
+        assert(id);
+        assert(m);
+        assert(d);
+
+        if (!GREEDY_REALLOC(d->unit_times, d->size, d->c + 1))
+                return log_oom();
+
+        t = d->unit_times + d->c;
+        zero(*t);
+
+        assert_cc(sizeof(usec_t) == sizeof(uint64_t));
+
+        r = bus_message_map_all_properties(m, unit_times_map, &error, t);
+        if (r < 0)
+                return log_error_errno(r, "Failed to parse properties of %s: %s", id, bus_error_message(&error, r));
+
+        subtract_timestamp(&t->activating, d->boot_times->reverse_offset);
+        subtract_timestamp(&t->activated, d->boot_times->reverse_offset);
+        subtract_timestamp(&t->deactivating, d->boot_times->reverse_offset);
+        subtract_timestamp(&t->deactivated, d->boot_times->reverse_offset);
+
+        if (t->activated >= t->activating)
+                t->time = t->activated - t->activating;
+        else if (t->deactivated >= t->activating)
+                t->time = t->deactivated - t->activating;
+        else
+                t->time = 0;
+
+        if (t->activating == 0) {
+                t->after = strv_free(t->after);
+                return 0;
         }
 
-        *out = unit_times;
-        return c;
+        t->name = strdup(id);
+        if (!t->name)
+                return log_oom();
 
-fail:
-        if (unit_times)
-                free_unit_times(unit_times, (unsigned) c);
-        return r;
+        d->c++;
+        return 0;
+}
+
+static int acquire_time_data(sd_bus *bus, bool with_after, struct unit_times **out) {
+        struct unit_times_data d = {};
+        struct boot_times *boot_times = NULL;
+        int r;
+
+        r = acquire_boot_times(bus, &boot_times);
+        if (r < 0)
+                return r;
+
+        d.boot_times = boot_times;
+
+        /* The ordering dependencies are fetched along with the
+         * timestamps if requested, as critical-chain needs them for
+         * most units */
+        r = foreach_unit_properties(
+                        bus,
+                        with_after ?
+                        STRV_MAKE("InactiveExitTimestampMonotonic",
+                                  "ActiveEnterTimestampMonotonic",
+                                  "ActiveExitTimestampMonotonic",
+                                  "InactiveEnterTimestampMonotonic",
+                                  "After") :
+                        STRV_MAKE("InactiveExitTimestampMonotonic",
+                                  "ActiveEnterTimestampMonotonic",
+                                  "ActiveExitTimestampMonotonic",
+                                  "InactiveEnterTimestampMonotonic"),
+                        add_unit_times,
+                        &d);
+        if (r < 0) {
+                if (d.unit_times)
+                        free_unit_times(d.unit_times, (unsigned) d.c);
+                return r;
+        }
+
+        *out = d.unit_times;
+        return d.c;
 }
 
 static int acquire_host_info(sd_bus *bus, struct host_info **hi) {
@@ -561,7 +680,7 @@ static int analyze_plot(sd_bus *bus) {
         if (n < 0)
                 return n;
 
-        n = acquire_time_data(bus, &times);
+        n = acquire_time_data(bus, false, &times);
         if (n <= 0)
                 return n;
 
@@ -777,13 +896,26 @@ static int list_dependencies_print(const char *name, unsigned int level, unsigne
         return 0;
 }
 
+static Hashmap *unit_times_hashmap;
+
 static int list_dependencies_get_dependencies(sd_bus *bus, const char *name, char ***deps) {
         _cleanup_free_ char *path = NULL;
+        struct unit_times *times;
 
         assert(bus);
         assert(name);
         assert(deps);
 
+        /* Started units came with their dependencies already */
+        times = hashmap_get(unit_times_hashmap, name);
+        if (times) {
+                *deps = strv_copy(times->after);
+                if (!*deps)
+                        return -ENOMEM;
+
+                return 0;
+        }
+
         path = unit_dbus_path_from_name(name);
         if (path == NULL)
                 return -ENOMEM;
@@ -791,8 +923,6 @@ static int list_dependencies_get_dependencies(sd_bus *bus, const char *name, cha
         return bus_get_unit_property_strv(bus, path, "After", deps);
 }
 
-static Hashmap *unit_times_hashmap;
-
 static int list_dependencies_compare(const void *_a, const void *_b) {
         const char **a = (const char**) _a, **b = (const char**) _b;
         usec_t usa = 0, usb = 0;
@@ -948,7 +1078,7 @@ static int analyze_critical_chain(sd_bus *bus, char *names[]) {
         Hashmap *h;
         int n, r;
 
-        n = acquire_time_data(bus, &times);
+        n = acquire_time_data(bus, true, &times);
         if (n <= 0)
                 return n;
 
@@ -985,7 +1115,7 @@ static int analyze_blame(sd_bus *bus) {
         unsigned i;
         int n;
 
-        n = acquire_time_data(bus, &times);
+        n = acquire_time_data(bus, false, &times);
         if (n <= 0)
                 return n;
 
@@ -1016,71 +1146,480 @@ static int analyze_time(sd_bus *bus) {
         return 0;
 }
 
-static int graph_one_property(sd_bus *bus, const UnitInfo *u, const char* prop, const char *color, char* patterns[], char* from_patterns[], char* to_patterns[]) {
-        _cleanup_strv_free_ char **units = NULL;
-        char **unit;
+static int analyze_unit_load(sd_bus *bus) {
+        static const struct bus_properties_map unit_load_map[] = {
+                { "UnitsLoadUSec",       "t", NULL, offsetof(struct unit_load_times, load_time)    },
+                { "UnitFileCacheHits",   "t", NULL, offsetof(struct unit_load_times, cache_hits)   },
+                { "UnitFileCacheMisses", "t", NULL, offsetof(struct unit_load_times, cache_misses) },
+                {}
+        };
+
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        struct unit_load_times t = {};
+        char ts[FORMAT_TIMESPAN_MAX];
         int r;
-        bool match_patterns;
 
-        assert(u);
-        assert(prop);
-        assert(color);
+        r = bus_map_all_properties(bus,
+                                   "org.freedesktop.systemd1",
+                                   "/org/freedesktop/systemd1",
+                                   unit_load_map,
+                                   &error,
+                                   &t);
+        if (r < 0)
+                return log_error_errno(r, "Failed to get unit load properties: %s", bus_error_message(&error, r));
 
-        match_patterns = strv_fnmatch(patterns, u->id, 0);
+        printf("Units loaded in %s, %" PRIu64 " of %" PRIu64 " unit files read from the line cache.\n",
+               format_timespan(ts, sizeof(ts), t.load_time, USEC_PER_MSEC),
+               t.cache_hits, t.cache_hits + t.cache_misses);
 
-        if (!strv_isempty(from_patterns) &&
-            !match_patterns &&
-            !strv_fnmatch(from_patterns, u->id, 0))
+        return 0;
+}
+
+struct generator_time {
+        const char *name;
+        usec_t realtime;
+        usec_t cputime;
+        int code;
+        int status;
+        bool timed_out;
+};
+
+static int compare_generator_time(const void *a, const void *b) {
+        const struct generator_time *x = a, *y = b;
+
+        if (x->realtime > y->realtime)
+                return -1;
+        if (x->realtime < y->realtime)
+                return 1;
+
+        return 0;
+}
+
+static int analyze_generators(sd_bus *bus) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_free_ struct generator_time *times = NULL;
+        size_t n = 0, allocated = 0, i;
+        struct generator_time t;
+        int timed_out, r;
+
+        r = sd_bus_get_property(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "GeneratorTimes",
+                        &error,
+                        &reply,
+                        "a(sttiib)");
+        if (r < 0)
+                return log_error_errno(r, "Failed to get generator times: %s", bus_error_message(&error, r));
+
+        r = sd_bus_message_enter_container(reply, 'a', "(sttiib)");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        while ((r = sd_bus_message_read(reply, "(sttiib)",
+                                        &t.name, &t.realtime, &t.cputime,
+                                        &t.code, &t.status, &timed_out)) > 0) {
+                t.timed_out = timed_out;
+
+                if (!GREEDY_REALLOC(times, allocated, n + 1))
+                        return log_oom();
+
+                times[n++] = t;
+        }
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        if (n == 0) {
+                log_info("No generator timing information available.");
+                return 0;
+        }
+
+        qsort(times, n, sizeof(struct generator_time), compare_generator_time);
+
+        pager_open(arg_no_pager, false);
+
+        printf("%16s %16s %s\n", "WALL", "CPU", "GENERATOR");
+
+        for (i = 0; i < n; i++) {
+                char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX];
+
+                printf("%16s %16s %s",
+                       format_timespan(a, sizeof(a), times[i].realtime, USEC_PER_MSEC),
+                       format_timespan(b, sizeof(b), times[i].cputime, USEC_PER_MSEC),
+                       times[i].name);
+
+                if (times[i].timed_out)
+                        printf(" (timed out)");
+                else if (times[i].code == CLD_EXITED && times[i].status != 0)
+                        printf(" (exited with status %i)", times[i].status);
+                else if (times[i].code != CLD_EXITED)
+                        printf(" (%s by signal %s)",
+                               sigchld_code_to_string(times[i].code),
+                               signal_to_string(times[i].status));
+
+                putchar('\n');
+        }
+
+        return 0;
+}
+
+struct unit_memory {
+        const char *name;
+        uint64_t bytes;
+        uint32_t n_dependencies;
+};
+
+static int compare_unit_memory(const void *a, const void *b) {
+        const struct unit_memory *x = a, *y = b;
+
+        if (x->bytes > y->bytes)
+                return -1;
+        if (x->bytes < y->bytes)
+                return 1;
+
+        return strcmp(x->name, y->name);
+}
+
+static int analyze_unit_memory(sd_bus *bus) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_free_ struct unit_memory *units = NULL;
+        size_t n = 0, allocated = 0, i;
+        uint64_t total_bytes = 0, total_dependencies = 0;
+        char buf[FORMAT_BYTES_MAX];
+        struct unit_memory u;
+        int r;
+
+        r = sd_bus_call_method(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "ListUnitsMemoryUsage",
+                        &error, &reply,
+                        NULL);
+        if (r < 0)
+                return log_error_errno(r, "Failed to get unit memory usage: %s", bus_error_message(&error, r));
+
+        r = sd_bus_message_enter_container(reply, 'a', "(stu)");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        while ((r = sd_bus_message_read(reply, "(stu)", &u.name, &u.bytes, &u.n_dependencies)) > 0) {
+                if (!GREEDY_REALLOC(units, allocated, n + 1))
+                        return log_oom();
+
+                units[n++] = u;
+                total_bytes += u.bytes;
+                total_dependencies += u.n_dependencies;
+        }
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        qsort_safe(units, n, sizeof(struct unit_memory), compare_unit_memory);
+
+        pager_open(arg_no_pager, false);
+
+        printf("%10s %6s %s\n", "MEMORY", "DEPS", "UNIT");
+
+        for (i = 0; i < n; i++)
+                printf("%10s %6" PRIu32 " %s\n",
+                       format_bytes(buf, sizeof(buf), units[i].bytes),
+                       units[i].n_dependencies,
+                       units[i].name);
+
+        printf("\n%10s %6" PRIu64 " %zu units in total\n",
+               format_bytes(buf, sizeof(buf), total_bytes),
+               total_dependencies,
+               n);
+
+        return 0;
+}
+
+static int analyze_gc_stats(sd_bus *bus) {
+        static const struct bus_properties_map gc_stats_map[] = {
+                { "GCRuns",           "t", NULL, offsetof(struct gc_stats, runs)            },
+                { "GCUnitsVisited",   "t", NULL, offsetof(struct gc_stats, units_visited)   },
+                { "GCUnitsCollected", "t", NULL, offsetof(struct gc_stats, units_collected) },
+                { "GCUSec",           "t", NULL, offsetof(struct gc_stats, total_time)      },
+                { "GCLastUSec",       "t", NULL, offsetof(struct gc_stats, last_time)       },
+                { "GCMaxUSec",        "t", NULL, offsetof(struct gc_stats, max_time)        },
+                {}
+        };
+
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX], c[FORMAT_TIMESPAN_MAX];
+        struct gc_stats s = {};
+        int r;
+
+        r = bus_map_all_properties(bus,
+                                   "org.freedesktop.systemd1",
+                                   "/org/freedesktop/systemd1",
+                                   gc_stats_map,
+                                   &error,
+                                   &s);
+        if (r < 0)
+                return log_error_errno(r, "Failed to get garbage collector properties: %s", bus_error_message(&error, r));
+
+        if (s.runs == 0) {
+                log_info("The garbage collector did not run yet.");
+                return 0;
+        }
+
+        printf("Garbage collector ran %" PRIu64 " times for %s in total (last run %s, longest run %s).\n"
+               "%" PRIu64 " units visited (%.1f per run), %" PRIu64 " units collected.\n",
+               s.runs,
+               format_timespan(a, sizeof(a), s.total_time, 1),
+               format_timespan(b, sizeof(b), s.last_time, 1),
+               format_timespan(c, sizeof(c), s.max_time, 1),
+               s.units_visited, (double) s.units_visited / s.runs,
+               s.units_collected);
+
+        return 0;
+}
+
+static int analyze_start_jobs(sd_bus *bus) {
+        static const struct bus_properties_map start_job_map[] = {
+                { "MaxConcurrentStartJobs", "u", NULL, offsetof(struct start_job_stats, max_concurrent) },
+                { "RunningStartJobs",       "u", NULL, offsetof(struct start_job_stats, running)        },
+                { "StartJobs",              "t", NULL, offsetof(struct start_job_stats, jobs)           },
+                { "StartJobsThrottled",     "t", NULL, offsetof(struct start_job_stats, throttled)      },
+                { "StartJobWaitUSec",       "t", NULL, offsetof(struct start_job_stats, wait_time)      },
+                { "StartJobMaxWaitUSec",    "t", NULL, offsetof(struct start_job_stats, max_wait_time)  },
+                { "StartJobThrottleUSec",   "t", NULL, offsetof(struct start_job_stats, throttle_time)  },
+                {}
+        };
+
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX];
+        struct start_job_stats s = {};
+        int r;
+
+        r = bus_map_all_properties(bus,
+                                   "org.freedesktop.systemd1",
+                                   "/org/freedesktop/systemd1",
+                                   start_job_map,
+                                   &error,
+                                   &s);
+        if (r < 0)
+                return log_error_errno(r, "Failed to get start job properties: %s", bus_error_message(&error, r));
+
+        if (s.jobs == 0)
+                printf("No start jobs ran yet.\n");
+        else
+                printf("%" PRIu64 " start jobs waited %s in the job queue on average, %s at most.\n",
+                       s.jobs,
+                       format_timespan(a, sizeof(a), s.wait_time / s.jobs, USEC_PER_MSEC),
+                       format_timespan(b, sizeof(b), s.max_wait_time, USEC_PER_MSEC));
+
+        if (s.max_concurrent == 0) {
+                printf("Concurrent start jobs are not limited globally, %u running.\n", s.running);
+                if (s.throttled == 0)
                         return 0;
+        } else
+                printf("Up to %u start jobs may run concurrently, %u running.\n", s.max_concurrent, s.running);
+
+        printf("%" PRIu64 " start jobs waited %s in total for a free slot.\n",
+               s.throttled,
+               format_timespan(a, sizeof(a), s.throttle_time, USEC_PER_MSEC));
+
+        return 0;
+}
+
+static void trace_print_string(const char *s) {
+        json_escape(stdout, s, strlen(s), OUTPUT_SHOW_ALL);
+}
+
+static void trace_print_thread(unsigned tid, const char *name) {
+        printf(",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", tid);
+        trace_print_string(name);
+        printf("}}");
+}
+
+static int analyze_trace(sd_bus *bus) {
+        static const struct bus_properties_map trace_map[] = {
+                { "TraceBufferSize",    "u", NULL, offsetof(struct trace_info, buffer_size) },
+                { "TraceEventsDropped", "t", NULL, offsetof(struct trace_info, dropped)     },
+                {}
+        };
+
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_hashmap_free_ Hashmap *tids = NULL;
+        const char *phase, *name;
+        uint64_t begin, end;
+        struct trace_info t = {};
+        unsigned n_tids = 0;
+        int r;
+
+        r = bus_map_all_properties(bus,
+                                   "org.freedesktop.systemd1",
+                                   "/org/freedesktop/systemd1",
+                                   trace_map,
+                                   &error,
+                                   &t);
+        if (r < 0)
+                return log_error_errno(r, "Failed to get trace properties: %s", bus_error_message(&error, r));
+
+        if (t.buffer_size == 0) {
+                log_error("Tracing is not enabled, see TraceBufferSize= in systemd-system.conf(5).");
+                return -ENODATA;
+        }
 
-        r = bus_get_unit_property_strv(bus, u->unit_path, prop, &units);
+        r = sd_bus_call_method(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "DumpTrace",
+                        &error, &reply,
+                        NULL);
         if (r < 0)
-                return r;
+                return log_error_errno(r, "Failed to get trace: %s", bus_error_message(&error, r));
+
+        tids = hashmap_new(&string_hash_ops);
+        if (!tids)
+                return log_oom();
+
+        r = sd_bus_message_enter_container(reply, 'a', "(sstt)");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        /* Events of the manager itself go to thread 0, those of each
+         * unit or generator to a thread of its own, so that they show
+         * up as separate tracks in the viewer. */
+        printf("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+               "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"systemd\"}}");
+        trace_print_thread(0, "manager");
+
+        while ((r = sd_bus_message_read(reply, "(sstt)", &phase, &name, &begin, &end)) > 0) {
+                unsigned tid = 0;
+
+                if (!isempty(name)) {
+                        tid = PTR_TO_UINT(hashmap_get(tids, name));
+                        if (tid == 0) {
+                                tid = ++n_tids;
+
+                                r = hashmap_put(tids, name, UINT_TO_PTR(tid));
+                                if (r < 0)
+                                        return log_oom();
+
+                                trace_print_thread(tid, name);
+                        }
+                }
+
+                if (end < begin)
+                        end = begin;
+
+                printf(",\n{\"name\":");
+                trace_print_string(phase);
+                printf(",\"cat\":\"systemd\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                       "\"ts\":%" PRIu64 ".%03" PRIu64 ",\"dur\":%" PRIu64 ".%03" PRIu64 "}",
+                       tid,
+                       begin / NSEC_PER_USEC, begin % NSEC_PER_USEC,
+                       (end - begin) / NSEC_PER_USEC, (end - begin) % NSEC_PER_USEC);
+        }
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        printf("\n]}\n");
+
+        if (t.dropped > 0)
+                log_warning("The oldest %" PRIu64 " events were overwritten, consider increasing TraceBufferSize=.", t.dropped);
+
+        return 0;
+}
+
+struct unit_dependencies {
+        char **after;
+        char **requires;
+        char **requisite;
+        char **wants;
+        char **conflicts;
+};
+
+static void unit_dependencies_done(struct unit_dependencies *d) {
+        assert(d);
+
+        strv_free(d->after);
+        strv_free(d->requires);
+        strv_free(d->requisite);
+        strv_free(d->wants);
+        strv_free(d->conflicts);
+}
+
+struct graph_patterns {
+        char **patterns;
+        char **from_patterns;
+        char **to_patterns;
+};
+
+static void graph_one_property(const char *id, char **units, const char *color, const struct graph_patterns *p) {
+        char **unit;
+        bool match_patterns;
+
+        assert(id);
+        assert(color);
+        assert(p);
+
+        match_patterns = strv_fnmatch(p->patterns, id, 0);
+
+        if (!strv_isempty(p->from_patterns) &&
+            !match_patterns &&
+            !strv_fnmatch(p->from_patterns, id, 0))
+                        return;
 
         STRV_FOREACH(unit, units) {
                 bool match_patterns2;
 
-                match_patterns2 = strv_fnmatch(patterns, *unit, 0);
+                match_patterns2 = strv_fnmatch(p->patterns, *unit, 0);
 
-                if (!strv_isempty(to_patterns) &&
+                if (!strv_isempty(p->to_patterns) &&
                     !match_patterns2 &&
-                    !strv_fnmatch(to_patterns, *unit, 0))
+                    !strv_fnmatch(p->to_patterns, *unit, 0))
                         continue;
 
-                if (!strv_isempty(patterns) && !match_patterns && !match_patterns2)
+                if (!strv_isempty(p->patterns) && !match_patterns && !match_patterns2)
                         continue;
 
-                printf("\t\"%s\"->\"%s\" [color=\"%s\"];\n", u->id, *unit, color);
+                printf("\t\"%s\"->\"%s\" [color=\"%s\"];\n", id, *unit, color);
         }
-
-        return 0;
 }
 
-static int graph_one(sd_bus *bus, const UnitInfo *u, char *patterns[], char *from_patterns[], char *to_patterns[]) {
+static int graph_one(const char *id, sd_bus_message *m, void *userdata) {
+        static const struct bus_properties_map dependencies_map[] = {
+                { "After",     "as", NULL, offsetof(struct unit_dependencies, after)     },
+                { "Requires",  "as", NULL, offsetof(struct unit_dependencies, requires)  },
+                { "Requisite", "as", NULL, offsetof(struct unit_dependencies, requisite) },
+                { "Wants",     "as", NULL, offsetof(struct unit_dependencies, wants)     },
+                { "Conflicts", "as", NULL, offsetof(struct unit_dependencies, conflicts) },
+                {}
+        };
+
+        _cleanup_(unit_dependencies_done) struct unit_dependencies d = {};
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        const struct graph_patterns *p = userdata;
         int r;
 
-        assert(bus);
-        assert(u);
+        assert(id);
+        assert(m);
+        assert(p);
 
-        if (IN_SET(arg_dot, DEP_ORDER, DEP_ALL)) {
-                r = graph_one_property(bus, u, "After", "green", patterns, from_patterns, to_patterns);
-                if (r < 0)
-                        return r;
-        }
+        r = bus_message_map_all_properties(m, dependencies_map, &error, &d);
+        if (r < 0)
+                return log_error_errno(r, "Failed to parse properties of %s: %s", id, bus_error_message(&error, r));
+
+        if (IN_SET(arg_dot, DEP_ORDER, DEP_ALL))
+                graph_one_property(id, d.after, "green", p);
 
         if (IN_SET(arg_dot, DEP_REQUIRE, DEP_ALL)) {
-                r = graph_one_property(bus, u, "Requires", "black", patterns, from_patterns, to_patterns);
-                if (r < 0)
-                        return r;
-                r = graph_one_property(bus, u, "Requisite", "darkblue", patterns, from_patterns, to_patterns);
-                if (r < 0)
-                        return r;
-                r = graph_one_property(bus, u, "Wants", "grey66", patterns, from_patterns, to_patterns);
-                if (r < 0)
-                        return r;
-                r = graph_one_property(bus, u, "Conflicts", "red", patterns, from_patterns, to_patterns);
-                if (r < 0)
-                        return r;
+                graph_one_property(id, d.requires, "black", p);
+                graph_one_property(id, d.requisite, "darkblue", p);
+                graph_one_property(id, d.wants, "grey66", p);
+                graph_one_property(id, d.conflicts, "red", p);
         }
 
         return 0;
@@ -1129,13 +1668,11 @@ static int expand_patterns(sd_bus *bus, char **patterns, char ***ret) {
 }
 
 static int dot(sd_bus *bus, char* patterns[]) {
-        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
-        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         _cleanup_strv_free_ char **expanded_patterns = NULL;
         _cleanup_strv_free_ char **expanded_from_patterns = NULL;
         _cleanup_strv_free_ char **expanded_to_patterns = NULL;
+        struct graph_patterns p;
         int r;
-        UnitInfo u;
 
         r = expand_patterns(bus, patterns, &expanded_patterns);
         if (r < 0)
@@ -1149,34 +1686,21 @@ static int dot(sd_bus *bus, char* patterns[]) {
         if (r < 0)
                 return r;
 
-        r = sd_bus_call_method(
-                        bus,
-                       "org.freedesktop.systemd1",
-                       "/org/freedesktop/systemd1",
-                       "org.freedesktop.systemd1.Manager",
-                       "ListUnits",
-                       &error,
-                       &reply,
-                       "");
-        if (r < 0) {
-                log_error("Failed to list units: %s", bus_error_message(&error, -r));
-                return r;
-        }
-
-        r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "(ssssssouso)");
-        if (r < 0)
-                return bus_log_parse_error(r);
+        p = (struct graph_patterns) {
+                .patterns = expanded_patterns,
+                .from_patterns = expanded_from_patterns,
+                .to_patterns = expanded_to_patterns,
+        };
 
         printf("digraph systemd {\n");
 
-        while ((r = bus_parse_unit_info(reply, &u)) > 0) {
-
-                r = graph_one(bus, &u, expanded_patterns, expanded_from_patterns, expanded_to_patterns);
-                if (r < 0)
-                        return r;
-        }
+        r = foreach_unit_properties(
+                        bus,
+                        STRV_MAKE("After", "Requires", "Requisite", "Wants", "Conflicts"),
+                        graph_one,
+                        &p);
         if (r < 0)
-                return bus_log_parse_error(r);
+                return r;
 
         printf("}\n");
 
@@ -1362,6 +1886,12 @@ static void help(void) {
                "  blame                    Print list of running units ordered by time to init\n"
                "  critical-chain           Print a tree of the time critical chain of units\n"
                "  plot                     Output SVG graphic showing service initialization\n"
+               "  unit-load                Print time spent loading units at the last (re)load\n"
+               "  generators               Print time spent in each generator\n"
+               "  unit-memory              Print memory used by each unit object\n"
+               "  gc-stats                 Print statistics of the unit garbage collector\n"
+               "  start-jobs               Print how long start jobs waited in the job queue\n"
+               "  trace                    Output trace of the service manager in JSON format\n"
                "  dot                      Output dependency graph in man:dot(1) format\n"
                "  set-log-level LEVEL      Set logging threshold for manager\n"
                "  set-log-target TARGET    Set logging target for manager\n"
@@ -1526,6 +2056,18 @@ int main(int argc, char *argv[]) {
                         r = analyze_critical_chain(bus, argv+optind+1);
                 else if (streq(argv[optind], "plot"))
                         r = analyze_plot(bus);
+                else if (streq(argv[optind], "unit-load"))
+                        r = analyze_unit_load(bus);
+                else if (streq(argv[optind], "generators"))
+                        r = analyze_generators(bus);
+                else if (streq(argv[optind], "unit-memory"))
+                        r = analyze_unit_memory(bus);
+                else if (streq(argv[optind], "gc-stats"))
+                        r = analyze_gc_stats(bus);
+                else if (streq(argv[optind], "start-jobs"))
+                        r = analyze_start_jobs(bus);
+                else if (streq(argv[optind], "trace"))
+                        r = analyze_trace(bus);
                 else if (streq(argv[optind], "dot"))
                         r = dot(bus, argv+optind+1);
                 else if (streq(argv[optind], "dump"))
@@ -1201,6 +1201,8 @@ int cg_is_empty_recursive(const char *controller, const char *path) {
                  * via the "populated" attribute of "cgroup.events". */
 
                 r = cg_read_event(controller, path, "populated", &t);
+                if (r == -ENOENT) /* Like on legacy, a group that is gone is empty */
+                        return true;
                 if (r < 0)
                         return r;
 
@@ -20,7 +20,9 @@
 #include <dirent.h>
 #include <errno.h>
 #include <sys/prctl.h>
+#include <sys/resource.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <stdio.h>
 
@@ -61,6 +63,9 @@ static int do_spawn(const char *path, char *argv[], int stdout_fd, pid_t *pid) {
 
                 assert_se(prctl(PR_SET_PDEATHSIG, SIGTERM) == 0);
 
+                /* The executor blocks SIGCHLD, don't pass that on */
+                (void) reset_signal_mask();
+
                 if (stdout_fd >= 0) {
                         /* If the fd happens to be in the right place, go along with that */
                         if (stdout_fd != STDOUT_FILENO &&
@@ -87,23 +92,143 @@ static int do_spawn(const char *path, char *argv[], int stdout_fd, pid_t *pid) {
         return 1;
 }
 
+typedef struct ExecChild {
+        char *path;
+        usec_t start;
+        bool timed_out;
+} ExecChild;
+
+static ExecChild *exec_child_free(ExecChild *c) {
+        if (!c)
+                return NULL;
+
+        free(c->path);
+        return mfree(c);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(ExecChild*, exec_child_free);
+
+static void exec_child_report(ExecChild *c, int status, const struct rusage *ru, FILE *timing) {
+        usec_t realtime, cputime;
+        int code;
+
+        assert(c);
+        assert(ru);
+
+        if (WIFEXITED(status)) {
+                code = CLD_EXITED;
+                status = WEXITSTATUS(status);
+
+                if (status != 0)
+                        log_warning("%s failed with error code %i.", c->path, status);
+                else
+                        log_debug("%s succeeded.", c->path);
+        } else {
+                code = WCOREDUMP(status) ? CLD_DUMPED : CLD_KILLED;
+                status = WTERMSIG(status);
+
+                if (!c->timed_out)
+                        log_warning("%s terminated by signal %s.", c->path, signal_to_string(status));
+        }
+
+        realtime = now(CLOCK_MONOTONIC) - c->start;
+        cputime = timeval_load(&ru->ru_utime) + timeval_load(&ru->ru_stime);
+
+        if (timing)
+                fprintf(timing, USEC_FMT " " USEC_FMT " " USEC_FMT " %i %i %i %s\n",
+                        c->start, realtime, cputime, code, status, c->timed_out, c->path);
+}
+
+static int wait_for_child(Hashmap *pids, usec_t timeout_each, FILE *timing) {
+        sigset_t ss;
+
+        /* Waits until one of the children has exited, killing those
+         * that take longer than timeout_each. Returns 0 if there are
+         * no children (left). */
+
+        assert_se(sigemptyset(&ss) >= 0);
+        assert_se(sigaddset(&ss, SIGCHLD) >= 0);
+
+        while (!hashmap_isempty(pids)) {
+                _cleanup_(exec_child_freep) ExecChild *c = NULL;
+                usec_t n, deadline = USEC_INFINITY;
+                struct timespec ts;
+                struct rusage ru;
+                Iterator i;
+                void *k;
+                int status;
+                pid_t pid;
+
+                pid = wait4(-1, &status, WNOHANG, &ru);
+                if (pid < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        return log_error_errno(errno, "Failed to wait for children: %m");
+                }
+                if (pid > 0) {
+                        c = hashmap_remove(pids, PID_TO_PTR(pid));
+                        if (!c)
+                                continue;
+
+                        exec_child_report(c, status, &ru, timing);
+                        return 1;
+                }
+
+                /* Nothing exited yet, kill whoever is out of time and
+                 * sleep until the next child exits or runs out of time */
+                n = now(CLOCK_MONOTONIC);
+
+                if (timeout_each != USEC_INFINITY)
+                        HASHMAP_FOREACH_KEY(c, k, pids, i) {
+                                if (c->timed_out)
+                                        continue;
+
+                                if (n >= usec_add(c->start, timeout_each)) {
+                                        log_warning("%s timed out, killing.", c->path);
+                                        (void) kill(PTR_TO_PID(k), SIGKILL);
+                                        c->timed_out = true;
+                                        continue;
+                                }
+
+                                deadline = MIN(deadline, usec_add(c->start, timeout_each));
+                        }
+
+                /* Make sure the cleanup handler doesn't free a child
+                 * that is still in the table */
+                c = NULL;
+
+                if (sigtimedwait(&ss, NULL,
+                                 deadline == USEC_INFINITY ? NULL : timespec_store(&ts, deadline - n)) < 0 &&
+                    !IN_SET(errno, EAGAIN, EINTR))
+                        return log_error_errno(errno, "Failed to wait for SIGCHLD: %m");
+        }
+
+        return 0;
+}
+
 static int do_execute(
                 char **directories,
                 usec_t timeout,
+                usec_t timeout_each,
+                unsigned max_parallel,
                 gather_stdout_callback_t const callbacks[_STDOUT_CONSUME_MAX],
                 void* const callback_args[_STDOUT_CONSUME_MAX],
                 int output_fd,
+                int timing_fd,
                 char *argv[]) {
 
-        _cleanup_hashmap_free_free_ Hashmap *pids = NULL;
+        _cleanup_(hashmap_freep) Hashmap *pids = NULL;
         _cleanup_strv_free_ char **paths = NULL;
+        _cleanup_fclose_ FILE *timing = NULL;
         char **path;
         int r;
 
         /* We fork this all off from a child process so that we can somewhat cleanly make
          * use of SIGALRM to set a time limit.
          *
-         * If callbacks is nonnull, execution is serial. Otherwise, we default to parallel.
+         * If callbacks is nonnull, execution is serial. Otherwise, we default to parallel,
+         * with at most max_parallel binaries running at the same time, unless that is 0.
          */
 
         (void) reset_all_signal_handlers();
@@ -111,15 +236,27 @@ static int do_execute(
 
         assert_se(prctl(PR_SET_PDEATHSIG, SIGTERM) == 0);
 
+        /* We wait for SIGCHLD with sigtimedwait() */
+        assert_se(sigprocmask_many(SIG_BLOCK, NULL, SIGCHLD, -1) >= 0);
+
+        if (timing_fd >= 0) {
+                timing = fdopen(timing_fd, "w");
+                if (!timing) {
+                        safe_close(timing_fd);
+                        return log_error_errno(errno, "Failed to open timing file: %m");
+                }
+        }
+
         r = conf_files_list_strv(&paths, NULL, NULL, (const char* const*) directories);
         if (r < 0)
                 return r;
 
-        if (!callbacks) {
-                pids = hashmap_new(NULL);
-                if (!pids)
-                        return log_oom();
-        }
+        pids = hashmap_new(NULL);
+        if (!pids)
+                return log_oom();
+
+        if (callbacks)
+                max_parallel = 1;
 
         /* Abort execution of this process after the timout. We simply rely on SIGALRM as
          * default action terminating the process, and turn on alarm(). */
@@ -128,12 +265,23 @@ static int do_execute(
                 alarm((timeout + USEC_PER_SEC - 1) / USEC_PER_SEC);
 
         STRV_FOREACH(path, paths) {
-                _cleanup_free_ char *t = NULL;
+                _cleanup_(exec_child_freep) ExecChild *c = NULL;
                 _cleanup_close_ int fd = -1;
                 pid_t pid;
 
-                t = strdup(*path);
-                if (!t)
+                if (max_parallel > 0)
+                        while (hashmap_size(pids) >= max_parallel) {
+                                r = wait_for_child(pids, timeout_each, timing);
+                                if (r < 0)
+                                        return r;
+                        }
+
+                c = new0(ExecChild, 1);
+                if (!c)
+                        return log_oom();
+
+                c->path = strdup(*path);
+                if (!c->path)
                         return log_oom();
 
                 if (callbacks) {
@@ -142,19 +290,21 @@ static int do_execute(
                                 return log_error_errno(fd, "Failed to open serialization file: %m");
                 }
 
-                r = do_spawn(t, argv, fd, &pid);
+                c->start = now(CLOCK_MONOTONIC);
+
+                r = do_spawn(c->path, argv, fd, &pid);
                 if (r <= 0)
                         continue;
 
-                if (pids) {
-                        r = hashmap_put(pids, PID_TO_PTR(pid), t);
-                        if (r < 0)
-                                return log_oom();
-                        t = NULL;
-                } else {
-                        r = wait_for_terminate_and_warn(t, pid, true);
+                r = hashmap_put(pids, PID_TO_PTR(pid), c);
+                if (r < 0)
+                        return log_oom();
+                c = NULL;
+
+                if (callbacks) {
+                        r = wait_for_child(pids, timeout_each, timing);
                         if (r < 0)
-                                continue;
+                                return r;
 
                         if (lseek(fd, 0, SEEK_SET) < 0)
                                 return log_error_errno(errno, "Failed to seek on serialization fd: %m");
@@ -172,36 +322,99 @@ static int do_execute(
                         return log_error_errno(r, "Callback two failed: %m");
         }
 
-        while (!hashmap_isempty(pids)) {
-                _cleanup_free_ char *t = NULL;
-                pid_t pid;
+        do {
+                r = wait_for_child(pids, timeout_each, timing);
+                if (r < 0)
+                        return r;
+        } while (r > 0);
 
-                pid = PTR_TO_PID(hashmap_first_key(pids));
-                assert(pid > 0);
+        if (timing) {
+                r = fflush_and_check(timing);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to write timing file: %m");
+        }
 
-                t = hashmap_remove(pids, PID_TO_PTR(pid));
-                assert(t);
+        return 0;
+}
+
+void exec_timing_free_many(ExecTiming *t, size_t n) {
+        size_t i;
+
+        for (i = 0; i < n; i++)
+                free(t[i].name);
 
-                wait_for_terminate_and_warn(t, pid, true);
+        free(t);
+}
+
+static int read_timing(int fd, ExecTiming **ret, size_t *ret_n) {
+        _cleanup_fclose_ FILE *f = NULL;
+        ExecTiming *t = NULL;
+        size_t n = 0, allocated = 0;
+        char line[LINE_MAX];
+        int r = 0;
+
+        f = fdopen(fd, "r");
+        if (!f) {
+                safe_close(fd);
+                return -errno;
         }
 
+        FOREACH_LINE(line, f, r = -EIO; goto fail) {
+                ExecTiming e = {};
+                int timed_out, k = 0;
+
+                truncate_nl(line);
+
+                if (sscanf(line, USEC_FMT " " USEC_FMT " " USEC_FMT " %i %i %i %n",
+                           &e.start, &e.realtime, &e.cputime, &e.code, &e.status, &timed_out, &k) != 6 || k == 0) {
+                        r = -EBADMSG;
+                        goto fail;
+                }
+
+                e.timed_out = timed_out;
+                e.name = strdup(basename(line + k));
+                if (!e.name) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+
+                if (!GREEDY_REALLOC(t, allocated, n + 1)) {
+                        free(e.name);
+                        r = -ENOMEM;
+                        goto fail;
+                }
+
+                t[n++] = e;
+        }
+
+        *ret = t;
+        *ret_n = n;
         return 0;
+
+fail:
+        exec_timing_free_many(t, n);
+        return r;
 }
 
-int execute_directories(
+int execute_directories_full(
                 const char* const* directories,
                 usec_t timeout,
+                usec_t timeout_each,
+                unsigned max_parallel,
                 gather_stdout_callback_t const callbacks[_STDOUT_CONSUME_MAX],
                 void* const callback_args[_STDOUT_CONSUME_MAX],
-                char *argv[]) {
+                char *argv[],
+                ExecTiming **ret_timing,
+                size_t *ret_n_timing) {
 
         pid_t executor_pid;
         char *name;
         char **dirs = (char**) directories;
-        _cleanup_close_ int fd = -1;
+        _cleanup_close_ int fd = -1, timing_fd = -1;
         int r;
 
         assert(!strv_isempty(dirs));
+        assert(!ret_timing == !ret_n_timing);
 
         name = basename(dirs[0]);
         assert(!isempty(name));
@@ -217,16 +430,23 @@ int execute_directories(
                         return log_error_errno(fd, "Failed to open serialization file: %m");
         }
 
+        if (ret_timing) {
+                timing_fd = open_serialization_fd("timing");
+                if (timing_fd < 0)
+                        return log_error_errno(timing_fd, "Failed to open timing file: %m");
+        }
+
         /* Executes all binaries in the directories serially or in parallel and waits for
-         * them to finish. Optionally a timeout is applied. If a file with the same name
-         * exists in more than one directory, the earliest one wins. */
+         * them to finish. Optionally a timeout is applied, in total and for each binary. If
+         * a file with the same name exists in more than one directory, the earliest one
+         * wins. If requested, returns how long each binary took. */
 
         executor_pid = fork();
         if (executor_pid < 0)
                 return log_error_errno(errno, "Failed to fork: %m");
 
         if (executor_pid == 0) {
-                r = do_execute(dirs, timeout, callbacks, callback_args, fd, argv);
+                r = do_execute(dirs, timeout, timeout_each, max_parallel, callbacks, callback_args, fd, timing_fd, argv);
                 _exit(r < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
         }
 
@@ -239,6 +459,16 @@ int execute_directories(
                 return -EREMOTEIO;
         }
 
+        if (ret_timing) {
+                if (lseek(timing_fd, 0, SEEK_SET) < 0)
+                        return log_error_errno(errno, "Failed to rewind timing fd: %m");
+
+                r = read_timing(timing_fd, ret_timing, ret_n_timing);
+                timing_fd = -1;
+                if (r < 0)
+                        return log_error_errno(r, "Failed to parse timing data: %m");
+        }
+
         if (!callbacks)
                 return 0;
 
@@ -252,6 +482,17 @@ int execute_directories(
         return 0;
 }
 
+int execute_directories(
+                const char* const* directories,
+                usec_t timeout,
+                gather_stdout_callback_t const callbacks[_STDOUT_CONSUME_MAX],
+                void* const callback_args[_STDOUT_CONSUME_MAX],
+                char *argv[]) {
+
+        return execute_directories_full(directories, timeout, USEC_INFINITY, 0,
+                                        callbacks, callback_args, argv, NULL, NULL);
+}
+
 static int gather_environment_generate(int fd, void *arg) {
         char ***env = arg, **x, **y;
         _cleanup_fclose_ FILE *f = NULL;
@@ -1,3 +1,5 @@
+#pragma once
+
 /***
   This file is part of systemd.
 
@@ -30,6 +32,30 @@ enum {
         _STDOUT_CONSUME_MAX,
 };
 
+/* How one of the binaries run by execute_directories_full() fared */
+typedef struct ExecTiming {
+        char *name;
+        usec_t start;     /* CLOCK_MONOTONIC */
+        usec_t realtime;
+        usec_t cputime;
+        int code;     /* CLD_EXITED, CLD_KILLED or CLD_DUMPED */
+        int status;   /* the exit status or signal */
+        bool timed_out;
+} ExecTiming;
+
+void exec_timing_free_many(ExecTiming *t, size_t n);
+
+int execute_directories_full(
+                const char* const* directories,
+                usec_t timeout,
+                usec_t timeout_each,
+                unsigned max_parallel,
+                gather_stdout_callback_t const callbacks[_STDOUT_CONSUME_MAX],
+                void* const callback_args[_STDOUT_CONSUME_MAX],
+                char *argv[],
+                ExecTiming **ret_timing,
+                size_t *ret_n_timing);
+
 int execute_directories(
                 const char* const* directories,
                 usec_t timeout,
@@ -1560,6 +1560,22 @@ unsigned internal_hashmap_buckets(HashmapBase *h) {
         return n_buckets(h);
 }
 
+size_t internal_hashmap_memory_usage(HashmapBase *h) {
+        const struct hashmap_type_info *hi;
+
+        if (!h)
+                return 0;
+
+        hi = &hashmap_type_info[h->type];
+
+        /* Direct storage is part of the head, indirect storage is
+         * allocated in a power of two sized block, see resize_buckets() */
+        if (!h->has_indirect)
+                return hi->head_size;
+
+        return hi->head_size + n_buckets(h) * (hi->entry_size + sizeof(dib_raw_t));
+}
+
 int internal_hashmap_merge(Hashmap *h, Hashmap *other) {
         Iterator i;
         unsigned idx;
@@ -91,6 +91,10 @@ static inline unsigned set_buckets(Set *s) {
         return internal_hashmap_buckets(HASHMAP_BASE(s));
 }
 
+static inline size_t set_memory_usage(Set *s) {
+        return internal_hashmap_memory_usage(HASHMAP_BASE(s));
+}
+
 bool set_iterate(Set *s, Iterator *i, void **value);
 
 static inline void set_clear(Set *s) {
@@ -19,11 +19,14 @@
 
 #include <alloca.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <signal.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "sd-bus.h"
@@ -35,18 +38,32 @@
 #include "cgroup-util.h"
 #include "fd-util.h"
 #include "fileio.h"
+#include "fs-util.h"
 #include "hashmap.h"
 #include "parse-util.h"
 #include "path-util.h"
 #include "process-util.h"
+#include "rlimit-util.h"
 #include "stdio-util.h"
 #include "terminal-util.h"
 #include "unit-name.h"
 #include "util.h"
 
+typedef enum GroupAttribute {
+        GROUP_ATTRIBUTE_TASKS,
+        GROUP_ATTRIBUTE_CPU,
+        GROUP_ATTRIBUTE_MEMORY,
+        GROUP_ATTRIBUTE_IO,
+        _GROUP_ATTRIBUTE_MAX,
+} GroupAttribute;
+
 typedef struct Group {
         char *path;
 
+        /* The attribute files are kept open across iterations and
+         * read again with pread() */
+        int fds[_GROUP_ATTRIBUTE_MAX];
+
         bool n_tasks_valid:1;
         bool cpu_valid:1;
         bool memory_valid:1;
@@ -67,6 +84,41 @@ typedef struct Group {
         uint64_t io_input_bps, io_output_bps;
 } Group;
 
+static const char *const controllers[] = {
+        SYSTEMD_CGROUP_CONTROLLER,
+        "cpu",
+        "cpuacct",
+        "memory",
+        "io",
+        "blkio",
+        "pids",
+};
+
+typedef struct TreeEntry {
+        char *path;
+        size_t parent;
+        Group *group;
+} TreeEntry;
+
+/* All control groups of one hierarchy, in the order they were found
+ * while walking it, i.e. parents before their children. The
+ * directories are watched with inotify, so that the hierarchy only
+ * needs to be walked again if control groups were added or
+ * removed. */
+typedef struct Tree {
+        const char *controllers[ELEMENTSOF(controllers)];
+        unsigned n_controllers;
+
+        dev_t dev;
+        ino_t ino;
+
+        TreeEntry *entries;
+        size_t n_entries, n_allocated;
+
+        int inotify_fd;
+        bool valid;
+} Tree;
+
 static unsigned arg_depth = 3;
 static unsigned arg_iterations = (unsigned) -1;
 static bool arg_batch = false;
@@ -76,6 +128,10 @@ static char* arg_machine = NULL;
 static char* arg_root = NULL;
 static bool arg_recursive = true;
 static bool arg_recursive_unset = false;
+static bool arg_benchmark = false;
+
+static unsigned n_fds = 0, n_fds_max = 0;
+static uint64_t n_walks = 0, n_opens = 0, n_reads = 0;
 
 static enum {
         COUNT_PIDS,
@@ -96,13 +152,102 @@ static enum {
         CPU_TIME,
 } arg_cpu_type = CPU_PERCENT;
 
+static void group_close_attributes(Group *g) {
+        GroupAttribute a;
+
+        assert(g);
+
+        for (a = 0; a < _GROUP_ATTRIBUTE_MAX; a++)
+                if (g->fds[a] >= 0) {
+                        g->fds[a] = safe_close(g->fds[a]);
+                        n_fds--;
+                }
+}
+
 static void group_free(Group *g) {
         assert(g);
 
+        group_close_attributes(g);
         free(g->path);
         free(g);
 }
 
+static int group_read_attribute(
+                Group *g,
+                GroupAttribute a,
+                const char *controller,
+                const char *attribute,
+                char *buf,
+                size_t size) {
+
+        ssize_t n;
+        int fd, r;
+
+        assert(g);
+        assert(controller);
+        assert(attribute);
+        assert(buf);
+        assert(size > 0);
+
+        fd = g->fds[a];
+        if (fd < 0) {
+                _cleanup_free_ char *p = NULL;
+
+                r = cg_get_path(controller, g->path, attribute, &p);
+                if (r < 0)
+                        return r;
+
+                fd = open(p, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+                if (fd < 0)
+                        return -errno;
+
+                n_opens++;
+        }
+
+        n = pread(fd, buf, size - 1, 0);
+        r = n < 0 ? -errno : 0;
+
+        /* Keep the file open for the next iteration, unless we are
+         * running out of file descriptors */
+        if (r < 0 || (g->fds[a] < 0 && n_fds >= n_fds_max)) {
+                if (g->fds[a] >= 0)
+                        n_fds--;
+                g->fds[a] = -1;
+                safe_close(fd);
+        } else if (g->fds[a] < 0) {
+                g->fds[a] = fd;
+                n_fds++;
+        }
+
+        /* The files of removed control groups return ENODEV */
+        if (r == -ENODEV)
+                return -ENOENT;
+        if (r < 0)
+                return r;
+
+        n_reads++;
+        buf[n] = 0;
+
+        return 0;
+}
+
+static int group_read_attribute_u64(
+                Group *g,
+                GroupAttribute a,
+                const char *controller,
+                const char *attribute,
+                uint64_t *ret) {
+
+        char buf[DECIMAL_STR_MAX(uint64_t) + 1];
+        int r;
+
+        r = group_read_attribute(g, a, controller, attribute, buf, sizeof(buf));
+        if (r < 0)
+                return r;
+
+        return safe_atou64(strstrip(buf), ret);
+}
+
 static void group_hashmap_clear(Hashmap *h) {
         Group *g;
 
@@ -148,10 +293,15 @@ static int process(
         if (!g) {
                 g = hashmap_get(b, path);
                 if (!g) {
+                        GroupAttribute i;
+
                         g = new0(Group, 1);
                         if (!g)
                                 return -ENOMEM;
 
+                        for (i = 0; i < _GROUP_ATTRIBUTE_MAX; i++)
+                                g->fds[i] = -1;
+
                         g->path = strdup(path);
                         if (!g->path) {
                                 group_free(g);
@@ -195,44 +345,38 @@ static int process(
                         g->n_tasks_valid = true;
 
         } else if (streq(controller, "pids") && arg_count == COUNT_PIDS) {
-                _cleanup_free_ char *p = NULL, *v = NULL;
-
-                r = cg_get_path(controller, path, "pids.current", &p);
-                if (r < 0)
-                        return r;
 
-                r = read_one_line_file(p, &v);
+                r = group_read_attribute_u64(g, GROUP_ATTRIBUTE_TASKS, controller, "pids.current", &g->n_tasks);
                 if (r == -ENOENT)
                         return 0;
                 if (r < 0)
                         return r;
 
-                r = safe_atou64(v, &g->n_tasks);
-                if (r < 0)
-                        return r;
-
                 if (g->n_tasks > 0)
                         g->n_tasks_valid = true;
 
         } else if (streq(controller, "cpu") || streq(controller, "cpuacct")) {
-                _cleanup_free_ char *p = NULL, *v = NULL;
                 uint64_t new_usage;
                 nsec_t timestamp;
 
                 if (all_unified) {
-                        const char *keys[] = { "usage_usec", NULL };
-                        _cleanup_free_ char *val = NULL;
+                        char buf[LINE_MAX], *l;
 
                         if (!streq(controller, "cpu"))
                                 return 0;
 
-                        r = cg_get_keyed_attribute("cpu", path, "cpu.stat", keys, &val);
+                        r = group_read_attribute(g, GROUP_ATTRIBUTE_CPU, controller, "cpu.stat", buf, sizeof(buf));
                         if (r == -ENOENT)
                                 return 0;
                         if (r < 0)
                                 return r;
 
-                        r = safe_atou64(val, &new_usage);
+                        l = startswith(buf, "usage_usec ");
+                        if (!l)
+                                return -ENODATA;
+
+                        l[strcspn(l, NEWLINE)] = 0;
+                        r = safe_atou64(l, &new_usage);
                         if (r < 0)
                                 return r;
 
@@ -241,19 +385,11 @@ static int process(
                         if (!streq(controller, "cpuacct"))
                                 return 0;
 
-                        r = cg_get_path(controller, path, "cpuacct.usage", &p);
-                        if (r < 0)
-                                return r;
-
-                        r = read_one_line_file(p, &v);
+                        r = group_read_attribute_u64(g, GROUP_ATTRIBUTE_CPU, controller, "cpuacct.usage", &new_usage);
                         if (r == -ENOENT)
                                 return 0;
                         if (r < 0)
                                 return r;
-
-                        r = safe_atou64(v, &new_usage);
-                        if (r < 0)
-                                return r;
                 }
 
                 timestamp = now_nsec(CLOCK_MONOTONIC);
@@ -277,52 +413,39 @@ static int process(
                 g->cpu_iteration = iteration;
 
         } else if (streq(controller, "memory")) {
-                _cleanup_free_ char *p = NULL, *v = NULL;
 
-                if (all_unified)
-                        r = cg_get_path(controller, path, "memory.current", &p);
-                else
-                        r = cg_get_path(controller, path, "memory.usage_in_bytes", &p);
-                if (r < 0)
-                        return r;
-
-                r = read_one_line_file(p, &v);
+                r = group_read_attribute_u64(g, GROUP_ATTRIBUTE_MEMORY, controller,
+                                             all_unified ? "memory.current" : "memory.usage_in_bytes",
+                                             &g->memory);
                 if (r == -ENOENT)
                         return 0;
                 if (r < 0)
                         return r;
 
-                r = safe_atou64(v, &g->memory);
-                if (r < 0)
-                        return r;
-
                 if (g->memory > 0)
                         g->memory_valid = true;
 
         } else if ((streq(controller, "io") && all_unified) ||
                    (streq(controller, "blkio") && !all_unified)) {
-                _cleanup_fclose_ FILE *f = NULL;
-                _cleanup_free_ char *p = NULL;
+                char buf[64 * 1024], *line, *next;
                 uint64_t wr = 0, rd = 0;
                 nsec_t timestamp;
 
-                r = cg_get_path(controller, path, all_unified ? "io.stat" : "blkio.io_service_bytes", &p);
+                r = group_read_attribute(g, GROUP_ATTRIBUTE_IO, controller,
+                                         all_unified ? "io.stat" : "blkio.io_service_bytes",
+                                         buf, sizeof(buf));
+                if (r == -ENOENT)
+                        return 0;
                 if (r < 0)
                         return r;
 
-                f = fopen(p, "re");
-                if (!f) {
-                        if (errno == ENOENT)
-                                return 0;
-                        return -errno;
-                }
-
-                for (;;) {
-                        char line[LINE_MAX], *l;
+                for (line = buf; !isempty(line); line = next) {
                         uint64_t k, *q;
+                        char *l;
 
-                        if (!fgets(line, sizeof(line), f))
-                                break;
+                        next = line + strcspn(line, NEWLINE);
+                        if (*next)
+                                *(next++) = 0;
 
                         /* Trim and skip the device */
                         l = strstrip(line);
@@ -396,29 +519,167 @@ static int process(
         return 0;
 }
 
-static int refresh_one(
-                const char *controller,
-                const char *path,
-                Hashmap *a,
-                Hashmap *b,
-                unsigned iteration,
-                unsigned depth,
-                Group **ret) {
+static void tree_flush(Tree *t) {
+        size_t i;
+
+        assert(t);
+
+        for (i = 0; i < t->n_entries; i++)
+                free(t->entries[i].path);
+
+        t->n_entries = 0;
+        t->valid = false;
+}
+
+static void trees_free(Tree *trees, unsigned n) {
+        unsigned i;
+
+        for (i = 0; i < n; i++) {
+                tree_flush(trees + i);
+                free(trees[i].entries);
+                safe_close(trees[i].inotify_fd);
+        }
+}
+
+static bool tree_has_controller(Tree *t, const char *controller) {
+        unsigned i;
+
+        assert(t);
+
+        for (i = 0; i < t->n_controllers; i++)
+                if (streq(t->controllers[i], controller))
+                        return true;
+
+        return false;
+}
+
+static int trees_setup(const char *root, Tree *trees, unsigned *n_trees) {
+        unsigned i, j, n = 0;
+        int r;
+
+        assert(root);
+        assert(trees);
+        assert(n_trees);
+
+        *n_trees = 0;
+
+        /* Controllers that are mounted together, or all of them on the
+         * unified hierarchy, share a tree, so that each hierarchy is
+         * only walked once */
+
+        for (i = 0; i < ELEMENTSOF(controllers); i++) {
+                _cleanup_free_ char *p = NULL;
+                struct stat st;
+
+                r = cg_get_path(controllers[i], root, NULL, &p);
+                if (r < 0)
+                        return r;
+
+                if (stat(p, &st) < 0) {
+                        if (errno == ENOENT)
+                                continue;
+
+                        return -errno;
+                }
+
+                for (j = 0; j < n; j++)
+                        if (trees[j].dev == st.st_dev && trees[j].ino == st.st_ino)
+                                break;
+
+                if (j >= n) {
+                        trees[n] = (Tree) {
+                                .dev = st.st_dev,
+                                .ino = st.st_ino,
+                        };
+
+                        /* If we cannot watch the hierarchy, it is simply walked on each refresh */
+                        trees[n].inotify_fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+                        if (trees[n].inotify_fd < 0)
+                                log_debug_errno(errno, "Failed to allocate inotify fd, ignoring: %m");
+
+                        *n_trees = ++n;
+                }
+
+                assert(trees[j].n_controllers < ELEMENTSOF(trees[j].controllers));
+                trees[j].controllers[trees[j].n_controllers++] = controllers[i];
+        }
 
+        return 0;
+}
+
+static void tree_flush_events(Tree *t) {
+        union inotify_event_buffer buffer;
+        ssize_t l;
+
+        assert(t);
+
+        if (t->inotify_fd < 0) {
+                t->valid = false;
+                return;
+        }
+
+        /* Any event means that a control group was added, removed or
+         * renamed, or that we lost track of some */
+        for (;;) {
+                l = read(t->inotify_fd, &buffer, sizeof(buffer));
+                if (l < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        if (errno != EAGAIN)
+                                t->valid = false;
+
+                        break;
+                }
+
+                t->valid = false;
+        }
+}
+
+static int tree_walk_one(Tree *t, const char *controller, const char *path, size_t parent, unsigned depth) {
         _cleanup_closedir_ DIR *d = NULL;
-        Group *ours = NULL;
+        size_t self;
+        char *copy;
         int r;
 
+        assert(t);
         assert(controller);
         assert(path);
-        assert(a);
 
-        if (depth > arg_depth)
+        copy = strdup(path);
+        if (!copy)
+                return -ENOMEM;
+
+        if (!GREEDY_REALLOC(t->entries, t->n_allocated, t->n_entries + 1)) {
+                free(copy);
+                return -ENOMEM;
+        }
+
+        self = t->n_entries++;
+        t->entries[self] = (TreeEntry) {
+                .path = copy,
+                .parent = parent,
+        };
+
+        if (depth >= arg_depth)
                 return 0;
 
-        r = process(controller, path, a, b, iteration, &ours);
-        if (r < 0)
-                return r;
+        /* Watch before enumerating, so that nothing added in between
+         * is missed */
+        if (t->inotify_fd >= 0) {
+                _cleanup_free_ char *p = NULL;
+
+                r = cg_get_path(controller, path, NULL, &p);
+                if (r < 0)
+                        return r;
+
+                if (inotify_add_watch(t->inotify_fd, p, IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_ONLYDIR) < 0) {
+                        if (errno == ENOENT)
+                                return 0;
+
+                        log_debug_errno(errno, "Failed to watch %s, walking the hierarchy on each refresh: %m", p);
+                        t->inotify_fd = safe_close(t->inotify_fd);
+                }
+        }
 
         r = cg_enumerate_subgroups(controller, path, &d);
         if (r == -ENOENT)
@@ -428,7 +689,6 @@ static int refresh_one(
 
         for (;;) {
                 _cleanup_free_ char *fn = NULL, *p = NULL;
-                Group *child = NULL;
 
                 r = cg_read_subgroup(d, &fn);
                 if (r < 0)
@@ -442,17 +702,62 @@ static int refresh_one(
 
                 path_kill_slashes(p);
 
-                r = refresh_one(controller, p, a, b, iteration, depth + 1, &child);
+                r = tree_walk_one(t, controller, p, self, depth + 1);
                 if (r < 0)
                         return r;
+        }
+
+        return 0;
+}
+
+static int tree_refresh(Tree *t, const char *root, Hashmap *a, Hashmap *b, unsigned iteration) {
+        unsigned i;
+        size_t k;
+        int r;
+
+        assert(t);
+        assert(root);
+        assert(a);
+
+        tree_flush_events(t);
+
+        if (!t->valid) {
+                tree_flush(t);
+
+                r = tree_walk_one(t, t->controllers[0], root, (size_t) -1, 0);
+                if (r < 0)
+                        return r;
+
+                t->valid = true;
+                n_walks++;
+        }
+
+        for (k = 0; k < t->n_entries; k++) {
+                t->entries[k].group = NULL;
+
+                for (i = 0; i < t->n_controllers; i++) {
+                        r = process(t->controllers[i], t->entries[k].path, a, b, iteration, &t->entries[k].group);
+                        if (r < 0)
+                                return r;
+                }
+        }
 
-                if (arg_recursive &&
-                    IN_SET(arg_count, COUNT_ALL_PROCESSES, COUNT_USERSPACE_PROCESSES) &&
-                    child &&
-                    child->n_tasks_valid &&
-                    streq(controller, SYSTEMD_CGROUP_CONTROLLER)) {
+        if (arg_recursive &&
+            IN_SET(arg_count, COUNT_ALL_PROCESSES, COUNT_USERSPACE_PROCESSES) &&
+            tree_has_controller(t, SYSTEMD_CGROUP_CONTROLLER)) {
 
-                        /* Recursively sum up processes */
+                /* Recursively sum up processes. Children come after
+                 * their parents, hence going backwards each child is
+                 * complete before it is added to its parent. */
+
+                for (k = t->n_entries; k > 1; k--) {
+                        Group *child, *ours;
+
+                        child = t->entries[k-1].group;
+                        ours = t->entries[t->entries[k-1].parent].group;
+
+                        if (!child || !child->n_tasks_valid || !ours)
+                                continue;
 
                         if (ours->n_tasks_valid)
                                 ours->n_tasks += child->n_tasks;
@@ -463,38 +768,20 @@ static int refresh_one(
                 }
         }
 
-        if (ret)
-                *ret = ours;
-
-        return 1;
+        return 0;
 }
 
-static int refresh(const char *root, Hashmap *a, Hashmap *b, unsigned iteration) {
+static int refresh(const char *root, Tree *trees, unsigned n_trees, Hashmap *a, Hashmap *b, unsigned iteration) {
+        unsigned i;
         int r;
 
         assert(a);
 
-        r = refresh_one(SYSTEMD_CGROUP_CONTROLLER, root, a, b, iteration, 0, NULL);
-        if (r < 0)
-                return r;
-        r = refresh_one("cpu", root, a, b, iteration, 0, NULL);
-        if (r < 0)
-                return r;
-        r = refresh_one("cpuacct", root, a, b, iteration, 0, NULL);
-        if (r < 0)
-                return r;
-        r = refresh_one("memory", root, a, b, iteration, 0, NULL);
-        if (r < 0)
-                return r;
-        r = refresh_one("io", root, a, b, iteration, 0, NULL);
-        if (r < 0)
-                return r;
-        r = refresh_one("blkio", root, a, b, iteration, 0, NULL);
-        if (r < 0)
-                return r;
-        r = refresh_one("pids", root, a, b, iteration, 0, NULL);
-        if (r < 0)
-                return r;
+        for (i = 0; i < n_trees; i++) {
+                r = tree_refresh(trees + i, root, a, b, iteration);
+                if (r < 0)
+                        return r;
+        }
 
         return 0;
 }
@@ -704,6 +991,7 @@ static void help(void) {
                "  -n --iterations=N   Run for N iterations before exiting\n"
                "  -b --batch          Run in batch mode, accepting no input\n"
                "     --depth=DEPTH    Maximum traversal depth (default: %u)\n"
+               "     --benchmark      Show the cost of each refresh instead of the groups\n"
                "  -M --machine=       Show container\n"
                , program_invocation_short_name, arg_depth);
 }
@@ -716,6 +1004,7 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_CPU_TYPE,
                 ARG_ORDER,
                 ARG_RECURSIVE,
+                ARG_BENCHMARK,
         };
 
         static const struct option options[] = {
@@ -730,6 +1019,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "order",        required_argument, NULL, ARG_ORDER     },
                 { "recursive",    required_argument, NULL, ARG_RECURSIVE },
                 { "machine",      required_argument, NULL, 'M'           },
+                { "benchmark",    no_argument,       NULL, ARG_BENCHMARK },
                 {}
         };
 
@@ -859,6 +1149,10 @@ static int parse_argv(int argc, char *argv[]) {
                         arg_machine = optarg;
                         break;
 
+                case ARG_BENCHMARK:
+                        arg_benchmark = arg_batch = true;
+                        break;
+
                 case '?':
                         return -EINVAL;
 
@@ -876,6 +1170,40 @@ static int parse_argv(int argc, char *argv[]) {
         return 1;
 }
 
+static void setup_fds_max(void) {
+        struct rlimit rl;
+
+        /* Each control group may keep up to four attribute files
+         * open, hence raise the soft limit as far as we may, and leave
+         * some room for everything else */
+
+        if (getrlimit(RLIMIT_NOFILE, &rl) < 0)
+                return;
+
+        if (rl.rlim_cur < rl.rlim_max) {
+                rl.rlim_cur = rl.rlim_max;
+                (void) setrlimit_closest(RLIMIT_NOFILE, &rl);
+
+                if (getrlimit(RLIMIT_NOFILE, &rl) < 0)
+                        return;
+        }
+
+        if (rl.rlim_cur == RLIM_INFINITY || rl.rlim_cur > UINT_MAX)
+                rl.rlim_cur = UINT_MAX;
+
+        n_fds_max = rl.rlim_cur > 64 ? (unsigned) rl.rlim_cur - 64 : 0;
+}
+
+static void show_refresh_cost(unsigned iteration, usec_t t, Hashmap *h, uint64_t walks, uint64_t opens, uint64_t reads) {
+        char buffer[FORMAT_TIMESPAN_MAX];
+
+        printf("Refresh %u: %s, %u groups, %" PRIu64 " walks, %" PRIu64 " opens, %" PRIu64 " reads, %u files open\n",
+               iteration,
+               format_timespan(buffer, sizeof(buffer), t, USEC_PER_MSEC/100),
+               hashmap_size(h),
+               walks, opens, reads, n_fds);
+}
+
 static const char* counting_what(void) {
         if (arg_count == COUNT_PIDS)
                 return "tasks";
@@ -888,8 +1216,9 @@ static const char* counting_what(void) {
 int main(int argc, char *argv[]) {
         int r;
         Hashmap *a = NULL, *b = NULL;
-        unsigned iteration = 0;
-        usec_t last_refresh = 0;
+        Tree trees[ELEMENTSOF(controllers)] = {};
+        unsigned iteration = 0, n_trees = 0;
+        usec_t last_refresh = 0, total_cost = 0;
         bool quit = false, immediate_refresh = false;
         _cleanup_free_ char *root = NULL;
         CGroupMask mask;
@@ -921,6 +1250,14 @@ int main(int argc, char *argv[]) {
         } else
                 log_debug("Cgroup path: %s", root);
 
+        r = trees_setup(root, trees, &n_trees);
+        if (r < 0) {
+                log_error_errno(r, "Failed to determine control group hierarchies: %m");
+                goto finish;
+        }
+
+        setup_fds_max();
+
         a = hashmap_new(&string_hash_ops);
         b = hashmap_new(&string_hash_ops);
         if (!a || !b) {
@@ -931,7 +1268,7 @@ int main(int argc, char *argv[]) {
         signal(SIGWINCH, columns_lines_cache_reset);
 
         if (arg_iterations == (unsigned) -1)
-                arg_iterations = on_tty() ? 0 : 1;
+                arg_iterations = arg_benchmark ? 10 : on_tty() ? 0 : 1;
 
         while (!quit) {
                 Hashmap *c;
@@ -942,13 +1279,22 @@ int main(int argc, char *argv[]) {
                 t = now(CLOCK_MONOTONIC);
 
                 if (t >= last_refresh + arg_delay || immediate_refresh) {
+                        uint64_t walks = n_walks, opens = n_opens, reads = n_reads;
+                        usec_t cost;
 
-                        r = refresh(root, a, b, iteration++);
+                        r = refresh(root, trees, n_trees, a, b, iteration++);
                         if (r < 0) {
                                 log_error_errno(r, "Failed to refresh: %m");
                                 goto finish;
                         }
 
+                        if (arg_benchmark) {
+                                cost = now(CLOCK_MONOTONIC) - t;
+                                total_cost += cost;
+
+                                show_refresh_cost(iteration, cost, a, n_walks - walks, n_opens - opens, n_reads - reads);
+                        }
+
                         group_hashmap_clear(b);
 
                         c = a;
@@ -959,11 +1305,17 @@ int main(int argc, char *argv[]) {
                         immediate_refresh = false;
                 }
 
-                display(b);
+                if (!arg_benchmark)
+                        display(b);
 
                 if (arg_iterations && iteration >= arg_iterations)
                         break;
 
+                if (arg_benchmark) {
+                        (void) usleep(last_refresh + arg_delay - t);
+                        continue;
+                }
+
                 if (!on_tty()) /* non-TTY: Empty newline as delimiter between polls */
                         fputs("\n", stdout);
                 fflush(stdout);
@@ -1099,9 +1451,16 @@ int main(int argc, char *argv[]) {
 
         r = 0;
 
+        if (arg_benchmark && iteration > 0) {
+                char buffer[FORMAT_TIMESPAN_MAX];
+
+                printf("Average refresh: %s\n", format_timespan(buffer, sizeof(buffer), total_cost / iteration, USEC_PER_MSEC/100));
+        }
+
 finish:
         group_hashmap_free(a);
         group_hashmap_free(b);
+        trees_free(trees, n_trees);
 
         return r < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 }
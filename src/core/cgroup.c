@@ -19,6 +19,7 @@
 
 #include <fcntl.h>
 #include <fnmatch.h>
+#include <sys/resource.h>
 
 #include "alloc-util.h"
 #include "cgroup-util.h"
@@ -33,9 +34,35 @@
 #include "string-table.h"
 #include "string-util.h"
 #include "stdio-util.h"
+#include "strv.h"
+#include "trace.h"
 
 #define CGROUP_CPU_QUOTA_PERIOD_USEC ((usec_t) 100 * USEC_PER_MSEC)
 
+/* The most accounting attribute files kept open at a time */
+#define CGROUP_METRIC_FDS_MAX 16384U
+
+/* At most this many units are checked for empty cgroups in one go, to
+ * not starve other event sources during mass teardowns */
+#define CGROUP_EMPTY_BATCH_MAX 1024U
+
+/* How long, and for how many processes at most, the unit a process
+ * belongs to is remembered, without looking at /proc again */
+#define CGROUP_PID_CACHE_USEC (5*USEC_PER_SEC)
+#define CGROUP_PID_CACHE_MAX 65536U
+
+typedef struct CGroupPidCacheEntry {
+        char *unit;
+        usec_t timestamp;
+} CGroupPidCacheEntry;
+
+/* One entry of /proc/devices */
+struct CGroupProcDevice {
+        char type;
+        unsigned major;
+        char *name;
+};
+
 static void cgroup_compat_warn(void) {
         static bool cgroup_compat_warned = false;
 
@@ -284,13 +311,129 @@ static int lookup_block_device(const char *p, dev_t *dev) {
         return 0;
 }
 
-static int whitelist_device(const char *path, const char *node, const char *acc) {
+static bool unit_cgroup_attribute_is_cached(Unit *u, const char *key, const char *value) {
+        assert(u);
+        assert(key);
+        assert(value);
+
+        return streq_ptr(hashmap_get(u->cgroup_attributes, key), value);
+}
+
+static void unit_cgroup_attribute_remember(Unit *u, const char *key, const char *value) {
+        _cleanup_free_ char *k = NULL, *v = NULL;
+        char *old_key, *old_value;
+        int r;
+
+        assert(u);
+        assert(key);
+
+        old_value = hashmap_get2(u->cgroup_attributes, key, (void**) &old_key);
+        if (old_value) {
+                /* Either way the old value is not what's in the
+                 * cgroup anymore */
+                hashmap_remove(u->cgroup_attributes, key);
+                free(old_key);
+                free(old_value);
+        }
+
+        if (!value)
+                return;
+
+        r = hashmap_ensure_allocated(&u->cgroup_attributes, &string_hash_ops);
+        if (r < 0)
+                return;
+
+        k = strdup(key);
+        v = strdup(value);
+        if (!k || !v)
+                return;
+
+        r = hashmap_put(u->cgroup_attributes, k, v);
+        if (r < 0)
+                return;
+
+        k = v = NULL;
+}
+
+static void unit_cgroup_attributes_flush(Unit *u, CGroupMask mask) {
+        char *key, *value;
+        Iterator i;
+
+        assert(u);
+
+        /* Forgets the values written to the attributes of the
+         * specified controllers, whose name every attribute starts
+         * with */
+        HASHMAP_FOREACH_KEY(value, key, u->cgroup_attributes, i) {
+                _cleanup_free_ char *controller = NULL;
+                CGroupController c;
+
+                controller = strndup(key, strcspn(key, "."));
+                if (controller) {
+                        c = cgroup_controller_from_string(controller);
+                        if (c >= 0 && !(mask & CGROUP_CONTROLLER_TO_MASK(c)))
+                                continue;
+                }
+
+                hashmap_remove(u->cgroup_attributes, key);
+                free(key);
+                free(value);
+        }
+}
+
+static void unit_close_cgroup_metric(Unit *u, CGroupMetric metric) {
+        assert(u);
+
+        if (u->cgroup_metric_fd[metric] >= 0) {
+                u->cgroup_metric_fd[metric] = safe_close(u->cgroup_metric_fd[metric]);
+                u->manager->n_cgroup_metric_fds--;
+        }
+
+        u->cgroup_metric_timestamp[metric] = 0;
+}
+
+static void unit_close_cgroup_metrics(Unit *u) {
+        CGroupMetric metric;
+
+        assert(u);
+
+        for (metric = 0; metric < _CGROUP_METRIC_MAX; metric++)
+                unit_close_cgroup_metric(u, metric);
+}
+
+/* Writes a cgroup attribute of the unit, unless the very same value
+ * was written to it before. Attributes which take one line per device
+ * are cached per device, as specified by the key. */
+static int unit_set_cgroup_attribute(Unit *u, const char *controller, const char *attribute, const char *key, const char *value) {
+        const char *k;
+        int r;
+
+        assert(u);
+        assert(controller);
+        assert(attribute);
+        assert(value);
+
+        k = key ? strjoina(attribute, " ", key) : attribute;
+
+        if (unit_cgroup_attribute_is_cached(u, k, value)) {
+                u->manager->n_cgroup_attribute_writes_skipped++;
+                return 0;
+        }
+
+        u->manager->n_cgroup_attribute_writes++;
+
+        r = cg_set_attribute(controller, u->cgroup_path, attribute, value);
+        unit_cgroup_attribute_remember(u, k, r >= 0 ? value : NULL);
+
+        return r;
+}
+
+static int whitelist_device(char ***allow, const char *node, const char *acc) {
         char buf[2+DECIMAL_STR_MAX(dev_t)*2+2+4];
         struct stat st;
         bool ignore_notfound;
-        int r;
 
-        assert(path);
+        assert(allow);
         assert(acc);
 
         if (node[0] == '-') {
@@ -318,50 +461,66 @@ static int whitelist_device(const char *path, const char *node, const char *acc)
                 major(st.st_rdev), minor(st.st_rdev),
                 acc);
 
-        r = cg_set_attribute("devices", path, "devices.allow", buf);
-        if (r < 0)
-                log_full_errno(IN_SET(r, -ENOENT, -EROFS, -EINVAL, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
-                               "Failed to set devices.allow on %s: %m", path);
+        return strv_extend(allow, buf);
+}
 
-        return r;
+static void manager_free_proc_devices(Manager *m) {
+        size_t i;
+
+        assert(m);
+
+        for (i = 0; i < m->n_proc_devices; i++)
+                free(m->proc_devices[i].name);
+
+        m->proc_devices = mfree(m->proc_devices);
+        m->n_proc_devices = 0;
 }
 
-static int whitelist_major(const char *path, const char *name, char type, const char *acc) {
+static int manager_load_proc_devices(Manager *m) {
         _cleanup_fclose_ FILE *f = NULL;
+        size_t allocated = 0;
         char line[LINE_MAX];
-        bool good = false;
-        int r;
+        uint64_t iteration;
+        char type = 0;
 
-        assert(path);
-        assert(acc);
-        assert(type == 'b' || type == 'c');
+        assert(m);
+
+        /* /proc/devices only changes when drivers are loaded, hence
+         * reading it once per event loop iteration is plenty, however
+         * many units are realized in it */
+        if (sd_event_get_iteration(m->event, &iteration) < 0)
+                iteration = UINT64_MAX;
+        else if (m->proc_devices && m->proc_devices_iteration == iteration)
+                return 0;
+
+        manager_free_proc_devices(m);
 
         f = fopen("/proc/devices", "re");
         if (!f)
-                return log_warning_errno(errno, "Cannot open /proc/devices to resolve %s (%c): %m", name, type);
+                return -errno;
 
         FOREACH_LINE(line, f, goto fail) {
-                char buf[2+DECIMAL_STR_MAX(unsigned)+3+4], *p, *w;
+                char *p, *w, *name;
                 unsigned maj;
 
                 truncate_nl(line);
 
-                if (type == 'c' && streq(line, "Character devices:")) {
-                        good = true;
+                if (streq(line, "Character devices:")) {
+                        type = 'c';
                         continue;
                 }
 
-                if (type == 'b' && streq(line, "Block devices:")) {
-                        good = true;
+                if (streq(line, "Block devices:")) {
+                        type = 'b';
                         continue;
                 }
 
                 if (isempty(line)) {
-                        good = false;
+                        type = 0;
                         continue;
                 }
 
-                if (!good)
+                if (type == 0)
                         continue;
 
                 p = strstrip(line);
@@ -371,8 +530,7 @@ static int whitelist_major(const char *path, const char *name, char type, const
                         continue;
                 *w = 0;
 
-                r = safe_atou(p, &maj);
-                if (r < 0)
+                if (safe_atou(p, &maj) < 0)
                         continue;
                 if (maj <= 0)
                         continue;
@@ -380,25 +538,150 @@ static int whitelist_major(const char *path, const char *name, char type, const
                 w++;
                 w += strspn(w, WHITESPACE);
 
-                if (fnmatch(name, w, 0) != 0)
+                name = strdup(w);
+                if (!name)
+                        goto oom;
+
+                if (!GREEDY_REALLOC(m->proc_devices, allocated, m->n_proc_devices + 1)) {
+                        free(name);
+                        goto oom;
+                }
+
+                m->proc_devices[m->n_proc_devices++] = (struct CGroupProcDevice) {
+                        .type = type,
+                        .major = maj,
+                        .name = name,
+                };
+        }
+
+        m->proc_devices_iteration = iteration;
+        return 0;
+
+fail:
+        manager_free_proc_devices(m);
+        return -errno;
+
+oom:
+        manager_free_proc_devices(m);
+        return -ENOMEM;
+}
+
+static int whitelist_major(Manager *m, char ***allow, const char *name, char type, const char *acc) {
+        size_t i;
+        int r;
+
+        assert(m);
+        assert(allow);
+        assert(acc);
+        assert(type == 'b' || type == 'c');
+
+        r = manager_load_proc_devices(m);
+        if (r < 0)
+                return log_warning_errno(r, "Cannot read /proc/devices to resolve %s (%c): %m", name, type);
+
+        for (i = 0; i < m->n_proc_devices; i++) {
+                char buf[2+DECIMAL_STR_MAX(unsigned)+3+4];
+
+                if (m->proc_devices[i].type != type)
+                        continue;
+
+                if (fnmatch(name, m->proc_devices[i].name, 0) != 0)
                         continue;
 
                 sprintf(buf,
                         "%c %u:* %s",
                         type,
-                        maj,
+                        m->proc_devices[i].major,
                         acc);
 
-                r = cg_set_attribute("devices", path, "devices.allow", buf);
+                r = strv_extend(allow, buf);
                 if (r < 0)
-                        log_full_errno(IN_SET(r, -ENOENT, -EROFS, -EINVAL, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
-                                       "Failed to set devices.allow on %s: %m", path);
+                        return log_oom();
         }
 
         return 0;
+}
 
-fail:
-        return log_warning_errno(errno, "Failed to read /proc/devices: %m");
+static void cgroup_apply_devices(Unit *u, const char *path, bool deny_all, char **allow) {
+        _cleanup_free_ char *fn = NULL, *entries = NULL, *list = NULL;
+        _cleanup_close_ int fd = -1;
+        bool complete;
+        char **i;
+        int r;
+
+        assert(u);
+        assert(path);
+
+        /* The device list is reset and then set up entry by entry,
+         * hence is cached as a whole. All entries are written through
+         * the same fd, the kernel takes one entry per write. */
+        entries = strv_join(allow, "\n");
+        if (!entries) {
+                log_oom();
+                return;
+        }
+
+        list = strjoin(deny_all ? "deny a\n" : "allow a\n", entries);
+        if (!list) {
+                log_oom();
+                return;
+        }
+
+        if (unit_cgroup_attribute_is_cached(u, "devices.list", list)) {
+                u->manager->n_cgroup_attribute_writes_skipped += 1 + strv_length(allow);
+                return;
+        }
+
+        unit_cgroup_attribute_remember(u, "devices.list", NULL);
+
+        /* Changing the devices list of a populated cgroup
+         * might result in EINVAL, hence ignore EINVAL
+         * here. */
+
+        u->manager->n_cgroup_attribute_writes++;
+        if (deny_all)
+                r = cg_set_attribute("devices", path, "devices.deny", "a");
+        else
+                r = cg_set_attribute("devices", path, "devices.allow", "a");
+        if (r < 0) {
+                log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EINVAL, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
+                              "Failed to reset devices.list: %m");
+                if (r != -EINVAL)
+                        return;
+        }
+
+        complete = r >= 0;
+
+        if (strv_isempty(allow))
+                goto finish;
+
+        r = cg_get_path("devices", path, "devices.allow", &fn);
+        if (r < 0) {
+                log_unit_warning_errno(u, r, "Failed to determine path of devices.allow: %m");
+                return;
+        }
+
+        fd = open(fn, O_WRONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0) {
+                log_unit_full(u, IN_SET(errno, ENOENT, EROFS, EACCES) ? LOG_DEBUG : LOG_WARNING, errno,
+                              "Failed to open devices.allow on %s: %m", path);
+                return;
+        }
+
+        STRV_FOREACH(i, allow) {
+                u->manager->n_cgroup_attribute_writes++;
+
+                if (write(fd, *i, strlen(*i)) < 0) {
+                        log_unit_full(u, IN_SET(errno, ENOENT, EROFS, EINVAL, EACCES) ? LOG_DEBUG : LOG_WARNING, errno,
+                                      "Failed to set devices.allow on %s: %m", path);
+                        complete = false;
+                }
+        }
+
+finish:
+        /* Only a list that was set up completely is known */
+        if (complete)
+                unit_cgroup_attribute_remember(u, "devices.list", list);
 }
 
 static bool cgroup_context_has_cpu_weight(CGroupContext *c) {
@@ -436,7 +719,7 @@ static void cgroup_apply_unified_cpu_config(Unit *u, uint64_t weight, uint64_t q
         int r;
 
         xsprintf(buf, "%" PRIu64 "\n", weight);
-        r = cg_set_attribute("cpu", u->cgroup_path, "cpu.weight", buf);
+        r = unit_set_cgroup_attribute(u, "cpu", "cpu.weight", NULL, buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set cpu.weight: %m");
@@ -447,7 +730,7 @@ static void cgroup_apply_unified_cpu_config(Unit *u, uint64_t weight, uint64_t q
         else
                 xsprintf(buf, "max " USEC_FMT "\n", CGROUP_CPU_QUOTA_PERIOD_USEC);
 
-        r = cg_set_attribute("cpu", u->cgroup_path, "cpu.max", buf);
+        r = unit_set_cgroup_attribute(u, "cpu", "cpu.max", NULL, buf);
 
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
@@ -459,22 +742,22 @@ static void cgroup_apply_legacy_cpu_config(Unit *u, uint64_t shares, uint64_t qu
         int r;
 
         xsprintf(buf, "%" PRIu64 "\n", shares);
-        r = cg_set_attribute("cpu", u->cgroup_path, "cpu.shares", buf);
+        r = unit_set_cgroup_attribute(u, "cpu", "cpu.shares", NULL, buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set cpu.shares: %m");
 
         xsprintf(buf, USEC_FMT "\n", CGROUP_CPU_QUOTA_PERIOD_USEC);
-        r = cg_set_attribute("cpu", u->cgroup_path, "cpu.cfs_period_us", buf);
+        r = unit_set_cgroup_attribute(u, "cpu", "cpu.cfs_period_us", NULL, buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set cpu.cfs_period_us: %m");
 
         if (quota != USEC_INFINITY) {
                 xsprintf(buf, USEC_FMT "\n", quota * CGROUP_CPU_QUOTA_PERIOD_USEC / USEC_PER_SEC);
-                r = cg_set_attribute("cpu", u->cgroup_path, "cpu.cfs_quota_us", buf);
+                r = unit_set_cgroup_attribute(u, "cpu", "cpu.cfs_quota_us", NULL, buf);
         } else
-                r = cg_set_attribute("cpu", u->cgroup_path, "cpu.cfs_quota_us", "-1");
+                r = unit_set_cgroup_attribute(u, "cpu", "cpu.cfs_quota_us", NULL, "-1");
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set cpu.cfs_quota_us: %m");
@@ -538,6 +821,7 @@ static uint64_t cgroup_weight_io_to_blkio(uint64_t io_weight) {
 
 static void cgroup_apply_io_device_weight(Unit *u, const char *dev_path, uint64_t io_weight) {
         char buf[DECIMAL_STR_MAX(dev_t)*2+2+DECIMAL_STR_MAX(uint64_t)+1];
+        char key[DECIMAL_STR_MAX(dev_t)*2+2];
         dev_t dev;
         int r;
 
@@ -545,8 +829,9 @@ static void cgroup_apply_io_device_weight(Unit *u, const char *dev_path, uint64_
         if (r < 0)
                 return;
 
-        xsprintf(buf, "%u:%u %" PRIu64 "\n", major(dev), minor(dev), io_weight);
-        r = cg_set_attribute("io", u->cgroup_path, "io.weight", buf);
+        xsprintf(key, "%u:%u", major(dev), minor(dev));
+        xsprintf(buf, "%s %" PRIu64 "\n", key, io_weight);
+        r = unit_set_cgroup_attribute(u, "io", "io.weight", key, buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set io.weight: %m");
@@ -554,6 +839,7 @@ static void cgroup_apply_io_device_weight(Unit *u, const char *dev_path, uint64_
 
 static void cgroup_apply_blkio_device_weight(Unit *u, const char *dev_path, uint64_t blkio_weight) {
         char buf[DECIMAL_STR_MAX(dev_t)*2+2+DECIMAL_STR_MAX(uint64_t)+1];
+        char key[DECIMAL_STR_MAX(dev_t)*2+2];
         dev_t dev;
         int r;
 
@@ -561,8 +847,9 @@ static void cgroup_apply_blkio_device_weight(Unit *u, const char *dev_path, uint
         if (r < 0)
                 return;
 
-        xsprintf(buf, "%u:%u %" PRIu64 "\n", major(dev), minor(dev), blkio_weight);
-        r = cg_set_attribute("blkio", u->cgroup_path, "blkio.weight_device", buf);
+        xsprintf(key, "%u:%u", major(dev), minor(dev));
+        xsprintf(buf, "%s %" PRIu64 "\n", key, blkio_weight);
+        r = unit_set_cgroup_attribute(u, "blkio", "blkio.weight_device", key, buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set blkio.weight_device: %m");
@@ -571,6 +858,7 @@ static void cgroup_apply_blkio_device_weight(Unit *u, const char *dev_path, uint
 static unsigned cgroup_apply_io_device_limit(Unit *u, const char *dev_path, uint64_t *limits) {
         char limit_bufs[_CGROUP_IO_LIMIT_TYPE_MAX][DECIMAL_STR_MAX(uint64_t)];
         char buf[DECIMAL_STR_MAX(dev_t)*2+2+(6+DECIMAL_STR_MAX(uint64_t)+1)*4];
+        char key[DECIMAL_STR_MAX(dev_t)*2+2];
         CGroupIOLimitType type;
         dev_t dev;
         unsigned n = 0;
@@ -589,10 +877,11 @@ static unsigned cgroup_apply_io_device_limit(Unit *u, const char *dev_path, uint
                 }
         }
 
-        xsprintf(buf, "%u:%u rbps=%s wbps=%s riops=%s wiops=%s\n", major(dev), minor(dev),
+        xsprintf(key, "%u:%u", major(dev), minor(dev));
+        xsprintf(buf, "%s rbps=%s wbps=%s riops=%s wiops=%s\n", key,
                  limit_bufs[CGROUP_IO_RBPS_MAX], limit_bufs[CGROUP_IO_WBPS_MAX],
                  limit_bufs[CGROUP_IO_RIOPS_MAX], limit_bufs[CGROUP_IO_WIOPS_MAX]);
-        r = cg_set_attribute("io", u->cgroup_path, "io.max", buf);
+        r = unit_set_cgroup_attribute(u, "io", "io.max", key, buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set io.max: %m");
@@ -601,6 +890,7 @@ static unsigned cgroup_apply_io_device_limit(Unit *u, const char *dev_path, uint
 
 static unsigned cgroup_apply_blkio_device_limit(Unit *u, const char *dev_path, uint64_t rbps, uint64_t wbps) {
         char buf[DECIMAL_STR_MAX(dev_t)*2+2+DECIMAL_STR_MAX(uint64_t)+1];
+        char key[DECIMAL_STR_MAX(dev_t)*2+2];
         dev_t dev;
         unsigned n = 0;
         int r;
@@ -609,18 +899,20 @@ static unsigned cgroup_apply_blkio_device_limit(Unit *u, const char *dev_path, u
         if (r < 0)
                 return 0;
 
+        xsprintf(key, "%u:%u", major(dev), minor(dev));
+
         if (rbps != CGROUP_LIMIT_MAX)
                 n++;
-        sprintf(buf, "%u:%u %" PRIu64 "\n", major(dev), minor(dev), rbps);
-        r = cg_set_attribute("blkio", u->cgroup_path, "blkio.throttle.read_bps_device", buf);
+        sprintf(buf, "%s %" PRIu64 "\n", key, rbps);
+        r = unit_set_cgroup_attribute(u, "blkio", "blkio.throttle.read_bps_device", key, buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set blkio.throttle.read_bps_device: %m");
 
         if (wbps != CGROUP_LIMIT_MAX)
                 n++;
-        sprintf(buf, "%u:%u %" PRIu64 "\n", major(dev), minor(dev), wbps);
-        r = cg_set_attribute("blkio", u->cgroup_path, "blkio.throttle.write_bps_device", buf);
+        sprintf(buf, "%s %" PRIu64 "\n", key, wbps);
+        r = unit_set_cgroup_attribute(u, "blkio", "blkio.throttle.write_bps_device", key, buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set blkio.throttle.write_bps_device: %m");
@@ -639,7 +931,7 @@ static void cgroup_apply_unified_memory_limit(Unit *u, const char *file, uint64_
         if (v != CGROUP_LIMIT_MAX)
                 xsprintf(buf, "%" PRIu64 "\n", v);
 
-        r = cg_set_attribute("memory", u->cgroup_path, file, buf);
+        r = unit_set_cgroup_attribute(u, "memory", file, NULL, buf);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set %s: %m", file);
@@ -733,7 +1025,7 @@ static void cgroup_context_apply(Unit *u, CGroupMask mask, ManagerState state) {
                                 weight = CGROUP_WEIGHT_DEFAULT;
 
                         xsprintf(buf, "default %" PRIu64 "\n", weight);
-                        r = cg_set_attribute("io", path, "io.weight", buf);
+                        r = unit_set_cgroup_attribute(u, "io", "io.weight", "default", buf);
                         if (r < 0)
                                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                                               "Failed to set io.weight: %m");
@@ -810,7 +1102,7 @@ static void cgroup_context_apply(Unit *u, CGroupMask mask, ManagerState state) {
                                 weight = CGROUP_BLKIO_WEIGHT_DEFAULT;
 
                         xsprintf(buf, "%" PRIu64 "\n", weight);
-                        r = cg_set_attribute("blkio", path, "blkio.weight", buf);
+                        r = unit_set_cgroup_attribute(u, "blkio", "blkio.weight", NULL, buf);
                         if (r < 0)
                                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                                               "Failed to set blkio.weight: %m");
@@ -889,7 +1181,7 @@ static void cgroup_context_apply(Unit *u, CGroupMask mask, ManagerState state) {
                         else
                                 xsprintf(buf, "%" PRIu64 "\n", val);
 
-                        r = cg_set_attribute("memory", path, "memory.limit_in_bytes", buf);
+                        r = unit_set_cgroup_attribute(u, "memory", "memory.limit_in_bytes", NULL, buf);
                         if (r < 0)
                                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                                               "Failed to set memory.limit_in_bytes: %m");
@@ -897,20 +1189,9 @@ static void cgroup_context_apply(Unit *u, CGroupMask mask, ManagerState state) {
         }
 
         if ((mask & CGROUP_MASK_DEVICES) && !is_root) {
+                _cleanup_strv_free_ char **allow = NULL;
                 CGroupDeviceAllow *a;
 
-                /* Changing the devices list of a populated cgroup
-                 * might result in EINVAL, hence ignore EINVAL
-                 * here. */
-
-                if (c->device_allow || c->device_policy != CGROUP_AUTO)
-                        r = cg_set_attribute("devices", path, "devices.deny", "a");
-                else
-                        r = cg_set_attribute("devices", path, "devices.allow", "a");
-                if (r < 0)
-                        log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EINVAL, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
-                                      "Failed to reset devices.list: %m");
-
                 if (c->device_policy == CGROUP_CLOSED ||
                     (c->device_policy == CGROUP_AUTO && c->device_allow)) {
                         static const char auto_devices[] =
@@ -928,11 +1209,11 @@ static void cgroup_context_apply(Unit *u, CGroupMask mask, ManagerState state) {
                         const char *x, *y;
 
                         NULSTR_FOREACH_PAIR(x, y, auto_devices)
-                                whitelist_device(path, x, y);
+                                whitelist_device(&allow, x, y);
 
-                        whitelist_major(path, "pts", 'c', "rw");
-                        whitelist_major(path, "kdbus", 'c', "rw");
-                        whitelist_major(path, "kdbus/*", 'c', "rw");
+                        whitelist_major(u->manager, &allow, "pts", 'c', "rw");
+                        whitelist_major(u->manager, &allow, "kdbus", 'c', "rw");
+                        whitelist_major(u->manager, &allow, "kdbus/*", 'c', "rw");
                 }
 
                 LIST_FOREACH(device_allow, a, c->device_allow) {
@@ -952,14 +1233,16 @@ static void cgroup_context_apply(Unit *u, CGroupMask mask, ManagerState state) {
                         acc[k++] = 0;
 
                         if (startswith(a->path, "/dev/"))
-                                whitelist_device(path, a->path, acc);
+                                whitelist_device(&allow, a->path, acc);
                         else if ((val = startswith(a->path, "block-")))
-                                whitelist_major(path, val, 'b', acc);
+                                whitelist_major(u->manager, &allow, val, 'b', acc);
                         else if ((val = startswith(a->path, "char-")))
-                                whitelist_major(path, val, 'c', acc);
+                                whitelist_major(u->manager, &allow, val, 'c', acc);
                         else
                                 log_unit_debug(u, "Ignoring device %s while writing cgroup attribute.", a->path);
                 }
+
+                cgroup_apply_devices(u, path, c->device_allow || c->device_policy != CGROUP_AUTO, allow);
         }
 
         if ((mask & CGROUP_MASK_PIDS) && !is_root) {
@@ -968,9 +1251,9 @@ static void cgroup_context_apply(Unit *u, CGroupMask mask, ManagerState state) {
                         char buf[DECIMAL_STR_MAX(uint64_t) + 2];
 
                         sprintf(buf, "%" PRIu64 "\n", c->tasks_max);
-                        r = cg_set_attribute("pids", path, "pids.max", buf);
+                        r = unit_set_cgroup_attribute(u, "pids", "pids.max", NULL, buf);
                 } else
-                        r = cg_set_attribute("pids", path, "pids.max", "max");
+                        r = unit_set_cgroup_attribute(u, "pids", "pids.max", NULL, "max");
 
                 if (r < 0)
                         log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
@@ -1053,7 +1336,7 @@ CGroupMask unit_get_members_mask(Unit *u) {
                 Unit *member;
                 Iterator i;
 
-                SET_FOREACH(member, u->dependencies[UNIT_BEFORE], i) {
+                UNIT_FOREACH_DEPENDENCY(member, u, UNIT_BEFORE, i) {
 
                         if (member == u)
                                 continue;
@@ -1335,6 +1618,16 @@ static int unit_create_cgroup(
         if (r < 0)
                 log_unit_warning_errno(u, r, "Failed to enable controllers on cgroup %s, ignoring: %m", u->cgroup_path);
 
+        /* Values written to attributes before are only still in
+         * place for the controllers the cgroup had all along */
+        if (u->cgroup_realized)
+                unit_cgroup_attributes_flush(u, ~(u->cgroup_attributes_mask & target_mask));
+        else {
+                unit_cgroup_attributes_flush(u, _CGROUP_MASK_ALL);
+                unit_close_cgroup_metrics(u);
+        }
+        u->cgroup_attributes_mask = target_mask;
+
         /* Keep track that this is now realized */
         u->cgroup_realized = true;
         u->cgroup_realized_mask = target_mask;
@@ -1354,7 +1647,10 @@ static int unit_create_cgroup(
 }
 
 int unit_attach_pids_to_cgroup(Unit *u) {
+        Iterator i;
+        void *pid;
         int r;
+
         assert(u);
 
         r = unit_realize_cgroup(u);
@@ -1365,6 +1661,9 @@ int unit_attach_pids_to_cgroup(Unit *u) {
         if (r < 0)
                 return r;
 
+        SET_FOREACH(pid, u->pids, i)
+                manager_forget_pid_cgroup(u->manager, PTR_TO_PID(pid));
+
         return 0;
 }
 
@@ -1477,7 +1776,7 @@ static void unit_queue_siblings(Unit *u) {
                 Iterator i;
                 Unit *m;
 
-                SET_FOREACH(m, slice->dependencies[UNIT_BEFORE], i) {
+                UNIT_FOREACH_DEPENDENCY(m, slice, UNIT_BEFORE, i) {
                         if (m == u)
                                 continue;
 
@@ -1505,6 +1804,9 @@ static void unit_queue_siblings(Unit *u) {
 }
 
 int unit_realize_cgroup(Unit *u) {
+        nsec_t trace;
+        int r;
+
         assert(u);
 
         if (!UNIT_HAS_CGROUP_CONTEXT(u))
@@ -1521,11 +1823,17 @@ int unit_realize_cgroup(Unit *u) {
          * defer work on the siblings to the next event loop
          * iteration. */
 
+        trace = trace_begin(u->manager->trace);
+
         /* Add all sibling slices to the cgroup queue. */
         unit_queue_siblings(u);
 
         /* And realize this one now (and apply the values) */
-        return unit_realize_cgroup_now(u, manager_state(u->manager));
+        r = unit_realize_cgroup_now(u, manager_state(u->manager));
+
+        trace_end(u->manager->trace, TRACE_CGROUP_REALIZE, u->id, trace);
+
+        return r;
 }
 
 void unit_release_cgroup(Unit *u) {
@@ -1533,6 +1841,10 @@ void unit_release_cgroup(Unit *u) {
 
         /* Forgets all cgroup details for this cgroup */
 
+        unit_close_cgroup_metrics(u);
+
+        u->cgroup_attributes = hashmap_free_free_free(u->cgroup_attributes);
+
         if (u->cgroup_path) {
                 (void) hashmap_remove(u->manager->cgroup_unit, u->cgroup_path);
                 u->cgroup_path = mfree(u->cgroup_path);
@@ -1712,6 +2024,84 @@ int unit_notify_cgroup_empty(Unit *u) {
         return 0;
 }
 
+void unit_add_to_cgroup_empty_queue(Unit *u) {
+        int r;
+
+        assert(u);
+
+        /* Empty notifications are only queued here, and checked
+         * later in batches. Multiple notifications for the same unit
+         * before that are handled only once. */
+
+        u->manager->n_cgroup_empty_events++;
+
+        if (u->in_cgroup_empty_queue) {
+                u->manager->n_cgroup_empty_events_coalesced++;
+                return;
+        }
+
+        LIST_PREPEND(cgroup_empty_queue, u->manager->cgroup_empty_queue, u);
+        u->in_cgroup_empty_queue = true;
+
+        if (!u->manager->cgroup_empty_event_source)
+                return;
+
+        r = sd_event_source_set_enabled(u->manager->cgroup_empty_event_source, SD_EVENT_ONESHOT);
+        if (r < 0)
+                log_debug_errno(r, "Failed to enable cgroup empty event source, ignoring: %m");
+}
+
+unsigned manager_dispatch_cgroup_empty_queue(Manager *m) {
+        unsigned n = 0;
+        Unit *u;
+        int r;
+
+        assert(m);
+
+        while (n < CGROUP_EMPTY_BATCH_MAX && (u = m->cgroup_empty_queue)) {
+                assert(u->in_cgroup_empty_queue);
+
+                LIST_REMOVE(cgroup_empty_queue, m->cgroup_empty_queue, u);
+                u->in_cgroup_empty_queue = false;
+
+                r = unit_notify_cgroup_empty(u);
+                if (r < 0)
+                        log_unit_debug_errno(u, r, "Failed to check whether cgroup is empty, ignoring: %m");
+
+                n++;
+        }
+
+        if (n > 0)
+                m->n_cgroup_empty_dispatches++;
+
+        /* Whatever is left over is processed in the next batch */
+        if (m->cgroup_empty_queue && m->cgroup_empty_event_source) {
+                r = sd_event_source_set_enabled(m->cgroup_empty_event_source, SD_EVENT_ONESHOT);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to enable cgroup empty event source, ignoring: %m");
+        }
+
+        return n;
+}
+
+void manager_flush_cgroup_empty_queue(Manager *m) {
+        assert(m);
+
+        while (manager_dispatch_cgroup_empty_queue(m) > 0)
+                ;
+}
+
+static int on_cgroup_empty_event(sd_event_source *s, void *userdata) {
+        Manager *m = userdata;
+
+        assert(s);
+        assert(m);
+
+        (void) manager_dispatch_cgroup_empty_queue(m);
+
+        return 0;
+}
+
 static int on_cgroup_inotify_event(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
         Manager *m = userdata;
 
@@ -1751,7 +2141,7 @@ static int on_cgroup_inotify_event(sd_event_source *s, int fd, uint32_t revents,
                                  * this here safely. */
                                 continue;
 
-                        (void) unit_notify_cgroup_empty(u);
+                        unit_add_to_cgroup_empty_queue(u);
                 }
         }
 }
@@ -1815,6 +2205,24 @@ int manager_setup_cgroup(Manager *m) {
                         log_debug("Using cgroup controller " SYSTEMD_CGROUP_CONTROLLER_LEGACY ". File system hierarchy is at %s.", path);
         }
 
+        /* Empty notifications are processed in batches, once nothing
+         * more important is to be done */
+        if (!m->cgroup_empty_event_source) {
+                r = sd_event_add_defer(m->event, &m->cgroup_empty_event_source, on_cgroup_empty_event, m);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to create cgroup empty event source: %m");
+
+                r = sd_event_source_set_priority(m->cgroup_empty_event_source, SD_EVENT_PRIORITY_IDLE);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to set priority of cgroup empty event source: %m");
+
+                r = sd_event_source_set_enabled(m->cgroup_empty_event_source, m->cgroup_empty_queue ? SD_EVENT_ONESHOT : SD_EVENT_OFF);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to disable cgroup empty event source: %m");
+
+                (void) sd_event_source_set_description(m->cgroup_empty_event_source, "cgroup-empty");
+        }
+
         if (!m->test_run) {
                 const char *scope_path;
 
@@ -1894,6 +2302,23 @@ int manager_setup_cgroup(Manager *m) {
         return 0;
 }
 
+static void cgroup_pid_cache_entry_free(CGroupPidCacheEntry *e) {
+        if (!e)
+                return;
+
+        free(e->unit);
+        free(e);
+}
+
+static void manager_flush_cgroup_pid_cache(Manager *m) {
+        CGroupPidCacheEntry *e;
+
+        assert(m);
+
+        while ((e = hashmap_steal_first(m->cgroup_pid_cache)))
+                cgroup_pid_cache_entry_free(e);
+}
+
 void manager_shutdown_cgroup(Manager *m, bool delete) {
         assert(m);
 
@@ -1907,8 +2332,15 @@ void manager_shutdown_cgroup(Manager *m, bool delete) {
         m->cgroup_inotify_event_source = sd_event_source_unref(m->cgroup_inotify_event_source);
         m->cgroup_inotify_fd = safe_close(m->cgroup_inotify_fd);
 
+        m->cgroup_empty_event_source = sd_event_source_unref(m->cgroup_empty_event_source);
+
+        manager_flush_cgroup_pid_cache(m);
+        m->cgroup_pid_cache = hashmap_free(m->cgroup_pid_cache);
+
         m->pin_cgroupfs_fd = safe_close(m->pin_cgroupfs_fd);
 
+        manager_free_proc_devices(m);
+
         m->cgroup_root = mfree(m->cgroup_root);
 }
 
@@ -1955,6 +2387,75 @@ Unit *manager_get_unit_by_pid_cgroup(Manager *m, pid_t pid) {
         return manager_get_unit_by_cgroup(m, cgroup);
 }
 
+void manager_forget_pid_cgroup(Manager *m, pid_t pid) {
+        assert(m);
+
+        cgroup_pid_cache_entry_free(hashmap_remove(m->cgroup_pid_cache, PID_TO_PTR(pid)));
+}
+
+Unit *manager_get_unit_by_pid_cgroup_cached(Manager *m, pid_t pid) {
+        CGroupPidCacheEntry *e;
+        usec_t n;
+        Unit *u;
+
+        assert(m);
+
+        /* Like manager_get_unit_by_pid_cgroup(), but remembers the
+         * result for a while, for processes that send us messages
+         * frequently. Only PIDs we watch are remembered: we reap
+         * those ourselves, so their PID cannot be reused before we
+         * drop the entry. Entries are also dropped when we stop
+         * watching the PID, or move the process to a different
+         * cgroup. Since the process might move itself, they also
+         * expire. Units are remembered by name, so that entries
+         * survive reloads. */
+
+        if (pid <= 0)
+                return NULL;
+
+        if (!hashmap_contains(m->watch_pids1, PID_TO_PTR(pid)) &&
+            !hashmap_contains(m->watch_pids2, PID_TO_PTR(pid)))
+                return manager_get_unit_by_pid_cgroup(m, pid);
+
+        if (sd_event_now(m->event, CLOCK_MONOTONIC, &n) < 0)
+                n = now(CLOCK_MONOTONIC);
+
+        e = hashmap_get(m->cgroup_pid_cache, PID_TO_PTR(pid));
+        if (e) {
+                if (n < usec_add(e->timestamp, CGROUP_PID_CACHE_USEC)) {
+                        u = manager_get_unit(m, e->unit);
+                        if (u) {
+                                m->n_cgroup_pid_cache_hits++;
+                                return u;
+                        }
+                }
+
+                manager_forget_pid_cgroup(m, pid);
+        }
+
+        u = manager_get_unit_by_pid_cgroup(m, pid);
+        if (!u)
+                return NULL;
+
+        if (hashmap_size(m->cgroup_pid_cache) >= CGROUP_PID_CACHE_MAX)
+                manager_flush_cgroup_pid_cache(m);
+
+        if (hashmap_ensure_allocated(&m->cgroup_pid_cache, NULL) < 0)
+                return u;
+
+        e = new0(CGroupPidCacheEntry, 1);
+        if (!e)
+                return u;
+
+        e->unit = strdup(u->id);
+        e->timestamp = n;
+
+        if (!e->unit || hashmap_put(m->cgroup_pid_cache, PID_TO_PTR(pid), e) < 0)
+                cgroup_pid_cache_entry_free(e);
+
+        return u;
+}
+
 Unit *manager_get_unit_by_pid(Manager *m, pid_t pid) {
         Unit *u;
 
@@ -1989,40 +2490,111 @@ int manager_notify_cgroup_empty(Manager *m, const char *cgroup) {
         if (!u)
                 return 0;
 
-        return unit_notify_cgroup_empty(u);
+        unit_add_to_cgroup_empty_queue(u);
+        return 0;
 }
 
-int unit_get_memory_current(Unit *u, uint64_t *ret) {
-        _cleanup_free_ char *v = NULL;
+static int cgroup_metric_attribute(CGroupMetric metric, const char **ret_controller, const char **ret_attribute, CGroupMask *ret_mask) {
+        int unified;
+
+        assert(ret_controller);
+        assert(ret_attribute);
+        assert(ret_mask);
+
+        unified = cg_all_unified();
+        if (unified < 0)
+                return unified;
+
+        switch (metric) {
+
+        case CGROUP_METRIC_CPU_USAGE:
+                if (unified) {
+                        *ret_controller = "cpu";
+                        *ret_attribute = "cpu.stat";
+                        *ret_mask = CGROUP_MASK_CPU;
+                } else {
+                        *ret_controller = "cpuacct";
+                        *ret_attribute = "cpuacct.usage";
+                        *ret_mask = CGROUP_MASK_CPUACCT;
+                }
+                break;
+
+        case CGROUP_METRIC_MEMORY_CURRENT:
+                *ret_controller = "memory";
+                *ret_attribute = unified ? "memory.current" : "memory.usage_in_bytes";
+                *ret_mask = CGROUP_MASK_MEMORY;
+                break;
+
+        case CGROUP_METRIC_TASKS_CURRENT:
+                *ret_controller = "pids";
+                *ret_attribute = "pids.current";
+                *ret_mask = CGROUP_MASK_PIDS;
+                break;
+
+        default:
+                assert_not_reached("Unknown cgroup metric");
+        }
+
+        return unified;
+}
+
+static int cgroup_metric_parse(CGroupMetric metric, bool unified, char *buf, uint64_t *ret) {
+        char *p;
         int r;
 
-        assert(u);
+        assert(buf);
         assert(ret);
 
-        if (!u->cgroup_path)
-                return -ENODATA;
+        if (metric != CGROUP_METRIC_CPU_USAGE || !unified)
+                return safe_atou64(strstrip(buf), ret);
 
-        if ((u->cgroup_realized_mask & CGROUP_MASK_MEMORY) == 0)
-                return -ENODATA;
+        /* cpu.stat is a list of keyed values, in microseconds */
+        for (p = buf; p; ) {
+                char *v, *e;
+                uint64_t us;
 
-        r = cg_all_unified();
-        if (r < 0)
-                return r;
-        if (r > 0)
-                r = cg_get_attribute("memory", u->cgroup_path, "memory.current", &v);
-        else
-                r = cg_get_attribute("memory", u->cgroup_path, "memory.usage_in_bytes", &v);
-        if (r == -ENOENT)
-                return -ENODATA;
-        if (r < 0)
-                return r;
+                e = strchr(p, '\n');
+                if (e)
+                        *(e++) = 0;
+
+                v = startswith(p, "usage_usec ");
+                if (v) {
+                        r = safe_atou64(strstrip(v), &us);
+                        if (r < 0)
+                                return r;
+
+                        *ret = us * NSEC_PER_USEC;
+                        return 0;
+                }
+
+                p = e;
+        }
 
-        return safe_atou64(v, ret);
+        return -ENODATA;
 }
 
-int unit_get_tasks_current(Unit *u, uint64_t *ret) {
-        _cleanup_free_ char *v = NULL;
-        int r;
+static unsigned manager_cgroup_metric_fds_max(Manager *m) {
+        struct rlimit rl;
+
+        assert(m);
+
+        /* Leave the better part of the fd limit to everything else */
+        if (m->cgroup_metric_fds_max == 0) {
+                if (getrlimit(RLIMIT_NOFILE, &rl) >= 0 && rl.rlim_cur != RLIM_INFINITY)
+                        m->cgroup_metric_fds_max = MIN(CGROUP_METRIC_FDS_MAX, (unsigned) (rl.rlim_cur / 4));
+                else
+                        m->cgroup_metric_fds_max = CGROUP_METRIC_FDS_MAX;
+        }
+
+        return m->cgroup_metric_fds_max;
+}
+
+static int unit_read_cgroup_metric(Unit *u, CGroupMetric metric, uint64_t *ret) {
+        const char *controller, *attribute;
+        char buf[LINE_MAX];
+        CGroupMask mask;
+        unsigned attempt;
+        int unified, r;
 
         assert(u);
         assert(ret);
@@ -2030,68 +2602,163 @@ int unit_get_tasks_current(Unit *u, uint64_t *ret) {
         if (!u->cgroup_path)
                 return -ENODATA;
 
-        if ((u->cgroup_realized_mask & CGROUP_MASK_PIDS) == 0)
-                return -ENODATA;
+        unified = cgroup_metric_attribute(metric, &controller, &attribute, &mask);
+        if (unified < 0)
+                return unified;
 
-        r = cg_get_attribute("pids", u->cgroup_path, "pids.current", &v);
-        if (r == -ENOENT)
+        if ((u->cgroup_realized_mask & mask) == 0)
                 return -ENODATA;
-        if (r < 0)
-                return r;
 
-        return safe_atou64(v, ret);
+        /* The attribute files are kept open, and read from the
+         * beginning each time. A file of a cgroup that was removed in
+         * the meantime cannot be read anymore, then it's opened
+         * again. */
+        for (attempt = 0;; attempt++) {
+                _cleanup_close_ int fd = -1;
+                ssize_t n;
+
+                if (u->cgroup_metric_fd[metric] < 0) {
+                        _cleanup_free_ char *fn = NULL;
+
+                        r = cg_get_path(controller, u->cgroup_path, attribute, &fn);
+                        if (r < 0)
+                                return r;
+
+                        fd = open(fn, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+                        if (fd < 0)
+                                return errno == ENOENT ? -ENODATA : -errno;
+
+                        u->manager->n_cgroup_metric_opens++;
+
+                        if (u->manager->n_cgroup_metric_fds < manager_cgroup_metric_fds_max(u->manager)) {
+                                u->cgroup_metric_fd[metric] = fd;
+                                u->manager->n_cgroup_metric_fds++;
+                                fd = -1;
+                        }
+                }
+
+                n = pread(fd >= 0 ? fd : u->cgroup_metric_fd[metric], buf, sizeof(buf) - 1, 0);
+                if (n >= 0) {
+                        buf[n] = 0;
+                        break;
+                }
+
+                r = -errno;
+                unit_close_cgroup_metric(u, metric);
+
+                if (!IN_SET(r, -ENODEV, -ENOENT))
+                        return r;
+                if (attempt > 0)
+                        return -ENODATA;
+        }
+
+        u->manager->n_cgroup_metric_reads++;
+
+        return cgroup_metric_parse(metric, unified, buf, ret);
 }
 
-static int unit_get_cpu_usage_raw(Unit *u, nsec_t *ret) {
-        _cleanup_free_ char *v = NULL;
-        uint64_t ns;
-        int r;
+static usec_t manager_cgroup_metric_now(Manager *m) {
+        usec_t n;
+
+        assert(m);
+
+        /* The time of the current event loop iteration, hence values
+         * read in it are reused for the rest of it */
+        if (sd_event_now(m->event, CLOCK_MONOTONIC, &n) < 0)
+                n = now(CLOCK_MONOTONIC);
 
+        return n;
+}
+
+static bool unit_cgroup_metric_is_fresh(Unit *u, CGroupMetric metric, usec_t n) {
         assert(u);
-        assert(ret);
 
-        if (!u->cgroup_path)
-                return -ENODATA;
+        return u->cgroup_metric_timestamp[metric] > 0 &&
+                usec_add(u->cgroup_metric_timestamp[metric], u->manager->cgroup_accounting_cache_usec) >= n;
+}
 
-        r = cg_all_unified();
-        if (r < 0)
-                return r;
-        if (r > 0) {
-                const char *keys[] = { "usage_usec", NULL };
-                _cleanup_free_ char *val = NULL;
-                uint64_t us;
+static int unit_refresh_cgroup_metric(Unit *u, CGroupMetric metric, usec_t n) {
+        uint64_t v;
+        int r;
 
-                if ((u->cgroup_realized_mask & CGROUP_MASK_CPU) == 0)
-                        return -ENODATA;
+        assert(u);
 
-                r = cg_get_keyed_attribute("cpu", u->cgroup_path, "cpu.stat", keys, &val);
-                if (r < 0)
-                        return r;
+        r = unit_read_cgroup_metric(u, metric, &v);
+        if (r < 0) {
+                u->cgroup_metric_timestamp[metric] = 0;
+                return r;
+        }
 
-                r = safe_atou64(val, &us);
-                if (r < 0)
-                        return r;
+        u->cgroup_metric_value[metric] = v;
+        u->cgroup_metric_timestamp[metric] = MAX(n, 1U);
+        return 0;
+}
 
-                ns = us * NSEC_PER_USEC;
-        } else {
-                if ((u->cgroup_realized_mask & CGROUP_MASK_CPUACCT) == 0)
-                        return -ENODATA;
+int unit_get_cgroup_metric(Unit *u, CGroupMetric metric, uint64_t *ret) {
+        usec_t n;
+        int r;
 
-                r = cg_get_attribute("cpuacct", u->cgroup_path, "cpuacct.usage", &v);
-                if (r == -ENOENT)
-                        return -ENODATA;
-                if (r < 0)
-                        return r;
+        assert(u);
+        assert(metric >= 0 && metric < _CGROUP_METRIC_MAX);
+        assert(ret);
 
-                r = safe_atou64(v, &ns);
+        n = manager_cgroup_metric_now(u->manager);
+
+        if (unit_cgroup_metric_is_fresh(u, metric, n))
+                u->manager->n_cgroup_metric_cache_hits++;
+        else {
+                r = unit_refresh_cgroup_metric(u, metric, n);
                 if (r < 0)
                         return r;
         }
 
-        *ret = ns;
+        *ret = u->cgroup_metric_value[metric];
         return 0;
 }
 
+unsigned manager_collect_cgroup_accounting(Manager *m) {
+        CGroupMetric metric;
+        unsigned k = 0;
+        Iterator i;
+        usec_t n;
+        Unit *u;
+
+        assert(m);
+
+        /* Samples the accounting attributes of all realized cgroups
+         * in one pass, except for values that are still fresh. Errors
+         * are left to be reported to whoever asks for the value. */
+
+        n = manager_cgroup_metric_now(m);
+
+        HASHMAP_FOREACH(u, m->cgroup_unit, i) {
+                if (!u->cgroup_realized)
+                        continue;
+
+                for (metric = 0; metric < _CGROUP_METRIC_MAX; metric++) {
+                        if (unit_cgroup_metric_is_fresh(u, metric, n))
+                                continue;
+
+                        if (unit_refresh_cgroup_metric(u, metric, n) >= 0)
+                                k++;
+                }
+        }
+
+        return k;
+}
+
+int unit_get_memory_current(Unit *u, uint64_t *ret) {
+        return unit_get_cgroup_metric(u, CGROUP_METRIC_MEMORY_CURRENT, ret);
+}
+
+int unit_get_tasks_current(Unit *u, uint64_t *ret) {
+        return unit_get_cgroup_metric(u, CGROUP_METRIC_TASKS_CURRENT, ret);
+}
+
+static int unit_get_cpu_usage_raw(Unit *u, nsec_t *ret) {
+        return unit_get_cgroup_metric(u, CGROUP_METRIC_CPU_USAGE, ret);
+}
+
 int unit_get_cpu_usage(Unit *u, nsec_t *ret) {
         nsec_t ns;
         int r;
@@ -2127,20 +2794,21 @@ int unit_get_cpu_usage(Unit *u, nsec_t *ret) {
 }
 
 int unit_reset_cpu_usage(Unit *u) {
-        nsec_t ns;
         int r;
 
         assert(u);
 
         u->cpu_usage_last = NSEC_INFINITY;
 
-        r = unit_get_cpu_usage_raw(u, &ns);
+        /* The base has to be taken right now, not from earlier in
+         * this event loop iteration */
+        r = unit_refresh_cgroup_metric(u, CGROUP_METRIC_CPU_USAGE, manager_cgroup_metric_now(u->manager));
         if (r < 0) {
                 u->cpu_usage_base = 0;
                 return r;
         }
 
-        u->cpu_usage_base = ns;
+        u->cpu_usage_base = u->cgroup_metric_value[CGROUP_METRIC_CPU_USAGE];
         return 0;
 }
 
@@ -2169,6 +2837,12 @@ void unit_invalidate_cgroup(Unit *u, CGroupMask m) {
         if (m & (CGROUP_MASK_IO | CGROUP_MASK_BLKIO))
                 m |= CGROUP_MASK_IO | CGROUP_MASK_BLKIO;
 
+        /* Something asked for the settings to be applied again, and
+         * the attributes might have been changed behind our back
+         * since we wrote them. Hence write all of them, not only the
+         * ones whose value changed. */
+        unit_cgroup_attributes_flush(u, m);
+
         if ((u->cgroup_realized_mask & m) == 0)
                 return;
 
@@ -164,11 +164,16 @@ unsigned manager_dispatch_cgroup_queue(Manager *m);
 
 Unit *manager_get_unit_by_cgroup(Manager *m, const char *cgroup);
 Unit *manager_get_unit_by_pid_cgroup(Manager *m, pid_t pid);
+Unit *manager_get_unit_by_pid_cgroup_cached(Manager *m, pid_t pid);
+void manager_forget_pid_cgroup(Manager *m, pid_t pid);
 Unit* manager_get_unit_by_pid(Manager *m, pid_t pid);
 
 int unit_search_main_pid(Unit *u, pid_t *ret);
 int unit_watch_all_pids(Unit *u);
 
+int unit_get_cgroup_metric(Unit *u, CGroupMetric metric, uint64_t *ret);
+unsigned manager_collect_cgroup_accounting(Manager *m);
+
 int unit_get_memory_current(Unit *u, uint64_t *ret);
 int unit_get_tasks_current(Unit *u, uint64_t *ret);
 int unit_get_cpu_usage(Unit *u, nsec_t *ret);
@@ -177,6 +182,9 @@ int unit_reset_cpu_usage(Unit *u);
 bool unit_cgroup_delegate(Unit *u);
 
 int unit_notify_cgroup_empty(Unit *u);
+void unit_add_to_cgroup_empty_queue(Unit *u);
+unsigned manager_dispatch_cgroup_empty_queue(Manager *m);
+void manager_flush_cgroup_empty_queue(Manager *m);
 int manager_notify_cgroup_empty(Manager *m, const char *group);
 
 void unit_invalidate_cgroup(Unit *u, CGroupMask m);
@@ -26,6 +26,7 @@
 #include "architecture.h"
 #include "build.h"
 #include "bus-common-errors.h"
+#include "bus-objects.h"
 #include "clock-util.h"
 #include "dbus-execute.h"
 #include "dbus-job.h"
@@ -39,6 +40,7 @@
 #include "fs-util.h"
 #include "install.h"
 #include "log.h"
+#include "manager-snapshot.h"
 #include "parse-util.h"
 #include "path-util.h"
 #include "selinux-access.h"
@@ -46,6 +48,7 @@
 #include "string-util.h"
 #include "strv.h"
 #include "syslog-util.h"
+#include "unit-snapshot.h"
 #include "user-util.h"
 #include "virt.h"
 #include "watchdog.h"
@@ -300,6 +303,42 @@ static int property_get_n_jobs(
         return sd_bus_message_append(reply, "u", (uint32_t) hashmap_size(m->jobs));
 }
 
+static int property_get_trace_buffer_size(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        Manager *m = userdata;
+
+        assert(bus);
+        assert(reply);
+        assert(m);
+
+        return sd_bus_message_append(reply, "u", m->trace ? (uint32_t) m->trace->size : 0);
+}
+
+static int property_get_trace_events_dropped(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        Manager *m = userdata;
+
+        assert(bus);
+        assert(reply);
+        assert(m);
+
+        return sd_bus_message_append(reply, "t", m->trace ? m->trace->n_dropped : 0);
+}
+
 static int property_get_progress(
                 sd_bus *bus,
                 const char *path,
@@ -342,6 +381,40 @@ static int property_get_system_state(
         return sd_bus_message_append(reply, "s", manager_state_to_string(manager_state(m)));
 }
 
+static int property_get_generator_times(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        Manager *m = userdata;
+        size_t i;
+        int r;
+
+        assert(bus);
+        assert(reply);
+        assert(m);
+
+        r = sd_bus_message_open_container(reply, 'a', "(sttiib)");
+        if (r < 0)
+                return r;
+
+        for (i = 0; i < m->n_generator_timings; i++) {
+                ExecTiming *t = m->generator_timings + i;
+
+                r = sd_bus_message_append(reply, "(sttiib)",
+                                          t->name, t->realtime, t->cputime,
+                                          t->code, t->status, t->timed_out);
+                if (r < 0)
+                        return r;
+        }
+
+        return sd_bus_message_close_container(reply);
+}
+
 static int property_set_runtime_watchdog(
                 sd_bus *bus,
                 const char *path,
@@ -835,6 +908,117 @@ static int method_list_units_by_names(sd_bus_message *message, void *userdata, s
         return sd_bus_send(NULL, reply, NULL);
 }
 
+static int reply_unit_properties(sd_bus_message *reply, Unit *u, char **properties, sd_bus_error *error) {
+        _cleanup_free_ char *path = NULL;
+        sd_bus *bus;
+        int r;
+
+        assert(reply);
+        assert(u);
+
+        bus = sd_bus_message_get_bus(reply);
+
+        path = unit_dbus_path(u);
+        if (!path)
+                return -ENOMEM;
+
+        r = sd_bus_message_open_container(reply, 'r', "sa{sv}");
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append(reply, "s", u->id);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "{sv}");
+        if (r < 0)
+                return r;
+
+        r = bus_append_object_properties(bus, reply, path, "org.freedesktop.systemd1.Unit", properties, error);
+        if (r < 0)
+                return r;
+
+        r = bus_append_object_properties(bus, reply, path, unit_dbus_interface_from_type(u->type), properties, error);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_message_close_container(reply);
+}
+
+static int method_list_units_properties(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_strv_free_ char **units = NULL, **properties = NULL;
+        Manager *m = userdata;
+        char **unit;
+        Unit *u;
+        int r;
+
+        assert(message);
+        assert(m);
+
+        /* Anyone can call this method */
+
+        r = mac_selinux_access_check(message, "status", error);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_read_strv(message, &units);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_read_strv(message, &properties);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_new_method_return(message, &reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(sa{sv})");
+        if (r < 0)
+                return r;
+
+        /* Returns the selected properties (or all of them, if none
+         * are selected) of the selected units (or all loaded units),
+         * saving clients a Get or GetAll round trip per unit. */
+
+        if (strv_isempty(units)) {
+                const char *k;
+                Iterator i;
+
+                HASHMAP_FOREACH_KEY(u, k, m->units, i) {
+                        if (k != u->id)
+                                continue;
+
+                        r = reply_unit_properties(reply, u, properties, error);
+                        if (r < 0)
+                                return r;
+                }
+        } else
+                STRV_FOREACH(unit, units) {
+                        if (!unit_name_is_valid(*unit, UNIT_NAME_ANY))
+                                continue;
+
+                        r = manager_load_unit(m, *unit, NULL, error, &u);
+                        if (r < 0)
+                                return r;
+
+                        r = reply_unit_properties(reply, u, properties, error);
+                        if (r < 0)
+                                return r;
+                }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
 static int method_get_unit_processes(sd_bus_message *message, void *userdata, sd_bus_error *error) {
         Manager *m = userdata;
         const char *name;
@@ -1222,6 +1406,191 @@ static int method_list_jobs(sd_bus_message *message, void *userdata, sd_bus_erro
         return sd_bus_send(NULL, reply, NULL);
 }
 
+static int method_list_units_memory_usage(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        Manager *m = userdata;
+        const char *k;
+        Iterator i;
+        Unit *u;
+        int r;
+
+        assert(message);
+        assert(m);
+
+        /* Anyone can call this method */
+
+        r = mac_selinux_access_check(message, "status", error);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_new_method_return(message, &reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(stu)");
+        if (r < 0)
+                return r;
+
+        HASHMAP_FOREACH_KEY(u, k, m->units, i) {
+                /* ignore aliases */
+                if (k != u->id)
+                        continue;
+
+                r = sd_bus_message_append(
+                                reply, "(stu)",
+                                u->id,
+                                (uint64_t) unit_memory_usage(u),
+                                hashmap_size(u->dependencies));
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
+static int method_dump_trace(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        Manager *m = userdata;
+        const TraceEvent *e;
+        size_t i;
+        int r;
+
+        assert(message);
+        assert(m);
+
+        /* Anyone can call this method */
+
+        r = mac_selinux_access_check(message, "status", error);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_new_method_return(message, &reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(sstt)");
+        if (r < 0)
+                return r;
+
+        /* If tracing is off, the array is simply empty */
+        for (i = 0; (e = trace_buffer_get(m->trace, i)); i++) {
+                r = sd_bus_message_append(
+                                reply, "(sstt)",
+                                trace_phase_to_string(e->phase),
+                                strempty(e->name),
+                                (uint64_t) e->begin,
+                                (uint64_t) e->end);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
+static int method_get_units_snapshot(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        const UnitSnapshotHeader *h;
+        _cleanup_free_ void *p = NULL;
+        Manager *m = userdata;
+        uint64_t since, i;
+        size_t size;
+        int r;
+
+        assert(message);
+        assert(m);
+
+        /* Anyone can call this method */
+
+        r = mac_selinux_access_check(message, "status", error);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_read(message, "t", &since);
+        if (r < 0)
+                return r;
+
+        r = manager_build_units_snapshot(m, since, &p, &size);
+        if (r < 0)
+                return r;
+
+        assert_se(unit_snapshot_verify(p, size, &h) >= 0);
+
+        r = sd_bus_message_new_method_return(message, &reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append(reply, "tb", h->generation, !!(h->flags & UNIT_SNAPSHOT_COMPLETE));
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(stbsssuutttttt)");
+        if (r < 0)
+                return r;
+
+        for (i = 0; i < h->n_entries; i++) {
+                const UnitSnapshotEntry *e = unit_snapshot_entry(h, i);
+
+                r = sd_bus_message_append(
+                                reply, "(stbsssuutttttt)",
+                                unit_snapshot_string(h, e->id),
+                                e->generation,
+                                !!(e->flags & UNIT_SNAPSHOT_REMOVED),
+                                unit_snapshot_string(h, e->load_state),
+                                unit_snapshot_string(h, e->active_state),
+                                unit_snapshot_string(h, e->sub_state),
+                                e->main_pid,
+                                e->control_pid,
+                                e->cpu_usage_nsec,
+                                e->memory_current,
+                                e->tasks_current,
+                                e->state_change_timestamp,
+                                e->active_enter_timestamp,
+                                e->active_exit_timestamp);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
+static int method_get_units_snapshot_fd(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_close_ int fd = -1;
+        Manager *m = userdata;
+        uint64_t since;
+        int r;
+
+        assert(message);
+        assert(m);
+
+        /* Anyone can call this method */
+
+        r = mac_selinux_access_check(message, "status", error);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_read(message, "t", &since);
+        if (r < 0)
+                return r;
+
+        r = manager_units_snapshot_memfd(m, since, &fd);
+        if (r < 0)
+                return r;
+
+        return sd_bus_reply_method_return(message, "h", fd);
+}
+
 static int method_subscribe(sd_bus_message *message, void *userdata, sd_bus_error *error) {
         Manager *m = userdata;
         int r;
@@ -1348,8 +1717,7 @@ int verify_run_space_and_log(const char *message) {
         return r;
 }
 
-static int method_reload(sd_bus_message *message, void *userdata, sd_bus_error *error) {
-        Manager *m = userdata;
+static int method_reload_generic(sd_bus_message *message, Manager *m, bool incremental, sd_bus_error *error) {
         int r;
 
         assert(message);
@@ -1379,11 +1747,20 @@ static int method_reload(sd_bus_message *message, void *userdata, sd_bus_error *
         if (r < 0)
                 return r;
 
+        m->reload_incremental = incremental;
         m->exit_code = MANAGER_RELOAD;
 
         return 1;
 }
 
+static int method_reload(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        return method_reload_generic(message, userdata, false, error);
+}
+
+static int method_reload_incremental(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        return method_reload_generic(message, userdata, true, error);
+}
+
 static int method_reexecute(sd_bus_message *message, void *userdata, sd_bus_error *error) {
         Manager *m = userdata;
         int r;
@@ -2418,6 +2795,45 @@ const sd_bus_vtable bus_manager_vtable[] = {
         BUS_PROPERTY_DUAL_TIMESTAMP("GeneratorsFinishTimestamp", offsetof(Manager, generators_finish_timestamp), SD_BUS_VTABLE_PROPERTY_CONST),
         BUS_PROPERTY_DUAL_TIMESTAMP("UnitsLoadStartTimestamp", offsetof(Manager, units_load_start_timestamp), SD_BUS_VTABLE_PROPERTY_CONST),
         BUS_PROPERTY_DUAL_TIMESTAMP("UnitsLoadFinishTimestamp", offsetof(Manager, units_load_finish_timestamp), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("GeneratorTimes", "a(sttiib)", property_get_generator_times, 0, 0),
+        SD_BUS_PROPERTY("UnitsLoadUSec", "t", bus_property_get_usec, offsetof(Manager, units_load_usec), 0),
+        SD_BUS_PROPERTY("UnitFileCacheHits", "t", NULL, offsetof(Manager, unit_file_cache_hits), 0),
+        SD_BUS_PROPERTY("UnitFileCacheMisses", "t", NULL, offsetof(Manager, unit_file_cache_misses), 0),
+        SD_BUS_PROPERTY("UnitsGeneration", "t", NULL, offsetof(Manager, units_generation), 0),
+        SD_BUS_PROPERTY("BusSignalCoalesceUSec", "t", bus_property_get_usec, offsetof(Manager, bus_signal_coalesce_usec[BUS_SIGNAL_API]), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("PrivateBusSignalCoalesceUSec", "t", bus_property_get_usec, offsetof(Manager, bus_signal_coalesce_usec[BUS_SIGNAL_PRIVATE]), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("BusSignalsSent", "t", NULL, offsetof(Manager, n_bus_signals_sent), 0),
+        SD_BUS_PROPERTY("BusSignalsSuppressed", "t", NULL, offsetof(Manager, n_bus_signals_suppressed), 0),
+        SD_BUS_PROPERTY("DeviceEvents", "t", NULL, offsetof(Manager, n_device_events), 0),
+        SD_BUS_PROPERTY("DeviceEventsCoalesced", "t", NULL, offsetof(Manager, n_device_events_coalesced), 0),
+        SD_BUS_PROPERTY("DeviceEventDispatches", "t", NULL, offsetof(Manager, n_device_event_dispatches), 0),
+        SD_BUS_PROPERTY("CGroupAttributeWrites", "t", NULL, offsetof(Manager, n_cgroup_attribute_writes), 0),
+        SD_BUS_PROPERTY("CGroupAttributeWritesSkipped", "t", NULL, offsetof(Manager, n_cgroup_attribute_writes_skipped), 0),
+        SD_BUS_PROPERTY("CGroupAccountingCacheUSec", "t", bus_property_get_usec, offsetof(Manager, cgroup_accounting_cache_usec), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("CGroupAccountingOpens", "t", NULL, offsetof(Manager, n_cgroup_metric_opens), 0),
+        SD_BUS_PROPERTY("CGroupAccountingReads", "t", NULL, offsetof(Manager, n_cgroup_metric_reads), 0),
+        SD_BUS_PROPERTY("CGroupAccountingCacheHits", "t", NULL, offsetof(Manager, n_cgroup_metric_cache_hits), 0),
+        SD_BUS_PROPERTY("CGroupEmptyEvents", "t", NULL, offsetof(Manager, n_cgroup_empty_events), 0),
+        SD_BUS_PROPERTY("CGroupEmptyEventsCoalesced", "t", NULL, offsetof(Manager, n_cgroup_empty_events_coalesced), 0),
+        SD_BUS_PROPERTY("CGroupEmptyDispatches", "t", NULL, offsetof(Manager, n_cgroup_empty_dispatches), 0),
+        SD_BUS_PROPERTY("NotifyMessages", "t", NULL, offsetof(Manager, n_notify_messages), 0),
+        SD_BUS_PROPERTY("NotifyDispatches", "t", NULL, offsetof(Manager, n_notify_dispatches), 0),
+        SD_BUS_PROPERTY("NotifyPIDCacheHits", "t", NULL, offsetof(Manager, n_cgroup_pid_cache_hits), 0),
+        SD_BUS_PROPERTY("GCRuns", "t", NULL, offsetof(Manager, n_gc_runs), 0),
+        SD_BUS_PROPERTY("GCUnitsVisited", "t", NULL, offsetof(Manager, n_gc_units_visited), 0),
+        SD_BUS_PROPERTY("GCUnitsCollected", "t", NULL, offsetof(Manager, n_gc_units_collected), 0),
+        SD_BUS_PROPERTY("GCUSec", "t", bus_property_get_usec, offsetof(Manager, gc_usec), 0),
+        SD_BUS_PROPERTY("GCLastUSec", "t", bus_property_get_usec, offsetof(Manager, gc_last_usec), 0),
+        SD_BUS_PROPERTY("GCMaxUSec", "t", bus_property_get_usec, offsetof(Manager, gc_max_usec), 0),
+        SD_BUS_PROPERTY("MaxConcurrentStartJobs", "u", bus_property_get_unsigned, offsetof(Manager, max_concurrent_start_jobs), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("RunningStartJobs", "u", bus_property_get_unsigned, offsetof(Manager, n_running_start_jobs), 0),
+        SD_BUS_PROPERTY("StartJobs", "t", NULL, offsetof(Manager, n_start_jobs), 0),
+        SD_BUS_PROPERTY("StartJobsThrottled", "t", NULL, offsetof(Manager, n_start_jobs_throttled), 0),
+        SD_BUS_PROPERTY("StartJobWaitUSec", "t", bus_property_get_usec, offsetof(Manager, start_job_wait_usec), 0),
+        SD_BUS_PROPERTY("StartJobMaxWaitUSec", "t", bus_property_get_usec, offsetof(Manager, start_job_wait_max_usec), 0),
+        SD_BUS_PROPERTY("StartJobThrottleUSec", "t", bus_property_get_usec, offsetof(Manager, start_job_throttle_usec), 0),
+        SD_BUS_PROPERTY("TraceBufferSize", "u", property_get_trace_buffer_size, 0, 0),
+        SD_BUS_PROPERTY("TraceEventsDropped", "t", property_get_trace_events_dropped, 0, 0),
         SD_BUS_WRITABLE_PROPERTY("LogLevel", "s", property_get_log_level, property_set_log_level, 0, 0),
         SD_BUS_WRITABLE_PROPERTY("LogTarget", "s", property_get_log_target, property_set_log_target, 0, 0),
         SD_BUS_PROPERTY("NNames", "u", property_get_n_names, 0, 0),
@@ -2512,13 +2928,19 @@ const sd_bus_vtable bus_manager_vtable[] = {
         SD_BUS_METHOD("ListUnitsFiltered", "as", "a(ssssssouso)", method_list_units_filtered, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("ListUnitsByPatterns", "asas", "a(ssssssouso)", method_list_units_by_patterns, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("ListUnitsByNames", "as", "a(ssssssouso)", method_list_units_by_names, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("ListUnitsProperties", "asas", "a(sa{sv})", method_list_units_properties, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("ListJobs", NULL, "a(usssoo)", method_list_jobs, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("ListUnitsMemoryUsage", NULL, "a(stu)", method_list_units_memory_usage, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("DumpTrace", NULL, "a(sstt)", method_dump_trace, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("GetUnitsSnapshot", "t", "tba(stbsssuutttttt)", method_get_units_snapshot, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("GetUnitsSnapshotFD", "t", "h", method_get_units_snapshot_fd, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Subscribe", NULL, NULL, method_subscribe, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Unsubscribe", NULL, NULL, method_unsubscribe, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Dump", NULL, "s", method_dump, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("CreateSnapshot", "sb", "o", method_refuse_snapshot, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("RemoveSnapshot", "s", NULL, method_refuse_snapshot, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Reload", NULL, NULL, method_reload, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("ReloadIncremental", NULL, NULL, method_reload_incremental, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Reexecute", NULL, NULL, method_reexecute, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Exit", NULL, NULL, method_exit, 0),
         SD_BUS_METHOD("Reboot", NULL, NULL, method_reboot, SD_BUS_VTABLE_CAPABILITY(CAP_SYS_BOOT)),
@@ -2552,6 +2974,7 @@ const sd_bus_vtable bus_manager_vtable[] = {
 
         SD_BUS_SIGNAL("UnitNew", "so", 0),
         SD_BUS_SIGNAL("UnitRemoved", "so", 0),
+        SD_BUS_SIGNAL("UnitsChanged", "a(sssso)", 0),
         SD_BUS_SIGNAL("JobNew", "uos", 0),
         SD_BUS_SIGNAL("JobRemoved", "uoss", 0),
         SD_BUS_SIGNAL("StartupFinished", "tttttt", 0),
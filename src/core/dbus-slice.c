@@ -17,13 +17,18 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include "bus-util.h"
 #include "dbus-cgroup.h"
 #include "dbus-slice.h"
+#include "prioq.h"
 #include "slice.h"
+#include "string-util.h"
 #include "unit.h"
 
 const sd_bus_vtable bus_slice_vtable[] = {
         SD_BUS_VTABLE_START(0),
+        SD_BUS_PROPERTY("MaxConcurrentStartJobs", "u", bus_property_get_unsigned, offsetof(Slice, max_concurrent_start_jobs), 0),
+        SD_BUS_PROPERTY("RunningStartJobs", "u", bus_property_get_unsigned, offsetof(Slice, n_running_start_jobs), 0),
         SD_BUS_VTABLE_END
 };
 
@@ -35,10 +40,34 @@ int bus_slice_set_property(
                 sd_bus_error *error) {
 
         Slice *s = SLICE(u);
+        int r;
 
         assert(name);
         assert(u);
 
+        if (streq(name, "MaxConcurrentStartJobs")) {
+                uint32_t n;
+
+                r = sd_bus_message_read(message, "u", &n);
+                if (r < 0)
+                        return r;
+
+                if (mode != UNIT_CHECK) {
+                        Job *j;
+
+                        s->max_concurrent_start_jobs = n;
+                        unit_write_drop_in_private_format(u, mode, name, "MaxConcurrentStartJobs=%" PRIu32, n);
+
+                        /* Let the waiting jobs check the new limit */
+                        while ((j = prioq_peek(s->throttled_jobs))) {
+                                job_unthrottle(j);
+                                job_add_to_run_queue(j);
+                        }
+                }
+
+                return 1;
+        }
+
         return bus_cgroup_set_property(u, &s->cgroup_context, name, message, mode, error);
 }
 
@@ -103,6 +103,42 @@ static int property_get_fdname(
         return sd_bus_message_append(reply, "s", socket_fdname(s));
 }
 
+static int property_get_prefork_workers(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        Socket *s = SOCKET(userdata);
+        SocketPreforkWorker *w;
+        int r;
+
+        assert(bus);
+        assert(reply);
+        assert(s);
+
+        r = sd_bus_message_open_container(reply, 'a', "(ssu)");
+        if (r < 0)
+                return r;
+
+        LIST_FOREACH(prefork, w, s->prefork_workers) {
+                if (!UNIT_ISSET(w->service))
+                        continue;
+
+                r = sd_bus_message_append(reply, "(ssu)",
+                                          UNIT_DEREF(w->service)->id,
+                                          socket_prefork_state_to_string(w->state),
+                                          w->n_served);
+                if (r < 0)
+                        return r;
+        }
+
+        return sd_bus_message_close_container(reply);
+}
+
 const sd_bus_vtable bus_socket_vtable[] = {
         SD_BUS_VTABLE_START(0),
         SD_BUS_PROPERTY("BindIPv6Only", "s", property_get_bind_ipv6_only, offsetof(Socket, bind_ipv6_only), SD_BUS_VTABLE_PROPERTY_CONST),
@@ -148,6 +184,9 @@ const sd_bus_vtable bus_socket_vtable[] = {
         SD_BUS_PROPERTY("Result", "s", property_get_result, offsetof(Socket, result), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
         SD_BUS_PROPERTY("NConnections", "u", bus_property_get_unsigned, offsetof(Socket, n_connections), 0),
         SD_BUS_PROPERTY("NAccepted", "u", bus_property_get_unsigned, offsetof(Socket, n_accepted), 0),
+        SD_BUS_PROPERTY("PreforkMinSpare", "u", bus_property_get_unsigned, offsetof(Socket, prefork_min_spare), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("PreforkMaxSpare", "u", bus_property_get_unsigned, offsetof(Socket, prefork_max_spare), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("PreforkWorkers", "a(ssu)", property_get_prefork_workers, 0, 0),
         SD_BUS_PROPERTY("FileDescriptorName", "s", property_get_fdname, 0, 0),
         SD_BUS_PROPERTY("SocketProtocol", "i", bus_property_get_int, offsetof(Socket, socket_protocol), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("TriggerLimitIntervalUSec", "t", bus_property_get_usec, offsetof(Socket, trigger_limit.interval), SD_BUS_VTABLE_PROPERTY_CONST),
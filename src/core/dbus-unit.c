@@ -99,20 +99,25 @@ static int property_get_dependencies(
                 void *userdata,
                 sd_bus_error *error) {
 
-        Set *s = *(Set**) userdata;
+        Unit *u = userdata, *other;
+        UnitDependency d;
         Iterator j;
-        Unit *u;
         int r;
 
         assert(bus);
         assert(reply);
+        assert(u);
+
+        /* The property names match the dependency names */
+        d = unit_dependency_from_string(property);
+        assert_se(d >= 0);
 
         r = sd_bus_message_open_container(reply, 'a', "s");
         if (r < 0)
                 return r;
 
-        SET_FOREACH(u, s, j) {
-                r = sd_bus_message_append(reply, "s", u->id);
+        UNIT_FOREACH_DEPENDENCY(other, u, d, j) {
+                r = sd_bus_message_append(reply, "s", other->id);
                 if (r < 0)
                         return r;
         }
@@ -698,26 +703,26 @@ const sd_bus_vtable bus_unit_vtable[] = {
         SD_BUS_PROPERTY("Id", "s", NULL, offsetof(Unit, id), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("Names", "as", property_get_names, 0, SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("Following", "s", property_get_following, 0, 0),
-        SD_BUS_PROPERTY("Requires", "as", property_get_dependencies, offsetof(Unit, dependencies[UNIT_REQUIRES]), SD_BUS_VTABLE_PROPERTY_CONST),
-        SD_BUS_PROPERTY("Requisite", "as", property_get_dependencies, offsetof(Unit, dependencies[UNIT_REQUISITE]), SD_BUS_VTABLE_PROPERTY_CONST),
-        SD_BUS_PROPERTY("Wants", "as", property_get_dependencies, offsetof(Unit, dependencies[UNIT_WANTS]), SD_BUS_VTABLE_PROPERTY_CONST),
-        SD_BUS_PROPERTY("BindsTo", "as", property_get_dependencies, offsetof(Unit, dependencies[UNIT_BINDS_TO]), SD_BUS_VTABLE_PROPERTY_CONST),
-        SD_BUS_PROPERTY("PartOf", "as", property_get_dependencies, offsetof(Unit, dependencies[UNIT_PART_OF]), SD_BUS_VTABLE_PROPERTY_CONST),
-        SD_BUS_PROPERTY("RequiredBy", "as", property_get_dependencies, offsetof(Unit, dependencies[UNIT_REQUIRED_BY]), SD_BUS_VTABLE_PROPERTY_CONST),
-        SD_BUS_PROPERTY("RequisiteOf", "as", property_get_dependencies, offsetof(Unit, dependencies[UNIT_REQUISITE_OF]), SD_BUS_VTABLE_PROPERTY_CONST),
-        SD_BUS_PROPERTY("WantedBy", "as", property_get_dependencies, offsetof(Unit, dependencies[UNIT_WANTED_BY]), SD_BUS_VTABLE_PROPERTY_CONST),
-        SD_BUS_PROPERTY("BoundBy", "as", property_get_dependencies, offsetof(Unit, dependencies[UNIT_BOUND_BY]), SD_BUS_VTABLE_PROPERTY_CONST),
-        SD_BUS_PROPERTY("ConsistsOf", "as", property_get_dependencies, offsetof(Unit, dependencies[UNIT_CONSISTS_OF]), SD_BUS_VTABLE_PROPERTY_CONST),
-        SD_BUS_PROPERTY("Conflicts", "as", property_get_dependencies, offsetof(Unit, dependencies[UNIT_CONFLICTS]), SD_BUS_VTABLE_PROPERTY_CONST),
-        SD_BUS_PROPERTY("ConflictedBy", "as", property_get_dependencies, offsetof(Unit, dependencies[UNIT_CONFLICTED_BY]), SD_BUS_VTABLE_PROPERTY_CONST),
-        SD_BUS_PROPERTY("Before", "as", property_get_dependencies, offsetof(Unit, dependencies[UNIT_BEFORE]), SD_BUS_VTABLE_PROPERTY_CONST),
-        SD_BUS_PROPERTY("After", "as", property_get_dependencies, offsetof(Unit, dependencies[UNIT_AFTER]), SD_BUS_VTABLE_PROPERTY_CONST),
-        SD_BUS_PROPERTY("OnFailure", "as", property_get_dependencies, offsetof(Unit, dependencies[UNIT_ON_FAILURE]), SD_BUS_VTABLE_PROPERTY_CONST),
-        SD_BUS_PROPERTY("Triggers", "as", property_get_dependencies, offsetof(Unit, dependencies[UNIT_TRIGGERS]), SD_BUS_VTABLE_PROPERTY_CONST),
-        SD_BUS_PROPERTY("TriggeredBy", "as", property_get_dependencies, offsetof(Unit, dependencies[UNIT_TRIGGERED_BY]), SD_BUS_VTABLE_PROPERTY_CONST),
-        SD_BUS_PROPERTY("PropagatesReloadTo", "as", property_get_dependencies, offsetof(Unit, dependencies[UNIT_PROPAGATES_RELOAD_TO]), SD_BUS_VTABLE_PROPERTY_CONST),
-        SD_BUS_PROPERTY("ReloadPropagatedFrom", "as", property_get_dependencies, offsetof(Unit, dependencies[UNIT_RELOAD_PROPAGATED_FROM]), SD_BUS_VTABLE_PROPERTY_CONST),
-        SD_BUS_PROPERTY("JoinsNamespaceOf", "as", property_get_dependencies, offsetof(Unit, dependencies[UNIT_JOINS_NAMESPACE_OF]), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("Requires", "as", property_get_dependencies, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("Requisite", "as", property_get_dependencies, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("Wants", "as", property_get_dependencies, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("BindsTo", "as", property_get_dependencies, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("PartOf", "as", property_get_dependencies, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("RequiredBy", "as", property_get_dependencies, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("RequisiteOf", "as", property_get_dependencies, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("WantedBy", "as", property_get_dependencies, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("BoundBy", "as", property_get_dependencies, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("ConsistsOf", "as", property_get_dependencies, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("Conflicts", "as", property_get_dependencies, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("ConflictedBy", "as", property_get_dependencies, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("Before", "as", property_get_dependencies, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("After", "as", property_get_dependencies, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("OnFailure", "as", property_get_dependencies, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("Triggers", "as", property_get_dependencies, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("TriggeredBy", "as", property_get_dependencies, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("PropagatesReloadTo", "as", property_get_dependencies, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("ReloadPropagatedFrom", "as", property_get_dependencies, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("JoinsNamespaceOf", "as", property_get_dependencies, 0, SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("RequiresMountsFor", "as", NULL, offsetof(Unit, requires_mounts_for), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("Documentation", "as", NULL, offsetof(Unit, documentation), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("Description", "s", property_get_description, 0, SD_BUS_VTABLE_PROPERTY_CONST),
@@ -1107,6 +1112,8 @@ static int send_changed_signal(sd_bus *bus, void *userdata) {
          * type, then for the generic unit. The clients may rely on
          * this order to get atomic behavior if needed. */
 
+        u->manager->n_bus_signals_sent++;
+
         r = sd_bus_emit_properties_changed_strv(
                         bus, p,
                         unit_dbus_interface_from_type(u->type),
@@ -1120,8 +1127,189 @@ static int send_changed_signal(sd_bus *bus, void *userdata) {
                         NULL);
 }
 
+static int send_units_changed_signal(sd_bus *bus, void *userdata) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        Set *units = userdata;
+        Iterator i;
+        Unit *u;
+        int r;
+
+        assert(bus);
+
+        u = set_first(units);
+        if (!u)
+                return 0;
+
+        u->manager->n_bus_signals_sent++;
+
+        r = sd_bus_message_new_signal(
+                        bus,
+                        &m,
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "UnitsChanged");
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(m, 'a', "(sssso)");
+        if (r < 0)
+                return r;
+
+        SET_FOREACH(u, units, i) {
+                _cleanup_free_ char *p = NULL;
+
+                p = unit_dbus_path(u);
+                if (!p)
+                        return -ENOMEM;
+
+                r = sd_bus_message_append(
+                                m, "(sssso)",
+                                u->id,
+                                unit_load_state_to_string(u->load_state),
+                                unit_active_state_to_string(unit_active_state(u)),
+                                unit_sub_state_to_string(u),
+                                p);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(m);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(bus, m, NULL);
+}
+
+static void send_changed_signal_class(Unit *u, BusSignalClass c) {
+        int r;
+
+        assert(u);
+
+        r = bus_foreach_bus_class(u->manager, c, u->bus_track, send_changed_signal, u);
+        if (r < 0)
+                log_unit_debug_errno(u, r, "Failed to send unit change signal for %s: %m", u->id);
+}
+
+static int arm_coalesce_timer(Manager *m, BusSignalClass c);
+
+static int on_coalesce_timer(sd_event_source *s, uint64_t usec, void *userdata) {
+        _cleanup_set_free_ Set *units = NULL;
+        Manager *m = userdata;
+        BusSignalClass c;
+        Iterator i;
+        Unit *u;
+        int r;
+
+        assert(m);
+
+        for (c = 0; c < _BUS_SIGNAL_CLASS_MAX; c++)
+                if (m->bus_coalesce_event_source[c] == s)
+                        break;
+        assert(c < _BUS_SIGNAL_CLASS_MAX);
+
+        units = m->bus_coalesced_units[c];
+        m->bus_coalesced_units[c] = NULL;
+
+        /* Nothing happened during the window, hence the next change
+         * may be sent right away again */
+        if (set_isempty(units))
+                return 0;
+
+        SET_FOREACH(u, units, i)
+                send_changed_signal_class(u, c);
+
+        r = bus_foreach_bus_class(m, c, NULL, send_units_changed_signal, units);
+        if (r < 0)
+                log_debug_errno(r, "Failed to send units changed signal: %m");
+
+        /* Keep holding back changes for another window, so that we
+         * don't send more than one batch per window */
+        r = arm_coalesce_timer(m, c);
+        if (r < 0)
+                log_debug_errno(r, "Failed to arm signal coalescing timer, sending signals right away: %m");
+
+        return 0;
+}
+
+static int arm_coalesce_timer(Manager *m, BusSignalClass c) {
+        usec_t when;
+        int r;
+
+        assert(m);
+
+        when = usec_add(now(CLOCK_MONOTONIC), m->bus_signal_coalesce_usec[c]);
+
+        if (m->bus_coalesce_event_source[c]) {
+                r = sd_event_source_set_time(m->bus_coalesce_event_source[c], when);
+                if (r < 0)
+                        return r;
+
+                return sd_event_source_set_enabled(m->bus_coalesce_event_source[c], SD_EVENT_ONESHOT);
+        }
+
+        r = sd_event_add_time(m->event, &m->bus_coalesce_event_source[c], CLOCK_MONOTONIC, when, 0, on_coalesce_timer, m);
+        if (r < 0)
+                return r;
+
+        (void) sd_event_source_set_description(m->bus_coalesce_event_source[c], "bus-signal-coalesce");
+
+        return 0;
+}
+
+static bool coalesce_window_active(Manager *m, BusSignalClass c) {
+        int enabled = SD_EVENT_OFF;
+
+        assert(m);
+
+        if (!m->bus_coalesce_event_source[c])
+                return false;
+
+        return sd_event_source_get_enabled(m->bus_coalesce_event_source[c], &enabled) >= 0 &&
+                enabled != SD_EVENT_OFF;
+}
+
+static bool coalesce_change_signal(Unit *u, BusSignalClass c) {
+        Manager *m;
+        int r;
+
+        assert(u);
+
+        m = u->manager;
+
+        /* Returns true if sending the signal is taken care of. The
+         * first change is sent right away and opens a window, during
+         * which further changes are collected. At the end of the
+         * window they are sent, each unit once, and another window
+         * begins. */
+
+        if (m->bus_signal_coalesce_usec[c] <= 0)
+                return false;
+
+        if (!coalesce_window_active(m, c)) {
+                r = arm_coalesce_timer(m, c);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to arm signal coalescing timer, sending signals right away: %m");
+
+                return false;
+        }
+
+        r = set_ensure_allocated(&m->bus_coalesced_units[c], NULL);
+        if (r < 0)
+                return false;
+
+        r = set_put(m->bus_coalesced_units[c], u);
+        if (r < 0)
+                return false;
+        if (r == 0)
+                m->n_bus_signals_suppressed++;
+
+        return true;
+}
+
 void bus_unit_send_change_signal(Unit *u) {
+        BusSignalClass c;
         int r;
+
         assert(u);
 
         if (u->in_dbus_queue) {
@@ -1132,11 +1320,18 @@ void bus_unit_send_change_signal(Unit *u) {
         if (!u->id)
                 return;
 
-        r = bus_foreach_bus(u->manager, u->bus_track, u->sent_dbus_new_signal ? send_changed_signal : send_new_signal, u);
-        if (r < 0)
-                log_unit_debug_errno(u, r, "Failed to send unit change signal for %s: %m", u->id);
+        if (!u->sent_dbus_new_signal) {
+                r = bus_foreach_bus(u->manager, u->bus_track, send_new_signal, u);
+                if (r < 0)
+                        log_unit_debug_errno(u, r, "Failed to send unit change signal for %s: %m", u->id);
+
+                u->sent_dbus_new_signal = true;
+                return;
+        }
 
-        u->sent_dbus_new_signal = true;
+        for (c = 0; c < _BUS_SIGNAL_CLASS_MAX; c++)
+                if (!coalesce_change_signal(u, c))
+                        send_changed_signal_class(u, c);
 }
 
 static int send_removed_signal(sd_bus *bus, void *userdata) {
@@ -1169,12 +1364,18 @@ static int send_removed_signal(sd_bus *bus, void *userdata) {
 }
 
 void bus_unit_send_removed_signal(Unit *u) {
+        BusSignalClass c;
         int r;
         assert(u);
 
         if (!u->sent_dbus_new_signal || u->in_dbus_queue)
                 bus_unit_send_change_signal(u);
 
+        /* Changes held back are sent before the unit goes away */
+        for (c = 0; c < _BUS_SIGNAL_CLASS_MAX; c++)
+                if (set_remove(u->manager->bus_coalesced_units[c], u))
+                        send_changed_signal_class(u, c);
+
         if (!u->id)
                 return;
 
@@ -1183,6 +1384,15 @@ void bus_unit_send_removed_signal(Unit *u) {
                 log_unit_debug_errno(u, r, "Failed to send unit remove signal for %s: %m", u->id);
 }
 
+void bus_unit_forget_change_signal(Unit *u) {
+        BusSignalClass c;
+
+        assert(u);
+
+        for (c = 0; c < _BUS_SIGNAL_CLASS_MAX; c++)
+                (void) set_remove(u->manager->bus_coalesced_units[c], u);
+}
+
 int bus_unit_queue_job(
                 sd_bus_message *message,
                 Unit *u,
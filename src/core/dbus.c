@@ -40,6 +40,7 @@
 #include "missing.h"
 #include "mkdir.h"
 #include "selinux-access.h"
+#include "serialize.h"
 #include "special.h"
 #include "string-util.h"
 #include "strv.h"
@@ -1084,6 +1085,7 @@ static void destroy_bus(Manager *m, sd_bus **bus) {
 }
 
 void bus_done(Manager *m) {
+        BusSignalClass c;
         sd_bus *b;
 
         assert(m);
@@ -1100,6 +1102,11 @@ void bus_done(Manager *m) {
         m->subscribed = sd_bus_track_unref(m->subscribed);
         m->deserialized_subscribed = strv_free(m->deserialized_subscribed);
 
+        for (c = 0; c < _BUS_SIGNAL_CLASS_MAX; c++) {
+                m->bus_coalesced_units[c] = set_free(m->bus_coalesced_units[c]);
+                m->bus_coalesce_event_source[c] = sd_event_source_unref(m->bus_coalesce_event_source[c]);
+        }
+
         if (m->private_listen_event_source)
                 m->private_listen_event_source = sd_event_source_unref(m->private_listen_event_source);
 
@@ -1148,8 +1155,9 @@ int bus_fdset_add_all(Manager *m, FDSet *fds) {
         return 0;
 }
 
-int bus_foreach_bus(
+int bus_foreach_bus_class(
                 Manager *m,
+                BusSignalClass c,
                 sd_bus_track *subscribed2,
                 int (*send_message)(sd_bus *bus, void *userdata),
                 void *userdata) {
@@ -1158,17 +1166,39 @@ int bus_foreach_bus(
         sd_bus *b;
         int r, ret = 0;
 
-        /* Send to all direct buses, unconditionally */
-        SET_FOREACH(b, m->private_buses, i) {
-                r = send_message(b, userdata);
+        assert(m);
+        assert(c >= 0 && c < _BUS_SIGNAL_CLASS_MAX);
+
+        if (c == BUS_SIGNAL_PRIVATE) {
+                /* Send to all direct buses, unconditionally */
+                SET_FOREACH(b, m->private_buses, i) {
+                        r = send_message(b, userdata);
+                        if (r < 0)
+                                ret = r;
+                }
+
+        } else if (sd_bus_track_count(m->subscribed) > 0 ||
+                   sd_bus_track_count(subscribed2) > 0) {
+                /* Send to API bus, but only if somebody is subscribed */
+                r = send_message(m->api_bus, userdata);
                 if (r < 0)
                         ret = r;
         }
 
-        /* Send to API bus, but only if somebody is subscribed */
-        if (sd_bus_track_count(m->subscribed) > 0 ||
-            sd_bus_track_count(subscribed2) > 0) {
-                r = send_message(m->api_bus, userdata);
+        return ret;
+}
+
+int bus_foreach_bus(
+                Manager *m,
+                sd_bus_track *subscribed2,
+                int (*send_message)(sd_bus *bus, void *userdata),
+                void *userdata) {
+
+        BusSignalClass c;
+        int r, ret = 0;
+
+        for (c = 0; c < _BUS_SIGNAL_CLASS_MAX; c++) {
+                r = bus_foreach_bus_class(m, c, subscribed2, send_message, userdata);
                 if (r < 0)
                         ret = r;
         }
@@ -1176,7 +1206,7 @@ int bus_foreach_bus(
         return ret;
 }
 
-void bus_track_serialize(sd_bus_track *t, FILE *f, const char *prefix) {
+void bus_track_serialize(sd_bus_track *t, FILE *f, SerializationFormat format, const char *prefix) {
         const char *n;
 
         assert(f);
@@ -1187,12 +1217,8 @@ void bus_track_serialize(sd_bus_track *t, FILE *f, const char *prefix) {
 
                 c = sd_bus_track_count_name(t, n);
 
-                for (j = 0; j < c; j++) {
-                        fputs(prefix, f);
-                        fputc('=', f);
-                        fputs(n, f);
-                        fputc('\n', f);
-                }
+                for (j = 0; j < c; j++)
+                        serialize_item(f, format, prefix, n);
         }
 }
 
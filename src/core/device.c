@@ -25,6 +25,7 @@
 #include "alloc-util.h"
 #include "dbus-device.h"
 #include "device.h"
+#include "hashmap.h"
 #include "log.h"
 #include "parse-util.h"
 #include "path-util.h"
@@ -41,6 +42,18 @@ static const UnitActiveState state_translation_table[_DEVICE_STATE_MAX] = {
         [DEVICE_PLUGGED] = UNIT_ACTIVE,
 };
 
+/* At most this many udev events are read in one go, to not starve
+ * other event sources during coldplug */
+#define DEVICE_EVENTS_BATCH_MAX 1024U
+
+/* The udev events of one batch for the same device, of which only the
+ * last remove event and the last event after it matter */
+typedef struct DeviceEvent {
+        char *sysfs;
+        struct udev_device *removed;
+        struct udev_device *dev;
+} DeviceEvent;
+
 static int device_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata);
 
 static void device_unset_sysfs(Device *d) {
@@ -305,7 +318,7 @@ static int device_upgrade_mount_deps(Unit *u) {
         Iterator i;
         int r;
 
-        SET_FOREACH(other, u->dependencies[UNIT_REQUIRED_BY], i) {
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_REQUIRED_BY, i) {
                 if (other->type != UNIT_MOUNT)
                         continue;
 
@@ -729,30 +742,36 @@ fail:
         device_shutdown(m);
 }
 
-static int device_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
-        _cleanup_udev_device_unref_ struct udev_device *dev = NULL;
-        Manager *m = userdata;
-        const char *action, *sysfs;
-        int r;
+static DeviceEvent *device_event_free(DeviceEvent *e) {
+        if (!e)
+                return NULL;
 
-        assert(m);
+        udev_device_unref(e->removed);
+        udev_device_unref(e->dev);
+        free(e->sysfs);
 
-        if (revents != EPOLLIN) {
-                static RATELIMIT_DEFINE(limit, 10*USEC_PER_SEC, 5);
+        return mfree(e);
+}
 
-                if (!ratelimit_test(&limit))
-                        log_error_errno(errno, "Failed to get udev event: %m");
-                if (!(revents & EPOLLIN))
-                        return 0;
-        }
+static void device_events_free(OrderedHashmap *events) {
+        DeviceEvent *e;
 
-        /*
-         * libudev might filter-out devices which pass the bloom
-         * filter, so getting NULL here is not necessarily an error.
-         */
-        dev = udev_monitor_receive_device(m->udev_monitor);
-        if (!dev)
-                return 0;
+        while ((e = ordered_hashmap_steal_first(events)))
+                device_event_free(e);
+
+        ordered_hashmap_free(events);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(OrderedHashmap*, device_events_free);
+
+static int device_events_add(Manager *m, OrderedHashmap *events, struct udev_device *dev) {
+        const char *action, *sysfs;
+        DeviceEvent *e;
+        int r;
+
+        assert(m);
+        assert(events);
+        assert(dev);
 
         sysfs = udev_device_get_syspath(dev);
         if (!sysfs) {
@@ -766,37 +785,144 @@ static int device_dispatch_io(sd_event_source *source, int fd, uint32_t revents,
                 return 0;
         }
 
-        if (streq(action, "remove"))  {
-                r = swap_process_device_remove(m, dev);
-                if (r < 0)
-                        log_error_errno(r, "Failed to process swap device remove event: %m");
+        e = ordered_hashmap_get(events, sysfs);
+        if (e)
+                m->n_device_events_coalesced++;
+        else {
+                e = new0(DeviceEvent, 1);
+                if (!e)
+                        return -ENOMEM;
+
+                e->sysfs = strdup(sysfs);
+                if (!e->sysfs) {
+                        device_event_free(e);
+                        return -ENOMEM;
+                }
 
-                /* If we get notified that a device was removed by
-                 * udev, then it's completely gone, hence unset all
-                 * found bits */
-                device_update_found_by_sysfs(m, sysfs, false, DEVICE_FOUND_UDEV|DEVICE_FOUND_MOUNT|DEVICE_FOUND_SWAP, true);
+                r = ordered_hashmap_put(events, e->sysfs, e);
+                if (r < 0) {
+                        device_event_free(e);
+                        return r;
+                }
+        }
 
-        } else if (device_is_ready(dev)) {
+        /* Whatever happened before a remove event does not matter
+         * anymore, and of other events only the most recent state of
+         * the device does */
+        if (streq(action, "remove")) {
+                udev_device_unref(e->removed);
+                e->removed = udev_device_ref(dev);
+                e->dev = udev_device_unref(e->dev);
+        } else {
+                udev_device_unref(e->dev);
+                e->dev = udev_device_ref(dev);
+        }
 
-                (void) device_process_new(m, dev);
+        return 0;
+}
 
-                r = swap_process_device_new(m, dev);
-                if (r < 0)
-                        log_error_errno(r, "Failed to process swap device new event: %m");
+static void device_events_apply(Manager *m, OrderedHashmap *events) {
+        DeviceEvent *e;
+        Iterator i;
+        int r;
 
-                manager_dispatch_load_queue(m);
+        assert(m);
 
-                /* The device is found now, set the udev found bit */
-                device_update_found_by_sysfs(m, sysfs, true, DEVICE_FOUND_UDEV, true);
+        ORDERED_HASHMAP_FOREACH(e, events, i) {
 
-        } else {
-                /* The device is nominally around, but not ready for
-                 * us. Hence unset the udev bit, but leave the rest
-                 * around. */
+                if (e->removed) {
+                        r = swap_process_device_remove(m, e->removed);
+                        if (r < 0)
+                                log_error_errno(r, "Failed to process swap device remove event: %m");
+
+                        /* If we get notified that a device was removed by
+                         * udev, then it's completely gone, hence unset all
+                         * found bits */
+                        device_update_found_by_sysfs(m, e->sysfs, false, DEVICE_FOUND_UDEV|DEVICE_FOUND_MOUNT|DEVICE_FOUND_SWAP, true);
+                }
+
+                if (e->dev && device_is_ready(e->dev)) {
+                        (void) device_process_new(m, e->dev);
+
+                        r = swap_process_device_new(m, e->dev);
+                        if (r < 0)
+                                log_error_errno(r, "Failed to process swap device new event: %m");
+                }
+        }
+
+        /* Load the new units of all devices at once, before any of
+         * them changes state */
+        manager_dispatch_load_queue(m);
+
+        ORDERED_HASHMAP_FOREACH(e, events, i) {
+
+                if (!e->dev)
+                        continue;
+
+                if (device_is_ready(e->dev))
+                        /* The device is found now, set the udev found bit */
+                        device_update_found_by_sysfs(m, e->sysfs, true, DEVICE_FOUND_UDEV, true);
+                else
+                        /* The device is nominally around, but not ready for
+                         * us. Hence unset the udev bit, but leave the rest
+                         * around. */
+                        device_update_found_by_sysfs(m, e->sysfs, false, DEVICE_FOUND_UDEV, true);
+        }
+}
+
+static int device_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        _cleanup_(device_events_freep) OrderedHashmap *events = NULL;
+        Manager *m = userdata;
+        unsigned n;
+        int r;
+
+        assert(m);
+
+        if (revents != EPOLLIN) {
+                static RATELIMIT_DEFINE(limit, 10*USEC_PER_SEC, 5);
 
-                device_update_found_by_sysfs(m, sysfs, false, DEVICE_FOUND_UDEV, true);
+                if (!ratelimit_test(&limit))
+                        log_error_errno(errno, "Failed to get udev event: %m");
+                if (!(revents & EPOLLIN))
+                        return 0;
         }
 
+        events = ordered_hashmap_new(&string_hash_ops);
+        if (!events)
+                return log_oom();
+
+        /* Read everything that is queued, so that several events for
+         * the same device, as frequent during coldplug, are applied
+         * only once. Whatever is left over when the batch is full
+         * makes us get called again. */
+        for (n = 0; n < DEVICE_EVENTS_BATCH_MAX; n++) {
+                _cleanup_udev_device_unref_ struct udev_device *dev = NULL;
+
+                /*
+                 * libudev might filter-out devices which pass the bloom
+                 * filter, so getting NULL here is not necessarily an error.
+                 */
+                dev = udev_monitor_receive_device(m->udev_monitor);
+                if (!dev)
+                        break;
+
+                r = device_events_add(m, events, dev);
+                if (r < 0) {
+                        log_oom();
+                        break;
+                }
+        }
+
+        if (n == 0)
+                return 0;
+
+        m->n_device_events += n;
+        m->n_device_event_dispatches++;
+
+        if (n > 1)
+                log_debug("Processing %u udev events for %u devices.", n, ordered_hashmap_size(events));
+
+        device_events_apply(m, events);
         return 0;
 }
 
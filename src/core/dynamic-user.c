@@ -26,6 +26,7 @@
 #include "fs-util.h"
 #include "parse-util.h"
 #include "random-util.h"
+#include "serialize.h"
 #include "stdio-util.h"
 #include "string-util.h"
 #include "user-util.h"
@@ -594,7 +595,7 @@ int dynamic_user_serialize(Manager *m, FILE *f, FDSet *fds) {
                 if (copy1 < 0)
                         return copy1;
 
-                fprintf(f, "dynamic-user=%s %i %i\n", d->name, copy0, copy1);
+                serialize_item_format(f, m->serialization_format, "dynamic-user", "%s %i %i", d->name, copy0, copy1);
         }
 
         return 0;
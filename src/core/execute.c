@@ -99,6 +99,7 @@
 #include "strv.h"
 #include "syslog-util.h"
 #include "terminal-util.h"
+#include "trace.h"
 #include "unit.h"
 #include "user-util.h"
 #include "util.h"
@@ -2923,6 +2924,7 @@ int exec_spawn(Unit *unit,
         int socket_fd, r;
         int named_iofds[3] = { -1, -1, -1 };
         char **argv;
+        nsec_t trace;
         pid_t pid;
 
         assert(unit);
@@ -2932,6 +2934,8 @@ int exec_spawn(Unit *unit,
         assert(params);
         assert(params->fds || (params->n_storage_fds + params->n_socket_fds <= 0));
 
+        trace = trace_begin(unit->manager->trace);
+
         if (context->std_input == EXEC_INPUT_SOCKET ||
             context->std_output == EXEC_OUTPUT_SOCKET ||
             context->std_error == EXEC_OUTPUT_SOCKET) {
@@ -3040,6 +3044,8 @@ int exec_spawn(Unit *unit,
 
         exec_status_start(&command->exec_status, pid);
 
+        trace_end(unit->manager->trace, TRACE_SPAWN, unit->id, trace);
+
         *ret = pid;
         return 0;
 }
@@ -31,13 +31,17 @@
 #include "log.h"
 #include "macro.h"
 #include "parse-util.h"
+#include "prioq.h"
+#include "serialize.h"
 #include "set.h"
+#include "slice.h"
 #include "special.h"
 #include "stdio-util.h"
 #include "string-table.h"
 #include "string-util.h"
 #include "strv.h"
 #include "terminal-util.h"
+#include "trace.h"
 #include "unit.h"
 #include "virt.h"
 
@@ -93,6 +97,8 @@ void job_free(Job *j) {
         if (j->in_gc_queue)
                 LIST_REMOVE(gc_queue, j->manager->gc_job_queue, j);
 
+        job_unthrottle(j);
+
         sd_event_source_unref(j->timer_event_source);
 
         sd_bus_track_unref(j->bus_track);
@@ -101,6 +107,8 @@ void job_free(Job *j) {
         free(j);
 }
 
+static void job_release_start_slot(Job *j);
+
 static void job_set_state(Job *j, JobState state) {
         assert(j);
         assert(state >= 0);
@@ -124,7 +132,207 @@ static void job_set_state(Job *j, JobState state) {
 
                 if (j->unit->manager->n_running_jobs <= 0)
                         j->unit->manager->jobs_in_progress_event_source = sd_event_source_unref(j->unit->manager->jobs_in_progress_event_source);
+
+                job_release_start_slot(j);
+        }
+}
+
+static int job_throttle_compare(const void *a, const void *b) {
+        const Job *x = a, *y = b;
+
+        /* Jobs that other jobs are ordered after go first, as they
+         * are on the critical path of the transaction, then the rest
+         * in the order they were enqueued */
+
+        if (x->blocks_others != y->blocks_others)
+                return x->blocks_others ? -1 : 1;
+
+        if (x->id < y->id)
+                return -1;
+        if (x->id > y->id)
+                return 1;
+
+        return 0;
+}
+
+static bool job_needs_start_slot(Job *j) {
+        assert(j);
+
+        /* Only starting units that run processes counts against
+         * MaxConcurrentStartJobs=. Starting targets, slices, devices
+         * or scopes is cheap, and holding them back would just delay
+         * everything ordered after them. */
+
+        if (j->type != JOB_START)
+                return false;
+
+        if (!UNIT_HAS_EXEC_CONTEXT(j->unit))
+                return false;
+
+        return !UNIT_IS_ACTIVE_OR_RELOADING(unit_active_state(j->unit));
+}
+
+static bool job_blocks_others(Job *j) {
+        Iterator i;
+        Unit *other;
+
+        assert(j);
+
+        UNIT_FOREACH_DEPENDENCY(other, j->unit, UNIT_BEFORE, i)
+                if (other->job &&
+                    IN_SET(other->job->type, JOB_START, JOB_VERIFY_ACTIVE, JOB_RELOAD))
+                        return true;
+
+        return false;
+}
+
+static Prioq **throttle_queue(Manager *m, Unit *slice) {
+        assert(m);
+
+        return slice ? &SLICE(slice)->throttled_jobs : &m->throttled_jobs;
+}
+
+static bool job_start_slot_blocked(Job *j, Unit **ret_blocker) {
+        Manager *m;
+        Unit *s;
+
+        assert(j);
+        assert(ret_blocker);
+
+        m = j->manager;
+
+        /* Checks the limits of the slices the unit is in, innermost
+         * first, and then the global one. Returns the slice whose
+         * limit is reached, or NULL if it is the global one. */
+
+        for (s = UNIT_DEREF(j->unit->slice); s; s = UNIT_DEREF(s->slice)) {
+                Slice *t = SLICE(s);
+
+                if (t->max_concurrent_start_jobs > 0 &&
+                    t->n_running_start_jobs >= t->max_concurrent_start_jobs) {
+                        *ret_blocker = s;
+                        return true;
+                }
+        }
+
+        if (m->max_concurrent_start_jobs > 0 &&
+            m->n_running_start_jobs >= m->max_concurrent_start_jobs) {
+                *ret_blocker = NULL;
+                return true;
+        }
+
+        return false;
+}
+
+static int job_throttle(Job *j, Unit *blocker) {
+        Prioq **q;
+        int r;
+
+        assert(j);
+        assert(!j->throttled);
+
+        q = throttle_queue(j->manager, blocker);
+
+        r = prioq_ensure_allocated(q, job_throttle_compare);
+        if (r < 0)
+                return r;
+
+        j->blocks_others = job_blocks_others(j);
+
+        r = prioq_put(*q, j, &j->throttle_idx);
+        if (r < 0)
+                return r;
+
+        j->throttled = true;
+        j->throttled_by = blocker;
+
+        if (j->throttled_usec == 0) {
+                j->throttled_usec = now(CLOCK_MONOTONIC);
+                j->manager->n_start_jobs_throttled++;
+        }
+
+        return 0;
+}
+
+void job_unthrottle(Job *j) {
+        assert(j);
+
+        if (!j->throttled)
+                return;
+
+        prioq_remove(*throttle_queue(j->manager, j->throttled_by), j, &j->throttle_idx);
+
+        j->throttled = false;
+        j->throttled_by = NULL;
+}
+
+static void job_wake_throttled(Manager *m, Unit *slice) {
+        Unit *blocker;
+        Job *j;
+
+        assert(m);
+
+        /* A slot was freed in the slice (or globally, if NULL). Hand
+         * it to the first job waiting for it, unless that job is held
+         * back by another limit as well, in which case it moves over
+         * to the queue of that limit and the next one gets a chance. */
+
+        while ((j = prioq_peek(*throttle_queue(m, slice)))) {
+                job_unthrottle(j);
+
+                if (!job_start_slot_blocked(j, &blocker))
+                        break;
+
+                if (job_throttle(j, blocker) < 0)
+                        break;
+
+                if (blocker == slice)
+                        return;
+        }
+
+        if (j)
+                job_add_to_run_queue(j);
+}
+
+static void job_acquire_start_slot(Job *j) {
+        Unit *s;
+
+        assert(j);
+        assert(!j->holds_start_slot);
+
+        /* unit_set_slice() refuses to move the unit elsewhere until
+         * the slot is released again */
+        for (s = UNIT_DEREF(j->unit->slice); s; s = UNIT_DEREF(s->slice))
+                SLICE(s)->n_running_start_jobs++;
+
+        j->manager->n_running_start_jobs++;
+        j->holds_start_slot = true;
+}
+
+static void job_release_start_slot(Job *j) {
+        Manager *m;
+        Unit *s;
+
+        assert(j);
+
+        if (!j->holds_start_slot)
+                return;
+
+        m = j->manager;
+
+        for (s = UNIT_DEREF(j->unit->slice); s; s = UNIT_DEREF(s->slice)) {
+                assert(SLICE(s)->n_running_start_jobs > 0);
+                SLICE(s)->n_running_start_jobs--;
+
+                job_wake_throttled(m, s);
         }
+
+        assert(m->n_running_start_jobs > 0);
+        m->n_running_start_jobs--;
+
+        job_wake_throttled(m, NULL);
+
+        j->holds_start_slot = false;
 }
 
 void job_uninstall(Job *j) {
@@ -133,6 +341,7 @@ void job_uninstall(Job *j) {
         assert(j->installed);
 
         job_set_state(j, JOB_WAITING);
+        job_unthrottle(j);
 
         pj = (j->type == JOB_NOP) ? &j->unit->nop_job : &j->unit->job;
         assert(*pj == j);
@@ -254,9 +463,13 @@ int job_install_deserialized(Job *j) {
         *pj = j;
         j->installed = true;
 
-        if (j->state == JOB_RUNNING)
+        if (j->state == JOB_RUNNING) {
                 j->unit->manager->n_running_jobs++;
 
+                if (job_needs_start_slot(j))
+                        job_acquire_start_slot(j);
+        }
+
         log_unit_debug(j->unit,
                        "Reinstalled deserialized job %s/%s as %u",
                        j->unit->id, job_type_to_string(j->type), (unsigned) j->id);
@@ -317,6 +530,11 @@ void job_dump(Job *j, FILE*f, const char *prefix) {
                 prefix, j->unit->id, job_type_to_string(j->type),
                 prefix, job_state_to_string(j->state),
                 prefix, yes_no(j->irreversible));
+
+        if (j->throttled)
+                fprintf(f,
+                        "%s\tWaiting for slot in: %s\n",
+                        prefix, j->throttled_by ? j->throttled_by->id : "manager");
 }
 
 /*
@@ -471,7 +689,7 @@ static bool job_is_runnable(Job *j) {
                  * dependencies, regardless whether they are
                  * starting or stopping something. */
 
-                SET_FOREACH(other, j->unit->dependencies[UNIT_AFTER], i)
+                UNIT_FOREACH_DEPENDENCY(other, j->unit, UNIT_AFTER, i)
                         if (other->job)
                                 return false;
         }
@@ -479,7 +697,7 @@ static bool job_is_runnable(Job *j) {
         /* Also, if something else is being stopped and we should
          * change state after it, then let's wait. */
 
-        SET_FOREACH(other, j->unit->dependencies[UNIT_BEFORE], i)
+        UNIT_FOREACH_DEPENDENCY(other, j->unit, UNIT_BEFORE, i)
                 if (other->job &&
                     IN_SET(other->job->type, JOB_STOP, JOB_RESTART))
                         return false;
@@ -559,6 +777,28 @@ static int job_perform_on_unit(Job **j) {
         return r;
 }
 
+static void job_account_start_wait(Job *j) {
+        Manager *m;
+        usec_t t;
+
+        assert(j);
+
+        m = j->manager;
+
+        /* Jobs deserialized from an older manager carry no timestamp */
+        if (j->begin_usec == 0)
+                return;
+
+        t = usec_sub_unsigned(j->begin_running_usec, j->begin_usec);
+
+        m->n_start_jobs++;
+        m->start_job_wait_usec += t;
+        m->start_job_wait_max_usec = MAX(m->start_job_wait_max_usec, t);
+
+        if (j->throttled_usec > 0)
+                m->start_job_throttle_usec += usec_sub_unsigned(j->begin_running_usec, j->throttled_usec);
+}
+
 int job_run_and_invalidate(Job *j) {
         int r;
 
@@ -573,13 +813,39 @@ int job_run_and_invalidate(Job *j) {
         if (j->state != JOB_WAITING)
                 return 0;
 
+        /* Whatever put a throttled job back into the run queue, let's
+         * check its slot again below */
+        job_unthrottle(j);
+
         if (!job_is_runnable(j))
                 return -EAGAIN;
 
+        if (job_needs_start_slot(j)) {
+                Unit *blocker;
+
+                if (job_start_slot_blocked(j, &blocker)) {
+                        r = job_throttle(j, blocker);
+                        if (r >= 0)
+                                return -EAGAIN;
+
+                        log_unit_warning_errno(j->unit, r, "Failed to queue job for a free slot, running it right away: %m");
+                }
+
+                job_acquire_start_slot(j);
+        }
+
         job_start_timer(j, true);
         job_set_state(j, JOB_RUNNING);
         job_add_to_dbus_queue(j);
 
+        if (j->manager->trace && j->begin_usec > 0)
+                trace_buffer_add(j->manager->trace, TRACE_JOB_WAIT, j->unit->id,
+                                 j->begin_usec * NSEC_PER_USEC,
+                                 j->begin_running_usec * NSEC_PER_USEC);
+
+        if (j->type == JOB_START)
+                job_account_start_wait(j);
+
 
         switch (j->type) {
 
@@ -836,7 +1102,7 @@ static void job_fail_dependencies(Unit *u, UnitDependency d) {
 
         assert(u);
 
-        SET_FOREACH(other, u->dependencies[d], i) {
+        UNIT_FOREACH_DEPENDENCY(other, u, d, i) {
                 Job *j = other->job;
 
                 if (!j)
@@ -865,6 +1131,11 @@ int job_finish_and_invalidate(Job *j, JobResult result, bool recursive, bool alr
 
         log_unit_debug(u, "Job %s/%s finished, result=%s", u->id, job_type_to_string(t), job_result_to_string(result));
 
+        if (u->manager->trace && j->state == JOB_RUNNING)
+                trace_buffer_add(u->manager->trace, TRACE_JOB_RUN, u->id,
+                                 j->begin_running_usec * NSEC_PER_USEC,
+                                 now_nsec(CLOCK_MONOTONIC));
+
         /* If this job did nothing to respective unit we don't log the status message */
         if (!already)
                 job_emit_status_message(u, t, result);
@@ -921,12 +1192,12 @@ int job_finish_and_invalidate(Job *j, JobResult result, bool recursive, bool alr
 
 finish:
         /* Try to start the next jobs that can be started */
-        SET_FOREACH(other, u->dependencies[UNIT_AFTER], i)
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_AFTER, i)
                 if (other->job) {
                         job_add_to_run_queue(other->job);
                         job_add_to_gc_queue(other->job);
                 }
-        SET_FOREACH(other, u->dependencies[UNIT_BEFORE], i)
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_BEFORE, i)
                 if (other->job) {
                         job_add_to_run_queue(other->job);
                         job_add_to_gc_queue(other->job);
@@ -1044,57 +1315,53 @@ char *job_dbus_path(Job *j) {
 }
 
 int job_serialize(Job *j, FILE *f) {
+        SerializationFormat format;
+
         assert(j);
         assert(f);
 
-        fprintf(f, "job-id=%u\n", j->id);
-        fprintf(f, "job-type=%s\n", job_type_to_string(j->type));
-        fprintf(f, "job-state=%s\n", job_state_to_string(j->state));
-        fprintf(f, "job-irreversible=%s\n", yes_no(j->irreversible));
-        fprintf(f, "job-sent-dbus-new-signal=%s\n", yes_no(j->sent_dbus_new_signal));
-        fprintf(f, "job-ignore-order=%s\n", yes_no(j->ignore_order));
+        format = j->manager->serialization_format;
+
+        serialize_item_format(f, format, "job-id", "%u", j->id);
+        serialize_item(f, format, "job-type", job_type_to_string(j->type));
+        serialize_item(f, format, "job-state", job_state_to_string(j->state));
+        serialize_item(f, format, "job-irreversible", yes_no(j->irreversible));
+        serialize_item(f, format, "job-sent-dbus-new-signal", yes_no(j->sent_dbus_new_signal));
+        serialize_item(f, format, "job-ignore-order", yes_no(j->ignore_order));
 
         if (j->begin_usec > 0)
-                fprintf(f, "job-begin="USEC_FMT"\n", j->begin_usec);
+                serialize_item_format(f, format, "job-begin", USEC_FMT, j->begin_usec);
         if (j->begin_running_usec > 0)
-                fprintf(f, "job-begin-running="USEC_FMT"\n", j->begin_running_usec);
+                serialize_item_format(f, format, "job-begin-running", USEC_FMT, j->begin_running_usec);
 
-        bus_track_serialize(j->bus_track, f, "subscribed");
+        bus_track_serialize(j->bus_track, f, format, "subscribed");
 
         /* End marker */
-        fputc('\n', f);
+        serialize_end_marker(f, format);
         return 0;
 }
 
 int job_deserialize(Job *j, FILE *f) {
+        _cleanup_free_ char *buffer = NULL;
+        size_t allocated = 0;
+        int r;
+
         assert(j);
         assert(f);
 
         for (;;) {
-                char line[LINE_MAX], *l, *v;
-                size_t k;
+                char *l, *v;
 
-                if (!fgets(line, sizeof(line), f)) {
-                        if (feof(f))
-                                return 0;
-                        return -errno;
-                }
-
-                char_array_0(line);
-                l = strstrip(line);
+                r = deserialize_item(f, j->manager->deserialization_format, &buffer, &allocated, &l, &v);
+                if (r == -ENODATA)
+                        return 0;
+                if (r < 0)
+                        return r;
 
                 /* End marker */
-                if (l[0] == 0)
+                if (r == 0)
                         return 0;
 
-                k = strcspn(l, "=");
-
-                if (l[k] == '=') {
-                        l[k] = 0;
-                        v = l+k+1;
-                } else
-                        v = l+k;
-
                 if (streq(l, "job-id")) {
 
                         if (safe_atou32(v, &j->id) < 0)
@@ -1303,7 +1570,7 @@ bool job_check_gc(Job *j) {
 
         /* If a job is ordered after ours, and is to be started, then it needs to wait for us, regardless if we stop or
          * start, hence let's not GC in that case. */
-        SET_FOREACH(other, j->unit->dependencies[UNIT_BEFORE], i) {
+        UNIT_FOREACH_DEPENDENCY(other, j->unit, UNIT_BEFORE, i) {
                 if (!other->job)
                         continue;
 
@@ -1316,7 +1583,7 @@ bool job_check_gc(Job *j) {
 
         /* If we are going down, but something else is ordered After= us, then it needs to wait for us */
         if (IN_SET(j->type, JOB_STOP, JOB_RESTART))
-                SET_FOREACH(other, j->unit->dependencies[UNIT_AFTER], i) {
+                UNIT_FOREACH_DEPENDENCY(other, j->unit, UNIT_AFTER, i) {
                         if (!other->job)
                                 continue;
 
@@ -1407,7 +1674,7 @@ int job_get_before(Job *j, Job*** ret) {
 
         if (IN_SET(j->type, JOB_START, JOB_VERIFY_ACTIVE, JOB_RELOAD)) {
 
-                SET_FOREACH(other, j->unit->dependencies[UNIT_AFTER], i) {
+                UNIT_FOREACH_DEPENDENCY(other, j->unit, UNIT_AFTER, i) {
                         if (!other->job)
                                 continue;
 
@@ -1417,7 +1684,7 @@ int job_get_before(Job *j, Job*** ret) {
                 }
         }
 
-        SET_FOREACH(other, j->unit->dependencies[UNIT_BEFORE], i) {
+        UNIT_FOREACH_DEPENDENCY(other, j->unit, UNIT_BEFORE, i) {
                 if (!other->job)
                         continue;
 
@@ -1448,7 +1715,7 @@ int job_get_after(Job *j, Job*** ret) {
 
         /* Returns a list of all pending jobs that are waiting for this job to finish. */
 
-        SET_FOREACH(other, j->unit->dependencies[UNIT_BEFORE], i) {
+        UNIT_FOREACH_DEPENDENCY(other, j->unit, UNIT_BEFORE, i) {
                 if (!other->job)
                         continue;
 
@@ -1465,7 +1732,7 @@ int job_get_after(Job *j, Job*** ret) {
 
         if (IN_SET(j->type, JOB_STOP, JOB_RESTART)) {
 
-                SET_FOREACH(other, j->unit->dependencies[UNIT_AFTER], i) {
+                UNIT_FOREACH_DEPENDENCY(other, j->unit, UNIT_AFTER, i) {
                         if (!other->job)
                                 continue;
 
@@ -152,6 +152,13 @@ struct Job {
         usec_t begin_usec;
         usec_t begin_running_usec;
 
+        /* Start jobs waiting for a free slot, see
+         * MaxConcurrentStartJobs=, are queued in the manager or in
+         * the slice whose limit was reached, ordered by priority */
+        Unit *throttled_by;
+        unsigned throttle_idx;
+        usec_t throttled_usec;
+
         /*
          * This tracks where to send signals, and also which clients
          * are allowed to call DBus methods on the job (other than
@@ -173,6 +180,9 @@ struct Job {
         bool irreversible:1;
         bool in_gc_queue:1;
         bool ref_by_private_bus:1;
+        bool throttled:1;
+        bool blocks_others:1;
+        bool holds_start_slot:1;
 };
 
 Job* job_new(Unit *unit, JobType type);
@@ -219,6 +229,7 @@ JobType job_type_collapse(JobType t, Unit *u);
 int job_type_merge_and_collapse(JobType *a, JobType b, Unit *u);
 
 void job_add_to_run_queue(Job *j);
+void job_unthrottle(Job *j);
 void job_add_to_dbus_queue(Job *j);
 
 int job_start_timer(Job *j, bool job_running);
@@ -52,21 +52,20 @@ static int unit_name_compatible(const char *a, const char *b) {
         return 0;
 }
 
-static int process_deps(Unit *u, UnitDependency dependency, const char *dir_suffix) {
-        _cleanup_strv_free_ char **paths = NULL;
+static int find_deps(Unit *u, const char *dir_suffix, char ***paths) {
+        return unit_file_find_dropin_paths(NULL,
+                                           u->manager->lookup_paths.search_path,
+                                           u->manager->unit_path_cache,
+                                           dir_suffix,
+                                           NULL,
+                                           u->names,
+                                           paths);
+}
+
+static int process_deps(Unit *u, UnitDependency dependency, char **paths) {
         char **p;
         int r;
 
-        r = unit_file_find_dropin_paths(NULL,
-                                        u->manager->lookup_paths.search_path,
-                                        u->manager->unit_path_cache,
-                                        dir_suffix,
-                                        NULL,
-                                        u->names,
-                                        &paths);
-        if (r < 0)
-                return r;
-
         STRV_FOREACH(p, paths) {
                 const char *entry;
                 _cleanup_free_ char *target = NULL;
@@ -124,22 +123,61 @@ static int process_deps(Unit *u, UnitDependency dependency, const char *dir_suff
         return 0;
 }
 
+int unit_find_dropin_dependency_paths(Unit *u, char ***paths) {
+        _cleanup_strv_free_ char **wants = NULL, **requires = NULL;
+        int r;
+
+        assert(u);
+        assert(paths);
+
+        r = find_deps(u, ".wants", &wants);
+        if (r < 0)
+                return r;
+
+        r = find_deps(u, ".requires", &requires);
+        if (r < 0)
+                return r;
+
+        r = strv_extend_strv(&wants, requires, true);
+        if (r < 0)
+                return r;
+
+        *paths = wants;
+        wants = NULL;
+
+        return 0;
+}
+
 int unit_load_dropin(Unit *u) {
-        _cleanup_strv_free_ char **l = NULL;
+        _cleanup_strv_free_ char **l = NULL, **wants = NULL, **requires = NULL;
+        struct siphash state;
         char **f;
         int r;
 
         assert(u);
 
         /* Load dependencies from .wants and .requires directories */
-        r = process_deps(u, UNIT_WANTS, ".wants");
+        r = find_deps(u, ".wants", &wants);
         if (r < 0)
                 return r;
 
-        r = process_deps(u, UNIT_REQUIRES, ".requires");
+        r = find_deps(u, ".requires", &requires);
         if (r < 0)
                 return r;
 
+        r = process_deps(u, UNIT_WANTS, wants);
+        if (r < 0)
+                return r;
+
+        r = process_deps(u, UNIT_REQUIRES, requires);
+        if (r < 0)
+                return r;
+
+        /* Remember them, so that we notice when they change */
+        if (strv_extend_strv(&u->dropin_dependency_paths, wants, true) < 0 ||
+            strv_extend_strv(&u->dropin_dependency_paths, requires, true) < 0)
+                return log_oom();
+
         /* Load .conf dropins */
         r = unit_find_dropin_paths(u, &l);
         if (r <= 0)
@@ -154,14 +192,18 @@ int unit_load_dropin(Unit *u) {
                         return log_oom();
         }
 
+        config_hash_init(&state);
+
         STRV_FOREACH(f, u->dropin_paths) {
-                config_parse(u->id, *f, NULL,
-                             UNIT_VTABLE(u)->sections,
-                             config_item_perf_lookup, load_fragment_gperf_lookup,
-                             false, false, false, u);
+                config_parse_cached(u->manager->unit_file_cache,
+                                    u->id, *f, NULL,
+                                    UNIT_VTABLE(u)->sections,
+                                    config_item_perf_lookup, load_fragment_gperf_lookup,
+                                    false, false, false, &state, u);
         }
 
         u->dropin_mtime = now(CLOCK_REALTIME);
+        u->dropin_hash = siphash24_finalize(&state);
 
         return 0;
 }
@@ -32,4 +32,5 @@ static inline int unit_find_dropin_paths(Unit *u, char ***paths) {
                                                 paths);
 }
 
+int unit_find_dropin_dependency_paths(Unit *u, char ***paths);
 int unit_load_dropin(Unit *u);
@@ -58,6 +58,7 @@
 #include "seccomp-util.h"
 #endif
 #include "securebits.h"
+#include "serialize.h"
 #include "signal-util.h"
 #include "stat-util.h"
 #include "string-util.h"
@@ -1554,7 +1555,7 @@ int config_parse_trigger_unit(
         assert(rvalue);
         assert(data);
 
-        if (!set_isempty(u->dependencies[UNIT_TRIGGERS])) {
+        if (unit_dependency_first(u, UNIT_TRIGGERS)) {
                 log_syntax(unit, LOG_ERR, filename, line, 0, "Multiple units to trigger specified, ignoring: %s", rvalue);
                 return 0;
         }
@@ -2559,6 +2560,7 @@ int config_parse_unit_condition_null(
 
 DEFINE_CONFIG_PARSE_ENUM(config_parse_notify_access, notify_access, NotifyAccess, "Failed to parse notify access specifier");
 DEFINE_CONFIG_PARSE_ENUM(config_parse_emergency_action, emergency_action, EmergencyAction, "Failed to parse failure action specifier");
+DEFINE_CONFIG_PARSE_ENUM(config_parse_serialization_format, serialization_format, SerializationFormat, "Failed to parse serialization format");
 
 int config_parse_unit_requires_mounts_for(
                 const char *unit,
@@ -4468,16 +4470,22 @@ static int load_from_path(Unit *u, const char *path) {
                 u->load_state = UNIT_MASKED;
                 u->fragment_mtime = 0;
         } else {
+                struct siphash state;
+
                 u->load_state = UNIT_LOADED;
                 u->fragment_mtime = timespec_load(&st.st_mtim);
 
                 /* Now, parse the file contents */
-                r = config_parse(u->id, filename, f,
-                                 UNIT_VTABLE(u)->sections,
-                                 config_item_perf_lookup, load_fragment_gperf_lookup,
-                                 false, true, false, u);
+                config_hash_init(&state);
+                r = config_parse_cached(u->manager->unit_file_cache,
+                                        u->id, filename, f,
+                                        UNIT_VTABLE(u)->sections,
+                                        config_item_perf_lookup, load_fragment_gperf_lookup,
+                                        false, true, false, &state, u);
                 if (r < 0)
                         return r;
+
+                u->fragment_hash = siphash24_finalize(&state);
         }
 
         free(u->fragment_path);
@@ -4494,6 +4502,72 @@ static int load_from_path(Unit *u, const char *path) {
         return 0;
 }
 
+static int find_fragment(Unit *u, const char *name, char **ret) {
+        _cleanup_set_free_free_ Set *symlink_names = NULL;
+        char **p;
+        int r;
+
+        symlink_names = set_new(&string_hash_ops);
+        if (!symlink_names)
+                return -ENOMEM;
+
+        STRV_FOREACH(p, u->manager->lookup_paths.search_path) {
+                _cleanup_fclose_ FILE *f = NULL;
+                _cleanup_free_ char *filename = NULL;
+                char *id;
+
+                filename = path_make_absolute(name, *p);
+                if (!filename)
+                        return -ENOMEM;
+
+                if (u->manager->unit_path_cache &&
+                    !set_get(u->manager->unit_path_cache, filename))
+                        continue;
+
+                r = open_follow(&filename, &f, symlink_names, &id);
+                if (r >= 0) {
+                        *ret = filename;
+                        filename = NULL;
+                        return 1;
+                }
+
+                /* Same as in load_from_path() */
+                if (!IN_SET(r, -ENOENT, -ENOTDIR, -EACCES))
+                        return r;
+
+                set_clear_free(symlink_names);
+        }
+
+        *ret = NULL;
+        return 0;
+}
+
+int unit_find_fragment(Unit *u, char **ret) {
+        _cleanup_free_ char *k = NULL;
+        int r;
+
+        assert(u);
+        assert(ret);
+
+        /* Determines the fragment a unit of this name would be loaded
+         * from if it was loaded from scratch now, without loading it */
+
+        if (u->transient) {
+                *ret = NULL;
+                return 0;
+        }
+
+        r = find_fragment(u, u->id, ret);
+        if (r != 0 || !u->instance)
+                return r;
+
+        r = unit_name_template(u->id, &k);
+        if (r < 0)
+                return r;
+
+        return find_fragment(u, k, ret);
+}
+
 int unit_load_fragment(Unit *u) {
         int r;
         Iterator i;
@@ -124,6 +124,12 @@ static struct rlimit *arg_default_rlimit[_RLIMIT_MAX] = {};
 static uint64_t arg_capability_bounding_set = CAP_ALL;
 static nsec_t arg_timer_slack_nsec = NSEC_INFINITY;
 static usec_t arg_default_timer_accuracy_usec = 1 * USEC_PER_MINUTE;
+static usec_t arg_bus_signal_coalesce_usec = 0;
+static usec_t arg_private_bus_signal_coalesce_usec = 0;
+static usec_t arg_cgroup_accounting_cache_usec = 0;
+static unsigned arg_max_concurrent_start_jobs = 0;
+static unsigned arg_trace_buffer_size = 0;
+static SerializationFormat arg_serialization_format = SERIALIZATION_TEXT;
 static Set* arg_syscall_archs = NULL;
 static FILE* arg_serialization = NULL;
 static bool arg_default_cpu_accounting = false;
@@ -459,6 +465,15 @@ static int parse_proc_cmdline_item(const char *key, const char *value, void *dat
                 if (arg_default_timeout_start_usec <= 0)
                         arg_default_timeout_start_usec = USEC_INFINITY;
 
+        } else if (proc_cmdline_key_streq(key, "systemd.trace_buffer_size")) {
+
+                if (proc_cmdline_value_missing(key, value))
+                        return 0;
+
+                r = safe_atou(value, &arg_trace_buffer_size);
+                if (r < 0)
+                        log_warning_errno(r, "Failed to parse trace buffer size: %s, ignoring.", value);
+
         } else if (streq(key, "quiet") && !value) {
 
                 if (arg_show_status == _SHOW_STATUS_UNSET)
@@ -753,6 +768,12 @@ static int parse_config_file(void) {
                 { "Manager", "DefaultTasksAccounting",    config_parse_bool,             0, &arg_default_tasks_accounting          },
                 { "Manager", "DefaultTasksMax",           config_parse_tasks_max,        0, &arg_default_tasks_max                 },
                 { "Manager", "CtrlAltDelBurstAction",     config_parse_emergency_action, 0, &arg_cad_burst_action                  },
+                { "Manager", "BusSignalCoalesceSec",      config_parse_sec,              0, &arg_bus_signal_coalesce_usec          },
+                { "Manager", "PrivateBusSignalCoalesceSec",config_parse_sec,             0, &arg_private_bus_signal_coalesce_usec  },
+                { "Manager", "CGroupAccountingCacheSec",  config_parse_sec,              0, &arg_cgroup_accounting_cache_usec      },
+                { "Manager", "MaxConcurrentStartJobs",    config_parse_unsigned,         0, &arg_max_concurrent_start_jobs         },
+                { "Manager", "TraceBufferSize",           config_parse_unsigned,         0, &arg_trace_buffer_size                 },
+                { "Manager", "SerializationFormat",       config_parse_serialization_format, 0, &arg_serialization_format      },
                 {}
         };
 
@@ -796,6 +817,14 @@ static void manager_set_defaults(Manager *m) {
         m->default_memory_accounting = arg_default_memory_accounting;
         m->default_tasks_accounting = arg_default_tasks_accounting;
         m->default_tasks_max = arg_default_tasks_max;
+        m->bus_signal_coalesce_usec[BUS_SIGNAL_API] = arg_bus_signal_coalesce_usec;
+        m->bus_signal_coalesce_usec[BUS_SIGNAL_PRIVATE] = arg_private_bus_signal_coalesce_usec;
+        m->cgroup_accounting_cache_usec = arg_cgroup_accounting_cache_usec;
+        m->max_concurrent_start_jobs = arg_max_concurrent_start_jobs;
+
+        if (manager_set_trace_buffer_size(m, arg_trace_buffer_size) < 0)
+                log_warning("Failed to allocate trace buffer, not tracing.");
+        m->serialization_format = arg_serialization_format;
 
         manager_set_default_rlimits(m, arg_default_rlimit);
         manager_environment_add(m, NULL, arg_default_environment);
@@ -1124,6 +1153,8 @@ static int prepare_reexecute(Manager *m, FILE **_f, FDSet **_fds, bool switching
         assert(_f);
         assert(_fds);
 
+        manager_flush_cgroup_empty_queue(m);
+
         r = manager_open_serialization(m, &f);
         if (r < 0)
                 return log_error_errno(r, "Failed to create serialization file: %m");
@@ -1940,7 +1971,11 @@ int main(int argc, char *argv[]) {
 
                         manager_set_defaults(m);
 
-                        r = manager_reload(m);
+                        if (m->reload_incremental)
+                                r = manager_reload_incremental(m);
+                        else
+                                r = manager_reload(m);
+                        m->reload_incremental = false;
                         if (r < 0)
                                 log_error_errno(r, "Failed to reload: %m");
                         break;
@@ -0,0 +1,372 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+#include <string.h>
+
+#include "alloc-util.h"
+#include "cgroup.h"
+#include "fd-util.h"
+#include "hashmap.h"
+#include "io-util.h"
+#include "manager-snapshot.h"
+#include "memfd-util.h"
+#include "string-util.h"
+#include "unit-snapshot.h"
+#include "unit.h"
+#include "util.h"
+
+/* Units get a new generation whenever they are queued for a
+ * PropertiesChanged signal, i.e. whenever anything visible about them
+ * changes, see unit_add_to_dbus_queue(). Clients remember the
+ * generation of the last snapshot they took, and ask for the units
+ * that changed since then. Resource counters are sampled when the
+ * snapshot is taken, but do not bump the generation on their own.
+ *
+ * We remember this many removed units, beyond that clients which
+ * haven't looked for a while are handed a complete snapshot. */
+#define UNIT_REMOVALS_MAX 1024U
+
+typedef struct SnapshotBuilder {
+        UnitSnapshotEntry *entries;
+        size_t n_entries, n_entries_allocated;
+
+        char *strings;
+        size_t strings_size, strings_allocated;
+
+        /* The state strings are shared by many units, hence stored once */
+        Hashmap *string_offsets;
+} SnapshotBuilder;
+
+void manager_record_unit_removal(Manager *m, Unit *u) {
+        UnitRemoval *r;
+        size_t n;
+
+        assert(m);
+        assert(u);
+
+        if (!u->id || u->load_state == UNIT_STUB)
+                return;
+
+        if (m->n_unit_removals >= UNIT_REMOVALS_MAX) {
+                /* Forget the older half, and make sure clients that
+                 * might have missed one of them get everything */
+                n = m->n_unit_removals / 2;
+                m->unit_removals_floor = m->unit_removals[n - 1].generation;
+
+                for (r = m->unit_removals; r < m->unit_removals + n; r++)
+                        free(r->id);
+
+                memmove(m->unit_removals, m->unit_removals + n, (m->n_unit_removals - n) * sizeof(UnitRemoval));
+                m->n_unit_removals -= n;
+        }
+
+        /* Losing track of a removal is not fatal, it only means the
+         * next client gets a complete snapshot */
+        if (!GREEDY_REALLOC(m->unit_removals, m->n_unit_removals_allocated, m->n_unit_removals + 1))
+                goto forget;
+
+        r = m->unit_removals + m->n_unit_removals;
+        r->id = strdup(u->id);
+        if (!r->id)
+                goto forget;
+
+        r->generation = ++m->units_generation;
+        m->n_unit_removals++;
+        return;
+
+forget:
+        m->unit_removals_floor = ++m->units_generation;
+}
+
+void manager_free_unit_removals(Manager *m) {
+        size_t i;
+
+        assert(m);
+
+        for (i = 0; i < m->n_unit_removals; i++)
+                free(m->unit_removals[i].id);
+
+        m->unit_removals = mfree(m->unit_removals);
+        m->n_unit_removals = m->n_unit_removals_allocated = 0;
+}
+
+bool manager_units_snapshot_complete(Manager *m, uint64_t since) {
+        assert(m);
+
+        /* A generation from the future was handed out by an earlier
+         * incarnation of the manager, before a reexecution. */
+
+        return since == 0 ||
+                since > m->units_generation ||
+                since < m->unit_removals_floor;
+}
+
+static void snapshot_builder_done(SnapshotBuilder *b) {
+        assert(b);
+
+        free(b->entries);
+        free(b->strings);
+        hashmap_free(b->string_offsets);
+}
+
+static int snapshot_builder_add_string(SnapshotBuilder *b, const char *s, bool shared, uint32_t *ret) {
+        size_t l;
+        int r;
+
+        assert(b);
+        assert(ret);
+
+        s = strempty(s);
+
+        if (shared) {
+                void *v;
+
+                v = hashmap_get(b->string_offsets, s);
+                if (v) {
+                        *ret = PTR_TO_UINT32(v) - 1;
+                        return 0;
+                }
+        }
+
+        l = strlen(s) + 1;
+        if (b->strings_size + l >= UINT32_MAX)
+                return -E2BIG;
+
+        if (!GREEDY_REALLOC(b->strings, b->strings_allocated, b->strings_size + l))
+                return -ENOMEM;
+
+        memcpy(b->strings + b->strings_size, s, l);
+
+        if (shared) {
+                /* The strings are static, or owned by the units, which
+                 * don't change while we build the snapshot */
+                r = hashmap_put(b->string_offsets, s, UINT32_TO_PTR(b->strings_size + 1));
+                if (r < 0)
+                        return r;
+        }
+
+        *ret = b->strings_size;
+        b->strings_size += l;
+
+        return 0;
+}
+
+static UnitSnapshotEntry *snapshot_builder_new_entry(SnapshotBuilder *b) {
+        UnitSnapshotEntry *e;
+
+        assert(b);
+
+        if (!GREEDY_REALLOC(b->entries, b->n_entries_allocated, b->n_entries + 1))
+                return NULL;
+
+        e = b->entries + b->n_entries++;
+        *e = (UnitSnapshotEntry) {
+                .cpu_usage_nsec = UINT64_MAX,
+                .memory_current = UINT64_MAX,
+                .tasks_current = UINT64_MAX,
+        };
+
+        return e;
+}
+
+static int snapshot_builder_add_removal(SnapshotBuilder *b, const UnitRemoval *removal) {
+        UnitSnapshotEntry *e;
+
+        assert(b);
+        assert(removal);
+
+        e = snapshot_builder_new_entry(b);
+        if (!e)
+                return -ENOMEM;
+
+        e->generation = removal->generation;
+        e->flags = UNIT_SNAPSHOT_REMOVED;
+
+        return snapshot_builder_add_string(b, removal->id, false, &e->id);
+}
+
+static int snapshot_builder_add_unit(SnapshotBuilder *b, Unit *u) {
+        UnitSnapshotEntry *e;
+        uint64_t v;
+        nsec_t ns;
+        int r;
+
+        assert(b);
+        assert(u);
+
+        e = snapshot_builder_new_entry(b);
+        if (!e)
+                return -ENOMEM;
+
+        e->generation = u->state_generation;
+        e->main_pid = (uint32_t) unit_main_pid(u);
+        e->control_pid = (uint32_t) unit_control_pid(u);
+
+        if (unit_get_cpu_usage(u, &ns) >= 0)
+                e->cpu_usage_nsec = ns;
+        if (unit_get_memory_current(u, &v) >= 0)
+                e->memory_current = v;
+        if (unit_get_tasks_current(u, &v) >= 0)
+                e->tasks_current = v;
+
+        e->state_change_timestamp = u->state_change_timestamp.realtime;
+        e->active_enter_timestamp = u->active_enter_timestamp.realtime;
+        e->active_exit_timestamp = u->active_exit_timestamp.realtime;
+
+        r = snapshot_builder_add_string(b, u->id, false, &e->id);
+        if (r < 0)
+                return r;
+
+        /* Careful, the entry might have moved in the meantime */
+        e = b->entries + b->n_entries - 1;
+
+        r = snapshot_builder_add_string(b, unit_load_state_to_string(u->load_state), true, &e->load_state);
+        if (r < 0)
+                return r;
+        r = snapshot_builder_add_string(b, unit_active_state_to_string(unit_active_state(u)), true, &e->active_state);
+        if (r < 0)
+                return r;
+
+        return snapshot_builder_add_string(b, unit_sub_state_to_string(u), true, &e->sub_state);
+}
+
+int manager_build_units_snapshot(Manager *m, uint64_t since, void **ret, size_t *ret_size) {
+        _cleanup_(snapshot_builder_done) SnapshotBuilder b = {};
+        UnitSnapshotHeader *h;
+        bool complete;
+        uint32_t empty;
+        const char *k;
+        size_t size, i;
+        Iterator j;
+        uint8_t *p;
+        Unit *u;
+        int r;
+
+        assert(m);
+        assert(ret);
+        assert(ret_size);
+
+        complete = manager_units_snapshot_complete(m, since);
+
+        b.string_offsets = hashmap_new(&string_hash_ops);
+        if (!b.string_offsets)
+                return -ENOMEM;
+
+        /* Offset 0 is the empty string, as used by removed units */
+        r = snapshot_builder_add_string(&b, "", true, &empty);
+        if (r < 0)
+                return r;
+
+        /* Removals first, so that a unit that went away and came back
+         * since the last snapshot ends up with its current state */
+        if (!complete)
+                for (i = 0; i < m->n_unit_removals; i++) {
+                        if (m->unit_removals[i].generation <= since)
+                                continue;
+
+                        r = snapshot_builder_add_removal(&b, m->unit_removals + i);
+                        if (r < 0)
+                                return r;
+                }
+
+        /* A full snapshot carries the accounting values of all
+         * units, sample them in one go */
+        if (complete)
+                (void) manager_collect_cgroup_accounting(m);
+
+        HASHMAP_FOREACH_KEY(u, k, m->units, j) {
+                /* ignore aliases */
+                if (k != u->id)
+                        continue;
+
+                /* Units still to be loaded are announced once they are */
+                if (u->load_state == UNIT_STUB)
+                        continue;
+
+                if (!complete && u->state_generation <= since)
+                        continue;
+
+                r = snapshot_builder_add_unit(&b, u);
+                if (r < 0)
+                        return r;
+        }
+
+        size = sizeof(UnitSnapshotHeader) + b.n_entries * sizeof(UnitSnapshotEntry) + b.strings_size;
+        if (size > UNIT_SNAPSHOT_SIZE_MAX)
+                return -E2BIG;
+
+        p = malloc(size);
+        if (!p)
+                return -ENOMEM;
+
+        h = (UnitSnapshotHeader*) p;
+        *h = (UnitSnapshotHeader) {
+                .version = UNIT_SNAPSHOT_VERSION,
+                .flags = complete ? UNIT_SNAPSHOT_COMPLETE : 0,
+                .header_size = sizeof(UnitSnapshotHeader),
+                .entry_size = sizeof(UnitSnapshotEntry),
+                .n_entries = b.n_entries,
+                .generation = m->units_generation,
+                .since = complete ? 0 : since,
+                .strings_offset = sizeof(UnitSnapshotHeader) + b.n_entries * sizeof(UnitSnapshotEntry),
+                .strings_size = b.strings_size,
+        };
+        memcpy(h->signature, unit_snapshot_signature, sizeof(h->signature));
+
+        memcpy_safe(p + sizeof(UnitSnapshotHeader), b.entries, b.n_entries * sizeof(UnitSnapshotEntry));
+        memcpy(p + h->strings_offset, b.strings, b.strings_size);
+
+        *ret = p;
+        *ret_size = size;
+
+        return 0;
+}
+
+int manager_units_snapshot_memfd(Manager *m, uint64_t since, int *ret) {
+        _cleanup_close_ int fd = -1;
+        _cleanup_free_ void *p = NULL;
+        size_t size;
+        int r;
+
+        assert(m);
+        assert(ret);
+
+        /* Returns the snapshot in a sealed memfd, which the client may
+         * simply map */
+
+        r = manager_build_units_snapshot(m, since, &p, &size);
+        if (r < 0)
+                return r;
+
+        fd = memfd_new("units-snapshot");
+        if (fd < 0)
+                return fd;
+
+        r = loop_write(fd, p, size, false);
+        if (r < 0)
+                return r;
+
+        r = memfd_set_sealed(fd);
+        if (r < 0)
+                return r;
+
+        *ret = fd;
+        fd = -1;
+
+        return 0;
+}
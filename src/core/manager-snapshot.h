@@ -0,0 +1,31 @@
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "manager.h"
+
+void manager_record_unit_removal(Manager *m, Unit *u);
+void manager_free_unit_removals(Manager *m);
+
+bool manager_units_snapshot_complete(Manager *m, uint64_t since);
+
+int manager_build_units_snapshot(Manager *m, uint64_t since, void **ret, size_t *ret_size);
+int manager_units_snapshot_memfd(Manager *m, uint64_t since, int *ret);
@@ -62,6 +62,7 @@
 #include "locale-setup.h"
 #include "log.h"
 #include "macro.h"
+#include "manager-snapshot.h"
 #include "manager.h"
 #include "missing.h"
 #include "mkdir.h"
@@ -71,6 +72,7 @@
 #include "process-util.h"
 #include "ratelimit.h"
 #include "rm-rf.h"
+#include "serialize.h"
 #include "signal-util.h"
 #include "special.h"
 #include "stat-util.h"
@@ -79,6 +81,7 @@
 #include "strv.h"
 #include "terminal-util.h"
 #include "time-util.h"
+#include "trace.h"
 #include "transaction.h"
 #include "umask-util.h"
 #include "unit-name.h"
@@ -90,11 +93,30 @@
 #define NOTIFY_RCVBUF_SIZE (8*1024*1024)
 #define CGROUPS_AGENT_RCVBUF_SIZE (8*1024*1024)
 
+/* At most this many cgroups agent messages are read in one go */
+#define CGROUPS_AGENT_BATCH_MAX 1024U
+
+/* At most this many notification messages are read in one go */
+#define NOTIFY_BATCH_MAX 16U
+
+typedef struct NotifyBuffer {
+        char data[NOTIFY_BUFFER_MAX+1];
+        union {
+                struct cmsghdr cmsghdr;
+                uint8_t buf[CMSG_SPACE(sizeof(struct ucred)) +
+                            CMSG_SPACE(sizeof(int) * NOTIFY_FD_MAX)];
+        } control;
+} NotifyBuffer;
+
 /* Initial delay and the interval for printing status messages about running jobs */
 #define JOBS_IN_PROGRESS_WAIT_USEC (5*USEC_PER_SEC)
 #define JOBS_IN_PROGRESS_PERIOD_USEC (USEC_PER_SEC / 3)
 #define JOBS_IN_PROGRESS_PERIOD_DIVISOR 3
 
+/* How many generators to run at the same time, and how long each of them may take */
+#define GENERATORS_MAX_PARALLEL 16U
+#define GENERATOR_TIMEOUT_USEC (30*USEC_PER_SEC)
+
 static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
 static int manager_dispatch_cgroups_agent_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
 static int manager_dispatch_signal_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
@@ -572,6 +594,7 @@ int manager_new(UnitFileScope scope, bool test_run, Manager **_m) {
         m->default_timer_accuracy_usec = USEC_PER_MINUTE;
         m->default_tasks_accounting = true;
         m->default_tasks_max = UINT64_MAX;
+        m->serialization_format = SERIALIZATION_TEXT;
 
 #ifdef ENABLE_EFI
         if (MANAGER_IS_SYSTEM(m) && detect_container() <= 0)
@@ -732,6 +755,12 @@ static int manager_setup_notify(Manager *m) {
                 log_debug("Using notification socket %s", m->notify_socket);
         }
 
+        if (!m->notify_buffers) {
+                m->notify_buffers = new(NotifyBuffer, NOTIFY_BATCH_MAX);
+                if (!m->notify_buffers)
+                        return log_oom();
+        }
+
         if (!m->notify_event_source) {
                 r = sd_event_add_io(m->event, &m->notify_event_source, m->notify_fd, EPOLLIN, manager_dispatch_notify_fd, m);
                 if (r < 0)
@@ -928,8 +957,16 @@ static void unit_gc_mark_good(Unit *u, unsigned gc_marker) {
 
         u->gc_marker = gc_marker + GC_OFFSET_GOOD;
 
+        /* Only units marked UNSURE during this run need to learn that
+         * they are referenced after all. If there are none, there is no
+         * point in walking all units this one references, which for
+         * targets with many dependencies would turn collecting a
+         * single leaf unit into a walk over all its siblings. */
+        if (u->manager->gc_n_unsure == 0)
+                return;
+
         /* Recursively mark referenced units as GOOD as well */
-        SET_FOREACH(other, u->dependencies[UNIT_REFERENCES], i)
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_REFERENCES, i)
                 if (other->gc_marker == gc_marker + GC_OFFSET_UNSURE)
                         unit_gc_mark_good(other, gc_marker);
 }
@@ -947,6 +984,8 @@ static void unit_gc_sweep(Unit *u, unsigned gc_marker) {
             u->gc_marker == gc_marker + GC_OFFSET_IN_PATH)
                 return;
 
+        u->manager->n_gc_units_visited++;
+
         if (u->in_cleanup_queue)
                 goto bad;
 
@@ -957,7 +996,7 @@ static void unit_gc_sweep(Unit *u, unsigned gc_marker) {
 
         is_bad = true;
 
-        SET_FOREACH(other, u->dependencies[UNIT_REFERENCED_BY], i) {
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_REFERENCED_BY, i) {
                 unit_gc_sweep(other, gc_marker);
 
                 if (other->gc_marker == gc_marker + GC_OFFSET_GOOD)
@@ -973,6 +1012,7 @@ static void unit_gc_sweep(Unit *u, unsigned gc_marker) {
         /* We were unable to find anything out about this entry, so
          * let's investigate it later */
         u->gc_marker = gc_marker + GC_OFFSET_UNSURE;
+        u->manager->gc_n_unsure++;
         unit_add_to_gc_queue(u);
         return;
 
@@ -987,19 +1027,26 @@ good:
         unit_gc_mark_good(u, gc_marker);
 }
 
-static unsigned manager_dispatch_gc_unit_queue(Manager *m) {
+unsigned manager_dispatch_gc_unit_queue(Manager *m) {
         unsigned n = 0, gc_marker;
+        usec_t start, t;
         Unit *u;
 
         assert(m);
 
+        if (!m->gc_unit_queue)
+                return 0;
+
         /* log_debug("Running GC..."); */
 
+        start = now(CLOCK_MONOTONIC);
+
         m->gc_marker += _GC_OFFSET_MAX;
         if (m->gc_marker + _GC_OFFSET_MAX <= _GC_OFFSET_MAX)
                 m->gc_marker = 1;
 
         gc_marker = m->gc_marker;
+        m->gc_n_unsure = 0;
 
         while ((u = m->gc_unit_queue)) {
                 assert(u->in_gc_queue);
@@ -1017,9 +1064,16 @@ static unsigned manager_dispatch_gc_unit_queue(Manager *m) {
                                 log_unit_debug(u, "Collecting.");
                         u->gc_marker = gc_marker + GC_OFFSET_BAD;
                         unit_add_to_cleanup_queue(u);
+                        m->n_gc_units_collected++;
                 }
         }
 
+        t = now(CLOCK_MONOTONIC) - start;
+        m->n_gc_runs++;
+        m->gc_usec += t;
+        m->gc_last_usec = t;
+        m->gc_max_usec = MAX(m->gc_max_usec, t);
+
         return n;
 }
 
@@ -1048,10 +1102,17 @@ static unsigned manager_dispatch_gc_job_queue(Manager *m) {
 }
 
 static void manager_clear_jobs_and_units(Manager *m) {
+        Iterator i;
         Unit *u;
 
         assert(m);
 
+        /* Everything goes away, hence don't bother removing the
+         * dependency records about each unit from its neighbours one
+         * by one */
+        HASHMAP_FOREACH(u, m->units, i)
+                u->n_dependency_records = 0;
+
         while ((u = hashmap_first(m->units)))
                 unit_free(u);
 
@@ -1068,8 +1129,11 @@ static void manager_clear_jobs_and_units(Manager *m) {
         assert(hashmap_isempty(m->jobs));
         assert(hashmap_isempty(m->units));
 
+        assert(prioq_isempty(m->throttled_jobs));
+
         m->n_on_console = 0;
         m->n_running_jobs = 0;
+        m->n_running_start_jobs = 0;
 }
 
 Manager* manager_free(Manager *m) {
@@ -1099,6 +1163,8 @@ Manager* manager_free(Manager *m) {
         hashmap_free(m->units);
         hashmap_free(m->units_by_invocation_id);
         hashmap_free(m->jobs);
+        prioq_free(m->throttled_jobs);
+        trace_buffer_free(m->trace);
         hashmap_free(m->watch_pids1);
         hashmap_free(m->watch_pids2);
         hashmap_free(m->watch_bus);
@@ -1128,12 +1194,16 @@ Manager* manager_free(Manager *m) {
         sd_event_unref(m->event);
 
         free(m->notify_socket);
+        free(m->notify_buffers);
 
         lookup_paths_free(&m->lookup_paths);
         strv_free(m->environment);
 
         hashmap_free(m->cgroup_unit);
         set_free_free(m->unit_path_cache);
+        config_cache_free(m->unit_file_cache);
+        exec_timing_free_many(m->generator_timings, m->n_generator_timings);
+        manager_free_unit_removals(m);
 
         free(m->switch_root);
         free(m->switch_root_init);
@@ -1243,6 +1313,86 @@ fail:
         m->unit_path_cache = set_free_free(m->unit_path_cache);
 }
 
+static char *manager_unit_file_cache_path(Manager *m) {
+        const char *e;
+
+        assert(m);
+
+        e = manager_get_runtime_prefix(m);
+        if (!e)
+                return NULL;
+
+        return strappend(e, "/systemd/unit-cache");
+}
+
+static void manager_begin_units_load(Manager *m) {
+        _cleanup_free_ char *p = NULL;
+        int r;
+
+        assert(m);
+
+        if (!m->unit_file_cache) {
+                m->unit_file_cache = config_cache_new();
+                if (!m->unit_file_cache) {
+                        log_oom();
+                        return;
+                }
+
+                /* Pick up what a previous instance of us left behind */
+                if (!m->test_run) {
+                        p = manager_unit_file_cache_path(m);
+                        if (p) {
+                                r = config_cache_load(m->unit_file_cache, p);
+                                if (r < 0 && r != -ENOENT)
+                                        log_debug_errno(r, "Failed to load unit file cache %s, ignoring: %m", p);
+                        }
+                }
+        }
+
+        m->unit_file_cache->n_hits = m->unit_file_cache->n_misses = 0;
+}
+
+static void manager_end_units_load(Manager *m, usec_t start, bool vacuum) {
+        _cleanup_free_ char *p = NULL;
+        char ts[FORMAT_TIMESPAN_MAX];
+        int r;
+
+        assert(m);
+
+        m->units_load_usec = now(CLOCK_MONOTONIC) - start;
+
+        if (m->trace)
+                trace_buffer_add(m->trace, TRACE_UNITS_LOAD, NULL, start * NSEC_PER_USEC, now_nsec(CLOCK_MONOTONIC));
+
+        if (!m->unit_file_cache)
+                return;
+
+        m->unit_file_cache_hits = m->unit_file_cache->n_hits;
+        m->unit_file_cache_misses = m->unit_file_cache->n_misses;
+
+        log_debug("Loaded units in %s, %" PRIu64 " of %" PRIu64 " unit files from cache.",
+                  format_timespan(ts, sizeof(ts), m->units_load_usec, USEC_PER_MSEC),
+                  m->unit_file_cache_hits, m->unit_file_cache_hits + m->unit_file_cache_misses);
+
+        /* Unless all units were loaded, unused entries don't mean the
+         * files are gone */
+        if (vacuum)
+                config_cache_vacuum(m->unit_file_cache);
+
+        if (m->test_run || !m->unit_file_cache->dirty)
+                return;
+
+        p = manager_unit_file_cache_path(m);
+        if (!p)
+                return;
+
+        (void) mkdir_parents_label(p, 0755);
+
+        r = config_cache_save(m->unit_file_cache, p);
+        if (r < 0)
+                log_debug_errno(r, "Failed to save unit file cache %s, ignoring: %m", p);
+}
+
 static void manager_distribute_fds(Manager *m, FDSet *fds) {
         Iterator i;
         Unit *u;
@@ -1262,6 +1412,7 @@ static void manager_distribute_fds(Manager *m, FDSet *fds) {
 }
 
 int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
+        usec_t load_start;
         int r, q;
 
         assert(m);
@@ -1297,6 +1448,8 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
                 m->n_reloading++;
 
         /* First, enumerate what we can from all config files */
+        load_start = now(CLOCK_MONOTONIC);
+        manager_begin_units_load(m);
         dual_timestamp_get(&m->units_load_start_timestamp);
         manager_enumerate(m);
         dual_timestamp_get(&m->units_load_finish_timestamp);
@@ -1305,6 +1458,8 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
         if (serialization)
                 r = manager_deserialize(m, serialization, fds);
 
+        manager_end_units_load(m, load_start, true);
+
         /* Any fds left? Find some unit which wants them. This is
          * useful to allow container managers to pass some file
          * descriptors to us pre-initialized. This enables
@@ -1357,6 +1512,7 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
 int manager_add_job(Manager *m, JobType type, Unit *unit, JobMode mode, sd_bus_error *e, Job **_ret) {
         int r;
         Transaction *tr;
+        nsec_t trace;
 
         assert(m);
         assert(type < _JOB_TYPE_MAX);
@@ -1373,6 +1529,8 @@ int manager_add_job(Manager *m, JobType type, Unit *unit, JobMode mode, sd_bus_e
 
         type = job_type_collapse(type, unit);
 
+        trace = trace_begin(m->trace);
+
         tr = transaction_new(mode == JOB_REPLACE_IRREVERSIBLY);
         if (!tr)
                 return -ENOMEM;
@@ -1401,11 +1559,13 @@ int manager_add_job(Manager *m, JobType type, Unit *unit, JobMode mode, sd_bus_e
                 *_ret = tr->anchor_job;
 
         transaction_free(tr);
+        trace_end(m->trace, TRACE_TRANSACTION, unit->id, trace);
         return 0;
 
 tr_abort:
         transaction_abort(tr);
         transaction_free(tr);
+        trace_end(m->trace, TRACE_TRANSACTION, unit->id, trace);
         return r;
 }
 
@@ -1471,9 +1631,13 @@ unsigned manager_dispatch_load_queue(Manager *m) {
          * tries to load its data until the queue is empty */
 
         while ((u = m->load_queue)) {
+                nsec_t trace;
+
                 assert(u->in_load_queue);
 
+                trace = trace_begin(m->trace);
                 unit_load(u);
+                trace_end(m->trace, TRACE_UNIT_LOAD, u->id, trace);
                 n++;
         }
 
@@ -1672,29 +1836,43 @@ static unsigned manager_dispatch_dbus_queue(Manager *m) {
 
 static int manager_dispatch_cgroups_agent_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
         Manager *m = userdata;
-        char buf[PATH_MAX+1];
-        ssize_t n;
+        unsigned k;
 
-        n = recv(fd, buf, sizeof(buf), 0);
-        if (n < 0)
-                return log_error_errno(errno, "Failed to read cgroups agent message: %m");
-        if (n == 0) {
-                log_error("Got zero-length cgroups agent message, ignoring.");
-                return 0;
-        }
-        if ((size_t) n >= sizeof(buf)) {
-                log_error("Got overly long cgroups agent message, ignoring.");
-                return 0;
-        }
+        /* The messages are merely queued for processing, hence read
+         * a batch of them at once, which matters when lots of cgroups
+         * run empty at the same time. */
 
-        if (memchr(buf, 0, n)) {
-                log_error("Got cgroups agent message with embedded NUL byte, ignoring.");
-                return 0;
-        }
-        buf[n] = 0;
+        for (k = 0; k < CGROUPS_AGENT_BATCH_MAX; k++) {
+                char buf[PATH_MAX+1];
+                ssize_t n;
+
+                n = recv(fd, buf, sizeof(buf), 0);
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        if (errno == EAGAIN)
+                                return 0;
+
+                        return log_error_errno(errno, "Failed to read cgroups agent message: %m");
+                }
+                if (n == 0) {
+                        log_error("Got zero-length cgroups agent message, ignoring.");
+                        continue;
+                }
+                if ((size_t) n >= sizeof(buf)) {
+                        log_error("Got overly long cgroups agent message, ignoring.");
+                        continue;
+                }
 
-        manager_notify_cgroup_empty(m, buf);
-        bus_forward_agent_released(m, buf);
+                if (memchr(buf, 0, n)) {
+                        log_error("Got cgroups agent message with embedded NUL byte, ignoring.");
+                        continue;
+                }
+                buf[n] = 0;
+
+                manager_notify_cgroup_empty(m, buf);
+                bus_forward_agent_released(m, buf);
+        }
 
         return 0;
 }
@@ -1724,54 +1902,21 @@ static void manager_invoke_notify_message(Manager *m, Unit *u, pid_t pid, const
         }
 }
 
-static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
-
+static void manager_process_notify_message(Manager *m, struct msghdr *msghdr, size_t n) {
         _cleanup_fdset_free_ FDSet *fds = NULL;
-        Manager *m = userdata;
-        char buf[NOTIFY_BUFFER_MAX+1];
-        struct iovec iovec = {
-                .iov_base = buf,
-                .iov_len = sizeof(buf)-1,
-        };
-        union {
-                struct cmsghdr cmsghdr;
-                uint8_t buf[CMSG_SPACE(sizeof(struct ucred)) +
-                            CMSG_SPACE(sizeof(int) * NOTIFY_FD_MAX)];
-        } control = {};
-        struct msghdr msghdr = {
-                .msg_iov = &iovec,
-                .msg_iovlen = 1,
-                .msg_control = &control,
-                .msg_controllen = sizeof(control),
-        };
-
         struct cmsghdr *cmsg;
         struct ucred *ucred = NULL;
         Unit *u1, *u2, *u3;
         int r, *fd_array = NULL;
         unsigned n_fds = 0;
-        ssize_t n;
+        char *buf;
 
         assert(m);
-        assert(m->notify_fd == fd);
+        assert(msghdr);
 
-        if (revents != EPOLLIN) {
-                log_warning("Got unexpected poll event for notify fd.");
-                return 0;
-        }
-
-        n = recvmsg(m->notify_fd, &msghdr, MSG_DONTWAIT|MSG_CMSG_CLOEXEC|MSG_TRUNC);
-        if (n < 0) {
-                if (IN_SET(errno, EAGAIN, EINTR))
-                        return 0; /* Spurious wakeup, try again */
+        buf = msghdr->msg_iov[0].iov_base;
 
-                /* If this is any other, real error, then let's stop processing this socket. This of course means we
-                 * won't take notification messages anymore, but that's still better than busy looping around this:
-                 * being woken up over and over again but being unable to actually read the message off the socket. */
-                return log_error_errno(errno, "Failed to receive notification message: %m");
-        }
-
-        CMSG_FOREACH(cmsg, &msghdr) {
+        CMSG_FOREACH(cmsg, msghdr) {
                 if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
 
                         fd_array = (int*) CMSG_DATA(cmsg);
@@ -1792,25 +1937,25 @@ static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t
                 if (r < 0) {
                         close_many(fd_array, n_fds);
                         log_oom();
-                        return 0;
+                        return;
                 }
         }
 
         if (!ucred || ucred->pid <= 0) {
                 log_warning("Received notify message without valid credentials. Ignoring.");
-                return 0;
+                return;
         }
 
-        if ((size_t) n >= sizeof(buf) || (msghdr.msg_flags & MSG_TRUNC)) {
+        if (n > NOTIFY_BUFFER_MAX || (msghdr->msg_flags & MSG_TRUNC)) {
                 log_warning("Received notify message exceeded maximum size. Ignoring.");
-                return 0;
+                return;
         }
 
         /* As extra safety check, let's make sure the string we get doesn't contain embedded NUL bytes. We permit one
          * trailing NUL byte in the message, but don't expect it. */
         if (n > 1 && memchr(buf, 0, n-1)) {
                 log_warning("Received notify message with embedded NUL bytes. Ignoring.");
-                return 0;
+                return;
         }
 
         /* Make sure it's NUL-terminated. */
@@ -1818,7 +1963,7 @@ static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t
 
         /* Notify every unit that might be interested, but try
          * to avoid notifying the same one multiple times. */
-        u1 = manager_get_unit_by_pid_cgroup(m, ucred->pid);
+        u1 = manager_get_unit_by_pid_cgroup_cached(m, ucred->pid);
         if (u1)
                 manager_invoke_notify_message(m, u1, ucred->pid, buf, fds);
 
@@ -1835,6 +1980,58 @@ static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t
 
         if (fdset_size(fds) > 0)
                 log_warning("Got extra auxiliary fds with notification message, closing them.");
+}
+
+static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        struct mmsghdr msgs[NOTIFY_BATCH_MAX];
+        struct iovec iovecs[NOTIFY_BATCH_MAX];
+        Manager *m = userdata;
+        unsigned i;
+        int n;
+
+        assert(m);
+        assert(m->notify_fd == fd);
+
+        if (revents != EPOLLIN) {
+                log_warning("Got unexpected poll event for notify fd.");
+                return 0;
+        }
+
+        /* Services with a watchdog or frequent status updates might
+         * send us lots of messages, hence pick up a batch of them at
+         * once. Changes they cause to units are announced on the bus
+         * only once per batch. */
+
+        for (i = 0; i < NOTIFY_BATCH_MAX; i++) {
+                iovecs[i] = (struct iovec) {
+                        .iov_base = m->notify_buffers[i].data,
+                        .iov_len = sizeof(m->notify_buffers[i].data)-1,
+                };
+
+                msgs[i] = (struct mmsghdr) {
+                        .msg_hdr.msg_iov = iovecs + i,
+                        .msg_hdr.msg_iovlen = 1,
+                        .msg_hdr.msg_control = &m->notify_buffers[i].control,
+                        .msg_hdr.msg_controllen = sizeof(m->notify_buffers[i].control),
+                };
+        }
+
+        n = recvmmsg(m->notify_fd, msgs, NOTIFY_BATCH_MAX, MSG_DONTWAIT|MSG_CMSG_CLOEXEC|MSG_TRUNC, NULL);
+        if (n < 0) {
+                if (IN_SET(errno, EAGAIN, EINTR))
+                        return 0; /* Spurious wakeup, try again */
+
+                /* If this is any other, real error, then let's stop processing this socket. This of course means we
+                 * won't take notification messages anymore, but that's still better than busy looping around this:
+                 * being woken up over and over again but being unable to actually read the message off the socket. */
+                return log_error_errno(errno, "Failed to receive notification message: %m");
+        }
+
+        m->n_notify_messages += n;
+        m->n_notify_dispatches++;
+
+        for (i = 0; i < (unsigned) n; i++)
+                manager_process_notify_message(m, &msgs[i].msg_hdr, msgs[i].msg_len);
 
         return 0;
 }
@@ -1921,6 +2118,9 @@ static int manager_dispatch_sigchld(Manager *m) {
 
                         return -errno;
                 }
+
+                /* The PID may be reused from now on */
+                manager_forget_pid_cgroup(m, si.si_pid);
         }
 
         return 0;
@@ -2472,40 +2672,50 @@ int manager_open_serialization(Manager *m, FILE **_f) {
 }
 
 int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root) {
+        SerializationFormat format;
         Iterator i;
         Unit *u;
         const char *t;
+        char **e;
         int r;
 
         assert(m);
         assert(f);
         assert(fds);
 
+        format = m->serialization_format;
+
+        r = serialize_header(f, format);
+        if (r < 0)
+                return r;
+
         m->n_reloading++;
 
-        fprintf(f, "current-job-id=%"PRIu32"\n", m->current_job_id);
-        fprintf(f, "taint-usr=%s\n", yes_no(m->taint_usr));
-        fprintf(f, "n-installed-jobs=%u\n", m->n_installed_jobs);
-        fprintf(f, "n-failed-jobs=%u\n", m->n_failed_jobs);
+        serialize_item_format(f, format, "current-job-id", "%" PRIu32, m->current_job_id);
+        serialize_item(f, format, "taint-usr", yes_no(m->taint_usr));
+        serialize_item_format(f, format, "n-installed-jobs", "%u", m->n_installed_jobs);
+        serialize_item_format(f, format, "n-failed-jobs", "%u", m->n_failed_jobs);
+        serialize_item_format(f, format, "units-generation", "%" PRIu64, m->units_generation);
 
-        dual_timestamp_serialize(f, "firmware-timestamp", &m->firmware_timestamp);
-        dual_timestamp_serialize(f, "loader-timestamp", &m->loader_timestamp);
-        dual_timestamp_serialize(f, "kernel-timestamp", &m->kernel_timestamp);
-        dual_timestamp_serialize(f, "initrd-timestamp", &m->initrd_timestamp);
+        serialize_dual_timestamp(f, format, "firmware-timestamp", &m->firmware_timestamp);
+        serialize_dual_timestamp(f, format, "loader-timestamp", &m->loader_timestamp);
+        serialize_dual_timestamp(f, format, "kernel-timestamp", &m->kernel_timestamp);
+        serialize_dual_timestamp(f, format, "initrd-timestamp", &m->initrd_timestamp);
 
         if (!in_initrd()) {
-                dual_timestamp_serialize(f, "userspace-timestamp", &m->userspace_timestamp);
-                dual_timestamp_serialize(f, "finish-timestamp", &m->finish_timestamp);
-                dual_timestamp_serialize(f, "security-start-timestamp", &m->security_start_timestamp);
-                dual_timestamp_serialize(f, "security-finish-timestamp", &m->security_finish_timestamp);
-                dual_timestamp_serialize(f, "generators-start-timestamp", &m->generators_start_timestamp);
-                dual_timestamp_serialize(f, "generators-finish-timestamp", &m->generators_finish_timestamp);
-                dual_timestamp_serialize(f, "units-load-start-timestamp", &m->units_load_start_timestamp);
-                dual_timestamp_serialize(f, "units-load-finish-timestamp", &m->units_load_finish_timestamp);
+                serialize_dual_timestamp(f, format, "userspace-timestamp", &m->userspace_timestamp);
+                serialize_dual_timestamp(f, format, "finish-timestamp", &m->finish_timestamp);
+                serialize_dual_timestamp(f, format, "security-start-timestamp", &m->security_start_timestamp);
+                serialize_dual_timestamp(f, format, "security-finish-timestamp", &m->security_finish_timestamp);
+                serialize_dual_timestamp(f, format, "generators-start-timestamp", &m->generators_start_timestamp);
+                serialize_dual_timestamp(f, format, "generators-finish-timestamp", &m->generators_finish_timestamp);
+                serialize_dual_timestamp(f, format, "units-load-start-timestamp", &m->units_load_start_timestamp);
+                serialize_dual_timestamp(f, format, "units-load-finish-timestamp", &m->units_load_finish_timestamp);
         }
 
         if (!switching_root)
-                (void) serialize_environment(f, m->environment);
+                STRV_FOREACH(e, m->environment)
+                        (void) serialize_item_escaped(f, format, "env", *e);
 
         if (m->notify_fd >= 0) {
                 int copy;
@@ -2514,8 +2724,8 @@ int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root) {
                 if (copy < 0)
                         return copy;
 
-                fprintf(f, "notify-fd=%i\n", copy);
-                fprintf(f, "notify-socket=%s\n", m->notify_socket);
+                serialize_item_format(f, format, "notify-fd", "%i", copy);
+                serialize_item(f, format, "notify-socket", m->notify_socket);
         }
 
         if (m->cgroups_agent_fd >= 0) {
@@ -2525,7 +2735,7 @@ int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root) {
                 if (copy < 0)
                         return copy;
 
-                fprintf(f, "cgroups-agent-fd=%i\n", copy);
+                serialize_item_format(f, format, "cgroups-agent-fd", "%i", copy);
         }
 
         if (m->user_lookup_fds[0] >= 0) {
@@ -2539,10 +2749,10 @@ int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root) {
                 if (copy1 < 0)
                         return copy1;
 
-                fprintf(f, "user-lookup=%i %i\n", copy0, copy1);
+                serialize_item_format(f, format, "user-lookup", "%i %i", copy0, copy1);
         }
 
-        bus_track_serialize(m->subscribed, f, "subscribed");
+        bus_track_serialize(m->subscribed, f, format, "subscribed");
 
         r = dynamic_user_serialize(m, f, fds);
         if (r < 0)
@@ -2551,15 +2761,14 @@ int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root) {
         manager_serialize_uid_refs(m, f);
         manager_serialize_gid_refs(m, f);
 
-        fputc('\n', f);
+        serialize_end_marker(f, format);
 
         HASHMAP_FOREACH_KEY(u, t, m->units, i) {
                 if (u->id != t)
                         continue;
 
                 /* Start marker */
-                fputs(u->id, f);
-                fputc('\n', f);
+                serialize_start_marker(f, format, u->id);
 
                 r = unit_serialize(u, f, fds, !switching_root);
                 if (r < 0) {
@@ -2582,6 +2791,8 @@ int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root) {
 }
 
 int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
+        _cleanup_free_ char *buffer = NULL;
+        size_t allocated = 0;
         int r = 0;
 
         assert(m);
@@ -2589,28 +2800,28 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
 
         log_debug("Deserializing state...");
 
+        r = deserialize_header(f, &m->deserialization_format);
+        if (r < 0)
+                return log_error_errno(r, "Failed to read serialization header: %m");
+
+        log_debug("Serialization is in %s format.", serialization_format_to_string(m->deserialization_format));
+
         m->n_reloading++;
 
         for (;;) {
-                char line[LINE_MAX];
-                const char *val, *l;
-
-                if (!fgets(line, sizeof(line), f)) {
-                        if (feof(f))
-                                r = 0;
-                        else
-                                r = -errno;
+                char *l, *val;
 
+                r = deserialize_item(f, m->deserialization_format, &buffer, &allocated, &l, &val);
+                if (r == -ENODATA) {
+                        r = 0;
                         goto finish;
                 }
-
-                char_array_0(line);
-                l = strstrip(line);
-
-                if (l[0] == 0)
+                if (r < 0)
+                        goto finish;
+                if (r == 0)
                         break;
 
-                if ((val = startswith(l, "current-job-id="))) {
+                if (streq(l, "current-job-id")) {
                         uint32_t id;
 
                         if (safe_atou32(val, &id) < 0)
@@ -2618,7 +2829,7 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                         else
                                 m->current_job_id = MAX(m->current_job_id, id);
 
-                } else if ((val = startswith(l, "n-installed-jobs="))) {
+                } else if (streq(l, "n-installed-jobs")) {
                         uint32_t n;
 
                         if (safe_atou32(val, &n) < 0)
@@ -2626,7 +2837,7 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                         else
                                 m->n_installed_jobs += n;
 
-                } else if ((val = startswith(l, "n-failed-jobs="))) {
+                } else if (streq(l, "n-failed-jobs")) {
                         uint32_t n;
 
                         if (safe_atou32(val, &n) < 0)
@@ -2634,7 +2845,20 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                         else
                                 m->n_failed_jobs += n;
 
-                } else if ((val = startswith(l, "taint-usr="))) {
+                } else if (streq(l, "units-generation")) {
+                        uint64_t g;
+
+                        /* Keep handing out increasing generations, but
+                         * as removed units are not serialized, clients
+                         * that looked before get everything again */
+                        if (safe_atou64(val, &g) < 0)
+                                log_notice("Failed to parse units generation %s", val);
+                        else {
+                                m->units_generation = MAX(m->units_generation, g);
+                                m->unit_removals_floor = MAX(m->unit_removals_floor, g + 1);
+                        }
+
+                } else if (streq(l, "taint-usr")) {
                         int b;
 
                         b = parse_boolean(val);
@@ -2643,38 +2867,45 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                         else
                                 m->taint_usr = m->taint_usr || b;
 
-                } else if ((val = startswith(l, "firmware-timestamp=")))
+                } else if (streq(l, "firmware-timestamp"))
                         dual_timestamp_deserialize(val, &m->firmware_timestamp);
-                else if ((val = startswith(l, "loader-timestamp=")))
+                else if (streq(l, "loader-timestamp"))
                         dual_timestamp_deserialize(val, &m->loader_timestamp);
-                else if ((val = startswith(l, "kernel-timestamp=")))
+                else if (streq(l, "kernel-timestamp"))
                         dual_timestamp_deserialize(val, &m->kernel_timestamp);
-                else if ((val = startswith(l, "initrd-timestamp=")))
+                else if (streq(l, "initrd-timestamp"))
                         dual_timestamp_deserialize(val, &m->initrd_timestamp);
-                else if ((val = startswith(l, "userspace-timestamp=")))
+                else if (streq(l, "userspace-timestamp"))
                         dual_timestamp_deserialize(val, &m->userspace_timestamp);
-                else if ((val = startswith(l, "finish-timestamp=")))
+                else if (streq(l, "finish-timestamp"))
                         dual_timestamp_deserialize(val, &m->finish_timestamp);
-                else if ((val = startswith(l, "security-start-timestamp=")))
+                else if (streq(l, "security-start-timestamp"))
                         dual_timestamp_deserialize(val, &m->security_start_timestamp);
-                else if ((val = startswith(l, "security-finish-timestamp=")))
+                else if (streq(l, "security-finish-timestamp"))
                         dual_timestamp_deserialize(val, &m->security_finish_timestamp);
-                else if ((val = startswith(l, "generators-start-timestamp=")))
+                else if (streq(l, "generators-start-timestamp"))
                         dual_timestamp_deserialize(val, &m->generators_start_timestamp);
-                else if ((val = startswith(l, "generators-finish-timestamp=")))
+                else if (streq(l, "generators-finish-timestamp"))
                         dual_timestamp_deserialize(val, &m->generators_finish_timestamp);
-                else if ((val = startswith(l, "units-load-start-timestamp=")))
+                else if (streq(l, "units-load-start-timestamp"))
                         dual_timestamp_deserialize(val, &m->units_load_start_timestamp);
-                else if ((val = startswith(l, "units-load-finish-timestamp=")))
+                else if (streq(l, "units-load-finish-timestamp"))
                         dual_timestamp_deserialize(val, &m->units_load_finish_timestamp);
-                else if (startswith(l, "env=")) {
-                        r = deserialize_environment(&m->environment, l);
+                else if (streq(l, "env")) {
+                        char *uce;
+
+                        r = cunescape(val, 0, &uce);
+                        if (r >= 0) {
+                                r = strv_env_replace(&m->environment, uce);
+                                if (r < 0)
+                                        free(uce);
+                        }
                         if (r == -ENOMEM)
                                 goto finish;
                         if (r < 0)
-                                log_notice_errno(r, "Failed to parse environment entry: \"%s\": %m", l);
+                                log_notice_errno(r, "Failed to parse environment entry: \"%s\": %m", val);
 
-                } else if ((val = startswith(l, "notify-fd="))) {
+                } else if (streq(l, "notify-fd")) {
                         int fd;
 
                         if (safe_atoi(val, &fd) < 0 || fd < 0 || !fdset_contains(fds, fd))
@@ -2685,7 +2916,7 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                                 m->notify_fd = fdset_remove(fds, fd);
                         }
 
-                } else if ((val = startswith(l, "notify-socket="))) {
+                } else if (streq(l, "notify-socket")) {
                         char *n;
 
                         n = strdup(val);
@@ -2697,7 +2928,7 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                         free(m->notify_socket);
                         m->notify_socket = n;
 
-                } else if ((val = startswith(l, "cgroups-agent-fd="))) {
+                } else if (streq(l, "cgroups-agent-fd")) {
                         int fd;
 
                         if (safe_atoi(val, &fd) < 0 || fd < 0 || !fdset_contains(fds, fd))
@@ -2708,7 +2939,7 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                                 m->cgroups_agent_fd = fdset_remove(fds, fd);
                         }
 
-                } else if ((val = startswith(l, "user-lookup="))) {
+                } else if (streq(l, "user-lookup")) {
                         int fd0, fd1;
 
                         if (sscanf(val, "%i %i", &fd0, &fd1) != 2 || fd0 < 0 || fd1 < 0 || fd0 == fd1 || !fdset_contains(fds, fd0) || !fdset_contains(fds, fd1))
@@ -2720,38 +2951,37 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                                 m->user_lookup_fds[1] = fdset_remove(fds, fd1);
                         }
 
-                } else if ((val = startswith(l, "dynamic-user=")))
+                } else if (streq(l, "dynamic-user"))
                         dynamic_user_deserialize_one(m, val, fds);
-                else if ((val = startswith(l, "destroy-ipc-uid=")))
+                else if (streq(l, "destroy-ipc-uid"))
                         manager_deserialize_uid_refs_one(m, val);
-                else if ((val = startswith(l, "destroy-ipc-gid=")))
+                else if (streq(l, "destroy-ipc-gid"))
                         manager_deserialize_gid_refs_one(m, val);
-                else if ((val = startswith(l, "subscribed="))) {
+                else if (streq(l, "subscribed")) {
 
                         if (strv_extend(&m->deserialized_subscribed, val) < 0)
                                 log_oom();
 
-                } else if (!startswith(l, "kdbus-fd=")) /* ignore this one */
+                } else if (!streq(l, "kdbus-fd")) /* ignore this one */
                         log_notice("Unknown serialization item '%s'", l);
         }
 
         for (;;) {
+                char *name, *val;
                 Unit *u;
-                char name[UNIT_NAME_MAX+2];
 
                 /* Start marker */
-                if (!fgets(name, sizeof(name), f)) {
-                        if (feof(f))
-                                r = 0;
-                        else
-                                r = -errno;
-
+                r = deserialize_item(f, m->deserialization_format, &buffer, &allocated, &name, &val);
+                if (r == -ENODATA) {
+                        r = 0;
                         goto finish;
                 }
+                if (r < 0)
+                        goto finish;
+                if (r == 0)
+                        continue;
 
-                char_array_0(name);
-
-                r = manager_load_unit(m, strstrip(name), NULL, NULL, &u);
+                r = manager_load_unit(m, name, NULL, NULL, &u);
                 if (r < 0)
                         goto finish;
 
@@ -2770,13 +3000,45 @@ finish:
         return r;
 }
 
-int manager_reload(Manager *m) {
+static int manager_regenerate_unit_paths(Manager *m) {
+        int r = 0, q;
+
+        assert(m);
+
+        lookup_paths_flush_generator(&m->lookup_paths);
+        lookup_paths_free(&m->lookup_paths);
+
+        q = lookup_paths_init(&m->lookup_paths, m->unit_file_scope, 0, NULL);
+        if (q < 0 && r >= 0)
+                r = q;
+
+        q = manager_run_environment_generators(m);
+        if (q < 0 && r >= 0)
+                r = q;
+
+        /* Find new unit paths */
+        q = manager_run_generators(m);
+        if (q < 0 && r >= 0)
+                r = q;
+
+        lookup_paths_reduce(&m->lookup_paths);
+        manager_build_unit_path_cache(m);
+
+        return r;
+}
+
+static int manager_reload_internal(Manager *m, bool regenerate) {
+        usec_t load_start;
         int r, q;
         _cleanup_fclose_ FILE *f = NULL;
         _cleanup_fdset_free_ FDSet *fds = NULL;
 
         assert(m);
 
+        /* Let queued cgroup empty notifications take effect, they
+         * would get lost otherwise */
+        manager_flush_cgroup_empty_queue(m);
+
         r = manager_open_serialization(m, &f);
         if (r < 0)
                 return r;
@@ -2803,29 +3065,19 @@ int manager_reload(Manager *m) {
 
         /* From here on there is no way back. */
         manager_clear_jobs_and_units(m);
-        lookup_paths_flush_generator(&m->lookup_paths);
-        lookup_paths_free(&m->lookup_paths);
         dynamic_user_vacuum(m, false);
         m->uid_refs = hashmap_free(m->uid_refs);
         m->gid_refs = hashmap_free(m->gid_refs);
 
-        q = lookup_paths_init(&m->lookup_paths, m->unit_file_scope, 0, NULL);
-        if (q < 0 && r >= 0)
-                r = q;
-
-        q = manager_run_environment_generators(m);
-        if (q < 0 && r >= 0)
-                r = q;
-
-        /* Find new unit paths */
-        q = manager_run_generators(m);
-        if (q < 0 && r >= 0)
-                r = q;
-
-        lookup_paths_reduce(&m->lookup_paths);
-        manager_build_unit_path_cache(m);
+        if (regenerate) {
+                q = manager_regenerate_unit_paths(m);
+                if (q < 0 && r >= 0)
+                        r = q;
+        }
 
         /* First, enumerate what we can from all config files */
+        load_start = now(CLOCK_MONOTONIC);
+        manager_begin_units_load(m);
         manager_enumerate(m);
 
         /* Second, deserialize our stored data */
@@ -2833,6 +3085,8 @@ int manager_reload(Manager *m) {
         if (q < 0 && r >= 0)
                 r = q;
 
+        manager_end_units_load(m, load_start, true);
+
         fclose(f);
         f = NULL;
 
@@ -2871,6 +3125,346 @@ int manager_reload(Manager *m) {
         return r;
 }
 
+int manager_reload(Manager *m) {
+        return manager_reload_internal(m, true);
+}
+
+static bool unit_may_reload_alone(Unit *u) {
+        /* Units of these types get their state from their
+         * configuration only, everything else is left to a full
+         * reload */
+        return IN_SET(u->type, UNIT_SERVICE, UNIT_SOCKET, UNIT_BUSNAME, UNIT_TARGET, UNIT_TIMER, UNIT_PATH) &&
+                !u->transient &&
+                !u->perpetual;
+}
+
+static int manager_add_dependents(Set *s, Unit *u) {
+        Unit *other;
+        Iterator i;
+        void *v;
+        int r;
+
+        assert(s);
+        assert(u);
+
+        /* Adds the units that added dependencies on u while being
+         * loaded, so that these are refreshed when u is loaded again */
+
+        HASHMAP_FOREACH_KEY(v, other, u->dependencies, i)
+                if (unit_may_reload_alone(other) &&
+                    !IN_SET(other->load_state, UNIT_STUB, UNIT_MERGED) &&
+                    unit_owns_dependency_on(other, u)) {
+                        r = set_put(s, other);
+                        if (r < 0)
+                                return r;
+                }
+
+        return 0;
+}
+
+static int manager_find_changed_units(Manager *m, Set **ret) {
+        _cleanup_set_free_ Set *changed = NULL, *dependents = NULL;
+        const char *k;
+        Iterator i;
+        Unit *u;
+        int r;
+
+        assert(m);
+        assert(ret);
+
+        /* Returns 0 if some unit changed that can't be reloaded on its
+         * own, > 0 and the units to reload otherwise */
+
+        changed = set_new(NULL);
+        dependents = set_new(NULL);
+        if (!changed || !dependents)
+                return -ENOMEM;
+
+        HASHMAP_FOREACH_KEY(u, k, m->units, i) {
+                usec_t fragment_mtime, dropin_mtime;
+
+                /* Skip aliases */
+                if (u->id != k)
+                        continue;
+
+                if (u->transient || u->perpetual || IN_SET(u->load_state, UNIT_STUB, UNIT_MERGED))
+                        continue;
+
+                r = unit_configuration_changed(u, &fragment_mtime, &dropin_mtime);
+                if (r < 0)
+                        log_unit_debug_errno(u, r, "Failed to check unit configuration, reloading it: %m");
+                else if (r == 0) {
+                        /* Files rewritten with the same contents are
+                         * not reported as changed on disk anymore */
+                        u->fragment_mtime = fragment_mtime;
+                        u->dropin_mtime = dropin_mtime;
+                        continue;
+                }
+
+                if (!unit_may_reload_alone(u)) {
+                        log_unit_debug(u, "Configuration changed, unit cannot be reloaded on its own.");
+                        return 0;
+                }
+
+                r = set_put(changed, u);
+                if (r < 0)
+                        return r;
+        }
+
+        SET_FOREACH(u, changed, i) {
+                r = manager_add_dependents(dependents, u);
+                if (r < 0)
+                        return r;
+        }
+
+        r = set_merge(changed, dependents);
+        if (r < 0)
+                return r;
+
+        *ret = changed;
+        changed = NULL;
+
+        return 1;
+}
+
+static bool dependencies_equal(Hashmap *a, Hashmap *b) {
+        Iterator i;
+        Unit *other;
+        void *v;
+
+        if (hashmap_size(a) != hashmap_size(b))
+                return false;
+
+        HASHMAP_FOREACH_KEY(v, other, a, i)
+                if (hashmap_get(b, other) != v)
+                        return false;
+
+        return true;
+}
+
+static int manager_reload_unit(Manager *m, Unit *u, Unit **ret) {
+        _cleanup_free_ UnitSavedDependency *deps = NULL;
+        _cleanup_fdset_free_ FDSet *fds = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ UnitRef **refs = NULL;
+        _cleanup_free_ char *id = NULL;
+        size_t n_deps = 0, n_refs = 0, k;
+        bool sent_dbus_new_signal;
+        UnitRef *ref;
+        int r, q;
+
+        assert(m);
+        assert(u);
+        assert(ret);
+
+        /* Replaces the unit by a freshly loaded one, carrying over its
+         * runtime state, the dependencies and references other units
+         * have on it */
+
+        *ret = NULL;
+
+        id = strdup(u->id);
+        if (!id)
+                return -ENOMEM;
+
+        r = manager_open_serialization(m, &f);
+        if (r < 0)
+                return r;
+
+        fds = fdset_new();
+        if (!fds)
+                return -ENOMEM;
+
+        r = unit_serialize(u, f, fds, true);
+        if (r < 0)
+                return r;
+
+        m->deserialization_format = m->serialization_format;
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                return r;
+
+        if (fseeko(f, 0, SEEK_SET) < 0)
+                return -errno;
+
+        r = unit_save_dependencies(u, &deps, &n_deps);
+        if (r < 0)
+                return r;
+
+        LIST_FOREACH(refs, ref, u->refs)
+                n_refs++;
+
+        refs = new(UnitRef*, MAX(n_refs, 1U));
+        if (!refs)
+                return -ENOMEM;
+
+        n_refs = 0;
+        LIST_FOREACH(refs, ref, u->refs)
+                refs[n_refs++] = ref;
+
+        sent_dbus_new_signal = u->sent_dbus_new_signal;
+
+        /* From here on there is no way back. */
+        u->replaced = true;
+        unit_free(u);
+
+        r = manager_load_unit(m, id, NULL, NULL, ret);
+        if (r < 0) {
+                *ret = NULL;
+                return r;
+        }
+
+        /* Clients see the unit change, rather than go away and come
+         * back */
+        (*ret)->sent_dbus_new_signal = sent_dbus_new_signal;
+        unit_add_to_dbus_queue(*ret);
+
+        r = unit_deserialize(*ret, f, fds);
+
+        q = unit_restore_dependencies(*ret, deps, n_deps);
+        if (q < 0 && r >= 0)
+                r = q;
+
+        for (k = 0; k < n_refs; k++)
+                unit_ref_set(refs[k], *ret);
+
+        return r;
+}
+
+int manager_reload_incremental(Manager *m) {
+        _cleanup_strv_free_ char **search_path = NULL;
+        _cleanup_set_free_ Set *changed = NULL, *reloaded = NULL;
+        char ts[FORMAT_TIMESPAN_MAX];
+        usec_t load_start;
+        Iterator i;
+        Unit *u;
+        int r, q;
+
+        assert(m);
+
+        /* Runs the generators, and then only loads those units again
+         * whose configuration changed, leaving all others alone. If
+         * that is not possible, falls back to a full reload. */
+
+        search_path = strv_copy(m->lookup_paths.search_path);
+        if (!search_path)
+                return -ENOMEM;
+
+        r = manager_regenerate_unit_paths(m);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to regenerate unit paths, doing full reload: %m");
+                return manager_reload_internal(m, false);
+        }
+
+        if (!strv_equal(search_path, m->lookup_paths.search_path)) {
+                log_debug("Unit search path changed, doing full reload.");
+                return manager_reload_internal(m, false);
+        }
+
+        r = manager_find_changed_units(m, &changed);
+        if (r < 0)
+                log_debug_errno(r, "Failed to determine changed units, doing full reload: %m");
+        if (r <= 0)
+                return manager_reload_internal(m, false);
+
+        reloaded = set_new(NULL);
+        if (!reloaded)
+                return -ENOMEM;
+
+        m->n_reloading++;
+        bus_manager_send_reloading(m, true);
+
+        load_start = now(CLOCK_MONOTONIC);
+        manager_begin_units_load(m);
+
+        while ((u = set_steal_first(changed))) {
+                _cleanup_hashmap_free_ Hashmap *deps = NULL;
+                Unit *n;
+
+                /* A unit loaded again might have turned out to be an
+                 * alias of one we still had to look at */
+                if (u->load_state == UNIT_MERGED || set_contains(reloaded, u))
+                        continue;
+
+                log_unit_debug(u, "Reloading unit configuration.");
+
+                if (u->dependencies) {
+                        deps = hashmap_copy(u->dependencies);
+                        if (!deps) {
+                                r = -ENOMEM;
+                                break;
+                        }
+                }
+
+                q = manager_reload_unit(m, u, &n);
+                if (q < 0) {
+                        log_debug_errno(q, "Failed to reload unit: %m");
+                        if (r >= 0)
+                                r = q;
+                        if (!n)
+                                continue;
+                }
+
+                q = set_put(reloaded, n);
+                if (q < 0 && r >= 0)
+                        r = q;
+
+                /* The dependencies units added while being loaded
+                 * might be derived from those of this one, hence if
+                 * these changed, refresh them too, even if they were
+                 * already loaded again before. */
+                if (!dependencies_equal(deps, n->dependencies)) {
+                        _cleanup_set_free_ Set *dependents = NULL;
+                        Unit *other;
+
+                        dependents = set_new(NULL);
+                        if (!dependents) {
+                                r = -ENOMEM;
+                                break;
+                        }
+
+                        q = manager_add_dependents(dependents, n);
+                        if (q < 0) {
+                                r = q;
+                                break;
+                        }
+
+                        while ((other = set_steal_first(dependents))) {
+                                (void) set_remove(reloaded, other);
+
+                                q = set_put(changed, other);
+                                if (q < 0 && r >= 0)
+                                        r = q;
+                        }
+                }
+        }
+
+        manager_end_units_load(m, load_start, false);
+
+        /* Third, fire things up! */
+        SET_FOREACH(u, reloaded, i)
+                (void) unit_coldplug(u);
+
+        dynamic_user_vacuum(m, true);
+        manager_vacuum_uid_refs(m);
+        manager_vacuum_gid_refs(m);
+
+        if (m->api_bus)
+                manager_sync_bus_names(m, m->api_bus);
+
+        log_debug("Reloaded %u of %u units in %s.",
+                  set_size(reloaded), hashmap_size(m->units),
+                  format_timespan(ts, sizeof(ts), m->units_load_usec, USEC_PER_MSEC));
+
+        assert(m->n_reloading > 0);
+        m->n_reloading--;
+
+        m->send_reloading_done = true;
+
+        return r < 0 ? r : 0;
+}
+
 void manager_reset_failed(Manager *m) {
         Unit *u;
         Iterator i;
@@ -3055,9 +3649,53 @@ static int manager_run_environment_generators(Manager *m) {
         return execute_directories(paths, DEFAULT_TIMEOUT_USEC, gather_environment, args, NULL);
 }
 
+int manager_set_trace_buffer_size(Manager *m, size_t size) {
+        TraceBuffer *t;
+
+        assert(m);
+
+        if (size == 0) {
+                m->trace = trace_buffer_free(m->trace);
+                return 0;
+        }
+
+        /* Keep what was recorded so far if nothing changed */
+        if (m->trace && m->trace->size == size)
+                return 0;
+
+        t = trace_buffer_new(size);
+        if (!t)
+                return -ENOMEM;
+
+        trace_buffer_free(m->trace);
+        m->trace = t;
+
+        return 0;
+}
+
+static void manager_trace_generators(Manager *m, nsec_t begin) {
+        size_t i;
+
+        assert(m);
+
+        if (!m->trace)
+                return;
+
+        for (i = 0; i < m->n_generator_timings; i++) {
+                ExecTiming *t = m->generator_timings + i;
+
+                trace_buffer_add(m->trace, TRACE_GENERATOR, t->name,
+                                 t->start * NSEC_PER_USEC,
+                                 (t->start + t->realtime) * NSEC_PER_USEC);
+        }
+
+        trace_end(m->trace, TRACE_GENERATORS, NULL, begin);
+}
+
 static int manager_run_generators(Manager *m) {
         _cleanup_strv_free_ char **paths = NULL;
         const char *argv[5];
+        nsec_t trace;
         int r;
 
         assert(m);
@@ -3065,6 +3703,8 @@ static int manager_run_generators(Manager *m) {
         if (m->test_run)
                 return 0;
 
+        trace = trace_begin(m->trace);
+
         paths = generator_binary_paths(m->unit_file_scope);
         if (!paths)
                 return log_oom();
@@ -3082,9 +3722,17 @@ static int manager_run_generators(Manager *m) {
         argv[3] = m->lookup_paths.generator_late;
         argv[4] = NULL;
 
+        exec_timing_free_many(m->generator_timings, m->n_generator_timings);
+        m->generator_timings = NULL;
+        m->n_generator_timings = 0;
+
         RUN_WITH_UMASK(0022)
-                execute_directories((const char* const*) paths, DEFAULT_TIMEOUT_USEC,
-                                    NULL, NULL, (char**) argv);
+                (void) execute_directories_full((const char* const*) paths, DEFAULT_TIMEOUT_USEC,
+                                                GENERATOR_TIMEOUT_USEC, GENERATORS_MAX_PARALLEL,
+                                                NULL, NULL, (char**) argv,
+                                                &m->generator_timings, &m->n_generator_timings);
+
+        manager_trace_generators(m, trace);
 
 finish:
         lookup_paths_trim_generator(&m->lookup_paths);
@@ -3559,7 +4207,7 @@ static void manager_serialize_uid_refs_internal(
                 if (!(c & DESTROY_IPC_FLAG))
                         continue;
 
-                fprintf(f, "%s=" UID_FMT "\n", field_name, uid);
+                serialize_item_format(f, m->serialization_format, field_name, UID_FMT, uid);
         }
 }
 
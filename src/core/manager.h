@@ -26,12 +26,17 @@
 #include "sd-event.h"
 
 #include "cgroup-util.h"
+#include "conf-cache.h"
+#include "exec-util.h"
 #include "fdset.h"
 #include "hashmap.h"
 #include "list.h"
+#include "prioq.h"
 #include "ratelimit.h"
+#include "serialize.h"
 
 struct libmnt_monitor;
+struct MountInfo;
 
 /* Enforce upper limit how many names we allow */
 #define MANAGER_MAX_NAMES 131072 /* 128K */
@@ -69,10 +74,25 @@ typedef enum StatusType {
         STATUS_TYPE_EMERGENCY,
 } StatusType;
 
+/* The subscribers to unit signals, which might want them delivered
+ * with different latency */
+typedef enum BusSignalClass {
+        BUS_SIGNAL_PRIVATE,     /* direct connections, e.g. from systemctl */
+        BUS_SIGNAL_API,         /* clients on the API bus */
+        _BUS_SIGNAL_CLASS_MAX,
+        _BUS_SIGNAL_CLASS_INVALID = -1,
+} BusSignalClass;
+
+typedef struct UnitRemoval {
+        char *id;
+        uint64_t generation;
+} UnitRemoval;
+
 #include "execute.h"
 #include "job.h"
 #include "path-lookup.h"
 #include "show-status.h"
+#include "trace.h"
 #include "unit-name.h"
 
 struct Manager {
@@ -92,6 +112,9 @@ struct Manager {
         /* Units that need to be loaded */
         LIST_HEAD(Unit, load_queue); /* this is actually more a stack than a queue, but uh. */
 
+        /* The unit whose configuration is currently being loaded */
+        Unit *loading_unit;
+
         /* Jobs that need to be run */
         LIST_HEAD(Job, run_queue);   /* more a stack than a queue, too */
 
@@ -112,6 +135,10 @@ struct Manager {
         /* Units that should be realized */
         LIST_HEAD(Unit, cgroup_queue);
 
+        /* Units whose cgroup was reported empty */
+        LIST_HEAD(Unit, cgroup_empty_queue);
+        sd_event_source *cgroup_empty_event_source;
+
         sd_event *event;
 
         /* We use two hash tables here, since the same PID might be
@@ -134,6 +161,7 @@ struct Manager {
         char *notify_socket;
         int notify_fd;
         sd_event_source *notify_event_source;
+        struct NotifyBuffer *notify_buffers;
 
         int cgroups_agent_fd;
         sd_event_source *cgroups_agent_event_source;
@@ -153,6 +181,12 @@ struct Manager {
         LookupPaths lookup_paths;
         Set *unit_path_cache;
 
+        /* Logical lines of the unit files and drop-ins we read, kept
+         * across reloads and stored in the runtime directory to survive
+         * reexecution. The settings are parsed again from them on every
+         * load. */
+        ConfigCache *unit_file_cache;
+
         char **environment;
 
         usec_t runtime_watchdog;
@@ -172,18 +206,44 @@ struct Manager {
         dual_timestamp units_load_start_timestamp;
         dual_timestamp units_load_finish_timestamp;
 
+        /* Time spent loading units during the last startup or reload,
+         * and for how many unit files the lines were taken from the
+         * cache meanwhile */
+        usec_t units_load_usec;
+        uint64_t unit_file_cache_hits;
+        uint64_t unit_file_cache_misses;
+
+        /* How each generator fared during the last run */
+        ExecTiming *generator_timings;
+        size_t n_generator_timings;
+
+        /* Bumped whenever a unit changes, and the most recently
+         * removed units, so that monitoring may ask for the units
+         * that changed since it last looked. See manager-snapshot.c */
+        uint64_t units_generation;
+        UnitRemoval *unit_removals;
+        size_t n_unit_removals, n_unit_removals_allocated;
+        uint64_t unit_removals_floor;
+
         struct udev* udev;
 
         /* Data specific to the device subsystem */
         struct udev_monitor* udev_monitor;
         sd_event_source *udev_event_source;
         Hashmap *devices_by_sysfs;
+        uint64_t n_device_events;
+        uint64_t n_device_events_coalesced;
+        uint64_t n_device_event_dispatches;
 
         /* Data specific to the mount subsystem */
         FILE *proc_self_mountinfo;
         sd_event_source *mount_event_source;
         int utab_inotify_fd;
         sd_event_source *mount_utab_event_source;
+        struct MountInfo *mount_info;
+        sd_event_source *mount_rescan_event_source;
+        RateLimit mount_rescan_ratelimit;
+        bool mount_rescan_all;
 
         /* Data specific to the swap filesystem */
         FILE *proc_swaps;
@@ -203,6 +263,16 @@ struct Manager {
         sd_bus_track *subscribed;
         char **deserialized_subscribed;
 
+        /* PropertiesChanged signals of units may be held back for a
+         * while, to merge several changes of the same unit into one
+         * signal, per class of subscribers. These are the units with
+         * signals pending, see bus_unit_send_change_signal(). */
+        usec_t bus_signal_coalesce_usec[_BUS_SIGNAL_CLASS_MAX];
+        Set *bus_coalesced_units[_BUS_SIGNAL_CLASS_MAX];
+        sd_event_source *bus_coalesce_event_source[_BUS_SIGNAL_CLASS_MAX];
+        uint64_t n_bus_signals_sent;
+        uint64_t n_bus_signals_suppressed;
+
         /* This is used during reloading: before the reload we queue
          * the reply message here, and afterwards we send it */
         sd_bus_message *queued_message;
@@ -232,7 +302,61 @@ struct Manager {
          * file system */
         int pin_cgroupfs_fd;
 
+        /* /proc/devices as of some event loop iteration, for
+         * resolving device whitelist entries */
+        struct CGroupProcDevice *proc_devices;
+        size_t n_proc_devices;
+        uint64_t proc_devices_iteration;
+
+        uint64_t n_cgroup_attribute_writes;
+        uint64_t n_cgroup_attribute_writes_skipped;
+
+        /* How long accounting values read from cgroups are reused */
+        usec_t cgroup_accounting_cache_usec;
+        unsigned n_cgroup_metric_fds;
+        unsigned cgroup_metric_fds_max;
+        uint64_t n_cgroup_metric_opens;
+        uint64_t n_cgroup_metric_reads;
+        uint64_t n_cgroup_metric_cache_hits;
+
+        uint64_t n_cgroup_empty_events;
+        uint64_t n_cgroup_empty_events_coalesced;
+        uint64_t n_cgroup_empty_dispatches;
+
+        /* Which unit processes belong to, for frequent notifiers */
+        Hashmap *cgroup_pid_cache;
+        uint64_t n_cgroup_pid_cache_hits;
+
+        uint64_t n_notify_messages;
+        uint64_t n_notify_dispatches;
+
+        /* Limits the number of start jobs running at the same time,
+         * see job_run_and_invalidate(). Start jobs beyond it wait in
+         * throttled_jobs, unless a slice limit holds them back. */
+        unsigned max_concurrent_start_jobs;
+        unsigned n_running_start_jobs;
+        Prioq *throttled_jobs;
+
+        uint64_t n_start_jobs;
+        uint64_t n_start_jobs_throttled;
+        usec_t start_job_wait_usec;
+        usec_t start_job_wait_max_usec;
+        usec_t start_job_throttle_usec;
+
+        /* Phases recorded for profiling, NULL unless enabled with
+         * TraceBufferSize= */
+        TraceBuffer *trace;
+
         int gc_marker;
+        unsigned gc_n_unsure;
+
+        /* Garbage collector statistics */
+        uint64_t n_gc_runs;
+        uint64_t n_gc_units_visited;
+        uint64_t n_gc_units_collected;
+        usec_t gc_usec;
+        usec_t gc_last_usec;
+        usec_t gc_max_usec;
 
         /* Flags */
         ManagerExitCode exit_code:5;
@@ -273,6 +397,14 @@ struct Manager {
         /* non-zero if we are reloading or reexecuting, */
         int n_reloading;
 
+        /* The format state is serialized in, and the one of the
+         * state currently being deserialized */
+        SerializationFormat serialization_format;
+        SerializationFormat deserialization_format;
+
+        /* Whether the requested reload may be limited to changed units */
+        bool reload_incremental;
+
         unsigned n_installed_jobs;
         unsigned n_failed_jobs;
 
@@ -351,6 +483,9 @@ void manager_dump_jobs(Manager *s, FILE *f, const char *prefix);
 void manager_clear_jobs(Manager *m);
 
 unsigned manager_dispatch_load_queue(Manager *m);
+unsigned manager_dispatch_gc_unit_queue(Manager *m);
+
+int manager_set_trace_buffer_size(Manager *m, size_t size);
 
 int manager_environment_add(Manager *m, char **minus, char **plus);
 int manager_set_default_rlimits(Manager *m, struct rlimit **default_rlimit);
@@ -363,6 +498,7 @@ int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root);
 int manager_deserialize(Manager *m, FILE *f, FDSet *fds);
 
 int manager_reload(Manager *m);
+int manager_reload_incremental(Manager *m);
 
 void manager_reset_failed(Manager *m);
 
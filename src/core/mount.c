@@ -40,6 +40,7 @@
 #include "mount-setup.h"
 #include "mount-util.h"
 #include "mount.h"
+#include "mountinfo.h"
 #include "parse-util.h"
 #include "path-util.h"
 #include "process-util.h"
@@ -52,6 +53,11 @@
 
 #define RETRY_UMOUNT_MAX 32
 
+/* Beyond this many mount table changes per interval, they are handled
+ * in one go at the end of the interval */
+#define RESCAN_INTERVAL_USEC USEC_PER_SEC
+#define RESCAN_BURST 20
+
 DEFINE_TRIVIAL_CLEANUP_FUNC(struct libmnt_table*, mnt_free_table);
 DEFINE_TRIVIAL_CLEANUP_FUNC(struct libmnt_iter*, mnt_free_iter);
 
@@ -73,6 +79,8 @@ static const UnitActiveState state_translation_table[_MOUNT_STATE_MAX] = {
 
 static int mount_dispatch_timer(sd_event_source *source, usec_t usec, void *userdata);
 static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata);
+static bool mount_rescan_pending(Manager *m);
+static void mount_rescan(Manager *m);
 
 static bool mount_needs_network(const char *options, const char *fstype) {
         if (fstab_test_option(options, "_netdev\0"))
@@ -239,6 +247,11 @@ static void mount_done(Unit *u) {
 
         assert(m);
 
+        /* Whoever takes over this mount point learns about it with
+         * the next scan of the mount table */
+        if (m->where && m->from_proc_self_mountinfo)
+                mount_info_forget(u->manager->mount_info, m->where);
+
         m->where = mfree(m->where);
 
         mount_parameters_done(&m->parameters_proc_self_mountinfo);
@@ -1203,6 +1216,11 @@ static void mount_sigchld_event(Unit *u, pid_t pid, int code, int status) {
         if (pid != m->control_pid)
                 return;
 
+        /* Mount table changes are processed before SIGCHLD, also
+         * when they are held back */
+        if (mount_rescan_pending(u->manager))
+                mount_rescan(u->manager);
+
         m->control_pid = 0;
 
         if (is_clean_exit(code, status, EXIT_CLEAN_COMMAND, NULL))
@@ -1582,55 +1600,45 @@ fail:
         return r;
 }
 
-static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags) {
+static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags, MountInfoChanges *changes) {
         _cleanup_(mnt_free_tablep) struct libmnt_table *t = NULL;
-        _cleanup_(mnt_free_iterp) struct libmnt_iter *i = NULL;
+        const char *what, *where;
+        Iterator i;
         int r = 0;
 
         assert(m);
+        assert(changes);
 
         t = mnt_new_table();
         if (!t)
                 return log_oom();
 
-        i = mnt_new_iter(MNT_ITER_FORWARD);
-        if (!i)
-                return log_oom();
-
         r = mnt_table_parse_mtab(t, NULL);
         if (r < 0)
                 return log_error_errno(r, "Failed to parse /proc/self/mountinfo: %m");
 
-        r = 0;
-        for (;;) {
-                const char *device, *path, *options, *fstype;
-                _cleanup_free_ char *d = NULL, *p = NULL;
-                struct libmnt_fs *fs;
-                int k;
-
-                k = mnt_table_next_fs(t, i, &fs);
-                if (k == 1)
-                        break;
-                if (k < 0)
-                        return log_error_errno(k, "Failed to get next entry from /proc/self/mountinfo: %m");
+        /* Only the entries that changed since the last scan are of
+         * interest */
+        r = mount_info_update(m->mount_info, t, changes);
+        if (r < 0)
+                return log_error_errno(r, "Failed to process /proc/self/mountinfo: %m");
 
-                device = mnt_fs_get_source(fs);
-                path = mnt_fs_get_target(fs);
-                options = mnt_fs_get_options(fs);
-                fstype = mnt_fs_get_fstype(fs);
+        log_debug("Mount table has %u entries, %u mount points changed.",
+                  hashmap_size(m->mount_info->entries), set_size(changes->where));
 
-                if (!device || !path)
-                        continue;
+        SET_FOREACH(what, changes->what_new, i)
+                (void) device_found_node(m, what, true, DEVICE_FOUND_MOUNT, set_flags);
 
-                if (cunescape(device, UNESCAPE_RELAX, &d) < 0)
-                        return log_oom();
-
-                if (cunescape(path, UNESCAPE_RELAX, &p) < 0)
-                        return log_oom();
+        SET_FOREACH(where, changes->where, i) {
+                MountInfoEntry *e;
+                int k;
 
-                (void) device_found_node(m, d, true, DEVICE_FOUND_MOUNT, set_flags);
+                /* Mount points without entries left are gone, see mount_rescan() */
+                e = mount_info_get_where(m->mount_info, where);
+                if (!e)
+                        continue;
 
-                k = mount_setup_unit(m, d, p, options, fstype, set_flags);
+                k = mount_setup_unit(m, e->what, e->where, e->options, e->fstype, set_flags);
                 if (r == 0 && k < 0)
                         r = k;
         }
@@ -1644,8 +1652,12 @@ static void mount_shutdown(Manager *m) {
         m->mount_event_source = sd_event_source_unref(m->mount_event_source);
         m->mount_utab_event_source = sd_event_source_unref(m->mount_utab_event_source);
 
+        m->mount_rescan_event_source = sd_event_source_unref(m->mount_rescan_event_source);
+
         m->proc_self_mountinfo = safe_fclose(m->proc_self_mountinfo);
         m->utab_inotify_fd = safe_close(m->utab_inotify_fd);
+
+        m->mount_info = mount_info_free(m->mount_info);
 }
 
 static int mount_get_timeout(Unit *u, usec_t *timeout) {
@@ -1698,6 +1710,7 @@ static bool mount_is_mounted(Mount *m) {
 }
 
 static void mount_enumerate(Manager *m) {
+        _cleanup_(mount_info_changes_done) MountInfoChanges changes = {};
         int r;
 
         assert(m);
@@ -1708,6 +1721,23 @@ static void mount_enumerate(Manager *m) {
 
         mnt_init_debug(0);
 
+        /* The mount units are set up from scratch, hence start over
+         * with the mount table, and look at every unit with the first
+         * change */
+        if (m->mount_info)
+                mount_info_flush(m->mount_info);
+        else {
+                m->mount_info = mount_info_new();
+                if (!m->mount_info) {
+                        log_oom();
+                        goto fail;
+                }
+
+                RATELIMIT_INIT(m->mount_rescan_ratelimit, RESCAN_INTERVAL_USEC, RESCAN_BURST);
+        }
+
+        m->mount_rescan_all = true;
+
         if (!m->proc_self_mountinfo) {
                 m->proc_self_mountinfo = fopen("/proc/self/mountinfo", "re");
                 if (!m->proc_self_mountinfo) {
@@ -1765,7 +1795,7 @@ static void mount_enumerate(Manager *m) {
                 (void) sd_event_source_set_description(m->mount_utab_event_source, "mount-utab-dispatch");
         }
 
-        r = mount_load_proc_self_mountinfo(m, false);
+        r = mount_load_proc_self_mountinfo(m, false, &changes);
         if (r < 0)
                 goto fail;
 
@@ -1775,14 +1805,189 @@ fail:
         mount_shutdown(m);
 }
 
-static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
-        _cleanup_set_free_ Set *around = NULL, *gone = NULL;
-        Manager *m = userdata;
-        const char *what;
+static void mount_process_change(Mount *mount) {
+        assert(mount);
+
+        if (!mount_is_mounted(mount)) {
+
+                /* A mount point is not around right now. It
+                 * might be gone, or might never have
+                 * existed. Devices that disappeared with it
+                 * are taken care of by the caller. */
+
+                mount->from_proc_self_mountinfo = false;
+
+                switch (mount->state) {
+
+                case MOUNT_MOUNTED:
+                        /* This has just been unmounted by
+                         * somebody else, follow the state
+                         * change. */
+                        mount->result = MOUNT_SUCCESS; /* make sure we forget any earlier umount failures */
+                        mount_enter_dead(mount, MOUNT_SUCCESS);
+                        break;
+
+                default:
+                        break;
+                }
+
+        } else if (mount->just_mounted || mount->just_changed) {
+
+                /* A mount point was added or changed */
+
+                switch (mount->state) {
+
+                case MOUNT_DEAD:
+                case MOUNT_FAILED:
+
+                        /* This has just been mounted by somebody else, follow the state change, but let's
+                         * generate a new invocation ID for this implicitly and automatically. */
+                        (void) unit_acquire_invocation_id(UNIT(mount));
+                        mount_enter_mounted(mount, MOUNT_SUCCESS);
+                        break;
+
+                case MOUNT_MOUNTING:
+                        mount_set_state(mount, MOUNT_MOUNTING_DONE);
+                        break;
+
+                default:
+                        /* Nothing really changed, but let's
+                         * issue an notification call
+                         * nonetheless, in case somebody is
+                         * waiting for this. (e.g. file system
+                         * ro/rw remounts.) */
+                        mount_set_state(mount, mount->state);
+                        break;
+                }
+        }
+
+        /* Reset the flags for later calls */
+        mount->is_mounted = mount->just_mounted = mount->just_changed = false;
+}
+
+static void mount_rescan(Manager *m) {
+        _cleanup_(mount_info_changes_done) MountInfoChanges changes = {};
+        const char *what, *where;
         Iterator i;
         Unit *u;
         int r;
 
+        assert(m);
+
+        if (m->mount_rescan_event_source)
+                (void) sd_event_source_set_enabled(m->mount_rescan_event_source, SD_EVENT_OFF);
+
+        /* Every mount point has to be reported again for looking at
+         * all units */
+        if (m->mount_rescan_all)
+                mount_info_flush(m->mount_info);
+
+        r = mount_load_proc_self_mountinfo(m, true, &changes);
+        if (r < 0) {
+                /* Reset flags, just in case, for later calls, and
+                 * look at everything again the next time */
+                LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT]) {
+                        Mount *mount = MOUNT(u);
+
+                        mount->is_mounted = mount->just_mounted = mount->just_changed = false;
+                }
+
+                mount_info_flush(m->mount_info);
+                m->mount_rescan_all = true;
+                return;
+        }
+
+        manager_dispatch_load_queue(m);
+
+        if (m->mount_rescan_all) {
+                /* Units not listed at all are taken care of here,
+                 * including the devices they were mounted from, as
+                 * the table has no record of them anymore */
+                LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT]) {
+                        Mount *mount = MOUNT(u);
+
+                        if (!mount_is_mounted(mount) &&
+                            mount->from_proc_self_mountinfo &&
+                            mount->parameters_proc_self_mountinfo.what &&
+                            !mount_info_has_what(m->mount_info, mount->parameters_proc_self_mountinfo.what))
+                                (void) device_found_node(m, mount->parameters_proc_self_mountinfo.what, false, DEVICE_FOUND_MOUNT, true);
+
+                        mount_process_change(mount);
+                }
+
+                m->mount_rescan_all = false;
+        } else
+                SET_FOREACH(where, changes.where, i) {
+                        _cleanup_free_ char *e = NULL;
+
+                        if (unit_name_from_path(where, ".mount", &e) < 0)
+                                continue;
+
+                        u = manager_get_unit(m, e);
+                        if (u && u->type == UNIT_MOUNT)
+                                mount_process_change(MOUNT(u));
+                }
+
+        SET_FOREACH(what, changes.what_gone, i)
+                /* Let the device units know that the device is no longer mounted */
+                (void) device_found_node(m, what, false, DEVICE_FOUND_MOUNT, true);
+}
+
+static bool mount_rescan_pending(Manager *m) {
+        int enabled;
+
+        assert(m);
+
+        return m->mount_rescan_event_source &&
+                sd_event_source_get_enabled(m->mount_rescan_event_source, &enabled) >= 0 &&
+                enabled != SD_EVENT_OFF;
+}
+
+static int mount_dispatch_rescan(sd_event_source *source, usec_t usec, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+
+        mount_rescan(m);
+        return 0;
+}
+
+static int mount_schedule_rescan(Manager *m) {
+        usec_t next;
+        int r;
+
+        assert(m);
+
+        if (mount_rescan_pending(m))
+                return 0;
+
+        next = usec_add(m->mount_rescan_ratelimit.begin, m->mount_rescan_ratelimit.interval);
+
+        if (m->mount_rescan_event_source) {
+                r = sd_event_source_set_time(m->mount_rescan_event_source, next);
+                if (r < 0)
+                        return r;
+
+                return sd_event_source_set_enabled(m->mount_rescan_event_source, SD_EVENT_ONESHOT);
+        }
+
+        r = sd_event_add_time(m->event, &m->mount_rescan_event_source, CLOCK_MONOTONIC, next, 0, mount_dispatch_rescan, m);
+        if (r < 0)
+                return r;
+
+        /* Like the mount table events themselves, before SIGCHLD */
+        r = sd_event_source_set_priority(m->mount_rescan_event_source, -10);
+        if (r < 0)
+                return r;
+
+        (void) sd_event_source_set_description(m->mount_rescan_event_source, "mount-rescan");
+        return 0;
+}
+
+static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        Manager *m = userdata;
+        int r;
+
         assert(m);
         assert(revents & (EPOLLPRI | EPOLLIN));
 
@@ -1827,105 +2032,20 @@ static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents,
                         return 0;
         }
 
-        r = mount_load_proc_self_mountinfo(m, true);
-        if (r < 0) {
-                /* Reset flags, just in case, for later calls */
-                LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT]) {
-                        Mount *mount = MOUNT(u);
-
-                        mount->is_mounted = mount->just_mounted = mount->just_changed = false;
-                }
-
-                return 0;
-        }
-
-        manager_dispatch_load_queue(m);
-
-        LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT]) {
-                Mount *mount = MOUNT(u);
-
-                if (!mount_is_mounted(mount)) {
-
-                        /* A mount point is not around right now. It
-                         * might be gone, or might never have
-                         * existed. */
-
-                        if (mount->from_proc_self_mountinfo &&
-                            mount->parameters_proc_self_mountinfo.what) {
-
-                                /* Remember that this device might just have disappeared */
-                                if (set_ensure_allocated(&gone, &string_hash_ops) < 0 ||
-                                    set_put(gone, mount->parameters_proc_self_mountinfo.what) < 0)
-                                        log_oom(); /* we don't care too much about OOM here... */
-                        }
-
-                        mount->from_proc_self_mountinfo = false;
-
-                        switch (mount->state) {
-
-                        case MOUNT_MOUNTED:
-                                /* This has just been unmounted by
-                                 * somebody else, follow the state
-                                 * change. */
-                                mount->result = MOUNT_SUCCESS; /* make sure we forget any earlier umount failures */
-                                mount_enter_dead(mount, MOUNT_SUCCESS);
-                                break;
-
-                        default:
-                                break;
-                        }
-
-                } else if (mount->just_mounted || mount->just_changed) {
+        /* During bursts of mount table changes, e.g. while many
+         * containers start, process them in batches */
+        if (!ratelimit_test(&m->mount_rescan_ratelimit)) {
+                if (!mount_rescan_pending(m))
+                        log_debug("Mount table changes too often, processing them in batches.");
 
-                        /* A mount point was added or changed */
-
-                        switch (mount->state) {
-
-                        case MOUNT_DEAD:
-                        case MOUNT_FAILED:
-
-                                /* This has just been mounted by somebody else, follow the state change, but let's
-                                 * generate a new invocation ID for this implicitly and automatically. */
-                                (void) unit_acquire_invocation_id(UNIT(mount));
-                                mount_enter_mounted(mount, MOUNT_SUCCESS);
-                                break;
-
-                        case MOUNT_MOUNTING:
-                                mount_set_state(mount, MOUNT_MOUNTING_DONE);
-                                break;
-
-                        default:
-                                /* Nothing really changed, but let's
-                                 * issue an notification call
-                                 * nonetheless, in case somebody is
-                                 * waiting for this. (e.g. file system
-                                 * ro/rw remounts.) */
-                                mount_set_state(mount, mount->state);
-                                break;
-                        }
-                }
-
-                if (mount_is_mounted(mount) &&
-                    mount->from_proc_self_mountinfo &&
-                    mount->parameters_proc_self_mountinfo.what) {
-
-                        if (set_ensure_allocated(&around, &string_hash_ops) < 0 ||
-                            set_put(around, mount->parameters_proc_self_mountinfo.what) < 0)
-                                log_oom();
-                }
-
-                /* Reset the flags for later calls */
-                mount->is_mounted = mount->just_mounted = mount->just_changed = false;
-        }
-
-        SET_FOREACH(what, gone, i) {
-                if (set_contains(around, what))
-                        continue;
+                r = mount_schedule_rescan(m);
+                if (r >= 0)
+                        return 0;
 
-                /* Let the device units know that the device is no longer mounted */
-                (void) device_found_node(m, what, false, DEVICE_FOUND_MOUNT, true);
+                log_warning_errno(r, "Failed to schedule mount table rescan, processing changes right away: %m");
         }
 
+        mount_rescan(m);
         return 0;
 }
 
@@ -0,0 +1,357 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+
+#include "alloc-util.h"
+#include "escape.h"
+#include "mountinfo.h"
+#include "string-util.h"
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(struct libmnt_iter*, mnt_free_iter);
+
+static MountInfoEntry *mount_info_entry_free(MountInfoEntry *e) {
+        if (!e)
+                return NULL;
+
+        free(e->source);
+        free(e->target);
+        free(e->options);
+        free(e->fstype);
+        free(e->what);
+        free(e->where);
+
+        return mfree(e);
+}
+
+MountInfo *mount_info_new(void) {
+        MountInfo *mi;
+
+        mi = new0(MountInfo, 1);
+        if (!mi)
+                return NULL;
+
+        mi->entries = hashmap_new(NULL);
+        mi->by_where = hashmap_new(&string_hash_ops);
+        mi->by_what = hashmap_new(&string_hash_ops);
+        if (!mi->entries || !mi->by_where || !mi->by_what)
+                return mount_info_free(mi);
+
+        return mi;
+}
+
+void mount_info_flush(MountInfo *mi) {
+        MountInfoEntry *e;
+
+        if (!mi)
+                return;
+
+        hashmap_clear(mi->by_where);
+        hashmap_clear(mi->by_what);
+
+        while ((e = hashmap_steal_first(mi->entries)))
+                mount_info_entry_free(e);
+}
+
+MountInfo *mount_info_free(MountInfo *mi) {
+        if (!mi)
+                return NULL;
+
+        mount_info_flush(mi);
+
+        hashmap_free(mi->entries);
+        hashmap_free(mi->by_where);
+        hashmap_free(mi->by_what);
+
+        return mfree(mi);
+}
+
+static int key_from_id(int id, unsigned *anonymous) {
+
+        /* Mount IDs start at 0, hence shift them by one to keep the
+         * key non-NULL. Entries without ID, which libmount reports
+         * when the table is not read from mountinfo, are keyed by
+         * their position instead. */
+
+        if (id >= 0)
+                return id + 1;
+
+        return -(int) ++(*anonymous);
+}
+
+static void mount_info_remove(MountInfo *mi, MountInfoEntry *e) {
+        MountInfoEntry *first;
+
+        assert(mi);
+        assert(e);
+
+        first = hashmap_get(mi->by_where, e->where);
+        LIST_REMOVE(same_where, first, e);
+        if (first)
+                assert_se(hashmap_replace(mi->by_where, first->where, first) >= 0);
+        else
+                hashmap_remove(mi->by_where, e->where);
+
+        first = hashmap_get(mi->by_what, e->what);
+        LIST_REMOVE(same_what, first, e);
+        if (first)
+                assert_se(hashmap_replace(mi->by_what, first->what, first) >= 0);
+        else
+                hashmap_remove(mi->by_what, e->what);
+
+        hashmap_remove(mi->entries, INT_TO_PTR(e->id));
+        mount_info_entry_free(e);
+}
+
+static int mount_info_add(
+                MountInfo *mi,
+                int id,
+                const char *source,
+                const char *target,
+                const char *options,
+                const char *fstype,
+                MountInfoEntry **ret) {
+
+        MountInfoEntry *e, *first;
+        int r;
+
+        assert(mi);
+        assert(source);
+        assert(target);
+        assert(ret);
+
+        e = new0(MountInfoEntry, 1);
+        if (!e)
+                return -ENOMEM;
+
+        e->id = id;
+        e->generation = mi->generation;
+
+        e->source = strdup(source);
+        e->target = strdup(target);
+        e->options = strdup(strempty(options));
+        e->fstype = strdup(strempty(fstype));
+        if (!e->source || !e->target || !e->options || !e->fstype) {
+                mount_info_entry_free(e);
+                return -ENOMEM;
+        }
+
+        if (cunescape(source, UNESCAPE_RELAX, &e->what) < 0 ||
+            cunescape(target, UNESCAPE_RELAX, &e->where) < 0) {
+                mount_info_entry_free(e);
+                return -ENOMEM;
+        }
+
+        r = hashmap_put(mi->entries, INT_TO_PTR(id), e);
+        if (r < 0) {
+                mount_info_entry_free(e);
+                return r;
+        }
+
+        /* On failure the entry stays half-linked, the caller flushes
+         * everything then. */
+        first = hashmap_get(mi->by_where, e->where);
+        LIST_PREPEND(same_where, first, e);
+        r = hashmap_replace(mi->by_where, first->where, first);
+        if (r < 0)
+                return r;
+
+        first = hashmap_get(mi->by_what, e->what);
+        LIST_PREPEND(same_what, first, e);
+        r = hashmap_replace(mi->by_what, first->what, first);
+        if (r < 0)
+                return r;
+
+        *ret = e;
+        return 0;
+}
+
+static int changes_put(Set **s, const char *p) {
+        int r;
+
+        r = set_ensure_allocated(s, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        r = set_put_strdup(*s, p);
+        if (r < 0)
+                return r;
+
+        return 0;
+}
+
+int mount_info_update(MountInfo *mi, struct libmnt_table *t, MountInfoChanges *changes) {
+        _cleanup_(mnt_free_iterp) struct libmnt_iter *i = NULL;
+        _cleanup_set_free_free_ Set *what_removed = NULL;
+        unsigned anonymous = 0;
+        MountInfoEntry *e;
+        Iterator j;
+        char *what;
+        int r;
+
+        assert(mi);
+        assert(t);
+        assert(changes);
+
+        /* Compares the table with the one of the previous call, and
+         * records the mount points and sources touched in between. On
+         * failure the copy is flushed, hence the next call reports
+         * everything as new. */
+
+        i = mnt_new_iter(MNT_ITER_FORWARD);
+        if (!i)
+                return -ENOMEM;
+
+        mi->generation++;
+        mi->n_scans++;
+
+        for (;;) {
+                const char *source, *target, *options, *fstype;
+                struct libmnt_fs *fs;
+                int key;
+
+                r = mnt_table_next_fs(t, i, &fs);
+                if (r == 1)
+                        break;
+                if (r < 0)
+                        goto fail;
+
+                source = mnt_fs_get_source(fs);
+                target = mnt_fs_get_target(fs);
+                options = mnt_fs_get_options(fs);
+                fstype = mnt_fs_get_fstype(fs);
+
+                if (!source || !target)
+                        continue;
+
+                mi->n_entries_scanned++;
+
+                key = key_from_id(mnt_fs_get_id(fs), &anonymous);
+
+                e = hashmap_get(mi->entries, INT_TO_PTR(key));
+                if (e &&
+                    streq(e->source, source) &&
+                    streq(e->target, target) &&
+                    streq(e->options, strempty(options)) &&
+                    streq(e->fstype, strempty(fstype))) {
+                        e->generation = mi->generation;
+                        continue;
+                }
+
+                mi->n_entries_changed++;
+
+                if (e) {
+                        /* Changed in place, e.g. remounted or moved */
+                        r = changes_put(&changes->where, e->where);
+                        if (r < 0)
+                                goto fail;
+
+                        r = changes_put(&what_removed, e->what);
+                        if (r < 0)
+                                goto fail;
+
+                        mount_info_remove(mi, e);
+                }
+
+                r = mount_info_add(mi, key, source, target, options, fstype, &e);
+                if (r < 0)
+                        goto fail;
+
+                r = changes_put(&changes->where, e->where);
+                if (r < 0)
+                        goto fail;
+
+                r = changes_put(&changes->what_new, e->what);
+                if (r < 0)
+                        goto fail;
+        }
+
+        HASHMAP_FOREACH(e, mi->entries, j) {
+                if (e->generation == mi->generation)
+                        continue;
+
+                mi->n_entries_changed++;
+
+                r = changes_put(&changes->where, e->where);
+                if (r < 0)
+                        goto fail;
+
+                r = changes_put(&what_removed, e->what);
+                if (r < 0)
+                        goto fail;
+
+                mount_info_remove(mi, e);
+        }
+
+        SET_FOREACH(what, what_removed, j) {
+                if (mount_info_has_what(mi, what))
+                        continue;
+
+                r = changes_put(&changes->what_gone, what);
+                if (r < 0)
+                        goto fail;
+        }
+
+        return 0;
+
+fail:
+        mount_info_flush(mi);
+        return r;
+}
+
+void mount_info_forget(MountInfo *mi, const char *where) {
+        MountInfoEntry *e;
+
+        assert(where);
+
+        if (!mi)
+                return;
+
+        /* Makes the next update report the mount point as new */
+        while ((e = hashmap_get(mi->by_where, where)))
+                mount_info_remove(mi, e);
+}
+
+MountInfoEntry *mount_info_get_where(MountInfo *mi, const char *where) {
+        MountInfoEntry *e, *top = NULL;
+
+        assert(mi);
+        assert(where);
+
+        /* Of stacked mounts the one with the highest ID is on top, as
+         * entries changed in place are moved to the front of the list */
+        LIST_FOREACH(same_where, e, hashmap_get(mi->by_where, where))
+                if (!top || e->id > top->id)
+                        top = e;
+
+        return top;
+}
+
+bool mount_info_has_what(MountInfo *mi, const char *what) {
+        assert(mi);
+        assert(what);
+
+        return hashmap_contains(mi->by_what, what);
+}
+
+void mount_info_changes_done(MountInfoChanges *changes) {
+        assert(changes);
+
+        changes->where = set_free_free(changes->where);
+        changes->what_new = set_free_free(changes->what_new);
+        changes->what_gone = set_free_free(changes->what_gone);
+}
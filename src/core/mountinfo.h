@@ -0,0 +1,83 @@
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <libmount.h>
+#include <stdbool.h>
+
+#include "hashmap.h"
+#include "list.h"
+#include "macro.h"
+#include "set.h"
+
+/* A copy of the mount table as of the last scan of
+ * /proc/self/mountinfo, keyed by mount ID, so that a new scan only
+ * needs to act on the entries that appeared, changed or went away
+ * since. */
+
+typedef struct MountInfoEntry MountInfoEntry;
+
+struct MountInfoEntry {
+        int id;
+
+        /* As returned by libmount, still escaped */
+        char *source;
+        char *target;
+        char *options;
+        char *fstype;
+
+        char *what;
+        char *where;
+
+        unsigned generation;
+
+        LIST_FIELDS(MountInfoEntry, same_where);
+        LIST_FIELDS(MountInfoEntry, same_what);
+};
+
+typedef struct MountInfo {
+        Hashmap *entries;  /* mount ID → MountInfoEntry */
+        Hashmap *by_where; /* where → list of MountInfoEntry */
+        Hashmap *by_what;  /* what → list of MountInfoEntry */
+
+        unsigned generation;
+
+        uint64_t n_scans;
+        uint64_t n_entries_scanned;
+        uint64_t n_entries_changed;
+} MountInfo;
+
+typedef struct MountInfoChanges {
+        Set *where;     /* Mount points with an entry added, changed or removed */
+        Set *what_new;  /* Sources of added or changed entries */
+        Set *what_gone; /* Sources not listed anymore at all */
+} MountInfoChanges;
+
+MountInfo *mount_info_new(void);
+MountInfo *mount_info_free(MountInfo *mi);
+void mount_info_flush(MountInfo *mi);
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(MountInfo*, mount_info_free);
+
+int mount_info_update(MountInfo *mi, struct libmnt_table *t, MountInfoChanges *changes);
+void mount_info_forget(MountInfo *mi, const char *where);
+
+MountInfoEntry *mount_info_get_where(MountInfo *mi, const char *where);
+bool mount_info_has_what(MountInfo *mi, const char *what);
+
+void mount_info_changes_done(MountInfoChanges *changes);
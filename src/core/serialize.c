@@ -0,0 +1,350 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "alloc-util.h"
+#include "escape.h"
+#include "serialize.h"
+#include "sparse-endian.h"
+#include "string-table.h"
+#include "string-util.h"
+#include "util.h"
+
+/* The leading NUL byte never starts a text serialization */
+static const uint8_t serialization_signature[8] = { 0, 'S', 'D', 'S', 'T', 'A', 'T', 'E' };
+
+typedef struct SerializationHeader {
+        uint8_t signature[8];
+        le32_t version;
+        le32_t reserved;
+} _packed_ SerializationHeader;
+
+typedef struct SerializationItemHeader {
+        le32_t key_size;
+        le32_t value_size;
+} _packed_ SerializationItemHeader;
+
+int serialize_header(FILE *f, SerializationFormat format) {
+        SerializationHeader h = {
+                .version = htole32(SERIALIZATION_VERSION),
+        };
+
+        assert(f);
+
+        if (format != SERIALIZATION_BINARY)
+                return 0;
+
+        memcpy(h.signature, serialization_signature, sizeof(h.signature));
+
+        if (fwrite(&h, sizeof(h), 1, f) != 1)
+                return -EIO;
+
+        return 0;
+}
+
+int deserialize_header(FILE *f, SerializationFormat *ret) {
+        SerializationHeader h;
+        uint32_t version;
+        int c;
+
+        assert(f);
+        assert(ret);
+
+        /* Streams without the signature are in the text format, which
+         * is what older versions and SerializationFormat=text write */
+
+        c = fgetc(f);
+        if (c != 0) {
+                if (c == EOF) {
+                        if (ferror(f))
+                                return -EIO;
+                } else if (ungetc(c, f) == EOF)
+                        return -EIO;
+
+                *ret = SERIALIZATION_TEXT;
+                return 0;
+        }
+
+        h.signature[0] = 0;
+        if (fread((uint8_t*) &h + 1, sizeof(h) - 1, 1, f) != 1)
+                return ferror(f) ? -EIO : -EBADMSG;
+
+        if (memcmp(h.signature, serialization_signature, sizeof(h.signature)) != 0)
+                return -EBADMSG;
+
+        version = le32toh(h.version);
+        if (version == 0 || version > SERIALIZATION_VERSION)
+                return -EPROTONOSUPPORT;
+
+        *ret = SERIALIZATION_BINARY;
+        return 0;
+}
+
+static int serialize_binary_item(FILE *f, const char *key, const char *value, size_t value_size) {
+        SerializationItemHeader h;
+        uint8_t buf[256];
+        size_t key_size;
+
+        key_size = strlen(key);
+        assert(key_size > 0);
+
+        if (key_size > SERIALIZATION_ITEM_MAX || value_size > SERIALIZATION_ITEM_MAX)
+                return -E2BIG;
+
+        h.key_size = htole32(key_size);
+        h.value_size = htole32(value_size);
+
+        /* The stream is not shared between threads, hence skip the
+         * locking, and write the typical short item in one go */
+
+        if (sizeof(h) + key_size + value_size <= sizeof(buf)) {
+                memcpy(buf, &h, sizeof(h));
+                memcpy(buf + sizeof(h), key, key_size);
+                memcpy_safe(buf + sizeof(h) + key_size, value, value_size);
+
+                fwrite_unlocked(buf, 1, sizeof(h) + key_size + value_size, f);
+        } else {
+                fwrite_unlocked(&h, sizeof(h), 1, f);
+                fwrite_unlocked(key, 1, key_size, f);
+                if (value_size > 0)
+                        fwrite_unlocked(value, 1, value_size, f);
+        }
+
+        /* caller should call ferror() */
+
+        return 1;
+}
+
+int serialize_item(FILE *f, SerializationFormat format, const char *key, const char *value) {
+        assert(f);
+        assert(key);
+
+        if (!value)
+                return 0;
+
+        if (format == SERIALIZATION_BINARY)
+                return serialize_binary_item(f, key, value, strlen(value));
+
+        fputs(key, f);
+        fputc('=', f);
+        fputs(value, f);
+        fputc('\n', f);
+
+        return 1;
+}
+
+int serialize_item_formatv(FILE *f, SerializationFormat format, const char *key, const char *fmt, va_list ap) {
+        _cleanup_free_ char *allocated = NULL;
+        char buf[LINE_MAX];
+        va_list aq;
+        int n;
+
+        assert(f);
+        assert(key);
+        assert(fmt);
+
+        if (format != SERIALIZATION_BINARY) {
+                fputs(key, f);
+                fputc('=', f);
+                vfprintf(f, fmt, ap);
+                fputc('\n', f);
+
+                return 1;
+        }
+
+        /* Most values are short numbers, avoid the allocation for them */
+        va_copy(aq, ap);
+        n = vsnprintf(buf, sizeof(buf), fmt, aq);
+        va_end(aq);
+        if (n < 0)
+                return -EINVAL;
+
+        if ((size_t) n < sizeof(buf))
+                return serialize_binary_item(f, key, buf, n);
+
+        n = vasprintf(&allocated, fmt, ap);
+        if (n < 0)
+                return -ENOMEM;
+
+        return serialize_binary_item(f, key, allocated, n);
+}
+
+int serialize_item_format(FILE *f, SerializationFormat format, const char *key, const char *fmt, ...) {
+        va_list ap;
+        int r;
+
+        va_start(ap, fmt);
+        r = serialize_item_formatv(f, format, key, fmt, ap);
+        va_end(ap);
+
+        return r;
+}
+
+int serialize_item_escaped(FILE *f, SerializationFormat format, const char *key, const char *value) {
+        _cleanup_free_ char *c = NULL;
+
+        assert(f);
+        assert(key);
+
+        if (!value)
+                return 0;
+
+        c = cescape(value);
+        if (!c)
+                return -ENOMEM;
+
+        return serialize_item(f, format, key, c);
+}
+
+void serialize_dual_timestamp(FILE *f, SerializationFormat format, const char *key, dual_timestamp *t) {
+        assert(f);
+        assert(key);
+        assert(t);
+
+        if (!dual_timestamp_is_set(t))
+                return;
+
+        (void) serialize_item_format(f, format, key, USEC_FMT " " USEC_FMT, t->realtime, t->monotonic);
+}
+
+void serialize_start_marker(FILE *f, SerializationFormat format, const char *name) {
+        assert(f);
+        assert(name);
+
+        /* Starts the section of a unit or job, as a key without value */
+
+        if (format == SERIALIZATION_BINARY)
+                (void) serialize_binary_item(f, name, NULL, 0);
+        else {
+                fputs(name, f);
+                fputc('\n', f);
+        }
+}
+
+void serialize_end_marker(FILE *f, SerializationFormat format) {
+        static const SerializationItemHeader end = {};
+
+        assert(f);
+
+        if (format == SERIALIZATION_BINARY)
+                fwrite(&end, sizeof(end), 1, f);
+        else
+                fputc('\n', f);
+}
+
+static int deserialize_text_item(FILE *f, char **buffer, size_t *allocated, char **ret_key, char **ret_value) {
+        char *l;
+        size_t k;
+
+        if (!GREEDY_REALLOC(*buffer, *allocated, LINE_MAX))
+                return -ENOMEM;
+
+        if (!fgets(*buffer, LINE_MAX, f)) {
+                if (feof(f))
+                        return -ENODATA;
+
+                return errno > 0 ? -errno : -EIO;
+        }
+
+        l = strstrip(*buffer);
+
+        /* End marker */
+        if (isempty(l))
+                return 0;
+
+        k = strcspn(l, "=");
+        if (l[k] == '=') {
+                l[k] = 0;
+                *ret_value = l + k + 1;
+        } else
+                *ret_value = l + k;
+
+        *ret_key = l;
+        return 1;
+}
+
+static int deserialize_binary_item(FILE *f, char **buffer, size_t *allocated, char **ret_key, char **ret_value) {
+        SerializationItemHeader h;
+        size_t n, key_size, value_size;
+        char *p;
+
+        n = fread_unlocked(&h, 1, sizeof(h), f);
+        if (n != sizeof(h)) {
+                if (ferror(f))
+                        return -EIO;
+
+                return n == 0 ? -ENODATA : -EBADMSG;
+        }
+
+        key_size = le32toh(h.key_size);
+        value_size = le32toh(h.value_size);
+
+        /* End marker */
+        if (key_size == 0 && value_size == 0)
+                return 0;
+
+        if (key_size == 0 || key_size > SERIALIZATION_ITEM_MAX || value_size > SERIALIZATION_ITEM_MAX)
+                return -EBADMSG;
+
+        if (!GREEDY_REALLOC(*buffer, *allocated, key_size + value_size + 2))
+                return -ENOMEM;
+
+        p = *buffer;
+
+        if (fread_unlocked(p, 1, key_size + value_size, f) != key_size + value_size)
+                return ferror(f) ? -EIO : -EBADMSG;
+
+        /* Keys and values are handed out as C strings */
+        if (memchr(p, 0, key_size + value_size))
+                return -EBADMSG;
+
+        memmove(p + key_size + 1, p + key_size, value_size);
+        p[key_size] = 0;
+        p[key_size + 1 + value_size] = 0;
+
+        *ret_key = p;
+        *ret_value = p + key_size + 1;
+        return 1;
+}
+
+int deserialize_item(FILE *f, SerializationFormat format, char **buffer, size_t *allocated, char **ret_key, char **ret_value) {
+        assert(f);
+        assert(buffer);
+        assert(allocated);
+        assert(ret_key);
+        assert(ret_value);
+
+        /* Returns 1 and the next item, 0 at the end marker of a
+         * section and -ENODATA at the end of the stream. The returned
+         * strings point into the buffer, and are valid until the next
+         * call. */
+
+        if (format == SERIALIZATION_BINARY)
+                return deserialize_binary_item(f, buffer, allocated, ret_key, ret_value);
+
+        return deserialize_text_item(f, buffer, allocated, ret_key, ret_value);
+}
+
+static const char* const serialization_format_table[_SERIALIZATION_FORMAT_MAX] = {
+        [SERIALIZATION_TEXT] = "text",
+        [SERIALIZATION_BINARY] = "binary",
+};
+
+DEFINE_STRING_TABLE_LOOKUP(serialization_format, SerializationFormat);
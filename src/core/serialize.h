@@ -0,0 +1,62 @@
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "macro.h"
+#include "time-util.h"
+
+/* The state handed over on daemon reload, reexecution and switching
+ * root is a sequence of key/value items, grouped in sections that are
+ * terminated by an end marker. In the traditional text format each
+ * item is a "key=value" line and the end marker an empty line. The
+ * binary format starts with a signature and version, and stores each
+ * item as a pair of little-endian 32bit sizes followed by the key and
+ * the value, the end marker being a pair of zero sizes. Values are
+ * formatted the same way in both formats, hence the same parsers
+ * apply. */
+
+typedef enum SerializationFormat {
+        SERIALIZATION_TEXT,
+        SERIALIZATION_BINARY,
+        _SERIALIZATION_FORMAT_MAX,
+        _SERIALIZATION_FORMAT_INVALID = -1,
+} SerializationFormat;
+
+#define SERIALIZATION_VERSION 1U
+
+/* Upper limit for a single key or value in the binary format */
+#define SERIALIZATION_ITEM_MAX (16U*1024U*1024U)
+
+int serialize_header(FILE *f, SerializationFormat format);
+int deserialize_header(FILE *f, SerializationFormat *ret);
+
+int serialize_item(FILE *f, SerializationFormat format, const char *key, const char *value);
+int serialize_item_formatv(FILE *f, SerializationFormat format, const char *key, const char *fmt, va_list ap) _printf_(4, 0);
+int serialize_item_format(FILE *f, SerializationFormat format, const char *key, const char *fmt, ...) _printf_(4, 5);
+int serialize_item_escaped(FILE *f, SerializationFormat format, const char *key, const char *value);
+void serialize_dual_timestamp(FILE *f, SerializationFormat format, const char *key, dual_timestamp *t);
+void serialize_start_marker(FILE *f, SerializationFormat format, const char *name);
+void serialize_end_marker(FILE *f, SerializationFormat format);
+
+int deserialize_item(FILE *f, SerializationFormat format, char **buffer, size_t *allocated, char **ret_key, char **ret_value);
+
+const char* serialization_format_to_string(SerializationFormat i) _const_;
+SerializationFormat serialization_format_from_string(const char *s) _pure_;
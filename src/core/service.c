@@ -186,6 +186,7 @@ void service_close_socket_fd(Service *s) {
         /* Undo the effect of service_set_socket_fd(). */
 
         s->socket_fd = asynchronous_close(s->socket_fd);
+        s->socket_fd_prefork = false;
 
         if (UNIT_ISSET(s->accept_socket)) {
                 socket_connection_unref(SOCKET(UNIT_DEREF(s->accept_socket)));
@@ -1085,14 +1086,15 @@ static int service_collect_fds(Service *s,
 
         if (s->socket_fd >= 0) {
 
-                /* Pass the per-connection socket */
+                /* Pass the per-connection socket, or the channel prefork pool workers receive their
+                 * connections on */
 
                 rfds = new(int, 1);
                 if (!rfds)
                         return -ENOMEM;
                 rfds[0] = s->socket_fd;
 
-                rfd_names = strv_new("connection", NULL);
+                rfd_names = strv_new(s->socket_fd_prefork ? "prefork" : "connection", NULL);
                 if (!rfd_names)
                         return -ENOMEM;
 
@@ -1103,7 +1105,7 @@ static int service_collect_fds(Service *s,
 
                 /* Pass all our configured sockets for singleton services */
 
-                SET_FOREACH(u, UNIT(s)->dependencies[UNIT_TRIGGERED_BY], i) {
+                UNIT_FOREACH_DEPENDENCY(u, UNIT(s), UNIT_TRIGGERED_BY, i) {
                         _cleanup_free_ int *cfds = NULL;
                         Socket *sock;
                         int cn_fds;
@@ -2220,7 +2222,7 @@ static int service_serialize_exec_command(Unit *u, FILE *f, ExecCommand *command
         if (!p)
                 return -ENOMEM;
 
-        fprintf(f, "%s-command=%s %u %s %s\n", type, service_exec_command_to_string(id), idx, p, args);
+        unit_serialize_item_format(u, f, strjoina(type, "-command"), "%s %u %s %s", service_exec_command_to_string(id), idx, p, args);
 
         return 0;
 }
@@ -2275,6 +2277,9 @@ static int service_serialize(Unit *u, FILE *f, FDSet *fds) {
         if (r < 0)
                 return r;
 
+        if (s->socket_fd_prefork)
+                unit_serialize_item(u, f, "socket-fd-prefork", yes_no(s->socket_fd_prefork));
+
         LIST_FOREACH(fd_store, fs, s->fd_store) {
                 _cleanup_free_ char *c = NULL;
                 int copy;
@@ -2290,8 +2295,8 @@ static int service_serialize(Unit *u, FILE *f, FDSet *fds) {
 
         if (s->main_exec_status.pid > 0) {
                 unit_serialize_item_format(u, f, "main-exec-status-pid", PID_FMT, s->main_exec_status.pid);
-                dual_timestamp_serialize(f, "main-exec-status-start", &s->main_exec_status.start_timestamp);
-                dual_timestamp_serialize(f, "main-exec-status-exit", &s->main_exec_status.exit_timestamp);
+                unit_serialize_dual_timestamp(u, f, "main-exec-status-start", &s->main_exec_status.start_timestamp);
+                unit_serialize_dual_timestamp(u, f, "main-exec-status-exit", &s->main_exec_status.exit_timestamp);
 
                 if (dual_timestamp_is_set(&s->main_exec_status.exit_timestamp)) {
                         unit_serialize_item_format(u, f, "main-exec-status-code", "%i", s->main_exec_status.code);
@@ -2299,7 +2304,7 @@ static int service_serialize(Unit *u, FILE *f, FDSet *fds) {
                 }
         }
 
-        dual_timestamp_serialize(f, "watchdog-timestamp", &s->watchdog_timestamp);
+        unit_serialize_dual_timestamp(u, f, "watchdog-timestamp", &s->watchdog_timestamp);
 
         unit_serialize_item(u, f, "forbid-restart", yes_no(s->forbid_restart));
 
@@ -2511,6 +2516,14 @@ static int service_deserialize_item(Unit *u, const char *key, const char *value,
                         asynchronous_close(s->socket_fd);
                         s->socket_fd = fdset_remove(fds, fd);
                 }
+        } else if (streq(key, "socket-fd-prefork")) {
+                int b;
+
+                b = parse_boolean(value);
+                if (b < 0)
+                        log_unit_debug(u, "Failed to parse socket-fd-prefork value: %s", value);
+                else
+                        s->socket_fd_prefork = b;
         } else if (streq(key, "fd-store-fd")) {
                 const char *fdv;
                 size_t pf;
@@ -3469,7 +3482,7 @@ static void service_bus_name_owner_change(
         }
 }
 
-int service_set_socket_fd(Service *s, int fd, Socket *sock, bool selinux_context_net) {
+int service_set_socket_fd(Service *s, int fd, Socket *sock, bool selinux_context_net, bool prefork) {
         _cleanup_free_ char *peer = NULL;
         int r;
 
@@ -3488,7 +3501,8 @@ int service_set_socket_fd(Service *s, int fd, Socket *sock, bool selinux_context
         if (s->state != SERVICE_DEAD)
                 return -EAGAIN;
 
-        if (getpeername_pretty(fd, true, &peer) >= 0) {
+        /* The peer of a prefork channel is PID 1 itself, which is not worth mentioning */
+        if (!prefork && getpeername_pretty(fd, true, &peer) >= 0) {
 
                 if (UNIT(s)->description) {
                         _cleanup_free_ char *a;
@@ -3511,6 +3525,7 @@ int service_set_socket_fd(Service *s, int fd, Socket *sock, bool selinux_context
 
         s->socket_fd = fd;
         s->socket_fd_selinux_context_net = selinux_context_net;
+        s->socket_fd_prefork = prefork;
 
         unit_ref_set(&s->accept_socket, UNIT(sock));
         return 0;
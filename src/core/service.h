@@ -149,6 +149,8 @@ struct Service {
         int socket_fd;
         SocketPeer *peer;
         bool socket_fd_selinux_context_net;
+        /* The socket fd is the dispatch channel of a prefork pool worker */
+        bool socket_fd_prefork;
 
         bool permissions_start_only;
         bool root_directory_start_only;
@@ -197,7 +199,7 @@ struct Service {
 
 extern const UnitVTable service_vtable;
 
-int service_set_socket_fd(Service *s, int fd, struct Socket *socket, bool selinux_context_net);
+int service_set_socket_fd(Service *s, int fd, struct Socket *socket, bool selinux_context_net, bool prefork);
 void service_close_socket_fd(Service *s);
 
 const char* service_restart_to_string(ServiceRestart i) _const_;
@@ -22,6 +22,7 @@
 #include "alloc-util.h"
 #include "dbus-slice.h"
 #include "log.h"
+#include "prioq.h"
 #include "slice.h"
 #include "special.h"
 #include "string-util.h"
@@ -41,6 +42,21 @@ static void slice_init(Unit *u) {
         u->ignore_on_isolate = true;
 }
 
+static void slice_done(Unit *u) {
+        Slice *t = SLICE(u);
+        Job *j;
+
+        assert(t);
+
+        /* Jobs waiting for a slot in here try again without us */
+        while ((j = prioq_peek(t->throttled_jobs))) {
+                job_unthrottle(j);
+                job_add_to_run_queue(j);
+        }
+
+        t->throttled_jobs = prioq_free(t->throttled_jobs);
+}
+
 static void slice_set_state(Slice *t, SliceState state) {
         SliceState old_state;
         assert(t);
@@ -207,6 +223,13 @@ static void slice_dump(Unit *u, FILE *f, const char *prefix) {
                 "%sSlice State: %s\n",
                 prefix, slice_state_to_string(t->state));
 
+        if (t->max_concurrent_start_jobs > 0)
+                fprintf(f,
+                        "%sMaxConcurrentStartJobs: %u\n"
+                        "%sRunning Start Jobs: %u\n",
+                        prefix, t->max_concurrent_start_jobs,
+                        prefix, t->n_running_start_jobs);
+
         cgroup_context_dump(&t->cgroup_context, f, prefix);
 }
 
@@ -326,6 +349,7 @@ const UnitVTable slice_vtable = {
         .can_transient = true,
 
         .init = slice_init,
+        .done = slice_done,
         .load = slice_load,
 
         .coldplug = slice_coldplug,
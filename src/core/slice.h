@@ -27,6 +27,12 @@ struct Slice {
         SliceState state, deserialized_state;
 
         CGroupContext cgroup_context;
+
+        /* Limits the start jobs running at the same time for units in
+         * this slice and below, 0 if unlimited */
+        unsigned max_concurrent_start_jobs;
+        unsigned n_running_start_jobs;
+        Prioq *throttled_jobs;
 };
 
 extern const UnitVTable slice_vtable;
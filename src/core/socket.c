@@ -83,6 +83,7 @@ static const UnitActiveState state_translation_table[_SOCKET_STATE_MAX] = {
 };
 
 static int socket_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata);
+static int socket_dispatch_prefork_io(sd_event_source *source, int fd, uint32_t revents, void *userdata);
 static int socket_dispatch_timer(sd_event_source *source, usec_t usec, void *userdata);
 
 static void socket_init(Unit *u) {
@@ -147,6 +148,30 @@ void socket_free_ports(Socket *s) {
         }
 }
 
+static SocketPreforkWorker *socket_prefork_worker_free(SocketPreforkWorker *w) {
+        if (!w)
+                return NULL;
+
+        if (w->socket)
+                LIST_REMOVE(prefork, w->socket->prefork_workers, w);
+
+        sd_event_source_unref(w->event_source);
+        safe_close(w->fd);
+        unit_ref_unset(&w->service);
+
+        return mfree(w);
+}
+
+static void socket_free_prefork_workers(Socket *s) {
+        assert(s);
+
+        /* Closing our end of the channels tells the workers to exit, after they finished serving the
+         * connection they are busy with, if any. */
+
+        while (s->prefork_workers)
+                socket_prefork_worker_free(s->prefork_workers);
+}
+
 static void socket_done(Unit *u) {
         Socket *s = SOCKET(u);
         SocketPeer *p;
@@ -154,6 +179,7 @@ static void socket_done(Unit *u) {
         assert(s);
 
         socket_free_ports(s);
+        socket_free_prefork_workers(s);
 
         while ((p = set_steal_first(s->peers_by_address)))
                 p->socket = NULL;
@@ -364,6 +390,11 @@ static int socket_add_extras(Socket *s) {
                         s->trigger_limit.burst = 20;
         }
 
+        if (s->prefork_max_spare < s->prefork_min_spare)
+                s->prefork_max_spare = s->prefork_min_spare;
+
+        RATELIMIT_INIT(s->prefork_limit, s->trigger_limit.interval, s->trigger_limit.burst);
+
         if (have_non_accept_socket(s)) {
 
                 if (!UNIT_DEREF(s->service)) {
@@ -463,6 +494,11 @@ static int socket_verify(Socket *s) {
                 return -EINVAL;
         }
 
+        if (!s->accept && s->prefork_min_spare > 0) {
+                log_unit_error(UNIT(s), "PreforkMinSpare= is only supported for accepting sockets. Refusing.");
+                return -EINVAL;
+        }
+
         if (s->accept && UNIT_DEREF(s->service)) {
                 log_unit_error(UNIT(s), "Explicit service configuration for accepting socket units not supported. Refusing.");
                 return -EINVAL;
@@ -717,6 +753,22 @@ static void socket_dump(Unit *u, FILE *f, const char *prefix) {
                         prefix, s->n_connections,
                         prefix, s->max_connections);
 
+        if (s->prefork_min_spare > 0) {
+                SocketPreforkWorker *w;
+
+                fprintf(f,
+                        "%sPreforkMinSpare: %u\n"
+                        "%sPreforkMaxSpare: %u\n",
+                        prefix, s->prefork_min_spare,
+                        prefix, s->prefork_max_spare);
+
+                LIST_FOREACH(prefork, w, s->prefork_workers)
+                        fprintf(f,
+                                "%sPreforkWorker: %s (%s, served %u)\n",
+                                prefix, UNIT_ISSET(w->service) ? UNIT_DEREF(w->service)->id : "n/a",
+                                socket_prefork_state_to_string(w->state), w->n_served);
+        }
+
         if (s->priority >= 0)
                 fprintf(f,
                         "%sPriority: %i\n",
@@ -1673,6 +1725,9 @@ static void socket_set_state(Socket *s, SocketState state) {
         if (state != SOCKET_LISTENING)
                 socket_unwatch_fds(s);
 
+        if (!IN_SET(state, SOCKET_LISTENING, SOCKET_RUNNING))
+                socket_free_prefork_workers(s);
+
         if (!IN_SET(state,
                     SOCKET_START_CHOWN,
                     SOCKET_START_POST,
@@ -2020,6 +2075,235 @@ fail:
         socket_enter_stop_post(s, SOCKET_FAILURE_RESOURCES);
 }
 
+static int socket_prefork_worker_new(Socket *s, Unit *service, int fd, SocketPreforkWorker **ret) {
+        SocketPreforkWorker *w;
+        int r;
+
+        assert(s);
+        assert(service);
+        assert(fd >= 0);
+
+        /* Takes possession of the fd on success only */
+
+        w = new0(SocketPreforkWorker, 1);
+        if (!w)
+                return -ENOMEM;
+
+        w->fd = -1;
+        w->state = SOCKET_PREFORK_STARTING;
+
+        r = sd_event_add_io(UNIT(s)->manager->event, &w->event_source, fd, EPOLLIN, socket_dispatch_prefork_io, w);
+        if (r < 0) {
+                socket_prefork_worker_free(w);
+                return r;
+        }
+
+        (void) sd_event_source_set_description(w->event_source, "socket-prefork");
+
+        w->fd = fd;
+        w->socket = s;
+        unit_ref_set(&w->service, service);
+        LIST_PREPEND(prefork, s->prefork_workers, w);
+
+        if (ret)
+                *ret = w;
+
+        return 0;
+}
+
+static int socket_prefork_spawn(Socket *s) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_free_ char *prefix = NULL, *name = NULL;
+        _cleanup_close_pair_ int pair[2] = { -1, -1 };
+        SocketPreforkWorker *w;
+        Unit *u;
+        int r;
+
+        assert(s);
+
+        /* Pool workers are instances of the same template as the per-connection services, but receive a
+         * SOCK_SEQPACKET channel instead of a connection. Whenever they are idle they write a datagram
+         * into it, and we reply with the next connection fd. */
+
+        r = unit_name_to_prefix(UNIT(s)->id, &prefix);
+        if (r < 0)
+                return r;
+
+        if (asprintf(&name, "%s@prefork-%u.service", prefix, s->n_prefork_spawned++) < 0)
+                return -ENOMEM;
+
+        r = manager_load_unit(UNIT(s)->manager, name, NULL, NULL, &u);
+        if (r < 0)
+                return r;
+
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC, 0, pair) < 0)
+                return -errno;
+
+        r = fd_nonblock(pair[0], true);
+        if (r < 0)
+                return r;
+
+        r = socket_prefork_worker_new(s, u, pair[0], &w);
+        if (r < 0)
+                return r;
+        pair[0] = -1;
+
+        r = service_set_socket_fd(SERVICE(u), pair[1], s, false, true);
+        if (r < 0) {
+                socket_prefork_worker_free(w);
+                return r;
+        }
+        pair[1] = -1;
+
+        /* Every worker holds a connection slot, so that MaxConnections= caps the pool too */
+        s->n_connections++;
+
+        r = manager_add_job(UNIT(s)->manager, JOB_START, u, JOB_REPLACE, &error, NULL);
+        if (r < 0) {
+                log_unit_warning(UNIT(s), "Failed to queue start job for prefork worker %s: %s", u->id, bus_error_message(&error, r));
+                service_close_socket_fd(SERVICE(u));
+                socket_prefork_worker_free(w);
+                return r;
+        }
+
+        log_unit_debug(UNIT(s), "Spawning prefork worker %s.", u->id);
+        return 0;
+}
+
+static void socket_prefork_adjust(Socket *s) {
+        SocketPreforkWorker *w;
+        unsigned n_spare = 0;
+        int r;
+
+        assert(s);
+
+        /* Tops up the pool until there are at least PreforkMinSpare= workers that are not busy */
+
+        if (s->prefork_min_spare <= 0)
+                return;
+
+        if (!IN_SET(s->state, SOCKET_LISTENING, SOCKET_RUNNING) || unit_stop_pending(UNIT(s)))
+                return;
+
+        LIST_FOREACH(prefork, w, s->prefork_workers)
+                if (w->state != SOCKET_PREFORK_BUSY)
+                        n_spare++;
+
+        for (; n_spare < s->prefork_min_spare; n_spare++) {
+
+                if (s->n_connections >= s->max_connections) {
+                        log_unit_debug(UNIT(s), "Connection limit reached, not spawning further prefork workers.");
+                        return;
+                }
+
+                /* Workers that die right away must not make us fork in a loop */
+                if (!ratelimit_test(&s->prefork_limit)) {
+                        log_unit_warning(UNIT(s), "Prefork limit hit, not spawning further prefork workers.");
+                        return;
+                }
+
+                r = socket_prefork_spawn(s);
+                if (r < 0) {
+                        log_unit_warning_errno(UNIT(s), r, "Failed to spawn prefork worker: %m");
+                        return;
+                }
+        }
+}
+
+static int socket_prefork_dispatch(Socket *s, int cfd) {
+        SocketPreforkWorker *w, *n;
+        int r;
+
+        assert(s);
+        assert(cfd >= 0);
+
+        /* Passes the connection to an idle worker. Returns > 0 and closes our copy of the fd if one took
+         * it, 0 if there is no idle worker. */
+
+        LIST_FOREACH_SAFE(prefork, w, n, s->prefork_workers) {
+                if (w->state != SOCKET_PREFORK_IDLE)
+                        continue;
+
+                r = send_one_fd(w->fd, cfd, MSG_DONTWAIT);
+                if (r < 0) {
+                        log_unit_debug_errno(UNIT(s), r, "Failed to pass connection to prefork worker, removing it from the pool: %m");
+                        socket_prefork_worker_free(w);
+                        continue;
+                }
+
+                w->state = SOCKET_PREFORK_BUSY;
+                w->n_served++;
+                s->n_accepted++;
+
+                safe_close(cfd);
+                return 1;
+        }
+
+        return 0;
+}
+
+static int socket_dispatch_prefork_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        SocketPreforkWorker *w = userdata, *i;
+        unsigned n_idle = 0;
+        bool ready = false;
+        Socket *s;
+
+        assert(w);
+        assert(w->socket);
+        assert(fd == w->fd);
+
+        s = w->socket;
+
+        /* Any non-empty datagram means the worker is idle. EOF means it went away. */
+
+        if (revents & EPOLLIN)
+                for (;;) {
+                        char buf[64];
+                        ssize_t l;
+
+                        l = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+                        if (l < 0) {
+                                if (errno == EINTR)
+                                        continue;
+                                if (errno == EAGAIN)
+                                        break;
+
+                                log_unit_debug_errno(UNIT(s), errno, "Failed to read from prefork channel: %m");
+                                goto gone;
+                        }
+                        if (l == 0)
+                                goto gone;
+
+                        ready = true;
+                }
+        else if (revents & (EPOLLHUP|EPOLLERR))
+                goto gone;
+
+        if (!ready || w->state == SOCKET_PREFORK_IDLE)
+                return 0;
+
+        w->state = SOCKET_PREFORK_IDLE;
+
+        LIST_FOREACH(prefork, i, s->prefork_workers)
+                if (i->state == SOCKET_PREFORK_IDLE)
+                        n_idle++;
+
+        if (n_idle > s->prefork_max_spare) {
+                log_unit_debug(UNIT(s), "More than %u idle prefork workers, retiring one.", s->prefork_max_spare);
+                socket_prefork_worker_free(w);
+        }
+
+        unit_add_to_dbus_queue(UNIT(s));
+        return 0;
+
+gone:
+        socket_prefork_worker_free(w);
+        socket_prefork_adjust(s);
+
+        unit_add_to_dbus_queue(UNIT(s));
+        return 0;
+}
+
 static void socket_enter_listening(Socket *s) {
         int r;
         assert(s);
@@ -2031,6 +2315,7 @@ static void socket_enter_listening(Socket *s) {
         }
 
         socket_set_state(s, SOCKET_LISTENING);
+        socket_prefork_adjust(s);
         return;
 
 fail:
@@ -2171,7 +2456,7 @@ static void socket_enter_running(Socket *s, int cfd) {
 
                 /* If there's already a start pending don't bother to
                  * do anything */
-                SET_FOREACH(other, UNIT(s)->dependencies[UNIT_TRIGGERS], i)
+                UNIT_FOREACH_DEPENDENCY(other, UNIT(s), UNIT_TRIGGERS, i)
                         if (unit_active_or_pending(other)) {
                                 pending = true;
                                 break;
@@ -2195,6 +2480,18 @@ static void socket_enter_running(Socket *s, int cfd) {
                 _cleanup_(socket_peer_unrefp) SocketPeer *p = NULL;
                 Service *service;
 
+                if (s->prefork_min_spare > 0) {
+                        r = socket_prefork_dispatch(s, cfd);
+                        socket_prefork_adjust(s);
+
+                        if (r > 0) {
+                                unit_add_to_dbus_queue(UNIT(s));
+                                return;
+                        }
+
+                        /* No idle worker, fall back to an instance for just this connection */
+                }
+
                 if (s->n_connections >= s->max_connections) {
                         log_unit_warning(UNIT(s), "Too many incoming connections (%u), dropping connection.",
                                          s->n_connections);
@@ -2254,7 +2551,7 @@ static void socket_enter_running(Socket *s, int cfd) {
                 s->n_accepted++;
                 unit_choose_id(UNIT(service), name);
 
-                r = service_set_socket_fd(service, cfd, s, s->selinux_context_from_net);
+                r = service_set_socket_fd(service, cfd, s, s->selinux_context_from_net, false);
                 if (r < 0)
                         goto fail;
 
@@ -2412,6 +2709,7 @@ static int socket_stop(Unit *u) {
 
 static int socket_serialize(Unit *u, FILE *f, FDSet *fds) {
         Socket *s = SOCKET(u);
+        SocketPreforkWorker *w;
         SocketPort *p;
         int r;
 
@@ -2463,6 +2761,23 @@ static int socket_serialize(Unit *u, FILE *f, FDSet *fds) {
                 }
         }
 
+        unit_serialize_item_format(u, f, "n-prefork-spawned", "%u", s->n_prefork_spawned);
+
+        LIST_FOREACH(prefork, w, s->prefork_workers) {
+                int copy;
+
+                if (!UNIT_ISSET(w->service))
+                        continue;
+
+                copy = fdset_put_dup(fds, w->fd);
+                if (copy < 0)
+                        return copy;
+
+                unit_serialize_item_format(u, f, "prefork-worker", "%i %s %u %s",
+                                           copy, socket_prefork_state_to_string(w->state), w->n_served,
+                                           UNIT_DEREF(w->service)->id);
+        }
+
         return 0;
 }
 
@@ -2601,6 +2916,44 @@ static int socket_deserialize_item(Unit *u, const char *key, const char *value,
                                         break;
                                 }
 
+        } else if (streq(key, "n-prefork-spawned")) {
+                unsigned k;
+
+                if (safe_atou(value, &k) < 0)
+                        log_unit_debug(u, "Failed to parse n-prefork-spawned value: %s", value);
+                else
+                        s->n_prefork_spawned = k;
+
+        } else if (streq(key, "prefork-worker")) {
+                SocketPreforkState state;
+                SocketPreforkWorker *w;
+                unsigned n_served;
+                char t[16];
+                int fd, skip = 0, r;
+                Unit *service;
+
+                if (sscanf(value, "%i %15s %u %n", &fd, t, &n_served, &skip) < 3 || fd < 0 || !fdset_contains(fds, fd))
+                        log_unit_debug(u, "Failed to parse prefork-worker value: %s", value);
+                else if ((state = socket_prefork_state_from_string(t)) < 0)
+                        log_unit_debug(u, "Failed to parse prefork-worker state: %s", t);
+                else {
+                        r = manager_load_unit(u->manager, value + skip, NULL, NULL, &service);
+                        if (r < 0)
+                                log_unit_debug_errno(u, r, "Failed to load prefork worker %s: %m", value + skip);
+                        else {
+                                fd = fdset_remove(fds, fd);
+
+                                r = socket_prefork_worker_new(s, service, fd, &w);
+                                if (r < 0) {
+                                        log_unit_debug_errno(u, r, "Failed to restore prefork worker %s: %m", service->id);
+                                        safe_close(fd);
+                                } else {
+                                        w->state = state;
+                                        w->n_served = n_served;
+                                }
+                        }
+                }
+
         } else
                 log_unit_debug(UNIT(s), "Unknown serialization key: %s", key);
 
@@ -3080,6 +3433,14 @@ static const char* const socket_result_table[_SOCKET_RESULT_MAX] = {
 
 DEFINE_STRING_TABLE_LOOKUP(socket_result, SocketResult);
 
+static const char* const socket_prefork_state_table[_SOCKET_PREFORK_STATE_MAX] = {
+        [SOCKET_PREFORK_STARTING] = "starting",
+        [SOCKET_PREFORK_IDLE] = "idle",
+        [SOCKET_PREFORK_BUSY] = "busy",
+};
+
+DEFINE_STRING_TABLE_LOOKUP(socket_prefork_state, SocketPreforkState);
+
 const UnitVTable socket_vtable = {
         .object_size = sizeof(Socket),
         .exec_context_offset = offsetof(Socket, exec_context),
@@ -75,6 +75,32 @@ typedef struct SocketPort {
         LIST_FIELDS(struct SocketPort, port);
 } SocketPort;
 
+typedef enum SocketPreforkState {
+        SOCKET_PREFORK_STARTING,
+        SOCKET_PREFORK_IDLE,
+        SOCKET_PREFORK_BUSY,
+        _SOCKET_PREFORK_STATE_MAX,
+        _SOCKET_PREFORK_STATE_INVALID = -1
+} SocketPreforkState;
+
+/* A pre-spawned instance of an Accept=yes service, which receives the
+ * connections over a SOCK_SEQPACKET channel whenever it reported to be
+ * idle. */
+typedef struct SocketPreforkWorker {
+        Socket *socket;
+
+        UnitRef service;
+        SocketPreforkState state;
+
+        /* Our end of the channel */
+        int fd;
+        sd_event_source *event_source;
+
+        unsigned n_served;
+
+        LIST_FIELDS(struct SocketPreforkWorker, prefork);
+} SocketPreforkWorker;
+
 struct Socket {
         Unit meta;
 
@@ -87,6 +113,16 @@ struct Socket {
         unsigned max_connections;
         unsigned max_connections_per_source;
 
+        /* Spare prefork workers to keep around, the pool is disabled if
+         * prefork_min_spare is zero */
+        unsigned prefork_min_spare;
+        unsigned prefork_max_spare;
+        unsigned n_prefork_spawned;
+        LIST_HEAD(SocketPreforkWorker, prefork_workers);
+        /* Refilling the pool has a budget of its own, so that it does not
+         * use up the one of trigger_limit */
+        RateLimit prefork_limit;
+
         unsigned backlog;
         unsigned keep_alive_cnt;
         usec_t timeout_usec;
@@ -195,3 +231,6 @@ const char* socket_result_to_string(SocketResult i) _const_;
 SocketResult socket_result_from_string(const char *s) _pure_;
 
 const char* socket_port_type_to_string(SocketPort *p) _pure_;
+
+const char* socket_prefork_state_to_string(SocketPreforkState i) _const_;
+SocketPreforkState socket_prefork_state_from_string(const char *s) _pure_;
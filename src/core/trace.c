@@ -0,0 +1,111 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include "alloc-util.h"
+#include "string-table.h"
+#include "string-util.h"
+#include "trace.h"
+
+TraceBuffer *trace_buffer_new(size_t size) {
+        TraceBuffer *t;
+
+        assert(size > 0);
+
+        t = new0(TraceBuffer, 1);
+        if (!t)
+                return NULL;
+
+        t->events = new0(TraceEvent, size);
+        if (!t->events)
+                return mfree(t);
+
+        t->size = size;
+
+        return t;
+}
+
+TraceBuffer *trace_buffer_free(TraceBuffer *t) {
+        size_t i;
+
+        if (!t)
+                return NULL;
+
+        for (i = 0; i < t->n_events; i++)
+                free(t->events[i].name);
+
+        free(t->events);
+        return mfree(t);
+}
+
+void trace_buffer_add(TraceBuffer *t, TracePhase phase, const char *name, nsec_t begin, nsec_t end) {
+        TraceEvent *e;
+
+        assert(t);
+        assert(phase >= 0);
+        assert(phase < _TRACE_PHASE_MAX);
+
+        e = t->events + t->next;
+
+        if (t->n_events < t->size)
+                t->n_events++;
+        else {
+                e->name = mfree(e->name);
+                t->n_dropped++;
+        }
+
+        t->next = (t->next + 1) % t->size;
+
+        /* If the name cannot be copied, the event still counts, just
+         * without the unit it belongs to */
+        *e = (TraceEvent) {
+                .phase = phase,
+                .name = name ? strdup(name) : NULL,
+                .begin = begin,
+                .end = MAX(begin, end),
+        };
+}
+
+const TraceEvent *trace_buffer_get(TraceBuffer *t, size_t i) {
+        if (!t || i >= t->n_events)
+                return NULL;
+
+        if (t->n_events < t->size)
+                return t->events + i;
+
+        return t->events + (t->next + i) % t->size;
+}
+
+void trace_end(TraceBuffer *t, TracePhase phase, const char *name, nsec_t begin) {
+        if (!t || begin == 0)
+                return;
+
+        trace_buffer_add(t, phase, name, begin, now_nsec(CLOCK_MONOTONIC));
+}
+
+static const char* const trace_phase_table[_TRACE_PHASE_MAX] = {
+        [TRACE_GENERATORS] = "generators",
+        [TRACE_GENERATOR] = "generator",
+        [TRACE_UNITS_LOAD] = "units-load",
+        [TRACE_UNIT_LOAD] = "unit-load",
+        [TRACE_TRANSACTION] = "transaction",
+        [TRACE_CGROUP_REALIZE] = "cgroup-realize",
+        [TRACE_SPAWN] = "spawn",
+        [TRACE_JOB_WAIT] = "job-wait",
+        [TRACE_JOB_RUN] = "job-run",
+};
+
+DEFINE_STRING_TABLE_LOOKUP(trace_phase, TracePhase);
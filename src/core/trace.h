@@ -0,0 +1,77 @@
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "macro.h"
+#include "time-util.h"
+
+/* A ring buffer of phases the service manager went through, with
+ * nanosecond timestamps, so that one can see where the time during
+ * boot went, on top of what the unit timestamps tell. Once full, the
+ * oldest events are overwritten. */
+
+typedef enum TracePhase {
+        TRACE_GENERATORS,
+        TRACE_GENERATOR,
+        TRACE_UNITS_LOAD,
+        TRACE_UNIT_LOAD,
+        TRACE_TRANSACTION,
+        TRACE_CGROUP_REALIZE,
+        TRACE_SPAWN,
+        TRACE_JOB_WAIT,
+        TRACE_JOB_RUN,
+        _TRACE_PHASE_MAX,
+        _TRACE_PHASE_INVALID = -1,
+} TracePhase;
+
+typedef struct TraceEvent {
+        TracePhase phase;
+        char *name;     /* The unit or generator, NULL for the manager itself */
+        nsec_t begin;
+        nsec_t end;
+} TraceEvent;
+
+typedef struct TraceBuffer {
+        TraceEvent *events;
+        size_t size;
+        size_t n_events;
+        size_t next;
+
+        uint64_t n_dropped;
+} TraceBuffer;
+
+TraceBuffer *trace_buffer_new(size_t size);
+TraceBuffer *trace_buffer_free(TraceBuffer *t);
+
+void trace_buffer_add(TraceBuffer *t, TracePhase phase, const char *name, nsec_t begin, nsec_t end);
+
+/* Returns the i-th oldest event, NULL past the last one or if t is NULL */
+const TraceEvent *trace_buffer_get(TraceBuffer *t, size_t i);
+
+/* Both are no-ops if tracing is off, i.e. t is NULL */
+static inline nsec_t trace_begin(TraceBuffer *t) {
+        return t ? now_nsec(CLOCK_MONOTONIC) : 0;
+}
+
+void trace_end(TraceBuffer *t, TracePhase phase, const char *name, nsec_t begin);
+
+const char* trace_phase_to_string(TracePhase i) _const_;
+TracePhase trace_phase_from_string(const char *s) _pure_;
@@ -61,29 +61,47 @@ void transaction_abort(Transaction *tr) {
         assert(hashmap_isempty(tr->jobs));
 }
 
-static void transaction_find_jobs_that_matter_to_anchor(Job *j, unsigned generation) {
+static int transaction_find_jobs_that_matter_to_anchor(Job *j, unsigned generation) {
+        _cleanup_free_ Job **stack = NULL;
+        size_t n_stack = 0, allocated = 0;
         JobDependency *l;
 
-        /* A recursive sweep through the graph that marks all units
-         * that matter to the anchor job, i.e. are directly or
-         * indirectly a dependency of the anchor job via paths that
-         * are fully marked as mattering. */
+        /* A sweep through the graph that marks all units that matter
+         * to the anchor job, i.e. are directly or indirectly a
+         * dependency of the anchor job via paths that are fully
+         * marked as mattering. Uses an explicit stack, since the
+         * dependency chains may be very long. */
 
         j->matters_to_anchor = true;
         j->generation = generation;
 
-        LIST_FOREACH(subject, l, j->subject_list) {
+        if (!GREEDY_REALLOC(stack, allocated, 1))
+                return -ENOMEM;
+        stack[n_stack++] = j;
 
-                /* This link does not matter */
-                if (!l->matters)
-                        continue;
+        while (n_stack > 0) {
+                j = stack[--n_stack];
 
-                /* This unit has already been marked */
-                if (l->object->generation == generation)
-                        continue;
+                LIST_FOREACH(subject, l, j->subject_list) {
+
+                        /* This link does not matter */
+                        if (!l->matters)
+                                continue;
+
+                        /* This unit has already been marked */
+                        if (l->object->generation == generation)
+                                continue;
 
-                transaction_find_jobs_that_matter_to_anchor(l->object, generation);
+                        l->object->matters_to_anchor = true;
+                        l->object->generation = generation;
+
+                        if (!GREEDY_REALLOC(stack, allocated, n_stack + 1))
+                                return -ENOMEM;
+                        stack[n_stack++] = l->object;
+                }
         }
+
+        return 0;
 }
 
 static void transaction_merge_and_delete_job(Transaction *tr, Job *j, Job *other, JobType t) {
@@ -305,8 +323,8 @@ static void transaction_drop_redundant(Transaction *tr) {
 
         assert(tr);
 
-rescan:
         HASHMAP_FOREACH(j, tr->jobs, i) {
+                Unit *u = j->unit;
                 Job *k;
 
                 LIST_FOREACH(transaction, k, j) {
@@ -317,9 +335,13 @@ rescan:
                                 goto next_unit;
                 }
 
+                /* Whether a job is redundant does not depend on the other jobs, and deleting them
+                 * without their dependencies touches no other hashmap entry than the current one,
+                 * hence there is no need to start over. */
+
                 /* log_debug("Found redundant job %s/%s, dropping.", j->unit->id, job_type_to_string(j->type)); */
-                transaction_delete_job(tr, j, false);
-                goto rescan;
+                while ((k = hashmap_get(tr->jobs, u)))
+                        transaction_delete_job(tr, k, false);
         next_unit:;
         }
 }
@@ -338,166 +360,215 @@ _pure_ static bool unit_matters_to_anchor(Unit *u, Job *j) {
         return false;
 }
 
-static int transaction_verify_order_one(Transaction *tr, Job *j, Job *from, unsigned generation, sd_bus_error *e) {
-        Iterator i;
-        Unit *u;
-        int r;
+static int transaction_break_cycle(Transaction *tr, Job *j, Job *from, unsigned generation, sd_bus_error *e) {
+        Job *k, *delete;
 
         assert(tr);
         assert(j);
-        assert(!j->transaction_prev);
-
-        /* Does a recursive sweep through the ordering graph, looking
-         * for a cycle. If we find a cycle we try to break it. */
+        assert(from);
 
-        /* Have we seen this before? */
-        if (j->generation == generation) {
-                Job *k, *delete;
+        /* We reached j again while it is still on our path, i.e. we
+         * have a cycle. Let's try to break it. We go backwards in our
+         * path and try to find a suitable job to remove. We use the
+         * marker to find our way back, since smart how we are we
+         * stored our way back in there. */
+        log_unit_warning(j->unit,
+                         "Found ordering cycle on %s/%s",
+                         j->unit->id, job_type_to_string(j->type));
 
-                /* If the marker is NULL we have been here already and
-                 * decided the job was loop-free from here. Hence
-                 * shortcut things and return right-away. */
-                if (!j->marker)
-                        return 0;
+        delete = NULL;
+        for (k = from; k; k = ((k->generation == generation && k->marker != k) ? k->marker : NULL)) {
 
-                /* So, the marker is not NULL and we already have been
-                 * here. We have a cycle. Let's try to break it. We go
-                 * backwards in our path and try to find a suitable
-                 * job to remove. We use the marker to find our way
-                 * back, since smart how we are we stored our way back
-                 * in there. */
+                /* logging for j not k here to provide consistent narrative */
                 log_unit_warning(j->unit,
-                                 "Found ordering cycle on %s/%s",
-                                 j->unit->id, job_type_to_string(j->type));
-
-                delete = NULL;
-                for (k = from; k; k = ((k->generation == generation && k->marker != k) ? k->marker : NULL)) {
-
-                        /* logging for j not k here to provide consistent narrative */
-                        log_unit_warning(j->unit,
-                                         "Found dependency on %s/%s",
-                                         k->unit->id, job_type_to_string(k->type));
-
-                        if (!delete && hashmap_get(tr->jobs, k->unit) && !unit_matters_to_anchor(k->unit, k))
-                                /* Ok, we can drop this one, so let's
-                                 * do so. */
-                                delete = k;
-
-                        /* Check if this in fact was the beginning of
-                         * the cycle */
-                        if (k == j)
-                                break;
-                }
-
-
-                if (delete) {
-                        const char *status;
-                        /* logging for j not k here to provide consistent narrative */
-                        log_unit_warning(j->unit,
-                                         "Breaking ordering cycle by deleting job %s/%s",
-                                         delete->unit->id, job_type_to_string(delete->type));
-                        log_unit_error(delete->unit,
-                                       "Job %s/%s deleted to break ordering cycle starting with %s/%s",
-                                       delete->unit->id, job_type_to_string(delete->type),
-                                       j->unit->id, job_type_to_string(j->type));
-
-                        if (log_get_show_color())
-                                status = ANSI_HIGHLIGHT_RED " SKIP " ANSI_NORMAL;
-                        else
-                                status = " SKIP ";
+                                 "Found dependency on %s/%s",
+                                 k->unit->id, job_type_to_string(k->type));
 
-                        unit_status_printf(delete->unit, status,
-                                           "Ordering cycle found, skipping %s");
-                        transaction_delete_unit(tr, delete->unit);
-                        return -EAGAIN;
-                }
-
-                log_error("Unable to break cycle");
+                if (!delete && hashmap_get(tr->jobs, k->unit) && !unit_matters_to_anchor(k->unit, k))
+                        /* Ok, we can drop this one, so let's
+                         * do so. */
+                        delete = k;
 
-                return sd_bus_error_setf(e, BUS_ERROR_TRANSACTION_ORDER_IS_CYCLIC,
-                                         "Transaction order is cyclic. See system logs for details.");
+                /* Check if this in fact was the beginning of
+                 * the cycle */
+                if (k == j)
+                        break;
         }
 
-        /* Make the marker point to where we come from, so that we can
-         * find our way backwards if we want to break a cycle. We use
-         * a special marker for the beginning: we point to
-         * ourselves. */
-        j->marker = from ? from : j;
-        j->generation = generation;
-
-        /* We assume that the dependencies are bidirectional, and
-         * hence can ignore UNIT_AFTER */
-        SET_FOREACH(u, j->unit->dependencies[UNIT_BEFORE], i) {
-                Job *o;
-
-                /* Is there a job for this unit? */
-                o = hashmap_get(tr->jobs, u);
-                if (!o) {
-                        /* Ok, there is no job for this in the
-                         * transaction, but maybe there is already one
-                         * running? */
-                        o = u->job;
-                        if (!o)
-                                continue;
-                }
 
-                r = transaction_verify_order_one(tr, o, j, generation, e);
-                if (r < 0)
-                        return r;
+        if (delete) {
+                const char *status;
+                /* logging for j not k here to provide consistent narrative */
+                log_unit_warning(j->unit,
+                                 "Breaking ordering cycle by deleting job %s/%s",
+                                 delete->unit->id, job_type_to_string(delete->type));
+                log_unit_error(delete->unit,
+                               "Job %s/%s deleted to break ordering cycle starting with %s/%s",
+                               delete->unit->id, job_type_to_string(delete->type),
+                               j->unit->id, job_type_to_string(j->type));
+
+                if (log_get_show_color())
+                        status = ANSI_HIGHLIGHT_RED " SKIP " ANSI_NORMAL;
+                else
+                        status = " SKIP ";
+
+                unit_status_printf(delete->unit, status,
+                                   "Ordering cycle found, skipping %s");
+                transaction_delete_unit(tr, delete->unit);
+                return -EAGAIN;
         }
 
-        /* Ok, let's backtrack, and remember that this entry is not on
-         * our path anymore. */
-        j->marker = NULL;
+        log_error("Unable to break cycle");
 
-        return 0;
+        return sd_bus_error_setf(e, BUS_ERROR_TRANSACTION_ORDER_IS_CYCLIC,
+                                 "Transaction order is cyclic. See system logs for details.");
 }
 
+typedef struct VerifyOrderFrame {
+        Job *job;
+        Iterator i;
+} VerifyOrderFrame;
+
 static int transaction_verify_order(Transaction *tr, unsigned *generation, sd_bus_error *e) {
-        Job *j;
-        int r;
+        _cleanup_free_ VerifyOrderFrame *stack = NULL;
+        size_t n_stack = 0, allocated = 0;
         Iterator i;
         unsigned g;
+        Job *j;
 
         assert(tr);
         assert(generation);
 
         /* Check if the ordering graph is cyclic. If it is, try to fix
-         * that up by dropping one of the jobs. */
+         * that up by dropping one of the jobs.
+         *
+         * This is a depth-first search with an explicit stack, visiting
+         * every job once per generation. The marker of each job on the
+         * current path points to where we came from, so that we can
+         * find our way backwards if we want to break a cycle. We use a
+         * special marker for the beginning: we point to ourselves. Jobs
+         * which are done have their marker reset to NULL, reaching
+         * them again is fine. */
 
         g = (*generation)++;
 
         HASHMAP_FOREACH(j, tr->jobs, i) {
-                r = transaction_verify_order_one(tr, j, NULL, g, e);
-                if (r < 0)
-                        return r;
+
+                if (j->generation == g)
+                        continue;
+
+                j->marker = j;
+                j->generation = g;
+
+                if (!GREEDY_REALLOC(stack, allocated, 1))
+                        return -ENOMEM;
+                stack[0] = (VerifyOrderFrame) { .job = j, .i = ITERATOR_FIRST };
+                n_stack = 1;
+
+                while (n_stack > 0) {
+                        VerifyOrderFrame *f = stack + n_stack - 1;
+                        Job *o;
+                        Unit *u;
+
+                        /* We assume that the dependencies are bidirectional, and
+                         * hence can ignore UNIT_AFTER */
+                        if (!unit_dependency_iterate(f->job->unit, UNIT_DEPENDENCY_MASK(UNIT_BEFORE), &f->i, &u)) {
+                                /* Ok, let's backtrack, and remember that this entry is not on
+                                 * our path anymore. */
+                                f->job->marker = NULL;
+                                n_stack--;
+                                continue;
+                        }
+
+                        /* Is there a job for this unit? */
+                        o = hashmap_get(tr->jobs, u);
+                        if (!o) {
+                                /* Ok, there is no job for this in the
+                                 * transaction, but maybe there is already one
+                                 * running? */
+                                o = u->job;
+                                if (!o)
+                                        continue;
+                        }
+
+                        if (o->generation == g) {
+                                /* If the marker is NULL we have been here already and
+                                 * decided the job was loop-free from here. */
+                                if (!o->marker)
+                                        continue;
+
+                                return transaction_break_cycle(tr, o, f->job, g, e);
+                        }
+
+                        o->marker = f->job;
+                        o->generation = g;
+
+                        if (!GREEDY_REALLOC(stack, allocated, n_stack + 1))
+                                return -ENOMEM;
+                        stack[n_stack++] = (VerifyOrderFrame) { .job = o, .i = ITERATOR_FIRST };
+                }
         }
 
         return 0;
 }
 
-static void transaction_collect_garbage(Transaction *tr) {
+static int transaction_collect_garbage(Transaction *tr) {
+        _cleanup_set_free_ Set *queue = NULL;
+        _cleanup_free_ Job **objects = NULL;
+        size_t allocated = 0;
         Iterator i;
-        Job *j;
+        Job *j, *k;
+        int r;
 
         assert(tr);
 
-        /* Drop jobs that are not required by any other job */
+        /* Drop jobs that are not required by any other job. Since such
+         * a job is required by nobody, deleting it deletes no other
+         * job, but may leave the jobs it required without any
+         * requirement in turn. Hence we queue those up instead of
+         * rescanning the whole transaction after each deletion. */
 
-rescan:
-        HASHMAP_FOREACH(j, tr->jobs, i) {
-                if (tr->anchor_job == j || j->object_list) {
-                        /* log_debug("Keeping job %s/%s because of %s/%s", */
-                        /*           j->unit->id, job_type_to_string(j->type), */
-                        /*           j->object_list->subject ? j->object_list->subject->unit->id : "root", */
-                        /*           j->object_list->subject ? job_type_to_string(j->object_list->subject->type) : "root"); */
-                        continue;
+        queue = set_new(NULL);
+        if (!queue)
+                return -ENOMEM;
+
+        HASHMAP_FOREACH(j, tr->jobs, i)
+                LIST_FOREACH(transaction, k, j) {
+                        if (tr->anchor_job == k || k->object_list)
+                                continue;
+
+                        r = set_put(queue, k);
+                        if (r < 0)
+                                return r;
+                }
+
+        while ((j = set_steal_first(queue))) {
+                JobDependency *l;
+                size_t n = 0, m;
+
+                assert(!j->object_list);
+
+                LIST_FOREACH(subject, l, j->subject_list) {
+                        if (!GREEDY_REALLOC(objects, allocated, n + 1))
+                                return -ENOMEM;
+
+                        objects[n++] = l->object;
                 }
 
                 /* log_debug("Garbage collecting job %s/%s", j->unit->id, job_type_to_string(j->type)); */
                 transaction_delete_job(tr, j, true);
-                goto rescan;
+
+                for (m = 0; m < n; m++) {
+                        if (tr->anchor_job == objects[m] || objects[m]->object_list)
+                                continue;
+
+                        r = set_put(queue, objects[m]);
+                        if (r < 0)
+                                return r;
+                }
         }
+
+        return 0;
 }
 
 static int transaction_is_destructive(Transaction *tr, JobMode mode, sd_bus_error *e) {
@@ -664,7 +735,9 @@ int transaction_activate(Transaction *tr, Manager *m, JobMode mode, sd_bus_error
                 j->generation = 0;
 
         /* First step: figure out which jobs matter */
-        transaction_find_jobs_that_matter_to_anchor(tr->anchor_job, generation++);
+        r = transaction_find_jobs_that_matter_to_anchor(tr->anchor_job, generation++);
+        if (r < 0)
+                return r;
 
         /* Second step: Try not to stop any running services if
          * we don't have to. Don't try to reverse running
@@ -678,8 +751,11 @@ int transaction_activate(Transaction *tr, Manager *m, JobMode mode, sd_bus_error
         for (;;) {
                 /* Fourth step: Let's remove unneeded jobs that might
                  * be lurking. */
-                if (mode != JOB_ISOLATE)
-                        transaction_collect_garbage(tr);
+                if (mode != JOB_ISOLATE) {
+                        r = transaction_collect_garbage(tr);
+                        if (r < 0)
+                                return r;
+                }
 
                 /* Fifth step: verify order makes sense and correct
                  * cycles if necessary and possible */
@@ -711,8 +787,11 @@ int transaction_activate(Transaction *tr, Manager *m, JobMode mode, sd_bus_error
 
                 /* Seventh step: an entry got dropped, let's garbage
                  * collect its dependencies. */
-                if (mode != JOB_ISOLATE)
-                        transaction_collect_garbage(tr);
+                if (mode != JOB_ISOLATE) {
+                        r = transaction_collect_garbage(tr);
+                        if (r < 0)
+                                return r;
+                }
 
                 /* Let's see if the resulting transaction still has
                  * unmergeable entries ... */
@@ -833,26 +912,51 @@ static void transaction_unlink_job(Transaction *tr, Job *j, bool delete_dependen
         }
 }
 
-int transaction_add_job_and_dependencies(
+/* How to deal with a job that could not be pulled in */
+typedef enum PullFailure {
+        PULL_FAILURE_FATAL,       /* fail the pulling job, unless the job type is not applicable */
+        PULL_FAILURE_FOLLOWING,   /* ignore, for units we follow */
+        PULL_FAILURE_WANTED,      /* ignore, quietly for units that are masked or not found */
+        PULL_FAILURE_IGNORE,
+        PULL_FAILURE_IGNORE_RELOAD,
+} PullFailure;
+
+typedef struct JobPull {
+        JobType type;
+        Unit *unit;
+        bool matters;
+        bool conflicts;
+        PullFailure failure;
+} JobPull;
+
+typedef struct JobPullFrame {
+        Job *job;
+        const JobPull *pulled_by; /* NULL for the first job */
+        JobPull *pulls;
+        size_t n_pulls, next;
+} JobPullFrame;
+
+static int transaction_add_pulled_job(
                 Transaction *tr,
                 JobType type,
                 Unit *unit,
                 Job *by,
                 bool matters,
                 bool conflicts,
-                bool ignore_requirements,
                 bool ignore_order,
-                sd_bus_error *e) {
-        Job *ret;
-        Iterator i;
-        Unit *dep;
+                sd_bus_error *e,
+                Job **ret,
+                bool *ret_new) {
+
+        Job *j;
         int r;
-        bool is_new;
 
         assert(tr);
         assert(type < _JOB_TYPE_MAX);
         assert(type < _JOB_TYPE_MAX_IN_TRANSACTION);
         assert(unit);
+        assert(ret);
+        assert(ret_new);
 
         /* Before adding jobs for this unit, let's ensure that its state has been loaded
          * This matters when jobs are spawned as part of coldplugging itself (see e. g. path_coldplug()).
@@ -882,167 +986,319 @@ int transaction_add_job_and_dependencies(
 
 
         /* First add the job. */
-        ret = transaction_add_one_job(tr, type, unit, &is_new);
-        if (!ret)
+        j = transaction_add_one_job(tr, type, unit, ret_new);
+        if (!j)
                 return -ENOMEM;
 
-        ret->ignore_order = ret->ignore_order || ignore_order;
+        j->ignore_order = j->ignore_order || ignore_order;
 
         /* Then, add a link to the job. */
         if (by) {
-                if (!job_dependency_new(by, ret, matters, conflicts))
+                if (!job_dependency_new(by, j, matters, conflicts))
                         return -ENOMEM;
         } else {
                 /* If the job has no parent job, it is the anchor job. */
                 assert(!tr->anchor_job);
-                tr->anchor_job = ret;
+                tr->anchor_job = j;
         }
 
-        if (is_new && !ignore_requirements && type != JOB_NOP) {
+        *ret = j;
+        return 0;
+}
+
+static int pull_add(
+                JobPull **pulls,
+                size_t *n,
+                size_t *allocated,
+                JobType type,
+                Unit *unit,
+                bool matters,
+                bool conflicts,
+                PullFailure failure) {
+
+        if (!GREEDY_REALLOC(*pulls, *allocated, *n + 1))
+                return -ENOMEM;
+
+        (*pulls)[(*n)++] = (JobPull) {
+                .type = type,
+                .unit = unit,
+                .matters = matters,
+                .conflicts = conflicts,
+                .failure = failure,
+        };
+
+        return 0;
+}
+
+static int job_collect_pulls(Job *j, JobPull **ret, size_t *ret_n) {
+        _cleanup_free_ JobPull *pulls = NULL;
+        size_t n = 0, allocated = 0;
+        Iterator i;
+        Unit *dep;
+        int r;
+
+        assert(j);
+        assert(ret);
+        assert(ret_n);
+
+        /* Determines the jobs a new job pulls in, in the order they
+         * are to be added */
+
+        if (j->type != JOB_NOP) {
                 Set *following;
 
                 /* If we are following some other unit, make sure we
                  * add all dependencies of everybody following. */
-                if (unit_following_set(ret->unit, &following) > 0) {
+                if (unit_following_set(j->unit, &following) > 0) {
                         SET_FOREACH(dep, following, i) {
-                                r = transaction_add_job_and_dependencies(tr, type, dep, ret, false, false, false, ignore_order, e);
+                                r = pull_add(&pulls, &n, &allocated, j->type, dep, false, false, PULL_FAILURE_FOLLOWING);
                                 if (r < 0) {
-                                        log_unit_full(dep,
-                                                      r == -ERFKILL ? LOG_INFO : LOG_WARNING,
-                                                      r, "Cannot add dependency job, ignoring: %s",
-                                                      bus_error_message(e, r));
-                                        sd_bus_error_free(e);
+                                        set_free(following);
+                                        return r;
                                 }
                         }
 
                         set_free(following);
                 }
+        }
 
-                /* Finally, recursively add in all dependencies. */
-                if (type == JOB_START || type == JOB_RESTART) {
-                        SET_FOREACH(dep, ret->unit->dependencies[UNIT_REQUIRES], i) {
-                                r = transaction_add_job_and_dependencies(tr, JOB_START, dep, ret, true, false, false, ignore_order, e);
-                                if (r < 0) {
-                                        if (r != -EBADR) /* job type not applicable */
-                                                goto fail;
-
-                                        sd_bus_error_free(e);
-                                }
+        if (IN_SET(j->type, JOB_START, JOB_RESTART)) {
+                static const struct {
+                        UnitDependency dependency;
+                        JobType type;
+                        bool matters;
+                        bool conflicts;
+                        PullFailure failure;
+                } start_deps[] = {
+                        { UNIT_REQUIRES,      JOB_START,         true,  false, PULL_FAILURE_FATAL  },
+                        { UNIT_BINDS_TO,      JOB_START,         true,  false, PULL_FAILURE_FATAL  },
+                        { UNIT_WANTS,         JOB_START,         false, false, PULL_FAILURE_WANTED },
+                        { UNIT_REQUISITE,     JOB_VERIFY_ACTIVE, true,  false, PULL_FAILURE_FATAL  },
+                        { UNIT_CONFLICTS,     JOB_STOP,          true,  true,  PULL_FAILURE_FATAL  },
+                        { UNIT_CONFLICTED_BY, JOB_STOP,          false, false, PULL_FAILURE_IGNORE },
+                };
+
+                unsigned k;
+
+                for (k = 0; k < ELEMENTSOF(start_deps); k++)
+                        UNIT_FOREACH_DEPENDENCY(dep, j->unit, start_deps[k].dependency, i) {
+                                r = pull_add(&pulls, &n, &allocated, start_deps[k].type, dep,
+                                             start_deps[k].matters, start_deps[k].conflicts, start_deps[k].failure);
+                                if (r < 0)
+                                        return r;
                         }
+        }
 
-                        SET_FOREACH(dep, ret->unit->dependencies[UNIT_BINDS_TO], i) {
-                                r = transaction_add_job_and_dependencies(tr, JOB_START, dep, ret, true, false, false, ignore_order, e);
-                                if (r < 0) {
-                                        if (r != -EBADR) /* job type not applicable */
-                                                goto fail;
+        if (IN_SET(j->type, JOB_STOP, JOB_RESTART)) {
+                static const UnitDependency propagate_deps[] = {
+                        UNIT_REQUIRED_BY,
+                        UNIT_REQUISITE_OF,
+                        UNIT_BOUND_BY,
+                        UNIT_CONSISTS_OF,
+                };
 
-                                        sd_bus_error_free(e);
-                                }
-                        }
+                JobType ptype;
+                unsigned k;
 
-                        SET_FOREACH(dep, ret->unit->dependencies[UNIT_WANTS], i) {
-                                r = transaction_add_job_and_dependencies(tr, JOB_START, dep, ret, false, false, false, ignore_order, e);
-                                if (r < 0) {
-                                        /* unit masked, job type not applicable and unit not found are not considered as errors. */
-                                        log_unit_full(dep,
-                                                      IN_SET(r, -ERFKILL, -EBADR, -ENOENT) ? LOG_DEBUG : LOG_WARNING,
-                                                      r, "Cannot add dependency job, ignoring: %s",
-                                                      bus_error_message(e, r));
-                                        sd_bus_error_free(e);
-                                }
-                        }
+                /* We propagate STOP as STOP, but RESTART only
+                 * as TRY_RESTART, in order not to start
+                 * dependencies that are not around. */
+                ptype = j->type == JOB_RESTART ? JOB_TRY_RESTART : j->type;
 
-                        SET_FOREACH(dep, ret->unit->dependencies[UNIT_REQUISITE], i) {
-                                r = transaction_add_job_and_dependencies(tr, JOB_VERIFY_ACTIVE, dep, ret, true, false, false, ignore_order, e);
-                                if (r < 0) {
-                                        if (r != -EBADR) /* job type not applicable */
-                                                goto fail;
+                for (k = 0; k < ELEMENTSOF(propagate_deps); k++)
+                        UNIT_FOREACH_DEPENDENCY(dep, j->unit, propagate_deps[k], i) {
+                                JobType nt;
 
-                                        sd_bus_error_free(e);
-                                }
+                                nt = job_type_collapse(ptype, dep);
+                                if (nt == JOB_NOP)
+                                        continue;
+
+                                r = pull_add(&pulls, &n, &allocated, nt, dep, true, false, PULL_FAILURE_FATAL);
+                                if (r < 0)
+                                        return r;
                         }
+        }
 
-                        SET_FOREACH(dep, ret->unit->dependencies[UNIT_CONFLICTS], i) {
-                                r = transaction_add_job_and_dependencies(tr, JOB_STOP, dep, ret, true, true, false, ignore_order, e);
-                                if (r < 0) {
-                                        if (r != -EBADR) /* job type not applicable */
-                                                goto fail;
+        if (j->type == JOB_RELOAD) {
 
-                                        sd_bus_error_free(e);
-                                }
-                        }
+                UNIT_FOREACH_DEPENDENCY(dep, j->unit, UNIT_PROPAGATES_RELOAD_TO, i) {
+                        JobType nt;
 
-                        SET_FOREACH(dep, ret->unit->dependencies[UNIT_CONFLICTED_BY], i) {
-                                r = transaction_add_job_and_dependencies(tr, JOB_STOP, dep, ret, false, false, false, ignore_order, e);
-                                if (r < 0) {
-                                        log_unit_warning(dep,
-                                                         "Cannot add dependency job, ignoring: %s",
-                                                         bus_error_message(e, r));
-                                        sd_bus_error_free(e);
-                                }
-                        }
+                        nt = job_type_collapse(JOB_TRY_RELOAD, dep);
+                        if (nt == JOB_NOP)
+                                continue;
 
+                        r = pull_add(&pulls, &n, &allocated, nt, dep, false, false, PULL_FAILURE_IGNORE_RELOAD);
+                        if (r < 0)
+                                return r;
                 }
+        }
 
-                if (type == JOB_STOP || type == JOB_RESTART) {
-                        static const UnitDependency propagate_deps[] = {
-                                UNIT_REQUIRED_BY,
-                                UNIT_REQUISITE_OF,
-                                UNIT_BOUND_BY,
-                                UNIT_CONSISTS_OF,
-                        };
-
-                        JobType ptype;
-                        unsigned j;
-
-                        /* We propagate STOP as STOP, but RESTART only
-                         * as TRY_RESTART, in order not to start
-                         * dependencies that are not around. */
-                        ptype = type == JOB_RESTART ? JOB_TRY_RESTART : type;
-
-                        for (j = 0; j < ELEMENTSOF(propagate_deps); j++)
-                                SET_FOREACH(dep, ret->unit->dependencies[propagate_deps[j]], i) {
-                                        JobType nt;
-
-                                        nt = job_type_collapse(ptype, dep);
-                                        if (nt == JOB_NOP)
-                                                continue;
-
-                                        r = transaction_add_job_and_dependencies(tr, nt, dep, ret, true, false, false, ignore_order, e);
-                                        if (r < 0) {
-                                                if (r != -EBADR) /* job type not applicable */
-                                                        goto fail;
-
-                                                sd_bus_error_free(e);
-                                        }
-                                }
-                }
+        /* JOB_VERIFY_STARTED require no dependency handling */
 
-                if (type == JOB_RELOAD) {
+        *ret = pulls;
+        *ret_n = n;
+        pulls = NULL;
 
-                        SET_FOREACH(dep, ret->unit->dependencies[UNIT_PROPAGATES_RELOAD_TO], i) {
-                                JobType nt;
+        return 0;
+}
 
-                                nt = job_type_collapse(JOB_TRY_RELOAD, dep);
-                                if (nt == JOB_NOP)
-                                        continue;
+static bool job_pull_failure_ignorable(const JobPull *p, int r, sd_bus_error *e) {
+        assert(p);
+
+        /* Returns false if failing to pull in the job fails the job
+         * that pulled it in as well, otherwise logs and forgets about
+         * the error */
+
+        switch (p->failure) {
+
+        case PULL_FAILURE_FATAL:
+                if (r != -EBADR) /* job type not applicable */
+                        return false;
+                break;
+
+        case PULL_FAILURE_FOLLOWING:
+                log_unit_full(p->unit,
+                              r == -ERFKILL ? LOG_INFO : LOG_WARNING,
+                              r, "Cannot add dependency job, ignoring: %s",
+                              bus_error_message(e, r));
+                break;
+
+        case PULL_FAILURE_WANTED:
+                /* unit masked, job type not applicable and unit not found are not considered as errors. */
+                log_unit_full(p->unit,
+                              IN_SET(r, -ERFKILL, -EBADR, -ENOENT) ? LOG_DEBUG : LOG_WARNING,
+                              r, "Cannot add dependency job, ignoring: %s",
+                              bus_error_message(e, r));
+                break;
+
+        case PULL_FAILURE_IGNORE:
+                log_unit_warning(p->unit,
+                                 "Cannot add dependency job, ignoring: %s",
+                                 bus_error_message(e, r));
+                break;
+
+        case PULL_FAILURE_IGNORE_RELOAD:
+                log_unit_warning(p->unit,
+                                 "Cannot add dependency reload job, ignoring: %s",
+                                 bus_error_message(e, r));
+                break;
+        }
 
-                                r = transaction_add_job_and_dependencies(tr, nt, dep, ret, false, false, false, ignore_order, e);
-                                if (r < 0) {
-                                        log_unit_warning(dep,
-                                                         "Cannot add dependency reload job, ignoring: %s",
-                                                         bus_error_message(e, r));
-                                        sd_bus_error_free(e);
-                                }
+        sd_bus_error_free(e);
+        return true;
+}
+
+static int job_pull_frame_push(JobPullFrame **stack, size_t *n_stack, size_t *allocated, Job *j, const JobPull *pulled_by) {
+        JobPull *pulls;
+        size_t n;
+        int r;
+
+        r = job_collect_pulls(j, &pulls, &n);
+        if (r < 0)
+                return r;
+
+        if (n == 0)
+                return 0;
+
+        if (!GREEDY_REALLOC(*stack, *allocated, *n_stack + 1)) {
+                free(pulls);
+                return -ENOMEM;
+        }
+
+        (*stack)[(*n_stack)++] = (JobPullFrame) {
+                .job = j,
+                .pulled_by = pulled_by,
+                .pulls = pulls,
+                .n_pulls = n,
+        };
+
+        return 0;
+}
+
+int transaction_add_job_and_dependencies(
+                Transaction *tr,
+                JobType type,
+                Unit *unit,
+                Job *by,
+                bool matters,
+                bool conflicts,
+                bool ignore_requirements,
+                bool ignore_order,
+                sd_bus_error *e) {
+
+        JobPullFrame *stack = NULL;
+        size_t n_stack = 0, allocated = 0;
+        bool is_new;
+        Job *ret;
+        int r;
+
+        assert(tr);
+        assert(unit);
+
+        r = transaction_add_pulled_job(tr, type, unit, by, matters, conflicts, ignore_order, e, &ret, &is_new);
+        if (r < 0)
+                return r;
+
+        if (!is_new || ignore_requirements)
+                return 0;
+
+        /* Now add in all dependencies, and theirs in turn. This is a
+         * depth-first walk with an explicit stack, in the same order
+         * as the recursion it replaces, so that deep dependency chains
+         * can't exhaust our stack. A job that can't be pulled in fails
+         * the job that pulled it in, unless that may do without it,
+         * and so on up to the first job. */
+
+        r = job_pull_frame_push(&stack, &n_stack, &allocated, ret, NULL);
+        if (r < 0)
+                goto finish;
+
+        while (n_stack > 0) {
+                JobPullFrame *f = stack + n_stack - 1;
+                const JobPull *p;
+                Job *j;
+
+                if (f->next >= f->n_pulls) {
+                        free(f->pulls);
+                        n_stack--;
+                        continue;
+                }
+
+                p = f->pulls + f->next++;
+
+                r = transaction_add_pulled_job(tr, p->type, p->unit, f->job, p->matters, p->conflicts, ignore_order, e, &j, &is_new);
+                if (r >= 0) {
+                        if (is_new) {
+                                r = job_pull_frame_push(&stack, &n_stack, &allocated, j, p);
+                                if (r < 0)
+                                        goto finish;
                         }
+
+                        continue;
                 }
 
-                /* JOB_VERIFY_STARTED require no dependency handling */
+                while (!job_pull_failure_ignorable(p, r, e)) {
+                        /* The job this frame is about fails, and so
+                         * might the one that pulled it in */
+                        p = f->pulled_by;
+                        free(f->pulls);
+                        n_stack--;
+
+                        if (n_stack == 0)
+                                goto finish;
+
+                        f = stack + n_stack - 1;
+                }
         }
 
-        return 0;
+        r = 0;
+
+finish:
+        while (n_stack > 0)
+                free(stack[--n_stack].pulls);
+        free(stack);
 
-fail:
         return r;
 }
 
@@ -30,6 +30,7 @@
 #include "bus-common-errors.h"
 #include "bus-util.h"
 #include "cgroup-util.h"
+#include "conf-parser.h"
 #include "dbus-unit.h"
 #include "dbus.h"
 #include "dropin.h"
@@ -42,11 +43,13 @@
 #include "load-fragment.h"
 #include "log.h"
 #include "macro.h"
+#include "manager-snapshot.h"
 #include "missing.h"
 #include "mkdir.h"
 #include "parse-util.h"
 #include "path-util.h"
 #include "process-util.h"
+#include "serialize.h"
 #include "set.h"
 #include "signal-util.h"
 #include "special.h"
@@ -78,6 +81,7 @@ const UnitVTable * const unit_vtable[_UNIT_TYPE_MAX] = {
 static void maybe_warn_about_dependency(Unit *u, const char *other, UnitDependency dependency);
 
 Unit *unit_new(Manager *m, size_t size) {
+        CGroupMetric i;
         Unit *u;
 
         assert(m);
@@ -98,6 +102,8 @@ Unit *unit_new(Manager *m, size_t size) {
         u->unit_file_preset = -1;
         u->on_failure_job_mode = JOB_REPLACE;
         u->cgroup_inotify_wd = -1;
+        for (i = 0; i < _CGROUP_METRIC_MAX; i++)
+                u->cgroup_metric_fd[i] = -1;
         u->job_timeout = USEC_INFINITY;
         u->job_running_timeout = USEC_INFINITY;
         u->ref_uid = UID_INVALID;
@@ -398,7 +404,12 @@ void unit_add_to_dbus_queue(Unit *u) {
         assert(u);
         assert(u->type != _UNIT_TYPE_INVALID);
 
-        if (u->load_state == UNIT_STUB || u->in_dbus_queue)
+        if (u->load_state == UNIT_STUB)
+                return;
+
+        u->state_generation = ++u->manager->units_generation;
+
+        if (u->in_dbus_queue)
                 return;
 
         /* Shortcut things if nobody cares */
@@ -413,25 +424,36 @@ void unit_add_to_dbus_queue(Unit *u) {
         u->in_dbus_queue = true;
 }
 
-static void bidi_set_free(Unit *u, Set *s) {
+static void unit_remove_dependency_records(Unit *u, Unit *other) {
+        size_t i, j = 0;
+
+        assert(u);
+
+        for (i = 0; i < u->n_dependency_records; i++)
+                if (u->dependency_records[i].other != other)
+                        u->dependency_records[j++] = u->dependency_records[i];
+
+        u->n_dependency_records = j;
+}
+
+static void unit_free_dependencies(Unit *u) {
         Iterator i;
         Unit *other;
+        void *v;
 
         assert(u);
 
-        /* Frees the set and makes sure we are dropped from the
-         * inverse pointers */
+        /* Frees the dependency table and makes sure we are dropped
+         * from the inverse pointers */
 
-        SET_FOREACH(other, s, i) {
-                UnitDependency d;
-
-                for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
-                        set_remove(other->dependencies[d], u);
+        HASHMAP_FOREACH_KEY(v, other, u->dependencies, i) {
+                hashmap_remove(other->dependencies, u);
 
+                unit_remove_dependency_records(other, u);
                 unit_add_to_gc_queue(other);
         }
 
-        set_free(s);
+        u->dependencies = hashmap_free(u->dependencies);
 }
 
 static void unit_remove_transient(Unit *u) {
@@ -514,7 +536,6 @@ static void unit_done(Unit *u) {
 }
 
 void unit_free(Unit *u) {
-        UnitDependency d;
         Iterator i;
         char *t;
 
@@ -527,7 +548,14 @@ void unit_free(Unit *u) {
         if (!MANAGER_IS_RELOADING(u->manager))
                 unit_remove_transient(u);
 
-        bus_unit_send_removed_signal(u);
+        if (u->replaced)
+                /* As far as clients are concerned, the unit never
+                 * goes away, its replacement announces the changes */
+                bus_unit_forget_change_signal(u);
+        else {
+                bus_unit_send_removed_signal(u);
+                manager_record_unit_removal(u->manager, u);
+        }
 
         unit_done(u);
 
@@ -556,8 +584,7 @@ void unit_free(Unit *u) {
                 job_free(j);
         }
 
-        for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
-                bidi_set_free(u, u->dependencies[d]);
+        unit_free_dependencies(u);
 
         if (u->type != _UNIT_TYPE_INVALID)
                 LIST_REMOVE(units_by_type, u->manager->units_by_type[u->type], u);
@@ -577,6 +604,9 @@ void unit_free(Unit *u) {
         if (u->in_cgroup_queue)
                 LIST_REMOVE(cgroup_queue, u->manager->cgroup_queue, u);
 
+        if (u->in_cgroup_empty_queue)
+                LIST_REMOVE(cgroup_empty_queue, u->manager->cgroup_empty_queue, u);
+
         unit_release_cgroup(u);
 
         unit_unref_uid_gid(u, false);
@@ -599,6 +629,8 @@ void unit_free(Unit *u) {
         free(u->fragment_path);
         free(u->source_path);
         strv_free(u->dropin_paths);
+        strv_free(u->dropin_dependency_paths);
+        free(u->dependency_records);
         free(u->instance);
 
         free(u->job_timeout_reboot_arg);
@@ -672,68 +704,116 @@ static int merge_names(Unit *u, Unit *other) {
         return 0;
 }
 
-static int reserve_dependencies(Unit *u, Unit *other, UnitDependency d) {
-        unsigned n_reserve;
-
+static int reserve_dependencies(Unit *u, Unit *other) {
         assert(u);
         assert(other);
-        assert(d < _UNIT_DEPENDENCY_MAX);
 
         /*
-         * If u does not have this dependency set allocated, there is no need
-         * to reserve anything. In that case other's set will be transferred
-         * as a whole to u by complete_move().
+         * If u does not have a dependency table allocated, there is no
+         * need to reserve anything. In that case other's table will be
+         * transferred as a whole to u by merge_dependencies().
          */
-        if (!u->dependencies[d])
+        if (!u->dependencies)
                 return 0;
 
-        /* merge_dependencies() will skip a u-on-u dependency */
-        n_reserve = set_size(other->dependencies[d]) - !!set_get(other->dependencies[d], u);
+        return hashmap_reserve(u->dependencies, hashmap_size(other->dependencies));
+}
 
-        return set_reserve(u->dependencies[d], n_reserve);
+static void merge_dependency_records(Unit *u, Unit *other) {
+        Iterator i;
+        Unit *back;
+        size_t k;
+        void *v;
+
+        assert(u);
+        assert(other);
+
+        /* Records of other units about dependencies on the merged unit
+         * now refer to us, and its own records become ours, except for
+         * those about dependencies between the two of us, which
+         * merge_dependencies() drops. */
+
+        HASHMAP_FOREACH_KEY(v, back, other->dependencies, i)
+                for (k = 0; k < back->n_dependency_records; k++)
+                        if (back->dependency_records[k].other == other)
+                                back->dependency_records[k].other = u;
+
+        unit_remove_dependency_records(u, u);
+
+        for (k = 0; k < other->n_dependency_records; k++)
+                if (other->dependency_records[k].other != u)
+                        u->dependency_records[u->n_dependency_records++] = other->dependency_records[k];
+
+        other->dependency_records = mfree(other->dependency_records);
+        other->n_dependency_records = other->n_dependency_records_allocated = 0;
+}
+
+static void warn_about_dependency_mask(Unit *u, const char *other_id, UnitDependencyMask mask) {
+        UnitDependency d;
+
+        for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
+                if (mask & UNIT_DEPENDENCY_MASK(d))
+                        maybe_warn_about_dependency(u, other_id, d);
 }
 
-static void merge_dependencies(Unit *u, Unit *other, const char *other_id, UnitDependency d) {
+static void merge_dependencies(Unit *u, Unit *other, const char *other_id) {
+        UnitDependencyMask mask;
         Iterator i;
         Unit *back;
+        void *v;
         int r;
 
         assert(u);
         assert(other);
-        assert(d < _UNIT_DEPENDENCY_MAX);
 
         /* Fix backwards pointers */
-        SET_FOREACH(back, other->dependencies[d], i) {
-                UnitDependency k;
-
-                for (k = 0; k < _UNIT_DEPENDENCY_MAX; k++) {
-                        /* Do not add dependencies between u and itself */
-                        if (back == u) {
-                                if (set_remove(back->dependencies[k], other))
-                                        maybe_warn_about_dependency(u, other_id, k);
-                        } else {
-                                r = set_remove_and_put(back->dependencies[k], other, u);
-                                if (r == -EEXIST)
-                                        set_remove(back->dependencies[k], other);
-                                else
-                                        assert(r >= 0 || r == -ENOENT);
-                        }
+        HASHMAP_FOREACH_KEY(v, back, other->dependencies, i) {
+
+                mask = unit_dependency_mask(back, other);
+                if (mask == 0)
+                        continue;
+
+                /* Do not add dependencies between u and itself */
+                if (back == u) {
+                        hashmap_remove(u->dependencies, other);
+                        warn_about_dependency_mask(u, other_id, mask);
+                        continue;
                 }
+
+                /* Replacing an entry never needs to allocate */
+                r = hashmap_remove_and_replace(back->dependencies, other, u, UINT32_TO_PTR(mask));
+                if (r == -EEXIST) {
+                        assert_se(hashmap_update(back->dependencies, u, UINT32_TO_PTR(mask | unit_dependency_mask(back, u))) >= 0);
+                        hashmap_remove(back->dependencies, other);
+                } else
+                        assert(r >= 0);
         }
 
         /* Also do not move dependencies on u to itself */
-        back = set_remove(other->dependencies[d], u);
-        if (back)
-                maybe_warn_about_dependency(u, other_id, d);
+        mask = PTR_TO_UINT32(hashmap_remove(other->dependencies, u));
+        if (mask != 0)
+                warn_about_dependency_mask(u, other_id, mask);
 
-        /* The move cannot fail. The caller must have performed a reservation. */
-        assert_se(complete_move(&u->dependencies[d], &other->dependencies[d]) == 0);
+        if (!u->dependencies) {
+                u->dependencies = other->dependencies;
+                other->dependencies = NULL;
+                return;
+        }
+
+        /* The moves cannot fail. The caller must have performed a reservation. */
+        HASHMAP_FOREACH_KEY(v, back, other->dependencies, i) {
+                mask = unit_dependency_mask(u, back);
+
+                if (mask != 0)
+                        assert_se(hashmap_update(u->dependencies, back, UINT32_TO_PTR(mask | PTR_TO_UINT32(v))) >= 0);
+                else
+                        assert_se(hashmap_put(u->dependencies, back, v) > 0);
+        }
 
-        other->dependencies[d] = set_free(other->dependencies[d]);
+        other->dependencies = hashmap_free(other->dependencies);
 }
 
 int unit_merge(Unit *u, Unit *other) {
-        UnitDependency d;
         const char *other_id = NULL;
         int r;
 
@@ -772,16 +852,19 @@ int unit_merge(Unit *u, Unit *other) {
         if (other->id)
                 other_id = strdupa(other->id);
 
-        /* Make reservations to ensure merge_dependencies() won't fail */
-        for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++) {
-                r = reserve_dependencies(u, other, d);
-                /*
-                 * We don't rollback reservations if we fail. We don't have
-                 * a way to undo reservations. A reservation is not a leak.
-                 */
-                if (r < 0)
-                        return r;
-        }
+        /* Make reservations to ensure merge_dependencies() and
+         * merge_dependency_records() won't fail */
+        if (!GREEDY_REALLOC(u->dependency_records, u->n_dependency_records_allocated,
+                            u->n_dependency_records + other->n_dependency_records))
+                return -ENOMEM;
+
+        r = reserve_dependencies(u, other);
+        /*
+         * We don't rollback reservations if we fail. We don't have
+         * a way to undo reservations. A reservation is not a leak.
+         */
+        if (r < 0)
+                return r;
 
         /* Merge names */
         r = merge_names(u, other);
@@ -793,8 +876,8 @@ int unit_merge(Unit *u, Unit *other) {
                 unit_ref_set(other->refs, u);
 
         /* Merge dependencies */
-        for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
-                merge_dependencies(u, other, other_id, d);
+        merge_dependency_records(u, other);
+        merge_dependencies(u, other, other_id);
 
         other->load_state = UNIT_MERGED;
         other->merged_into = u;
@@ -1046,7 +1129,7 @@ void unit_dump(Unit *u, FILE *f, const char *prefix) {
         for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++) {
                 Unit *other;
 
-                SET_FOREACH(other, u->dependencies[d], i)
+                UNIT_FOREACH_DEPENDENCY(other, u, d, i)
                         fprintf(f, "%s\t%s: %s\n", prefix, unit_dependency_to_string(d), other->id);
         }
 
@@ -1158,7 +1241,7 @@ int unit_add_default_target_dependency(Unit *u, Unit *target) {
                 return 0;
 
         /* Don't create loops */
-        if (set_get(target->dependencies[UNIT_BEFORE], u))
+        if (unit_has_dependency(target, UNIT_BEFORE, u))
                 return 0;
 
         return unit_add_dependency(target, UNIT_AFTER, u, true);
@@ -1181,7 +1264,7 @@ static int unit_add_target_dependencies(Unit *u) {
         assert(u);
 
         for (k = 0; k < ELEMENTSOF(deps); k++)
-                SET_FOREACH(target, u->dependencies[deps[k]], i) {
+                UNIT_FOREACH_DEPENDENCY(target, u, deps[k], i) {
                         r = unit_add_default_target_dependency(u, target);
                         if (r < 0)
                                 return r;
@@ -1274,6 +1357,7 @@ static int unit_add_startup_units(Unit *u) {
 }
 
 int unit_load(Unit *u) {
+        Unit *loading;
         int r;
 
         assert(u);
@@ -1289,6 +1373,11 @@ int unit_load(Unit *u) {
         if (u->load_state != UNIT_STUB)
                 return 0;
 
+        /* Loading one unit might trigger loading others, hence stack
+         * these */
+        loading = u->manager->loading_unit;
+        u->manager->loading_unit = u;
+
         if (u->transient_file) {
                 r = fflush_and_check(u->transient_file);
                 if (r < 0)
@@ -1329,7 +1418,7 @@ int unit_load(Unit *u) {
                 if (r < 0)
                         goto fail;
 
-                if (u->on_failure_job_mode == JOB_ISOLATE && set_size(u->dependencies[UNIT_ON_FAILURE]) > 1) {
+                if (u->on_failure_job_mode == JOB_ISOLATE && unit_dependency_count(u, UNIT_ON_FAILURE) > 1) {
                         log_unit_error(u, "More than one OnFailure= dependencies specified but OnFailureJobMode=isolate set. Refusing.");
                         r = -EINVAL;
                         goto fail;
@@ -1346,9 +1435,11 @@ int unit_load(Unit *u) {
         unit_add_to_dbus_queue(unit_follow_merge(u));
         unit_add_to_gc_queue(u);
 
+        u->manager->loading_unit = loading;
         return 0;
 
 fail:
+        u->manager->loading_unit = loading;
         u->load_state = u->load_state == UNIT_STUB ? UNIT_NOT_FOUND : UNIT_ERROR;
         u->load_error = r;
         unit_add_to_dbus_queue(u);
@@ -1551,9 +1642,9 @@ static bool unit_verify_deps(Unit *u) {
          * processing, but do not have any effect afterwards. We don't check BindsTo= dependencies that are not used in
          * conjunction with After= as for them any such check would make things entirely racy. */
 
-        SET_FOREACH(other, u->dependencies[UNIT_BINDS_TO], j) {
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_BINDS_TO, j) {
 
-                if (!set_contains(u->dependencies[UNIT_AFTER], other))
+                if (!unit_has_dependency(u, UNIT_AFTER, other))
                         continue;
 
                 if (!UNIT_IS_ACTIVE_OR_RELOADING(unit_active_state(other))) {
@@ -1784,7 +1875,7 @@ static void unit_check_unneeded(Unit *u) {
                 return;
 
         for (j = 0; j < ELEMENTSOF(needed_dependencies); j++)
-                SET_FOREACH(other, u->dependencies[needed_dependencies[j]], i)
+                UNIT_FOREACH_DEPENDENCY(other, u, needed_dependencies[j], i)
                         if (unit_active_or_pending(other))
                                 return;
 
@@ -1819,7 +1910,7 @@ static void unit_check_binds_to(Unit *u) {
         if (unit_active_state(u) != UNIT_ACTIVE)
                 return;
 
-        SET_FOREACH(other, u->dependencies[UNIT_BINDS_TO], i) {
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_BINDS_TO, i) {
                 if (other->job)
                         continue;
 
@@ -1861,26 +1952,26 @@ static void retroactively_start_dependencies(Unit *u) {
         assert(u);
         assert(UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(u)));
 
-        SET_FOREACH(other, u->dependencies[UNIT_REQUIRES], i)
-                if (!set_get(u->dependencies[UNIT_AFTER], other) &&
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_REQUIRES, i)
+                if (!unit_has_dependency(u, UNIT_AFTER, other) &&
                     !UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_START, other, JOB_REPLACE, NULL, NULL);
 
-        SET_FOREACH(other, u->dependencies[UNIT_BINDS_TO], i)
-                if (!set_get(u->dependencies[UNIT_AFTER], other) &&
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_BINDS_TO, i)
+                if (!unit_has_dependency(u, UNIT_AFTER, other) &&
                     !UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_START, other, JOB_REPLACE, NULL, NULL);
 
-        SET_FOREACH(other, u->dependencies[UNIT_WANTS], i)
-                if (!set_get(u->dependencies[UNIT_AFTER], other) &&
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_WANTS, i)
+                if (!unit_has_dependency(u, UNIT_AFTER, other) &&
                     !UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_START, other, JOB_FAIL, NULL, NULL);
 
-        SET_FOREACH(other, u->dependencies[UNIT_CONFLICTS], i)
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_CONFLICTS, i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_STOP, other, JOB_REPLACE, NULL, NULL);
 
-        SET_FOREACH(other, u->dependencies[UNIT_CONFLICTED_BY], i)
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_CONFLICTED_BY, i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_STOP, other, JOB_REPLACE, NULL, NULL);
 }
@@ -1893,7 +1984,7 @@ static void retroactively_stop_dependencies(Unit *u) {
         assert(UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(u)));
 
         /* Pull down units which are bound to us recursively if enabled */
-        SET_FOREACH(other, u->dependencies[UNIT_BOUND_BY], i)
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_BOUND_BY, i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_STOP, other, JOB_REPLACE, NULL, NULL);
 }
@@ -1906,16 +1997,16 @@ static void check_unneeded_dependencies(Unit *u) {
         assert(UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(u)));
 
         /* Garbage collect services that might not be needed anymore, if enabled */
-        SET_FOREACH(other, u->dependencies[UNIT_REQUIRES], i)
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_REQUIRES, i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         unit_check_unneeded(other);
-        SET_FOREACH(other, u->dependencies[UNIT_WANTS], i)
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_WANTS, i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         unit_check_unneeded(other);
-        SET_FOREACH(other, u->dependencies[UNIT_REQUISITE], i)
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_REQUISITE, i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         unit_check_unneeded(other);
-        SET_FOREACH(other, u->dependencies[UNIT_BINDS_TO], i)
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_BINDS_TO, i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         unit_check_unneeded(other);
 }
@@ -1926,12 +2017,12 @@ void unit_start_on_failure(Unit *u) {
 
         assert(u);
 
-        if (set_size(u->dependencies[UNIT_ON_FAILURE]) <= 0)
+        if (unit_dependency_count(u, UNIT_ON_FAILURE) <= 0)
                 return;
 
         log_unit_info(u, "Triggering OnFailure= dependencies.");
 
-        SET_FOREACH(other, u->dependencies[UNIT_ON_FAILURE], i) {
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_ON_FAILURE, i) {
                 int r;
 
                 r = manager_add_job(u->manager, JOB_START, other, u->on_failure_job_mode, NULL, NULL);
@@ -1946,7 +2037,7 @@ void unit_trigger_notify(Unit *u) {
 
         assert(u);
 
-        SET_FOREACH(other, u->dependencies[UNIT_TRIGGERED_BY], i)
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_TRIGGERED_BY, i)
                 if (UNIT_VTABLE(other)->trigger_notify)
                         UNIT_VTABLE(other)->trigger_notify(other, u);
 }
@@ -2197,6 +2288,9 @@ int unit_watch_pid(Unit *u, pid_t pid) {
         if (q < 0)
                 return q;
 
+        /* This might be a new process, reusing the PID of one we did not reap */
+        manager_forget_pid_cgroup(u->manager, pid);
+
         return r;
 }
 
@@ -2207,6 +2301,12 @@ void unit_unwatch_pid(Unit *u, pid_t pid) {
         (void) hashmap_remove_value(u->manager->watch_pids1, PID_TO_PTR(pid), u);
         (void) hashmap_remove_value(u->manager->watch_pids2, PID_TO_PTR(pid), u);
         (void) set_remove(u->pids, PID_TO_PTR(pid));
+
+        /* Only watched PIDs are safe to remember, see
+         * manager_get_unit_by_pid_cgroup_cached() */
+        if (!hashmap_contains(u->manager->watch_pids1, PID_TO_PTR(pid)) &&
+            !hashmap_contains(u->manager->watch_pids2, PID_TO_PTR(pid)))
+                manager_forget_pid_cgroup(u->manager, pid);
 }
 
 void unit_unwatch_all_pids(Unit *u) {
@@ -2285,34 +2385,215 @@ static void maybe_warn_about_dependency(Unit *u, const char *other, UnitDependen
                 log_unit_warning(u, "Dependency %s=%s dropped, merged into %s", unit_dependency_to_string(dependency), strna(other), u->id);
 }
 
-int unit_add_dependency(Unit *u, UnitDependency d, Unit *other, bool add_reference) {
+static const UnitDependency inverse_table[_UNIT_DEPENDENCY_MAX] = {
+        [UNIT_REQUIRES] = UNIT_REQUIRED_BY,
+        [UNIT_WANTS] = UNIT_WANTED_BY,
+        [UNIT_REQUISITE] = UNIT_REQUISITE_OF,
+        [UNIT_BINDS_TO] = UNIT_BOUND_BY,
+        [UNIT_PART_OF] = UNIT_CONSISTS_OF,
+        [UNIT_REQUIRED_BY] = UNIT_REQUIRES,
+        [UNIT_REQUISITE_OF] = UNIT_REQUISITE,
+        [UNIT_WANTED_BY] = UNIT_WANTS,
+        [UNIT_BOUND_BY] = UNIT_BINDS_TO,
+        [UNIT_CONSISTS_OF] = UNIT_PART_OF,
+        [UNIT_CONFLICTS] = UNIT_CONFLICTED_BY,
+        [UNIT_CONFLICTED_BY] = UNIT_CONFLICTS,
+        [UNIT_BEFORE] = UNIT_AFTER,
+        [UNIT_AFTER] = UNIT_BEFORE,
+        [UNIT_ON_FAILURE] = _UNIT_DEPENDENCY_INVALID,
+        [UNIT_REFERENCES] = UNIT_REFERENCED_BY,
+        [UNIT_REFERENCED_BY] = UNIT_REFERENCES,
+        [UNIT_TRIGGERS] = UNIT_TRIGGERED_BY,
+        [UNIT_TRIGGERED_BY] = UNIT_TRIGGERS,
+        [UNIT_PROPAGATES_RELOAD_TO] = UNIT_RELOAD_PROPAGATED_FROM,
+        [UNIT_RELOAD_PROPAGATED_FROM] = UNIT_PROPAGATES_RELOAD_TO,
+        [UNIT_JOINS_NAMESPACE_OF] = UNIT_JOINS_NAMESPACE_OF,
+};
+
+static Unit *dependency_record_owner(Unit *u, Unit *other) {
+        Unit *loading;
+
+        /* Dependencies are recorded on the unit whose configuration is
+         * being loaded, if it is one of the two involved */
+
+        loading = u->manager->loading_unit;
+        if (!loading)
+                return NULL;
+
+        loading = unit_follow_merge(loading);
+        if (loading != u && loading != other)
+                return NULL;
+
+        return loading;
+}
 
-        static const UnitDependency inverse_table[_UNIT_DEPENDENCY_MAX] = {
-                [UNIT_REQUIRES] = UNIT_REQUIRED_BY,
-                [UNIT_WANTS] = UNIT_WANTED_BY,
-                [UNIT_REQUISITE] = UNIT_REQUISITE_OF,
-                [UNIT_BINDS_TO] = UNIT_BOUND_BY,
-                [UNIT_PART_OF] = UNIT_CONSISTS_OF,
-                [UNIT_REQUIRED_BY] = UNIT_REQUIRES,
-                [UNIT_REQUISITE_OF] = UNIT_REQUISITE,
-                [UNIT_WANTED_BY] = UNIT_WANTS,
-                [UNIT_BOUND_BY] = UNIT_BINDS_TO,
-                [UNIT_CONSISTS_OF] = UNIT_PART_OF,
-                [UNIT_CONFLICTS] = UNIT_CONFLICTED_BY,
-                [UNIT_CONFLICTED_BY] = UNIT_CONFLICTS,
-                [UNIT_BEFORE] = UNIT_AFTER,
-                [UNIT_AFTER] = UNIT_BEFORE,
-                [UNIT_ON_FAILURE] = _UNIT_DEPENDENCY_INVALID,
-                [UNIT_REFERENCES] = UNIT_REFERENCED_BY,
-                [UNIT_REFERENCED_BY] = UNIT_REFERENCES,
-                [UNIT_TRIGGERS] = UNIT_TRIGGERED_BY,
-                [UNIT_TRIGGERED_BY] = UNIT_TRIGGERS,
-                [UNIT_PROPAGATES_RELOAD_TO] = UNIT_RELOAD_PROPAGATED_FROM,
-                [UNIT_RELOAD_PROPAGATED_FROM] = UNIT_PROPAGATES_RELOAD_TO,
-                [UNIT_JOINS_NAMESPACE_OF] = UNIT_JOINS_NAMESPACE_OF,
+static void unit_add_dependency_record(Unit *u, Unit *other, UnitDependency d, bool inverse) {
+        assert(u);
+        assert(u->n_dependency_records < u->n_dependency_records_allocated);
+
+        u->dependency_records[u->n_dependency_records++] = (UnitDependencyRecord) {
+                .other = other,
+                .dependency = d,
+                .inverse = inverse,
         };
-        int r, q = 0, v = 0, w = 0;
-        Unit *orig_u = u, *orig_other = other;
+}
+
+static bool dependency_record_matches(const UnitDependencyRecord *r, UnitDependency d, bool inverse) {
+        UnitDependency e;
+
+        /* Checks whether the record is about the dependency "u d other",
+         * or "other d u" if inverse is true, in either direction */
+
+        if (r->dependency == d && r->inverse == inverse)
+                return true;
+
+        e = inverse_table[d];
+        return e != _UNIT_DEPENDENCY_INVALID && e != d && r->dependency == e && r->inverse != inverse;
+}
+
+static bool unit_dependency_recorded(Unit *u, Unit *other, UnitDependency d, bool inverse) {
+        size_t k;
+
+        assert(u);
+
+        for (k = 0; k < u->n_dependency_records; k++)
+                if (u->dependency_records[k].other == other &&
+                    dependency_record_matches(u->dependency_records + k, d, inverse))
+                        return true;
+
+        return false;
+}
+
+bool unit_dependency_iterate(Unit *u, UnitDependencyMask mask, Iterator *i, Unit **ret) {
+        const void *other;
+        void *v;
+
+        assert_cc(_UNIT_DEPENDENCY_MAX <= sizeof(UnitDependencyMask) * 8);
+        assert(u);
+        assert(i);
+        assert(ret);
+
+        while (hashmap_iterate(u->dependencies, i, &v, &other))
+                if (PTR_TO_UINT32(v) & mask) {
+                        *ret = (Unit*) other;
+                        return true;
+                }
+
+        *ret = NULL;
+        return false;
+}
+
+unsigned unit_dependency_count(Unit *u, UnitDependency d) {
+        unsigned n = 0;
+        Iterator i;
+        Unit *other;
+
+        assert(u);
+
+        UNIT_FOREACH_DEPENDENCY(other, u, d, i)
+                n++;
+
+        return n;
+}
+
+Unit *unit_dependency_first(Unit *u, UnitDependency d) {
+        Iterator i = ITERATOR_FIRST;
+        Unit *other;
+
+        assert(u);
+
+        return unit_dependency_iterate(u, UNIT_DEPENDENCY_MASK(d), &i, &other) ? other : NULL;
+}
+
+static size_t str_memory_usage(const char *s) {
+        return s ? strlen(s) + 1 : 0;
+}
+
+static size_t strv_memory_usage(char **l) {
+        size_t n = 0;
+        char **s;
+
+        if (!l)
+                return 0;
+
+        STRV_FOREACH(s, l)
+                n += sizeof(char*) + str_memory_usage(*s);
+
+        return n + sizeof(char*);
+}
+
+size_t unit_memory_usage(Unit *u) {
+        Iterator i;
+        size_t n;
+        char *t;
+
+        assert(u);
+
+        /* Estimates the memory the unit object and the data structures
+         * hanging off it take up, ignoring allocator overhead and the
+         * type specific fields beyond the object itself. */
+
+        n = UNIT_VTABLE(u)->object_size;
+
+        n += hashmap_memory_usage(u->dependencies);
+        n += u->n_dependency_records_allocated * sizeof(UnitDependencyRecord);
+
+        n += set_memory_usage(u->names);
+        SET_FOREACH(t, u->names, i)
+                n += str_memory_usage(t);
+
+        n += str_memory_usage(u->description);
+        n += str_memory_usage(u->fragment_path);
+        n += str_memory_usage(u->source_path);
+        n += strv_memory_usage(u->documentation);
+        n += strv_memory_usage(u->dropin_paths);
+        n += strv_memory_usage(u->requires_mounts_for);
+
+        return n;
+}
+
+static int unit_reserve_dependency(Unit *u, Unit *other) {
+        int r;
+
+        assert(u);
+        assert(other);
+
+        /* Makes sure unit_set_dependency_mask() cannot fail. Note that we
+         * don't resize the table if there already is an entry for the
+         * other unit, so that dependencies may be added on units we
+         * already depend on while iterating through our dependencies. */
+
+        if (unit_dependency_mask(u, other) != 0)
+                return 0;
+
+        r = hashmap_ensure_allocated(&u->dependencies, NULL);
+        if (r < 0)
+                return r;
+
+        return hashmap_reserve(u->dependencies, 1);
+}
+
+static bool unit_set_dependency_mask(Unit *u, Unit *other, UnitDependencyMask mask) {
+        UnitDependencyMask m;
+
+        /* Returns true if anything changed */
+
+        m = unit_dependency_mask(u, other);
+        if ((m & mask) == mask)
+                return false;
+
+        if (m != 0)
+                assert_se(hashmap_update(u->dependencies, other, UINT32_TO_PTR(m | mask)) >= 0);
+        else
+                assert_se(hashmap_put(u->dependencies, other, UINT32_TO_PTR(mask)) > 0);
+
+        return true;
+}
+
+int unit_add_dependency(Unit *u, UnitDependency d, Unit *other, bool add_reference) {
+        UnitDependencyMask mask, inverse_mask = 0;
+        Unit *orig_u = u, *orig_other = other, *owner;
+        int r;
 
         assert(u);
         assert(d >= 0 && d < _UNIT_DEPENDENCY_MAX);
@@ -2333,62 +2614,199 @@ int unit_add_dependency(Unit *u, UnitDependency d, Unit *other, bool add_referen
                 return 0;
         }
 
-        r = set_ensure_allocated(&u->dependencies[d], NULL);
+        mask = UNIT_DEPENDENCY_MASK(d);
+        if (inverse_table[d] != _UNIT_DEPENDENCY_INVALID && inverse_table[d] != d)
+                inverse_mask = UNIT_DEPENDENCY_MASK(inverse_table[d]);
+
+        if (add_reference) {
+                mask |= UNIT_DEPENDENCY_MASK(UNIT_REFERENCES);
+                inverse_mask |= UNIT_DEPENDENCY_MASK(UNIT_REFERENCED_BY);
+        }
+
+        owner = dependency_record_owner(u, other);
+        if (owner && !GREEDY_REALLOC(owner->dependency_records, owner->n_dependency_records_allocated,
+                                     owner->n_dependency_records + 2))
+                return -ENOMEM;
+
+        r = unit_reserve_dependency(u, other);
         if (r < 0)
                 return r;
 
-        if (inverse_table[d] != _UNIT_DEPENDENCY_INVALID) {
-                r = set_ensure_allocated(&other->dependencies[inverse_table[d]], NULL);
+        if (inverse_mask != 0) {
+                r = unit_reserve_dependency(other, u);
                 if (r < 0)
                         return r;
         }
 
-        if (add_reference) {
-                r = set_ensure_allocated(&u->dependencies[UNIT_REFERENCES], NULL);
-                if (r < 0)
-                        return r;
+        (void) unit_set_dependency_mask(u, other, mask);
+        if (inverse_mask != 0)
+                (void) unit_set_dependency_mask(other, u, inverse_mask);
 
-                r = set_ensure_allocated(&other->dependencies[UNIT_REFERENCED_BY], NULL);
-                if (r < 0)
-                        return r;
+        if (owner) {
+                Unit *o = owner == u ? other : u;
+
+                unit_add_dependency_record(owner, o, d, owner != u);
+                if (add_reference)
+                        unit_add_dependency_record(owner, o, UNIT_REFERENCES, owner != u);
         }
 
-        q = set_put(u->dependencies[d], other);
-        if (q < 0)
-                return q;
+        unit_add_to_dbus_queue(u);
+        return 0;
+}
 
-        if (inverse_table[d] != _UNIT_DEPENDENCY_INVALID && inverse_table[d] != d) {
-                v = set_put(other->dependencies[inverse_table[d]], u);
-                if (v < 0) {
-                        r = v;
-                        goto fail;
-                }
+bool unit_owns_dependency_on(Unit *u, Unit *other) {
+        size_t k;
+
+        assert(u);
+        assert(other);
+
+        for (k = 0; k < u->n_dependency_records; k++)
+                if (u->dependency_records[k].other == other)
+                        return true;
+
+        return false;
+}
+
+static int push_saved_dependency(
+                UnitSavedDependency **saved,
+                size_t *n,
+                size_t *allocated,
+                Unit *other,
+                UnitDependency d,
+                bool inverse,
+                bool owned_by_other) {
+
+        if (!GREEDY_REALLOC(*saved, *allocated, *n + 1))
+                return -ENOMEM;
+
+        (*saved)[(*n)++] = (UnitSavedDependency) {
+                .record.other = other,
+                .record.dependency = d,
+                .record.inverse = inverse,
+                .owned_by_other = owned_by_other,
+        };
+
+        return 0;
+}
+
+static int dependency_record_compare(const void *a, const void *b) {
+        const UnitDependencyRecord *x = a, *y = b;
+
+        if (x->other < y->other)
+                return -1;
+        if (x->other > y->other)
+                return 1;
+        return 0;
+}
+
+static bool sorted_dependency_recorded(const UnitDependencyRecord *records, size_t n, Unit *other, UnitDependency d, bool inverse) {
+        size_t lo = 0, hi = n;
+
+        /* Like unit_dependency_recorded(), but on records sorted by
+         * the other unit, for units with lots of them */
+
+        while (lo < hi) {
+                size_t mid = lo + (hi - lo) / 2;
+
+                if (records[mid].other < other)
+                        lo = mid + 1;
+                else
+                        hi = mid;
         }
 
-        if (add_reference) {
-                w = set_put(u->dependencies[UNIT_REFERENCES], other);
-                if (w < 0) {
-                        r = w;
-                        goto fail;
-                }
+        for (; lo < n && records[lo].other == other; lo++)
+                if (dependency_record_matches(records + lo, d, inverse))
+                        return true;
 
-                r = set_put(other->dependencies[UNIT_REFERENCED_BY], u);
-                if (r < 0)
-                        goto fail;
+        return false;
+}
+
+int unit_save_dependencies(Unit *u, UnitSavedDependency **ret, size_t *ret_n) {
+        _cleanup_free_ UnitSavedDependency *saved = NULL;
+        _cleanup_free_ UnitDependencyRecord *own = NULL;
+        size_t n = 0, allocated = 0;
+        UnitDependency d;
+        Unit *other;
+        Iterator i;
+        void *v;
+        int r;
+
+        assert(u);
+        assert(ret);
+        assert(ret_n);
+
+        /* Saves the dependencies between u and other units that u does
+         * not owe to its own configuration, so that they may be
+         * restored with unit_restore_dependencies() after u has been
+         * freed and loaded again. */
+
+        if (u->n_dependency_records > 0) {
+                own = newdup(UnitDependencyRecord, u->dependency_records, u->n_dependency_records);
+                if (!own)
+                        return -ENOMEM;
+
+                qsort_safe(own, u->n_dependency_records, sizeof(UnitDependencyRecord), dependency_record_compare);
         }
 
-        unit_add_to_dbus_queue(u);
+        HASHMAP_FOREACH_KEY(v, other, u->dependencies, i)
+                for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++) {
+                        UnitDependency e = inverse_table[d];
+
+                        if (unit_has_dependency(u, d, other) &&
+                            !sorted_dependency_recorded(own, u->n_dependency_records, other, d, false)) {
+                                r = push_saved_dependency(&saved, &n, &allocated, other, d, false,
+                                                          unit_dependency_recorded(other, u, d, true));
+                                if (r < 0)
+                                        return r;
+                        }
+
+                        /* Skip the reverse direction of what was saved above */
+                        if (e != _UNIT_DEPENDENCY_INVALID && e != d && unit_has_dependency(u, e, other))
+                                continue;
+
+                        if (unit_has_dependency(other, d, u) &&
+                            !sorted_dependency_recorded(own, u->n_dependency_records, other, d, true)) {
+                                r = push_saved_dependency(&saved, &n, &allocated, other, d, true,
+                                                          unit_dependency_recorded(other, u, d, false));
+                                if (r < 0)
+                                        return r;
+                        }
+                }
+
+        *ret = saved;
+        *ret_n = n;
+        saved = NULL;
+
         return 0;
+}
 
-fail:
-        if (q > 0)
-                set_remove(u->dependencies[d], other);
+int unit_restore_dependencies(Unit *u, const UnitSavedDependency *saved, size_t n) {
+        Unit *loading;
+        size_t k;
+        int r = 0;
 
-        if (v > 0)
-                set_remove(other->dependencies[inverse_table[d]], u);
+        assert(u);
+        assert(saved || n == 0);
+
+        loading = u->manager->loading_unit;
 
-        if (w > 0)
-                set_remove(u->dependencies[UNIT_REFERENCES], other);
+        for (k = 0; k < n; k++) {
+                const UnitSavedDependency *s = saved + k;
+                int q;
+
+                /* Make sure dependencies owed to the other unit's
+                 * configuration are recorded for it again */
+                u->manager->loading_unit = s->owned_by_other ? s->record.other : NULL;
+
+                if (s->record.inverse)
+                        q = unit_add_dependency(s->record.other, s->record.dependency, u, false);
+                else
+                        q = unit_add_dependency(u, s->record.dependency, s->record.other, false);
+                if (q < 0 && r >= 0)
+                        r = q;
+        }
+
+        u->manager->loading_unit = loading;
 
         return r;
 }
@@ -2523,6 +2941,10 @@ int unit_set_slice(Unit *u, Unit *slice) {
         if (unit_active_state(u) != UNIT_INACTIVE)
                 return -EBUSY;
 
+        /* The slot of a running start job is accounted in the slice */
+        if (u->job && u->job->holds_start_slot)
+                return -EBUSY;
+
         if (slice->type != UNIT_SLICE)
                 return -EINVAL;
 
@@ -2702,7 +3124,7 @@ bool unit_can_serialize(Unit *u) {
         return UNIT_VTABLE(u)->serialize && UNIT_VTABLE(u)->deserialize_item;
 }
 
-static int unit_serialize_cgroup_mask(FILE *f, const char *key, CGroupMask mask) {
+static int unit_serialize_cgroup_mask(Unit *u, FILE *f, const char *key, CGroupMask mask) {
         _cleanup_free_ char *s = NULL;
         int r = 0;
 
@@ -2711,12 +3133,8 @@ static int unit_serialize_cgroup_mask(FILE *f, const char *key, CGroupMask mask)
 
         if (mask != 0) {
                 r = cg_mask_to_string(mask, &s);
-                if (r >= 0) {
-                        fputs(key, f);
-                        fputc('=', f);
-                        fputs(s, f);
-                        fputc('\n', f);
-                }
+                if (r >= 0)
+                        unit_serialize_item(u, f, key, s);
         }
         return r;
 }
@@ -2743,15 +3161,15 @@ int unit_serialize(Unit *u, FILE *f, FDSet *fds, bool serialize_jobs) {
                 }
         }
 
-        dual_timestamp_serialize(f, "state-change-timestamp", &u->state_change_timestamp);
+        unit_serialize_dual_timestamp(u, f, "state-change-timestamp", &u->state_change_timestamp);
 
-        dual_timestamp_serialize(f, "inactive-exit-timestamp", &u->inactive_exit_timestamp);
-        dual_timestamp_serialize(f, "active-enter-timestamp", &u->active_enter_timestamp);
-        dual_timestamp_serialize(f, "active-exit-timestamp", &u->active_exit_timestamp);
-        dual_timestamp_serialize(f, "inactive-enter-timestamp", &u->inactive_enter_timestamp);
+        unit_serialize_dual_timestamp(u, f, "inactive-exit-timestamp", &u->inactive_exit_timestamp);
+        unit_serialize_dual_timestamp(u, f, "active-enter-timestamp", &u->active_enter_timestamp);
+        unit_serialize_dual_timestamp(u, f, "active-exit-timestamp", &u->active_exit_timestamp);
+        unit_serialize_dual_timestamp(u, f, "inactive-enter-timestamp", &u->inactive_enter_timestamp);
 
-        dual_timestamp_serialize(f, "condition-timestamp", &u->condition_timestamp);
-        dual_timestamp_serialize(f, "assert-timestamp", &u->assert_timestamp);
+        unit_serialize_dual_timestamp(u, f, "condition-timestamp", &u->condition_timestamp);
+        unit_serialize_dual_timestamp(u, f, "assert-timestamp", &u->assert_timestamp);
 
         if (dual_timestamp_is_set(&u->condition_timestamp))
                 unit_serialize_item(u, f, "condition-result", yes_no(u->condition_result));
@@ -2768,8 +3186,8 @@ int unit_serialize(Unit *u, FILE *f, FDSet *fds, bool serialize_jobs) {
         if (u->cgroup_path)
                 unit_serialize_item(u, f, "cgroup", u->cgroup_path);
         unit_serialize_item(u, f, "cgroup-realized", yes_no(u->cgroup_realized));
-        (void) unit_serialize_cgroup_mask(f, "cgroup-realized-mask", u->cgroup_realized_mask);
-        (void) unit_serialize_cgroup_mask(f, "cgroup-enabled-mask", u->cgroup_enabled_mask);
+        (void) unit_serialize_cgroup_mask(u, f, "cgroup-realized-mask", u->cgroup_realized_mask);
+        (void) unit_serialize_cgroup_mask(u, f, "cgroup-enabled-mask", u->cgroup_enabled_mask);
 
         if (uid_is_valid(u->ref_uid))
                 unit_serialize_item_format(u, f, "ref-uid", UID_FMT, u->ref_uid);
@@ -2779,22 +3197,22 @@ int unit_serialize(Unit *u, FILE *f, FDSet *fds, bool serialize_jobs) {
         if (!sd_id128_is_null(u->invocation_id))
                 unit_serialize_item_format(u, f, "invocation-id", SD_ID128_FORMAT_STR, SD_ID128_FORMAT_VAL(u->invocation_id));
 
-        bus_track_serialize(u->bus_track, f, "ref");
+        bus_track_serialize(u->bus_track, f, u->manager->serialization_format, "ref");
 
         if (serialize_jobs) {
                 if (u->job) {
-                        fprintf(f, "job\n");
+                        serialize_start_marker(f, u->manager->serialization_format, "job");
                         job_serialize(u->job, f);
                 }
 
                 if (u->nop_job) {
-                        fprintf(f, "job\n");
+                        serialize_start_marker(f, u->manager->serialization_format, "job");
                         job_serialize(u->nop_job, f);
                 }
         }
 
         /* End marker */
-        fputc('\n', f);
+        serialize_end_marker(f, u->manager->serialization_format);
         return 0;
 }
 
@@ -2803,37 +3221,15 @@ int unit_serialize_item(Unit *u, FILE *f, const char *key, const char *value) {
         assert(f);
         assert(key);
 
-        if (!value)
-                return 0;
-
-        fputs(key, f);
-        fputc('=', f);
-        fputs(value, f);
-        fputc('\n', f);
-
-        return 1;
+        return serialize_item(f, u->manager->serialization_format, key, value);
 }
 
 int unit_serialize_item_escaped(Unit *u, FILE *f, const char *key, const char *value) {
-        _cleanup_free_ char *c = NULL;
-
         assert(u);
         assert(f);
         assert(key);
 
-        if (!value)
-                return 0;
-
-        c = cescape(value);
-        if (!c)
-                return -ENOMEM;
-
-        fputs(key, f);
-        fputc('=', f);
-        fputs(c, f);
-        fputc('\n', f);
-
-        return 1;
+        return serialize_item_escaped(f, u->manager->serialization_format, key, value);
 }
 
 int unit_serialize_item_fd(Unit *u, FILE *f, FDSet *fds, const char *key, int fd) {
@@ -2850,8 +3246,7 @@ int unit_serialize_item_fd(Unit *u, FILE *f, FDSet *fds, const char *key, int fd
         if (copy < 0)
                 return copy;
 
-        fprintf(f, "%s=%i\n", key, copy);
-        return 1;
+        return serialize_item_format(f, u->manager->serialization_format, key, "%i", copy);
 }
 
 void unit_serialize_item_format(Unit *u, FILE *f, const char *key, const char *format, ...) {
@@ -2862,17 +3257,20 @@ void unit_serialize_item_format(Unit *u, FILE *f, const char *key, const char *f
         assert(key);
         assert(format);
 
-        fputs(key, f);
-        fputc('=', f);
-
         va_start(ap, format);
-        vfprintf(f, format, ap);
+        (void) serialize_item_formatv(f, u->manager->serialization_format, key, format, ap);
         va_end(ap);
+}
 
-        fputc('\n', f);
+void unit_serialize_dual_timestamp(Unit *u, FILE *f, const char *key, dual_timestamp *t) {
+        assert(u);
+
+        serialize_dual_timestamp(f, u->manager->serialization_format, key, t);
 }
 
 int unit_deserialize(Unit *u, FILE *f, FDSet *fds) {
+        _cleanup_free_ char *buffer = NULL;
+        size_t allocated = 0;
         ExecRuntime **rt = NULL;
         size_t offset;
         int r;
@@ -2886,30 +3284,18 @@ int unit_deserialize(Unit *u, FILE *f, FDSet *fds) {
                 rt = (ExecRuntime**) ((uint8_t*) u + offset);
 
         for (;;) {
-                char line[LINE_MAX], *l, *v;
-                size_t k;
-
-                if (!fgets(line, sizeof(line), f)) {
-                        if (feof(f))
-                                return 0;
-                        return -errno;
-                }
+                char *l, *v;
 
-                char_array_0(line);
-                l = strstrip(line);
+                r = deserialize_item(f, u->manager->deserialization_format, &buffer, &allocated, &l, &v);
+                if (r == -ENODATA)
+                        return 0;
+                if (r < 0)
+                        return r;
 
                 /* End marker */
-                if (isempty(l))
+                if (r == 0)
                         break;
 
-                k = strcspn(l, "=");
-
-                if (l[k] == '=') {
-                        l[k] = 0;
-                        v = l+k+1;
-                } else
-                        v = l+k;
-
                 if (streq(l, "job")) {
                         if (v[0] == '\0') {
                                 /* new-style serialized job */
@@ -3244,6 +3630,110 @@ bool unit_need_daemon_reload(Unit *u) {
         return false;
 }
 
+static int unit_files_changed(char **paths, usec_t mtime, uint64_t hash, usec_t *ret_mtime) {
+        struct siphash state;
+        usec_t newest = mtime;
+        char **path;
+        int r;
+
+        assert(ret_mtime);
+
+        STRV_FOREACH(path, paths) {
+                struct stat st;
+
+                if (PATH_STARTSWITH_SET(*path, "/proc", "/sys"))
+                        continue;
+
+                if (stat(*path, &st) < 0)
+                        return 1;
+
+                newest = MAX(newest, timespec_load(&st.st_mtim));
+        }
+
+        if (newest <= mtime) {
+                *ret_mtime = mtime;
+                return 0;
+        }
+
+        /* Generators write their output anew on every reload, so
+         * before giving up compare the contents with what we parsed
+         * last time. The files were stat()ed first, hence any later
+         * modification shows up with a newer mtime next time. */
+        config_hash_init(&state);
+
+        STRV_FOREACH(path, paths) {
+                r = config_hash_file(&state, *path);
+                if (r < 0)
+                        return r;
+        }
+
+        if (siphash24_finalize(&state) != hash)
+                return 1;
+
+        *ret_mtime = newest;
+        return 0;
+}
+
+int unit_configuration_changed(Unit *u, usec_t *ret_fragment_mtime, usec_t *ret_dropin_mtime) {
+        _cleanup_strv_free_ char **t = NULL;
+        _cleanup_free_ char *fragment = NULL;
+        usec_t fragment_mtime, dropin_mtime;
+        int r;
+
+        assert(u);
+        assert(ret_fragment_mtime);
+        assert(ret_dropin_mtime);
+
+        /* Like unit_need_daemon_reload(), but also checks whether the
+         * unit would be loaded from a different file or with different
+         * .wants/ and .requires/ entries now, and doesn't consider
+         * files changed that were merely rewritten with the same
+         * contents as this unit was loaded from. Returns > 0 if the
+         * unit needs to be loaded again. Otherwise returns 0, and the
+         * modification times to record for the files, so that they
+         * are not reported as changed on disk anymore. */
+
+        r = unit_find_fragment(u, &fragment);
+        if (r < 0)
+                return r;
+        if (!streq_ptr(fragment, u->fragment_path))
+                return 1;
+
+        fragment_mtime = u->fragment_mtime;
+
+        if (u->load_state == UNIT_MASKED) {
+                if (fragment_mtime_newer(u->fragment_path, u->fragment_mtime, true))
+                        return 1;
+        } else if (u->fragment_path) {
+                r = unit_files_changed(STRV_MAKE(u->fragment_path), u->fragment_mtime, u->fragment_hash, &fragment_mtime);
+                if (r != 0)
+                        return r;
+        }
+
+        if (fragment_mtime_newer(u->source_path, u->source_mtime, false))
+                return 1;
+
+        (void) unit_find_dropin_paths(u, &t);
+        if (!strv_equal(u->dropin_paths, t))
+                return 1;
+
+        r = unit_files_changed(u->dropin_paths, u->dropin_mtime, u->dropin_hash, &dropin_mtime);
+        if (r != 0)
+                return r;
+
+        t = strv_free(t);
+        r = unit_find_dropin_dependency_paths(u, &t);
+        if (r < 0)
+                return r;
+        if (!strv_equal(u->dropin_dependency_paths, t))
+                return 1;
+
+        *ret_fragment_mtime = fragment_mtime;
+        *ret_dropin_mtime = dropin_mtime;
+
+        return 0;
+}
+
 void unit_reset_failed(Unit *u) {
         assert(u);
 
@@ -3793,6 +4283,7 @@ int unit_make_transient(Unit *u) {
 
         u->source_path = mfree(u->source_path);
         u->dropin_paths = strv_free(u->dropin_paths);
+        u->dropin_dependency_paths = strv_free(u->dropin_dependency_paths);
         u->fragment_mtime = u->source_mtime = u->dropin_mtime = 0;
 
         u->load_state = UNIT_STUB;
@@ -4043,7 +4534,7 @@ int unit_setup_exec_runtime(Unit *u) {
                 return 0;
 
         /* Try to get it from somebody else */
-        SET_FOREACH(other, u->dependencies[UNIT_JOINS_NAMESPACE_OF], i) {
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_JOINS_NAMESPACE_OF, i) {
 
                 *rt = unit_get_exec_runtime(other);
                 if (*rt) {
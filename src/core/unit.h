@@ -26,6 +26,8 @@
 typedef struct Unit Unit;
 typedef struct UnitVTable UnitVTable;
 typedef struct UnitRef UnitRef;
+typedef struct UnitDependencyRecord UnitDependencyRecord;
+typedef struct UnitSavedDependency UnitSavedDependency;
 typedef struct UnitStatusMessageFormats UnitStatusMessageFormats;
 
 #include "condition.h"
@@ -43,6 +45,14 @@ typedef enum KillOperation {
         _KILL_OPERATION_INVALID = -1
 } KillOperation;
 
+/* The accounting attributes of a cgroup read by the manager */
+typedef enum CGroupMetric {
+        CGROUP_METRIC_CPU_USAGE,
+        CGROUP_METRIC_MEMORY_CURRENT,
+        CGROUP_METRIC_TASKS_CURRENT,
+        _CGROUP_METRIC_MAX,
+} CGroupMetric;
+
 static inline bool UNIT_IS_ACTIVE_OR_RELOADING(UnitActiveState t) {
         return t == UNIT_ACTIVE || t == UNIT_RELOADING;
 }
@@ -61,6 +71,29 @@ static inline bool UNIT_IS_INACTIVE_OR_FAILED(UnitActiveState t) {
 
 #include "job.h"
 
+/* The dependency types one unit has on another, one bit per UnitDependency */
+typedef uint32_t UnitDependencyMask;
+
+#define UNIT_DEPENDENCY_MASK(d) ((UnitDependencyMask) 1U << (d))
+
+struct UnitDependencyRecord {
+        /* A dependency that was added while loading a unit. If
+         * inverse is false, the unit holding the record depends on
+         * the other one, otherwise it is the other way round. */
+
+        Unit *other;
+        UnitDependency dependency;
+        bool inverse;
+};
+
+struct UnitSavedDependency {
+        /* A dependency of a unit about to be reloaded that it doesn't
+         * owe to its own configuration, see unit_save_dependencies() */
+
+        UnitDependencyRecord record;
+        bool owned_by_other;
+};
+
 struct UnitRef {
         /* Keeps tracks of references to a unit. This is useful so
          * that we can merge two units if necessary and correct all
@@ -81,7 +114,18 @@ struct Unit {
         char *instance;
 
         Set *names;
-        Set *dependencies[_UNIT_DEPENDENCY_MAX];
+
+        /* Maps each unit we have any dependency on to the
+         * UnitDependencyMask of them. A single table instead of one per
+         * dependency type, as most units only have a few dependencies,
+         * and most other units they have several kinds of dependencies
+         * on (e.g. Wants= and After=). Use UNIT_FOREACH_DEPENDENCY()
+         * and friends to access it. */
+        Hashmap *dependencies;
+
+        /* The dependencies this unit's configuration gave it or other units */
+        UnitDependencyRecord *dependency_records;
+        size_t n_dependency_records, n_dependency_records_allocated;
 
         char **requires_mounts_for;
 
@@ -91,11 +135,17 @@ struct Unit {
         char *fragment_path; /* if loaded from a config file this is the primary path to it */
         char *source_path; /* if converted, the source file */
         char **dropin_paths;
+        char **dropin_dependency_paths; /* the entries of the .wants/ and .requires/ directories */
 
         usec_t fragment_mtime;
         usec_t source_mtime;
         usec_t dropin_mtime;
 
+        /* Hashes of the logical lines of the fragment and drop-ins we
+         * parsed, see unit_configuration_changed() */
+        uint64_t fragment_hash;
+        uint64_t dropin_hash;
+
         /* If this is a transient unit we are currently writing, this is where we are writing it to */
         FILE *transient_file;
 
@@ -132,6 +182,9 @@ struct Unit {
         /* Updated whenever the low-level state changes */
         dual_timestamp state_change_timestamp;
 
+        /* The manager's units_generation when the unit last changed */
+        uint64_t state_generation;
+
         /* Updated whenever the (high-level) active state enters or leaves the active or inactive states */
         dual_timestamp inactive_exit_timestamp;
         dual_timestamp active_enter_timestamp;
@@ -161,6 +214,9 @@ struct Unit {
         /* CGroup realize members queue */
         LIST_FIELDS(Unit, cgroup_queue);
 
+        /* CGroup empty queue */
+        LIST_FIELDS(Unit, cgroup_empty_queue);
+
         /* Units with the same CGroup netclass */
         LIST_FIELDS(Unit, cgroup_netclass);
 
@@ -206,6 +262,17 @@ struct Unit {
         CGroupMask cgroup_members_mask;
         int cgroup_inotify_wd;
 
+        /* The values last written to cgroup attributes, and the
+         * controllers they were written for */
+        Hashmap *cgroup_attributes;
+        CGroupMask cgroup_attributes_mask;
+
+        /* The accounting attributes, kept open, with the values last
+         * read from them and when */
+        int cgroup_metric_fd[_CGROUP_METRIC_MAX];
+        uint64_t cgroup_metric_value[_CGROUP_METRIC_MAX];
+        usec_t cgroup_metric_timestamp[_CGROUP_METRIC_MAX];
+
         /* How to start OnFailure units */
         JobMode on_failure_job_mode;
 
@@ -246,6 +313,7 @@ struct Unit {
         bool in_cleanup_queue:1;
         bool in_gc_queue:1;
         bool in_cgroup_queue:1;
+        bool in_cgroup_empty_queue:1;
 
         bool sent_dbus_new_signal:1;
 
@@ -262,6 +330,9 @@ struct Unit {
 
         /* For transient units: whether to add a bus track reference after creating the unit */
         bool bus_track_add:1;
+
+        /* Is this unit about to be replaced by a freshly loaded copy, see manager_reload_incremental()? */
+        bool replaced:1;
 };
 
 struct UnitStatusMessageFormats {
@@ -468,7 +539,7 @@ extern const UnitVTable * const unit_vtable[_UNIT_TYPE_MAX];
 #define UNIT_HAS_CGROUP_CONTEXT(u) (UNIT_VTABLE(u)->cgroup_context_offset > 0)
 #define UNIT_HAS_KILL_CONTEXT(u) (UNIT_VTABLE(u)->kill_context_offset > 0)
 
-#define UNIT_TRIGGER(u) ((Unit*) set_first((u)->dependencies[UNIT_TRIGGERS]))
+#define UNIT_TRIGGER(u) unit_dependency_first((u), UNIT_TRIGGERS)
 
 DEFINE_CAST(SERVICE, Service);
 DEFINE_CAST(SOCKET, Socket);
@@ -490,6 +561,30 @@ int unit_new_for_name(Manager *m, size_t size, const char *name, Unit **ret);
 int unit_add_name(Unit *u, const char *name);
 
 int unit_add_dependency(Unit *u, UnitDependency d, Unit *other, bool add_reference);
+
+static inline UnitDependencyMask unit_dependency_mask(Unit *u, Unit *other) {
+        return PTR_TO_UINT32(hashmap_get(u->dependencies, other));
+}
+
+static inline bool unit_has_dependency(Unit *u, UnitDependency d, Unit *other) {
+        return unit_dependency_mask(u, other) & UNIT_DEPENDENCY_MASK(d);
+}
+
+bool unit_dependency_iterate(Unit *u, UnitDependencyMask mask, Iterator *i, Unit **ret);
+unsigned unit_dependency_count(Unit *u, UnitDependency d);
+Unit *unit_dependency_first(Unit *u, UnitDependency d);
+
+#define UNIT_FOREACH_DEPENDENCY_MASK(other, u, mask, i)                 \
+        for ((i) = ITERATOR_FIRST; unit_dependency_iterate((u), (mask), &(i), &(other)); )
+
+#define UNIT_FOREACH_DEPENDENCY(other, u, d, i)                         \
+        UNIT_FOREACH_DEPENDENCY_MASK(other, u, UNIT_DEPENDENCY_MASK(d), i)
+
+size_t unit_memory_usage(Unit *u);
+
+bool unit_owns_dependency_on(Unit *u, Unit *other);
+int unit_save_dependencies(Unit *u, UnitSavedDependency **ret, size_t *ret_n);
+int unit_restore_dependencies(Unit *u, const UnitSavedDependency *saved, size_t n);
 int unit_add_two_dependencies(Unit *u, UnitDependency d, UnitDependency e, Unit *other, bool add_reference);
 
 int unit_add_dependency_by_name(Unit *u, UnitDependency d, const char *name, const char *filename, bool add_reference);
@@ -571,6 +666,7 @@ int unit_serialize_item(Unit *u, FILE *f, const char *key, const char *value);
 int unit_serialize_item_escaped(Unit *u, FILE *f, const char *key, const char *value);
 int unit_serialize_item_fd(Unit *u, FILE *f, FDSet *fds, const char *key, int fd);
 void unit_serialize_item_format(Unit *u, FILE *f, const char *key, const char *value, ...) _printf_(4,5);
+void unit_serialize_dual_timestamp(Unit *u, FILE *f, const char *key, dual_timestamp *t);
 
 int unit_add_node_link(Unit *u, const char *what, bool wants, UnitDependency d);
 
@@ -580,6 +676,7 @@ void unit_status_printf(Unit *u, const char *status, const char *unit_status_msg
 void unit_status_emit_starting_stopping_reloading(Unit *u, JobType t);
 
 bool unit_need_daemon_reload(Unit *u);
+int unit_configuration_changed(Unit *u, usec_t *ret_fragment_mtime, usec_t *ret_dropin_mtime);
 
 void unit_reset_failed(Unit *u);
 
@@ -109,6 +109,9 @@ struct node_vtable {
         const sd_bus_vtable *vtable;
         sd_bus_object_find_t find;
 
+        /* Introspection XML of the members, generated on first use */
+        char *introspection;
+
         unsigned last_iteration;
 
         LIST_FIELDS(struct node_vtable, vtables);
@@ -194,6 +197,7 @@ struct sd_bus {
 
         bool is_kernel:1;
         bool can_fds:1;
+        bool can_memfds:1;
         bool bus_client:1;
         bool ucred_valid:1;
         bool is_server:1;
@@ -229,6 +233,11 @@ struct sd_bus {
         size_t windex;
         size_t wqueue_allocated;
 
+        /* Statistics of the socket transport, to see how well
+         * message batching works */
+        uint64_t n_write_calls, n_messages_written;
+        uint64_t n_read_calls, n_messages_read;
+
         uint64_t cookie;
 
         char *unique_name;
@@ -243,6 +252,10 @@ struct sd_bus {
         Hashmap *vtable_methods;
         Hashmap *vtable_properties;
 
+        /* Resolved method lookups by (path, interface, member), flushed
+         * whenever object callbacks or vtables are added or removed */
+        Hashmap *vtable_method_cache;
+
         union sockaddr_union sockaddr;
         socklen_t sockaddr_size;
 
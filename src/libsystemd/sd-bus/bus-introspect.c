@@ -174,6 +174,39 @@ int introspect_write_interface(struct introspect *i, const sd_bus_vtable *v) {
         return 0;
 }
 
+int introspect_format_interface(const sd_bus_vtable *v, bool trusted, char **ret) {
+        _cleanup_(introspect_free) struct introspect i = {
+                .trusted = trusted,
+        };
+        int r;
+
+        assert(v);
+        assert(ret);
+
+        /* Formats the members of one vtable on their own, so that
+         * the result can be reused for every object that implements
+         * it */
+
+        i.f = open_memstream(&i.introspection, &i.size);
+        if (!i.f)
+                return -ENOMEM;
+
+        r = introspect_write_interface(&i, v);
+        if (r < 0)
+                return r;
+
+        r = fflush_and_check(i.f);
+        if (r < 0)
+                return r;
+
+        i.f = safe_fclose(i.f);
+
+        *ret = i.introspection;
+        i.introspection = NULL;
+
+        return 0;
+}
+
 int introspect_finish(struct introspect *i, sd_bus *bus, sd_bus_message *m, sd_bus_message **reply) {
         sd_bus_message *q;
         int r;
@@ -68,12 +68,6 @@ static inline bool BUS_MATCH_IS_COMPARE(enum bus_match_node_type t) {
         return t >= BUS_MATCH_SENDER && t <= BUS_MATCH_ARG_HAS_LAST;
 }
 
-static inline bool BUS_MATCH_CAN_HASH(enum bus_match_node_type t) {
-        return (t >= BUS_MATCH_MESSAGE_TYPE && t <= BUS_MATCH_PATH) ||
-                (t >= BUS_MATCH_ARG && t <= BUS_MATCH_ARG_LAST) ||
-                (t >= BUS_MATCH_ARG_HAS && t <= BUS_MATCH_ARG_HAS_LAST);
-}
-
 static void bus_match_node_free(struct bus_match_node *node) {
         assert(node);
         assert(node->parent);
@@ -102,15 +96,19 @@ static void bus_match_node_free(struct bus_match_node *node) {
 
                 if (node->parent->type == BUS_MATCH_MESSAGE_TYPE)
                         hashmap_remove(node->parent->compare.children, UINT_TO_PTR(node->value.u8));
-                else if (BUS_MATCH_CAN_HASH(node->parent->type) && node->value.str)
+                else if (node->value.str) {
                         hashmap_remove(node->parent->compare.children, node->value.str);
+                        hashmap_remove(node->parent->compare.well_known, node->value.str);
+                }
 
                 free(node->value.str);
         }
 
         if (BUS_MATCH_IS_COMPARE(node->type)) {
                 assert(hashmap_isempty(node->compare.children));
+                assert(hashmap_isempty(node->compare.well_known));
                 hashmap_free(node->compare.children);
+                hashmap_free(node->compare.well_known);
         }
 
         free(node);
@@ -132,127 +130,196 @@ static bool bus_match_node_maybe_free(struct bus_match_node *node) {
         return true;
 }
 
-static bool value_node_test(
+static int bus_match_run_prefix(
+                sd_bus *bus,
                 struct bus_match_node *node,
-                enum bus_match_node_type parent_type,
-                uint8_t value_u8,
-                const char *value_str,
-                char **value_strv,
+                char *buf,
+                size_t l,
                 sd_bus_message *m) {
 
-        assert(node);
-        assert(node->type == BUS_MATCH_VALUE);
+        struct bus_match_node *found;
+        char c;
 
-        /* Tests parameters against this value node, doing prefix
-         * magic and stuff. */
+        /* Looks up the first l characters of buf in the index of the
+         * compare node, by temporarily terminating the string
+         * there. */
 
-        switch (parent_type) {
+        c = buf[l];
+        buf[l] = 0;
+        found = hashmap_get(node->compare.children, buf);
+        buf[l] = c;
 
-        case BUS_MATCH_MESSAGE_TYPE:
-                return node->value.u8 == value_u8;
+        return bus_match_run(bus, found, m);
+}
 
-        case BUS_MATCH_SENDER:
-                if (streq_ptr(node->value.str, value_str))
-                        return true;
+static bool prefix_pattern_test(const char *pattern, const char *value, char separator, bool complex) {
+        if (separator == '/')
+                return complex ? path_complex_pattern(pattern, value) : path_simple_pattern(pattern, value);
 
-                if (m->creds.mask & SD_BUS_CREDS_WELL_KNOWN_NAMES) {
-                        char **i;
+        return complex ? namespace_complex_pattern(pattern, value) : namespace_simple_pattern(pattern, value);
+}
 
-                        /* on kdbus we have the well known names list
-                         * in the credentials, let's make use of that
-                         * for an accurate match */
+static int bus_match_run_prefixes(
+                sd_bus *bus,
+                struct bus_match_node *node,
+                const char *value,
+                char separator,
+                bool complex,
+                sd_bus_message *m) {
 
-                        STRV_FOREACH(i, m->creds.well_known_names)
-                                if (streq_ptr(node->value.str, *i))
-                                        return true;
+        _cleanup_free_ char *allocated = NULL;
+        size_t i, n, k = 1, last = (size_t) -1;
+        struct bus_match_node *c;
+        Iterator j;
+        char *buf;
+        int r;
 
-                } else {
+        assert(node);
 
-                        /* If we don't have kdbus, we don't know the
-                         * well-known names of the senders. In that,
-                         * let's just hope that dbus-daemon doesn't
-                         * send us stuff we didn't want. */
+        /* Namespace and path matches are indexed by the pattern
+         * string too. Instead of testing every pattern against the
+         * value, we look up all prefixes of the value that could be
+         * a matching pattern, see simple_pattern_check() and
+         * complex_pattern_check(). That way the cost depends on the
+         * number of labels of the value, not the number of
+         * matches. */
 
-                        if (node->value.str[0] != ':' && value_str && value_str[0] == ':')
-                                return true;
-                }
+        if (!value)
+                return 0;
 
-                return false;
+        for (n = 0; value[n]; n++)
+                if (value[n] == separator)
+                        k += 2;
+
+        /* If there are fewer patterns than lookups we'd have to do,
+         * just test them one by one. Also, complex patterns match
+         * the other way round, if the value ends in a separator and
+         * is a prefix of the pattern. This cannot be looked up, but
+         * values like that are rare, so let's just iterate in this
+         * case. */
+        if (hashmap_size(node->compare.children) <= k ||
+            (complex && n > 0 && value[n-1] == separator)) {
+
+                HASHMAP_FOREACH(c, node->compare.children, j) {
+                        if (!prefix_pattern_test(c->value.str, value, separator, complex))
+                                continue;
 
-        case BUS_MATCH_DESTINATION:
-        case BUS_MATCH_INTERFACE:
-        case BUS_MATCH_MEMBER:
-        case BUS_MATCH_PATH:
-        case BUS_MATCH_ARG ... BUS_MATCH_ARG_LAST:
+                        r = bus_match_run(bus, c, m);
+                        if (r != 0)
+                                return r;
 
-                if (value_str)
-                        return streq_ptr(node->value.str, value_str);
+                        if (bus && bus->match_callbacks_modified)
+                                return 0;
+                }
 
-                return false;
+                return 0;
+        }
 
-        case BUS_MATCH_ARG_HAS ... BUS_MATCH_ARG_HAS_LAST: {
-                char **i;
+        if (n < 256)
+                buf = strdupa(value);
+        else {
+                buf = allocated = strdup(value);
+                if (!buf)
+                        return -ENOMEM;
+        }
 
-                STRV_FOREACH(i, value_strv)
-                        if (streq_ptr(node->value.str, *i))
-                                return true;
+        for (i = 0; i < n; i++) {
+                if (buf[i] != separator)
+                        continue;
 
-                return false;
-        }
+                /* Simple patterns match if the value continues with a
+                 * separator right after them... */
+                if (!complex && i != last) {
+                        last = i;
 
-        case BUS_MATCH_ARG_NAMESPACE ... BUS_MATCH_ARG_NAMESPACE_LAST:
-                if (value_str)
-                        return namespace_simple_pattern(node->value.str, value_str);
+                        r = bus_match_run_prefix(bus, node, buf, i, m);
+                        if (r != 0)
+                                return r;
 
-                return false;
+                        if (bus && bus->match_callbacks_modified)
+                                return 0;
+                }
 
-        case BUS_MATCH_PATH_NAMESPACE:
-                return path_simple_pattern(node->value.str, value_str);
+                /* ... and both kinds match if they end in a separator
+                 * themselves. */
+                last = i + 1;
 
-        case BUS_MATCH_ARG_PATH ... BUS_MATCH_ARG_PATH_LAST:
-                if (value_str)
-                        return path_complex_pattern(node->value.str, value_str);
+                r = bus_match_run_prefix(bus, node, buf, i + 1, m);
+                if (r != 0)
+                        return r;
 
-                return false;
+                if (bus && bus->match_callbacks_modified)
+                        return 0;
+        }
 
-        default:
-                assert_not_reached("Invalid node type");
+        if (last != n) {
+                r = bus_match_run_prefix(bus, node, buf, n, m);
+                if (r != 0)
+                        return r;
         }
+
+        return 0;
 }
 
-static bool value_node_same(
+static int bus_match_run_sender(
+                sd_bus *bus,
                 struct bus_match_node *node,
-                enum bus_match_node_type parent_type,
-                uint8_t value_u8,
-                const char *value_str) {
+                const char *sender,
+                sd_bus_message *m) {
 
-        /* Tests parameters against this value node, not doing prefix
-         * magic and stuff, i.e. this one actually compares the match
-         * itself. */
+        struct bus_match_node *c;
+        int r;
 
         assert(node);
-        assert(node->type == BUS_MATCH_VALUE);
+        assert(m);
 
-        switch (parent_type) {
+        if (sender) {
+                r = bus_match_run(bus, hashmap_get(node->compare.children, sender), m);
+                if (r != 0)
+                        return r;
 
-        case BUS_MATCH_MESSAGE_TYPE:
-                return node->value.u8 == value_u8;
+                if (bus && bus->match_callbacks_modified)
+                        return 0;
+        }
 
-        case BUS_MATCH_SENDER:
-        case BUS_MATCH_DESTINATION:
-        case BUS_MATCH_INTERFACE:
-        case BUS_MATCH_MEMBER:
-        case BUS_MATCH_PATH:
-        case BUS_MATCH_ARG ... BUS_MATCH_ARG_LAST:
-        case BUS_MATCH_ARG_HAS ... BUS_MATCH_ARG_HAS_LAST:
-        case BUS_MATCH_ARG_NAMESPACE ... BUS_MATCH_ARG_NAMESPACE_LAST:
-        case BUS_MATCH_PATH_NAMESPACE:
-        case BUS_MATCH_ARG_PATH ... BUS_MATCH_ARG_PATH_LAST:
-                return streq(node->value.str, value_str);
+        if (m->creds.mask & SD_BUS_CREDS_WELL_KNOWN_NAMES) {
+                char **i;
 
-        default:
-                assert_not_reached("Invalid node type");
+                /* on kdbus we have the well known names list
+                 * in the credentials, let's make use of that
+                 * for an accurate match */
+
+                STRV_FOREACH(i, m->creds.well_known_names) {
+                        if (streq_ptr(*i, sender))
+                                continue;
+
+                        r = bus_match_run(bus, hashmap_get(node->compare.children, *i), m);
+                        if (r != 0)
+                                return r;
+
+                        if (bus && bus->match_callbacks_modified)
+                                return 0;
+                }
+
+        } else if (sender && sender[0] == ':') {
+                Iterator i;
+
+                /* If we don't have kdbus, we don't know the
+                 * well-known names of the senders. In that,
+                 * let's just hope that dbus-daemon doesn't
+                 * send us stuff we didn't want. */
+
+                HASHMAP_FOREACH(c, node->compare.well_known, i) {
+                        r = bus_match_run(bus, c, m);
+                        if (r != 0)
+                                return r;
+
+                        if (bus && bus->match_callbacks_modified)
+                                return 0;
+                }
         }
+
+        return 0;
 }
 
 int bus_match_run(
@@ -387,54 +454,55 @@ int bus_match_run(
                 assert_not_reached("Unknown match type.");
         }
 
-        if (BUS_MATCH_CAN_HASH(node->type)) {
-                struct bus_match_node *found;
+        /* All value nodes are indexed by their value, so let's jump
+         * directly to the ones that match. */
 
-                /* Lookup via hash table, nice! So let's jump directly. */
+        switch (node->type) {
 
-                if (test_str)
-                        found = hashmap_get(node->compare.children, test_str);
-                else if (test_strv) {
-                        char **i;
+        case BUS_MATCH_MESSAGE_TYPE:
+                r = bus_match_run(bus, hashmap_get(node->compare.children, UINT_TO_PTR(test_u8)), m);
+                break;
 
-                        STRV_FOREACH(i, test_strv) {
-                                found = hashmap_get(node->compare.children, *i);
-                                if (found) {
-                                        r = bus_match_run(bus, found, m);
-                                        if (r != 0)
-                                                return r;
-                                }
-                        }
+        case BUS_MATCH_SENDER:
+                r = bus_match_run_sender(bus, node, test_str, m);
+                break;
 
-                        found = NULL;
-                } else if (node->type == BUS_MATCH_MESSAGE_TYPE)
-                        found = hashmap_get(node->compare.children, UINT_TO_PTR(test_u8));
-                else
-                        found = NULL;
+        case BUS_MATCH_PATH_NAMESPACE:
+                r = bus_match_run_prefixes(bus, node, test_str, '/', false, m);
+                break;
 
-                if (found) {
-                        r = bus_match_run(bus, found, m);
-                        if (r != 0)
-                                return r;
-                }
-        } else {
-                struct bus_match_node *c;
+        case BUS_MATCH_ARG_NAMESPACE ... BUS_MATCH_ARG_NAMESPACE_LAST:
+                r = bus_match_run_prefixes(bus, node, test_str, '.', false, m);
+                break;
 
-                /* No hash table, so let's iterate manually... */
+        case BUS_MATCH_ARG_PATH ... BUS_MATCH_ARG_PATH_LAST:
+                r = bus_match_run_prefixes(bus, node, test_str, '/', true, m);
+                break;
 
-                for (c = node->child; c; c = c->next) {
-                        if (!value_node_test(c, node->type, test_u8, test_str, test_strv, m))
-                                continue;
+        case BUS_MATCH_ARG_HAS ... BUS_MATCH_ARG_HAS_LAST: {
+                char **i;
 
-                        r = bus_match_run(bus, c, m);
+                r = 0;
+                STRV_FOREACH(i, test_strv) {
+                        r = bus_match_run(bus, hashmap_get(node->compare.children, *i), m);
                         if (r != 0)
-                                return r;
+                                break;
 
                         if (bus && bus->match_callbacks_modified)
-                                return 0;
+                                break;
                 }
+
+                break;
+        }
+
+        default:
+                r = test_str ? bus_match_run(bus, hashmap_get(node->compare.children, test_str), m) : 0;
+                break;
         }
 
+        if (r != 0)
+                return r;
+
         if (bus && bus->match_callbacks_modified)
                 return 0;
 
@@ -466,12 +534,8 @@ static int bus_match_add_compare_value(
 
                 if (t == BUS_MATCH_MESSAGE_TYPE)
                         n = hashmap_get(c->compare.children, UINT_TO_PTR(value_u8));
-                else if (BUS_MATCH_CAN_HASH(t))
+                else
                         n = hashmap_get(c->compare.children, value_str);
-                else {
-                        for (n = c->child; n && !value_node_same(n, t, value_u8, value_str); n = n->next)
-                                ;
-                }
 
                 if (n) {
                         *ret = n;
@@ -494,18 +558,10 @@ static int bus_match_add_compare_value(
                         c->next->prev = c;
                 where->child = c;
 
-                if (t == BUS_MATCH_MESSAGE_TYPE) {
-                        c->compare.children = hashmap_new(NULL);
-                        if (!c->compare.children) {
-                                r = -ENOMEM;
-                                goto fail;
-                        }
-                } else if (BUS_MATCH_CAN_HASH(t)) {
-                        c->compare.children = hashmap_new(&string_hash_ops);
-                        if (!c->compare.children) {
-                                r = -ENOMEM;
-                                goto fail;
-                        }
+                c->compare.children = hashmap_new(t == BUS_MATCH_MESSAGE_TYPE ? NULL : &string_hash_ops);
+                if (!c->compare.children) {
+                        r = -ENOMEM;
+                        goto fail;
                 }
         }
 
@@ -526,20 +582,25 @@ static int bus_match_add_compare_value(
         }
 
         n->parent = c;
-        if (c->compare.children) {
 
-                if (t == BUS_MATCH_MESSAGE_TYPE)
-                        r = hashmap_put(c->compare.children, UINT_TO_PTR(value_u8), n);
-                else
-                        r = hashmap_put(c->compare.children, n->value.str, n);
+        if (t == BUS_MATCH_MESSAGE_TYPE)
+                r = hashmap_put(c->compare.children, UINT_TO_PTR(value_u8), n);
+        else
+                r = hashmap_put(c->compare.children, n->value.str, n);
+        if (r < 0)
+                goto fail;
 
-                if (r < 0)
+        /* Without kdbus a sender match on a well-known name also
+         * matches all messages from unique names, hence keep a
+         * separate index of those. */
+        if (t == BUS_MATCH_SENDER && n->value.str[0] != ':') {
+                r = hashmap_ensure_allocated(&c->compare.well_known, &string_hash_ops);
+                if (r >= 0)
+                        r = hashmap_put(c->compare.well_known, n->value.str, n);
+                if (r < 0) {
+                        hashmap_remove(c->compare.children, n->value.str);
                         goto fail;
-        } else {
-                n->next = c->child;
-                if (n->next)
-                        n->next->prev = n;
-                c->child = n;
+                }
         }
 
         *ret = n;
@@ -579,12 +640,8 @@ static int bus_match_find_compare_value(
 
         if (t == BUS_MATCH_MESSAGE_TYPE)
                 n = hashmap_get(c->compare.children, UINT_TO_PTR(value_u8));
-        else if (BUS_MATCH_CAN_HASH(t))
+        else
                 n = hashmap_get(c->compare.children, value_str);
-        else {
-                for (n = c->child; n && !value_node_same(n, t, value_u8, value_str); n = n->next)
-                        ;
-        }
 
         if (n) {
                 *ret = n;
@@ -1079,7 +1136,7 @@ void bus_match_free(struct bus_match_node *node) {
         if (!node)
                 return;
 
-        if (BUS_MATCH_CAN_HASH(node->type)) {
+        if (BUS_MATCH_IS_COMPARE(node->type)) {
                 Iterator i;
 
                 HASHMAP_FOREACH(c, node->compare.children, i)
@@ -1172,7 +1229,7 @@ void bus_match_dump(struct bus_match_node *node, unsigned level) {
         else
                 putchar('\n');
 
-        if (BUS_MATCH_CAN_HASH(node->type)) {
+        if (BUS_MATCH_IS_COMPARE(node->type)) {
                 Iterator i;
 
                 HASHMAP_FOREACH(c, node->compare.children, i)
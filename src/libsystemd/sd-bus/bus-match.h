@@ -61,8 +61,12 @@ struct bus_match_node {
                         struct match_callback *callback;
                 } leaf;
                 struct {
-                        /* If this is set, then the child is NULL */
+                        /* The value nodes below, indexed by value;
+                         * the child list is unused */
                         Hashmap *children;
+                        /* BUS_MATCH_SENDER only: the subset of value
+                         * nodes that are well-known names */
+                        Hashmap *well_known;
                 } compare;
         };
 };
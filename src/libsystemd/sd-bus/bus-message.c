@@ -145,6 +145,8 @@ static void message_free(sd_bus_message *m) {
         if (m->iovec != m->iovec_fixed)
                 free(m->iovec);
 
+        free(m->memfd_table);
+
         m->destination_ptr = mfree(m->destination_ptr);
         message_reset_containers(m);
         free(m->root_container.signature);
@@ -3013,6 +3015,21 @@ int bus_message_seal(sd_bus_message *m, uint64_t cookie, usec_t timeout) {
                         }
         }
 
+        /* On peer-to-peer AF_UNIX connections that negotiated it we
+         * pass sealed memfd parts as fds instead of copying their
+         * contents into the stream. Note that only dbus1 marshalling
+         * is spoken on sockets. */
+        if (m->bus->can_memfds && !BUS_MESSAGE_IS_GVARIANT(m)) {
+                unsigned n = 0;
+
+                MESSAGE_FOREACH_PART(part, i, m)
+                        if (part->memfd >= 0 && part->sealed)
+                                n++;
+
+                if (n > 0 && m->n_fds + n <= BUS_FDS_MAX)
+                        m->header->flags |= BUS_MESSAGE_MEMFD_PAYLOAD;
+        }
+
         m->root_container.end = m->user_body_size;
         m->root_container.index = 0;
         m->root_container.offset_index = 0;
@@ -128,6 +128,11 @@ struct sd_bus_message {
         struct iovec iovec_fixed[2];
         unsigned n_iovec;
 
+        /* The memfd table sent on AF_UNIX transports, see
+         * BUS_MESSAGE_MEMFD_PAYLOAD */
+        uint64_t *memfd_table;
+        unsigned n_memfds;
+
         struct kdbus_msg *kdbus;
 
         char *peeked_signature;
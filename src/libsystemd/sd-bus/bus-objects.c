@@ -851,6 +851,169 @@ static int property_get_all_callbacks_run(
         return 1;
 }
 
+static int node_append_all_properties(
+                sd_bus *bus,
+                sd_bus_message *reply,
+                const char *path,
+                const char *prefix,
+                bool require_fallback,
+                const char *interface,
+                sd_bus_error *error) {
+
+        struct node_vtable *c;
+        struct node *n;
+        bool found = false;
+        int r;
+
+        n = hashmap_get(bus->nodes, prefix);
+        if (!n)
+                return 0;
+
+        LIST_FOREACH(vtables, c, n->vtables) {
+                void *u;
+
+                if (require_fallback && !c->is_fallback)
+                        continue;
+
+                if (!streq(c->interface, interface))
+                        continue;
+
+                r = node_vtable_get_userdata(bus, path, c, &u, error);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        continue;
+
+                found = true;
+
+                r = vtable_append_all_properties(bus, reply, path, c, u, error);
+                if (r < 0)
+                        return r;
+        }
+
+        return found;
+}
+
+static int object_append_properties(
+                sd_bus *bus,
+                sd_bus_message *reply,
+                const char *path,
+                const char *interface,
+                char **properties,
+                sd_bus_error *error) {
+
+        bool found = false;
+        char **property;
+        size_t pl;
+        int r;
+
+        assert(bus);
+        assert(reply);
+        assert(path);
+        assert(interface);
+
+        pl = strlen(path);
+
+        if (strv_isempty(properties)) {
+                char prefix[pl+1];
+
+                /* Use the path itself, or the closest prefix that
+                 * has fallback vtables for the interface */
+
+                r = node_append_all_properties(bus, reply, path, path, false, interface, error);
+                if (r != 0)
+                        return r;
+
+                OBJECT_PATH_FOREACH_PREFIX(prefix, path) {
+                        r = node_append_all_properties(bus, reply, path, prefix, true, interface, error);
+                        if (r != 0)
+                                return r;
+                }
+
+                return 0;
+        }
+
+        STRV_FOREACH(property, properties) {
+                struct vtable_member key = {
+                        .interface = (char*) interface,
+                        .member = *property,
+                };
+                struct vtable_member *v;
+                char prefix[pl+1];
+                void *u;
+
+                /* Look for the property on the path itself first,
+                 * then on fallbacks registered for its prefixes */
+
+                key.path = (char*) path;
+                v = hashmap_get(bus->vtable_properties, &key);
+                if (!v) {
+                        OBJECT_PATH_FOREACH_PREFIX(prefix, path) {
+                                key.path = prefix;
+                                v = hashmap_get(bus->vtable_properties, &key);
+                                if (v && v->parent->is_fallback)
+                                        break;
+
+                                v = NULL;
+                        }
+                }
+                if (!v)
+                        continue;
+
+                r = node_vtable_get_userdata(bus, path, v->parent, &u, error);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        continue;
+
+                r = vtable_append_one_property(bus, reply, path, v->parent, v->vtable, u, error);
+                if (r < 0)
+                        return r;
+
+                found = true;
+        }
+
+        return found;
+}
+
+int bus_append_object_properties(
+                sd_bus *bus,
+                sd_bus_message *reply,
+                const char *path,
+                const char *interface,
+                char **properties,
+                sd_bus_error *error) {
+
+        sd_bus_slot *current_slot;
+        void *current_userdata;
+        int r;
+
+        assert(bus);
+        assert(reply);
+        assert(path);
+        assert(interface);
+
+        /* Appends the listed properties of an object, or all of
+         * them if the list is empty, as "{sv}" dict entries to
+         * reply, taking them from the vtables registered on the bus,
+         * exactly like Get and GetAll would. Properties that do not
+         * exist are skipped. Returns > 0 if any property was
+         * appended. This is useful for method handlers that
+         * want to return properties of many objects in one reply. As
+         * such handlers run from within a vtable callback, restore
+         * the current slot and userdata afterwards. */
+
+        current_slot = bus->current_slot;
+        current_userdata = bus->current_userdata;
+
+        r = object_append_properties(bus, reply, path, interface, properties, error);
+
+        bus->current_slot = current_slot;
+        bus->current_userdata = current_userdata;
+
+        return r;
+}
+
 static int bus_node_exists(
                 sd_bus *bus,
                 struct node *n,
@@ -960,9 +1123,13 @@ static int process_introspect(
                         fprintf(intro.f, " <interface name=\"%s\">\n", c->interface);
                 }
 
-                r = introspect_write_interface(&intro, c->vtable);
-                if (r < 0)
-                        goto finish;
+                if (!c->introspection) {
+                        r = introspect_format_interface(c->vtable, bus->trusted, &c->introspection);
+                        if (r < 0)
+                                goto finish;
+                }
+
+                fputs(c->introspection, intro.f);
 
                 previous_interface = c->interface;
         }
@@ -1356,7 +1523,142 @@ static int object_find_and_run(
         return 0;
 }
 
+static void vtable_member_hash_func(const void *a, struct siphash *state) {
+        const struct vtable_member *m = a;
+
+        assert(m);
+
+        string_hash_func(m->path, state);
+        string_hash_func(m->interface, state);
+        string_hash_func(m->member, state);
+}
+
+static int vtable_member_compare_func(const void *a, const void *b) {
+        const struct vtable_member *x = a, *y = b;
+        int r;
+
+        assert(x);
+        assert(y);
+
+        r = strcmp(x->path, y->path);
+        if (r != 0)
+                return r;
+
+        r = strcmp(x->interface, y->interface);
+        if (r != 0)
+                return r;
+
+        return strcmp(x->member, y->member);
+}
+
+static const struct hash_ops vtable_member_hash_ops = {
+        .hash = vtable_member_hash_func,
+        .compare = vtable_member_compare_func
+};
+
+#define VTABLE_METHOD_CACHE_MAX 4096U
+
+struct vtable_method_cache_entry {
+        struct vtable_member key;
+        struct vtable_member *member;
+};
+
+void bus_vtable_cache_flush(sd_bus *bus) {
+        assert(bus);
+
+        hashmap_clear_free(bus->vtable_method_cache);
+}
+
+static struct vtable_member *vtable_method_cache_lookup(sd_bus *bus, sd_bus_message *m) {
+        struct vtable_method_cache_entry *e;
+        struct vtable_member key, *v = NULL;
+        size_t pl, il, ml;
+        struct node *n;
+        char *p;
+
+        assert(bus);
+        assert(m);
+
+        /* Resolves the method a call would be dispatched to by
+         * object_find_and_run() when walking the path and its
+         * prefixes, and remembers the result. Returns NULL if the
+         * walk is needed anyway, i.e. if object callbacks are in the
+         * way or no method is registered for the call. */
+
+        if (!m->interface || !m->member)
+                return NULL;
+
+        /* The standard interfaces are never part of a vtable */
+        if (startswith(m->interface, "org.freedesktop.DBus."))
+                return NULL;
+
+        key.path = m->path;
+        key.interface = m->interface;
+        key.member = m->member;
+
+        e = hashmap_get(bus->vtable_method_cache, &key);
+        if (e)
+                return e->member;
+
+        n = hashmap_get(bus->nodes, m->path);
+        if (n) {
+                if (n->callbacks)
+                        return NULL;
+
+                v = hashmap_get(bus->vtable_methods, &key);
+        }
+
+        if (!v) {
+                char prefix[strlen(m->path) + 1];
+
+                OBJECT_PATH_FOREACH_PREFIX(prefix, m->path) {
+                        n = hashmap_get(bus->nodes, prefix);
+                        if (!n)
+                                continue;
+                        if (n->callbacks)
+                                return NULL;
+
+                        key.path = prefix;
+                        v = hashmap_get(bus->vtable_methods, &key);
+                        if (v && v->parent->is_fallback)
+                                break;
+
+                        v = NULL;
+                }
+
+                if (!v)
+                        return NULL;
+        }
+
+        /* Caching is best effort, the lookup result is good either way */
+        if (hashmap_size(bus->vtable_method_cache) >= VTABLE_METHOD_CACHE_MAX)
+                bus_vtable_cache_flush(bus);
+
+        if (hashmap_ensure_allocated(&bus->vtable_method_cache, &vtable_member_hash_ops) < 0)
+                return v;
+
+        pl = strlen(m->path) + 1;
+        il = strlen(m->interface) + 1;
+        ml = strlen(m->member) + 1;
+
+        e = malloc(sizeof(struct vtable_method_cache_entry) + pl + il + ml);
+        if (!e)
+                return v;
+
+        p = (char*) (e + 1);
+        e->key.path = memcpy(p, m->path, pl);
+        e->key.interface = memcpy(p + pl, m->interface, il);
+        e->key.member = memcpy(p + pl + il, m->member, ml);
+        e->member = v;
+
+        if (hashmap_put(bus->vtable_method_cache, &e->key, e) < 0)
+                free(e);
+
+        return v;
+}
+
 int bus_process_object(sd_bus *bus, sd_bus_message *m) {
+        struct vtable_member *v;
         int r;
         size_t pl;
         bool found_object = false;
@@ -1380,6 +1682,18 @@ int bus_process_object(sd_bus *bus, sd_bus_message *m) {
         assert(m->path);
         assert(m->member);
 
+        /* Try the method this call was last dispatched to first. If
+         * that doesn't settle it, e.g. because the find callback
+         * didn't know the object, do the full walk. */
+        v = vtable_method_cache_lookup(bus, m);
+        if (v) {
+                bus->nodes_modified = false;
+
+                r = method_callbacks_run(bus, m, v, !streq(v->path, m->path), &found_object);
+                if (r != 0)
+                        return r;
+        }
+
         pl = strlen(m->path);
         do {
                 char prefix[pl+1];
@@ -1563,6 +1877,7 @@ static int bus_add_object(
         s->node_callback.node = n;
         LIST_PREPEND(callbacks, n->callbacks, &s->node_callback);
         bus->nodes_modified = true;
+        bus_vtable_cache_flush(bus);
 
         if (slot)
                 *slot = s;
@@ -1596,39 +1911,6 @@ _public_ int sd_bus_add_fallback(
         return bus_add_object(bus, slot, true, prefix, callback, userdata);
 }
 
-static void vtable_member_hash_func(const void *a, struct siphash *state) {
-        const struct vtable_member *m = a;
-
-        assert(m);
-
-        string_hash_func(m->path, state);
-        string_hash_func(m->interface, state);
-        string_hash_func(m->member, state);
-}
-
-static int vtable_member_compare_func(const void *a, const void *b) {
-        const struct vtable_member *x = a, *y = b;
-        int r;
-
-        assert(x);
-        assert(y);
-
-        r = strcmp(x->path, y->path);
-        if (r != 0)
-                return r;
-
-        r = strcmp(x->interface, y->interface);
-        if (r != 0)
-                return r;
-
-        return strcmp(x->member, y->member);
-}
-
-static const struct hash_ops vtable_member_hash_ops = {
-        .hash = vtable_member_hash_func,
-        .compare = vtable_member_compare_func
-};
-
 static int add_object_vtable_internal(
                 sd_bus *bus,
                 sd_bus_slot **slot,
@@ -1808,6 +2090,7 @@ static int add_object_vtable_internal(
         s->node_vtable.node = n;
         LIST_INSERT_AFTER(vtables, n->vtables, existing, &s->node_vtable);
         bus->nodes_modified = true;
+        bus_vtable_cache_flush(bus);
 
         if (slot)
                 *slot = s;
@@ -22,4 +22,6 @@
 #include "bus-internal.h"
 
 int bus_process_object(sd_bus *bus, sd_bus_message *m);
+int bus_append_object_properties(sd_bus *bus, sd_bus_message *reply, const char *path, const char *interface, char **properties, sd_bus_error *error);
 void bus_node_gc(sd_bus *b, struct node *n);
+void bus_vtable_cache_flush(sd_bus *bus);
@@ -75,6 +75,12 @@ enum {
         BUS_MESSAGE_NO_REPLY_EXPECTED = 1,
         BUS_MESSAGE_NO_AUTO_START = 2,
         BUS_MESSAGE_ALLOW_INTERACTIVE_AUTHORIZATION = 4,
+
+        /* sd-bus extension, only used on peer-to-peer AF_UNIX
+         * connections that negotiated memfd passing: a table
+         * describing the body parts passed as sealed memfds follows
+         * the header fields on the wire. */
+        BUS_MESSAGE_MEMFD_PAYLOAD = 128,
 };
 
 /* Header fields */
@@ -107,6 +107,7 @@ void bus_slot_disconnect(sd_bus_slot *slot) {
                 if (slot->node_callback.node) {
                         LIST_REMOVE(callbacks, slot->node_callback.node->callbacks, &slot->node_callback);
                         slot->bus->nodes_modified = true;
+                        bus_vtable_cache_flush(slot->bus);
 
                         bus_node_gc(slot->bus, slot->node_callback.node);
                 }
@@ -140,6 +141,9 @@ void bus_slot_disconnect(sd_bus_slot *slot) {
                 if (slot->node_vtable.node && slot->node_vtable.interface && slot->node_vtable.vtable) {
                         const sd_bus_vtable *v;
 
+                        /* The cache points into the members freed below */
+                        bus_vtable_cache_flush(slot->bus);
+
                         for (v = slot->node_vtable.vtable; v->type != _SD_BUS_VTABLE_END; v++) {
                                 struct vtable_member *x = NULL;
 
@@ -174,6 +178,7 @@ void bus_slot_disconnect(sd_bus_slot *slot) {
                 }
 
                 free(slot->node_vtable.interface);
+                free(slot->node_vtable.introspection);
 
                 if (slot->node_vtable.node) {
                         LIST_REMOVE(vtables, slot->node_vtable.node->vtables, &slot->node_vtable);
@@ -18,6 +18,7 @@
 ***/
 
 #include <endian.h>
+#include <limits.h>
 #include <poll.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -33,17 +34,23 @@
 #include "format-util.h"
 #include "hexdecoct.h"
 #include "macro.h"
+#include "memfd-util.h"
 #include "missing.h"
 #include "selinux-util.h"
 #include "signal-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
+#include "unaligned.h"
 #include "user-util.h"
 #include "utf8.h"
 #include "util.h"
 
 #define SNDBUF_SIZE (8*1024*1024)
 
+/* If no fds may be passed we read ahead, and parse as many messages
+ * as we got from a single read */
+#define RBUFFER_READ_AHEAD_SIZE (64*1024)
+
 static void iovec_advance(struct iovec iov[], unsigned *idx, size_t size) {
 
         while (size > 0) {
@@ -76,9 +83,57 @@ static int append_iovec(sd_bus_message *m, const void *p, size_t sz) {
         return 0;
 }
 
+static bool message_part_is_memfd(struct bus_body_part *part) {
+        assert(part);
+
+        return part->memfd >= 0 && part->sealed;
+}
+
+static int message_setup_memfd_table(sd_bus_message *m) {
+        struct bus_body_part *part;
+        uint64_t *t, offset = 0;
+        unsigned n = 0, i;
+
+        assert(m);
+        assert(m->header->flags & BUS_MESSAGE_MEMFD_PAYLOAD);
+
+        MESSAGE_FOREACH_PART(part, i, m)
+                if (message_part_is_memfd(part))
+                        n++;
+
+        assert(n > 0);
+
+        /* The table consists of the number of entries, followed by
+         * one (body offset, memfd offset, size) triplet for each body
+         * part that is passed as memfd, all in little endian. */
+        t = new(uint64_t, 1 + n * 3);
+        if (!t)
+                return -ENOMEM;
+
+        t[0] = htole64(n);
+        n = 0;
+
+        MESSAGE_FOREACH_PART(part, i, m) {
+                if (message_part_is_memfd(part)) {
+                        t[1 + n * 3] = htole64(offset);
+                        t[1 + n * 3 + 1] = htole64(part->memfd_offset);
+                        t[1 + n * 3 + 2] = htole64(part->size);
+                        n++;
+                }
+
+                offset += part->size;
+        }
+
+        m->memfd_table = t;
+        m->n_memfds = n;
+
+        return 0;
+}
+
 static int bus_message_setup_iovec(sd_bus_message *m) {
         struct bus_body_part *part;
         unsigned n, i;
+        bool memfds;
         int r;
 
         assert(m);
@@ -89,7 +144,9 @@ static int bus_message_setup_iovec(sd_bus_message *m) {
 
         assert(!m->iovec);
 
-        n = 1 + m->n_body_parts;
+        memfds = m->header->flags & BUS_MESSAGE_MEMFD_PAYLOAD;
+
+        n = 1 + memfds + m->n_body_parts;
         if (n < ELEMENTSOF(m->iovec_fixed))
                 m->iovec = m->iovec_fixed;
         else {
@@ -104,7 +161,20 @@ static int bus_message_setup_iovec(sd_bus_message *m) {
         if (r < 0)
                 goto fail;
 
+        if (memfds) {
+                r = message_setup_memfd_table(m);
+                if (r < 0)
+                        goto fail;
+
+                r = append_iovec(m, m->memfd_table, sizeof(uint64_t) * (1 + m->n_memfds * 3));
+                if (r < 0)
+                        goto fail;
+        }
+
         MESSAGE_FOREACH_PART(part, i, m)  {
+                if (memfds && message_part_is_memfd(part))
+                        continue;
+
                 r = bus_body_part_map(part);
                 if (r < 0)
                         goto fail;
@@ -114,7 +184,7 @@ static int bus_message_setup_iovec(sd_bus_message *m) {
                         goto fail;
         }
 
-        assert(n == m->n_iovec);
+        assert(n >= m->n_iovec);
 
         return 0;
 
@@ -123,6 +193,29 @@ fail:
         return r;
 }
 
+size_t bus_socket_message_size(sd_bus_message *m) {
+        struct bus_body_part *part;
+        size_t sz;
+        unsigned i, n = 0;
+
+        assert(m);
+
+        if (!(m->header->flags & BUS_MESSAGE_MEMFD_PAYLOAD))
+                return BUS_MESSAGE_SIZE(m);
+
+        /* The bytes passed as memfd are not part of the stream, but
+         * the memfd table is */
+        sz = BUS_MESSAGE_BODY_BEGIN(m);
+
+        MESSAGE_FOREACH_PART(part, i, m)
+                if (message_part_is_memfd(part))
+                        n++;
+                else
+                        sz += part->size;
+
+        return sz + sizeof(uint64_t) * (1 + n * 3);
+}
+
 bool bus_socket_auth_needs_write(sd_bus *b) {
 
         unsigned i;
@@ -172,16 +265,26 @@ static int bus_socket_write_auth(sd_bus *b) {
         return 1;
 }
 
+static bool bus_socket_wants_memfds(sd_bus *b) {
+        assert(b);
+
+        /* Passing memfds is an sd-bus extension, hence we only ask
+         * for it on direct peer-to-peer connections, never when
+         * talking to a bus broker. It requires fd passing. */
+
+        return !b->bus_client && (b->hello_flags & KDBUS_HELLO_ACCEPT_FD);
+}
+
 static int bus_socket_auth_verify_client(sd_bus *b) {
-        char *e, *f, *start;
+        char *e, *f, *g, *start;
         sd_id128_t peer;
         unsigned i;
         int r;
 
         assert(b);
 
-        /* We expect two response lines: "OK" and possibly
-         * "AGREE_UNIX_FD" */
+        /* We expect up to three response lines: "OK" and possibly
+         * "AGREE_UNIX_FD" and "AGREE_MEMFD" */
 
         e = memmem_safe(b->rbuffer, b->rbuffer_size, "\r\n", 2);
         if (!e)
@@ -198,6 +301,15 @@ static int bus_socket_auth_verify_client(sd_bus *b) {
                 start = e + 2;
         }
 
+        if (bus_socket_wants_memfds(b)) {
+                g = memmem(start, b->rbuffer_size - (start - (char*) b->rbuffer), "\r\n", 2);
+                if (!g)
+                        return 0;
+
+                start = g + 2;
+        } else
+                g = NULL;
+
         /* Nice! We got all the lines we need. First check the OK
          * line */
 
@@ -234,6 +346,14 @@ static int bus_socket_auth_verify_client(sd_bus *b) {
                         (f - e == strlen("\r\nAGREE_UNIX_FD")) &&
                         memcmp(e + 2, "AGREE_UNIX_FD", strlen("AGREE_UNIX_FD")) == 0;
 
+        /* The server replies with ERROR if it doesn't know the memfd
+         * extension, in which case we just continue without it */
+        if (g)
+                b->can_memfds =
+                        b->can_fds &&
+                        (g - f == strlen("\r\nAGREE_MEMFD")) &&
+                        memcmp(f + 2, "AGREE_MEMFD", strlen("AGREE_MEMFD")) == 0;
+
         b->rbuffer_size -= (start - (char*) b->rbuffer);
         memmove(b->rbuffer, start, b->rbuffer_size);
 
@@ -479,6 +599,13 @@ static int bus_socket_auth_verify_server(sd_bus *b) {
                                 b->can_fds = true;
                                 r = bus_socket_auth_write(b, "AGREE_UNIX_FD\r\n");
                         }
+                } else if (line_equals(line, l, "NEGOTIATE_MEMFD")) {
+                        if (b->auth == _BUS_AUTH_INVALID || !b->can_fds)
+                                r = bus_socket_auth_write(b, "ERROR\r\n");
+                        else {
+                                b->can_memfds = true;
+                                r = bus_socket_auth_write(b, "AGREE_MEMFD\r\n");
+                        }
                 } else
                         r = bus_socket_auth_write(b, "ERROR\r\n");
 
@@ -640,7 +767,9 @@ static int bus_socket_start_auth_client(sd_bus *b) {
         if (!b->auth_buffer)
                 return -ENOMEM;
 
-        if (b->hello_flags & KDBUS_HELLO_ACCEPT_FD)
+        if (bus_socket_wants_memfds(b))
+                auth_suffix = "\r\nNEGOTIATE_UNIX_FD\r\nNEGOTIATE_MEMFD\r\nBEGIN\r\n";
+        else if (b->hello_flags & KDBUS_HELLO_ACCEPT_FD)
                 auth_suffix = "\r\nNEGOTIATE_UNIX_FD\r\nBEGIN\r\n";
         else
                 auth_suffix = "\r\nBEGIN\r\n";
@@ -766,74 +895,232 @@ int bus_socket_take_fd(sd_bus *b) {
         return bus_socket_start_auth(b);
 }
 
-int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
+static void message_setup_control(sd_bus_message *m, struct msghdr *mh, struct cmsghdr *control) {
+        struct bus_body_part *part;
+        unsigned n_fds, i;
+        int *f;
+
+        assert(m);
+        assert(mh);
+        assert(control);
+
+        n_fds = m->n_fds + m->n_memfds;
+
+        mh->msg_control = control;
+        mh->msg_controllen = control->cmsg_len = CMSG_LEN(sizeof(int) * n_fds);
+        control->cmsg_level = SOL_SOCKET;
+        control->cmsg_type = SCM_RIGHTS;
+
+        /* The memfds follow the fds of the message itself */
+        f = (int*) CMSG_DATA(control);
+        memcpy_safe(f, m->fds, sizeof(int) * m->n_fds);
+        f += m->n_fds;
+
+        if (m->n_memfds > 0)
+                MESSAGE_FOREACH_PART(part, i, m)
+                        if (message_part_is_memfd(part))
+                                *(f++) = part->memfd;
+}
+
+int bus_socket_write_messages(sd_bus *bus, sd_bus_message **messages, unsigned n_messages, size_t *idx, unsigned *ret_n_written) {
         struct iovec *iov;
+        unsigned i, j, n_iovec = 0, n_batch;
+        size_t sz = 0;
         ssize_t k;
-        size_t n;
-        unsigned j;
         int r;
 
         assert(bus);
-        assert(m);
+        assert(messages);
+        assert(n_messages > 0);
         assert(idx);
+        assert(ret_n_written);
         assert(bus->state == BUS_RUNNING || bus->state == BUS_HELLO);
 
-        if (*idx >= BUS_MESSAGE_SIZE(m))
+        *ret_n_written = 0;
+
+        if (*idx >= bus_socket_message_size(messages[0]))
                 return 0;
 
-        r = bus_message_setup_iovec(m);
-        if (r < 0)
-                return r;
+        /* Coalesce as many queued messages as possible into a single
+         * write. Since the kernel attaches fds to the bytes they were
+         * sent with, only the first message of a batch may carry
+         * fds, so that the receiver can attribute them correctly. */
+        for (n_batch = 0; n_batch < n_messages; n_batch++) {
+                sd_bus_message *m = messages[n_batch];
+
+                if ((m->header->flags & BUS_MESSAGE_MEMFD_PAYLOAD) && !bus->can_memfds)
+                        return -EPROTONOSUPPORT;
+
+                if (n_batch > 0) {
+                        if (m->n_fds > 0 || (m->header->flags & BUS_MESSAGE_MEMFD_PAYLOAD))
+                                break;
 
-        n = m->n_iovec * sizeof(struct iovec);
-        iov = alloca(n);
-        memcpy_safe(iov, m->iovec, n);
+                        if (sz >= SNDBUF_SIZE)
+                                break;
+                }
+
+                r = bus_message_setup_iovec(m);
+                if (r < 0)
+                        return r;
+
+                if (n_batch > 0 && n_iovec + m->n_iovec > IOV_MAX)
+                        break;
+
+                n_iovec += m->n_iovec;
+                sz += bus_socket_message_size(m);
+        }
+
+        iov = newa(struct iovec, n_iovec);
+
+        for (i = 0, n_iovec = 0; i < n_batch; i++) {
+                memcpy_safe(iov + n_iovec, messages[i]->iovec, messages[i]->n_iovec * sizeof(struct iovec));
+                n_iovec += messages[i]->n_iovec;
+        }
 
         j = 0;
         iovec_advance(iov, &j, *idx);
 
         if (bus->prefer_writev)
-                k = writev(bus->output_fd, iov, m->n_iovec);
+                k = writev(bus->output_fd, iov + j, n_iovec - j);
         else {
                 struct msghdr mh = {
-                        .msg_iov = iov,
-                        .msg_iovlen = m->n_iovec,
+                        .msg_iov = iov + j,
+                        .msg_iovlen = n_iovec - j,
                 };
 
-                if (m->n_fds > 0 && *idx == 0) {
-                        struct cmsghdr *control;
-
-                        mh.msg_control = control = alloca(CMSG_SPACE(sizeof(int) * m->n_fds));
-                        mh.msg_controllen = control->cmsg_len = CMSG_LEN(sizeof(int) * m->n_fds);
-                        control->cmsg_level = SOL_SOCKET;
-                        control->cmsg_type = SCM_RIGHTS;
-                        memcpy(CMSG_DATA(control), m->fds, sizeof(int) * m->n_fds);
-                }
+                if (messages[0]->n_fds + messages[0]->n_memfds > 0 && *idx == 0)
+                        message_setup_control(messages[0], &mh, alloca(CMSG_SPACE(sizeof(int) * (messages[0]->n_fds + messages[0]->n_memfds))));
 
                 k = sendmsg(bus->output_fd, &mh, MSG_DONTWAIT|MSG_NOSIGNAL);
                 if (k < 0 && errno == ENOTSOCK) {
                         bus->prefer_writev = true;
-                        k = writev(bus->output_fd, iov, m->n_iovec);
+                        k = writev(bus->output_fd, iov + j, n_iovec - j);
                 }
         }
 
         if (k < 0)
                 return errno == EAGAIN ? 0 : -errno;
 
-        *idx += (size_t) k;
+        bus->n_write_calls++;
+
+        /* Figure out how many messages went out completely, and how
+         * much of the next one */
+        for (i = 0; i < n_batch; i++) {
+                size_t left;
+
+                left = bus_socket_message_size(messages[i]) - *idx;
+                if ((size_t) k < left) {
+                        *idx += (size_t) k;
+                        break;
+                }
+
+                k -= left;
+                *idx = 0;
+        }
+
+        bus->n_messages_written += i;
+        *ret_n_written = i;
+
         return 1;
 }
 
-static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
+int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
+        unsigned n;
+        int r;
+
+        assert(m);
+        assert(idx);
+
+        r = bus_socket_write_messages(bus, &m, 1, idx, &n);
+        if (r <= 0)
+                return r;
+
+        if (n > 0)
+                *idx = bus_socket_message_size(m);
+
+        return 1;
+}
+
+static int bus_socket_read_header_sizes(sd_bus *bus, size_t offset, uint32_t *ret_fields_size, uint32_t *ret_body_size) {
+        const uint8_t *h;
+        uint32_t a, b;
+
+        assert(bus);
+        assert(bus->rbuffer_size >= offset + sizeof(struct bus_header));
+
+        /* After reading ahead messages might start at any offset */
+        h = (const uint8_t*) bus->rbuffer + offset;
+
+        if (h[0] == BUS_LITTLE_ENDIAN) {
+                a = unaligned_read_le32(h + 4);
+                b = unaligned_read_le32(h + 12);
+        } else if (h[0] == BUS_BIG_ENDIAN) {
+                a = unaligned_read_be32(h + 4);
+                b = unaligned_read_be32(h + 12);
+        } else
+                return -EBADMSG;
+
+        *ret_fields_size = b;
+        *ret_body_size = a;
+        return 0;
+}
+
+static int bus_socket_read_memfd_table_need(sd_bus *bus, size_t offset, size_t begin, uint32_t body_size, size_t *need) {
+        const uint8_t *t;
+        uint64_t n, i, end = 0, memfd_size = 0;
+
+        assert(bus);
+        assert(need);
+
+        /* First, we need the number of entries in the table */
+        if (bus->rbuffer_size < offset + begin + sizeof(uint64_t)) {
+                *need = begin + sizeof(uint64_t);
+                return 0;
+        }
+
+        t = (const uint8_t*) bus->rbuffer + offset + begin;
+
+        n = unaligned_read_le64(t);
+        if (n <= 0 || n > BUS_FDS_MAX)
+                return -EBADMSG;
+
+        /* Then, the table itself */
+        if (bus->rbuffer_size < offset + begin + sizeof(uint64_t) * (1 + n * 3)) {
+                *need = begin + sizeof(uint64_t) * (1 + n * 3);
+                return 0;
+        }
+
+        for (i = 0; i < n; i++) {
+                uint64_t o, size;
+
+                o = unaligned_read_le64(t + sizeof(uint64_t) * (1 + i * 3));
+                size = unaligned_read_le64(t + sizeof(uint64_t) * (1 + i * 3 + 2));
+
+                if (o < end || size <= 0)
+                        return -EBADMSG;
+                if (o > body_size || size > body_size - o)
+                        return -EBADMSG;
+
+                end = o + size;
+                memfd_size += size;
+        }
+
+        *need = begin + sizeof(uint64_t) * (1 + n * 3) + (body_size - memfd_size);
+        return 0;
+}
+
+/* Determines how many bytes the message starting at 'offset' in the
+ * read buffer needs, counted from that offset */
+static int bus_socket_read_message_need(sd_bus *bus, size_t offset, size_t *need) {
         uint32_t a, b;
-        uint8_t e;
         uint64_t sum;
+        int r;
 
         assert(bus);
         assert(need);
         assert(bus->state == BUS_RUNNING || bus->state == BUS_HELLO);
 
-        if (bus->rbuffer_size < sizeof(struct bus_header)) {
+        if (bus->rbuffer_size < offset + sizeof(struct bus_header)) {
                 *need = sizeof(struct bus_header) + 8;
 
                 /* Minimum message size:
@@ -855,27 +1142,149 @@ static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
                 return 0;
         }
 
-        a = ((const uint32_t*) bus->rbuffer)[1];
-        b = ((const uint32_t*) bus->rbuffer)[3];
-
-        e = ((const uint8_t*) bus->rbuffer)[0];
-        if (e == BUS_LITTLE_ENDIAN) {
-                a = le32toh(a);
-                b = le32toh(b);
-        } else if (e == BUS_BIG_ENDIAN) {
-                a = be32toh(a);
-                b = be32toh(b);
-        } else
-                return -EBADMSG;
+        r = bus_socket_read_header_sizes(bus, offset, &b, &a);
+        if (r < 0)
+                return r;
 
         sum = (uint64_t) sizeof(struct bus_header) + (uint64_t) ALIGN_TO(b, 8) + (uint64_t) a;
         if (sum >= BUS_MESSAGE_SIZE_MAX)
                 return -ENOBUFS;
 
+        if (((const uint8_t*) bus->rbuffer)[offset + offsetof(struct bus_header, flags)] & BUS_MESSAGE_MEMFD_PAYLOAD) {
+                if (!bus->can_memfds)
+                        return -EBADMSG;
+
+                return bus_socket_read_memfd_table_need(bus, offset, sizeof(struct bus_header) + ALIGN_TO(b, 8), a, need);
+        }
+
         *need = (size_t) sum;
         return 0;
 }
 
+static int bus_socket_message_from_memfd_table(sd_bus *bus, sd_bus_message **ret) {
+        struct bus_body_part *part;
+        sd_bus_message *m;
+        const uint64_t *t;
+        uint32_t fields_size, body_size;
+        size_t begin, table_size, pos = 0;
+        unsigned n, n_regular, i;
+        uint8_t *p;
+        int r;
+
+        assert(bus);
+        assert(ret);
+
+        /* Builds a message from the stream data followed by a memfd
+         * table. bus_socket_read_message_need() already validated the
+         * table layout, but we need to validate the fds we got. */
+
+        r = bus_socket_read_header_sizes(bus, 0, &fields_size, &body_size);
+        if (r < 0)
+                return r;
+
+        begin = sizeof(struct bus_header) + ALIGN_TO(fields_size, 8);
+        t = (const uint64_t*) ((const uint8_t*) bus->rbuffer + begin);
+        n = (unsigned) le64toh(t[0]);
+        table_size = sizeof(uint64_t) * (1 + n * 3);
+
+        if (bus->n_fds < n)
+                return -EBADMSG;
+        n_regular = bus->n_fds - n;
+
+        for (i = 0; i < n; i++) {
+                int fd = bus->fds[n_regular + i];
+                uint64_t sz;
+
+                /* We map the memfds only later, hence insist that
+                 * the sender cannot modify them anymore */
+                r = memfd_get_sealed(fd);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        return -EBADMSG;
+
+                r = memfd_get_size(fd, &sz);
+                if (r < 0)
+                        return r;
+
+                if (le64toh(t[1 + i * 3 + 1]) > sz || le64toh(t[1 + i * 3 + 2]) > sz - le64toh(t[1 + i * 3 + 1]))
+                        return -EBADMSG;
+        }
+
+        r = bus_message_from_header(
+                        bus,
+                        bus->rbuffer, begin,
+                        NULL, 0,
+                        begin + body_size,
+                        bus->fds, n_regular,
+                        NULL,
+                        0, &m);
+        if (r < 0)
+                return r;
+
+        p = (uint8_t*) bus->rbuffer + begin + table_size;
+
+        for (i = 0; i <= n; i++) {
+                size_t offset;
+
+                offset = i < n ? le64toh(t[1 + i * 3]) : body_size;
+
+                /* The bytes in front of the memfd are in the stream */
+                if (offset > pos) {
+                        part = message_append_part(m);
+                        if (!part) {
+                                r = -ENOMEM;
+                                goto fail;
+                        }
+
+                        part->data = p;
+                        part->size = offset - pos;
+                        part->sealed = true;
+
+                        p += part->size;
+                        pos = offset;
+                }
+
+                if (i >= n)
+                        break;
+
+                part = message_append_part(m);
+                if (!part) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+
+                part->memfd = bus->fds[n_regular + i];
+                part->memfd_offset = le64toh(t[1 + i * 3 + 1]);
+                part->size = le64toh(t[1 + i * 3 + 2]);
+                part->sealed = true;
+
+                pos += part->size;
+        }
+
+        r = bus_message_parse_fields(m);
+        if (r < 0)
+                goto fail;
+
+        /* From now on this is a message like any other */
+        m->header->flags &= ~BUS_MESSAGE_MEMFD_PAYLOAD;
+
+        /* We take possession of the memory and fds now */
+        m->free_header = true;
+        m->free_fds = true;
+
+        *ret = m;
+        return 0;
+
+fail:
+        /* The memfds are still owned by the bus */
+        MESSAGE_FOREACH_PART(part, i, m)
+                part->memfd = -1;
+
+        sd_bus_message_unref(m);
+        return r;
+}
+
 static int bus_socket_make_message(sd_bus *bus, size_t size) {
         sd_bus_message *t;
         void *b;
@@ -897,11 +1306,14 @@ static int bus_socket_make_message(sd_bus *bus, size_t size) {
         } else
                 b = NULL;
 
-        r = bus_message_from_malloc(bus,
-                                    bus->rbuffer, size,
-                                    bus->fds, bus->n_fds,
-                                    NULL,
-                                    &t);
+        if (((const struct bus_header*) bus->rbuffer)->flags & BUS_MESSAGE_MEMFD_PAYLOAD)
+                r = bus_socket_message_from_memfd_table(bus, &t);
+        else
+                r = bus_message_from_malloc(bus,
+                                            bus->rbuffer, size,
+                                            bus->fds, bus->n_fds,
+                                            NULL,
+                                            &t);
         if (r < 0) {
                 free(b);
                 return r;
@@ -914,15 +1326,69 @@ static int bus_socket_make_message(sd_bus *bus, size_t size) {
         bus->n_fds = 0;
 
         bus->rqueue[bus->rqueue_size++] = t;
+        bus->n_messages_read++;
 
         return 1;
 }
 
+static int bus_socket_make_messages(sd_bus *bus, size_t need) {
+        size_t offset = 0;
+        int r;
+
+        assert(bus);
+        assert(bus->rbuffer_size >= need);
+
+        /* If we didn't read ahead, or if the read buffer contains
+         * exactly one large message, just pass the buffer on */
+        if (bus->can_fds || (bus->rbuffer_size == need && need >= RBUFFER_READ_AHEAD_SIZE))
+                return bus_socket_make_message(bus, need);
+
+        /* Otherwise, copy all complete messages out of the buffer,
+         * and move what remains to the front only once at the end,
+         * so that the buffer can be reused for the next read. Note
+         * that no fds can be pending here. */
+        do {
+                sd_bus_message *t;
+                void *b;
+
+                r = bus_rqueue_make_room(bus);
+                if (r < 0)
+                        break;
+
+                b = memdup((const uint8_t*) bus->rbuffer + offset, need);
+                if (!b) {
+                        r = -ENOMEM;
+                        break;
+                }
+
+                r = bus_message_from_malloc(bus, b, need, NULL, 0, NULL, &t);
+                if (r < 0) {
+                        free(b);
+                        break;
+                }
+
+                bus->rqueue[bus->rqueue_size++] = t;
+                bus->n_messages_read++;
+
+                offset += need;
+
+                r = bus_socket_read_message_need(bus, offset, &need);
+                if (r < 0)
+                        break;
+
+        } while (bus->rbuffer_size - offset >= need);
+
+        memmove(bus->rbuffer, (uint8_t*) bus->rbuffer + offset, bus->rbuffer_size - offset);
+        bus->rbuffer_size -= offset;
+
+        return r < 0 ? r : 1;
+}
+
 int bus_socket_read_message(sd_bus *bus) {
         struct msghdr mh;
         struct iovec iov = {};
         ssize_t k;
-        size_t need;
+        size_t need, sz;
         int r;
         void *b;
         union {
@@ -934,21 +1400,30 @@ int bus_socket_read_message(sd_bus *bus) {
         assert(bus);
         assert(bus->state == BUS_RUNNING || bus->state == BUS_HELLO);
 
-        r = bus_socket_read_message_need(bus, &need);
+        r = bus_socket_read_message_need(bus, 0, &need);
         if (r < 0)
                 return r;
 
         if (bus->rbuffer_size >= need)
-                return bus_socket_make_message(bus, need);
+                return bus_socket_make_messages(bus, need);
+
+        /* The kernel attaches fds to the bytes they were sent with,
+         * hence if fds may be passed we have to read exactly one
+         * message at a time, so that we know which message they
+         * belong to. Otherwise, read as much as we can get. */
+        if (bus->can_fds)
+                sz = need;
+        else
+                sz = MAX(need, (size_t) RBUFFER_READ_AHEAD_SIZE);
 
-        b = realloc(bus->rbuffer, need);
+        b = realloc(bus->rbuffer, sz);
         if (!b)
                 return -ENOMEM;
 
         bus->rbuffer = b;
 
         iov.iov_base = (uint8_t*) bus->rbuffer + bus->rbuffer_size;
-        iov.iov_len = need - bus->rbuffer_size;
+        iov.iov_len = sz - bus->rbuffer_size;
 
         if (bus->prefer_readv)
                 k = readv(bus->input_fd, &iov, 1);
@@ -972,6 +1447,7 @@ int bus_socket_read_message(sd_bus *bus) {
                 return -ECONNRESET;
 
         bus->rbuffer_size += k;
+        bus->n_read_calls++;
 
         if (handle_cmsg) {
                 struct cmsghdr *cmsg;
@@ -1006,12 +1482,12 @@ int bus_socket_read_message(sd_bus *bus) {
                                           cmsg->cmsg_level, cmsg->cmsg_type);
         }
 
-        r = bus_socket_read_message_need(bus, &need);
+        r = bus_socket_read_message_need(bus, 0, &need);
         if (r < 0)
                 return r;
 
         if (bus->rbuffer_size >= need)
-                return bus_socket_make_message(bus, need);
+                return bus_socket_make_messages(bus, need);
 
         return 1;
 }
@@ -161,6 +161,7 @@ static void bus_free(sd_bus *b) {
 
         hashmap_free_free(b->vtable_methods);
         hashmap_free_free(b->vtable_properties);
+        hashmap_free_free(b->vtable_method_cache);
 
         assert(hashmap_isempty(b->nodes));
         hashmap_free(b->nodes);
@@ -1629,6 +1630,21 @@ int bus_seal_synthetic_message(sd_bus *b, sd_bus_message *m) {
         return bus_message_seal(m, 0xFFFFFFFFULL, 0);
 }
 
+static void log_sent_message(sd_bus_message *m) {
+        assert(m);
+
+        log_debug("Sent message type=%s sender=%s destination=%s object=%s interface=%s member=%s cookie=%" PRIu64 " reply_cookie=%" PRIu64 " error=%s",
+                  bus_message_type_to_string(m->header->type),
+                  strna(sd_bus_message_get_sender(m)),
+                  strna(sd_bus_message_get_destination(m)),
+                  strna(sd_bus_message_get_path(m)),
+                  strna(sd_bus_message_get_interface(m)),
+                  strna(sd_bus_message_get_member(m)),
+                  BUS_MESSAGE_COOKIE(m),
+                  m->reply_cookie,
+                  strna(m->error.message));
+}
+
 static int bus_write_message(sd_bus *bus, sd_bus_message *m, bool hint_sync_call, size_t *idx) {
         int r;
 
@@ -1643,17 +1659,8 @@ static int bus_write_message(sd_bus *bus, sd_bus_message *m, bool hint_sync_call
         if (r <= 0)
                 return r;
 
-        if (bus->is_kernel || *idx >= BUS_MESSAGE_SIZE(m))
-                log_debug("Sent message type=%s sender=%s destination=%s object=%s interface=%s member=%s cookie=%" PRIu64 " reply_cookie=%" PRIu64 " error=%s",
-                          bus_message_type_to_string(m->header->type),
-                          strna(sd_bus_message_get_sender(m)),
-                          strna(sd_bus_message_get_destination(m)),
-                          strna(sd_bus_message_get_path(m)),
-                          strna(sd_bus_message_get_interface(m)),
-                          strna(sd_bus_message_get_member(m)),
-                          BUS_MESSAGE_COOKIE(m),
-                          m->reply_cookie,
-                          strna(m->error.message));
+        if (bus->is_kernel || *idx >= bus_socket_message_size(m))
+                log_sent_message(m);
 
         return r;
 }
@@ -1665,15 +1672,22 @@ static int dispatch_wqueue(sd_bus *bus) {
         assert(bus->state == BUS_RUNNING || bus->state == BUS_HELLO);
 
         while (bus->wqueue_size > 0) {
+                unsigned n, i;
 
-                r = bus_write_message(bus, bus->wqueue[0], false, &bus->windex);
+                if (bus->is_kernel) {
+                        r = bus_write_message(bus, bus->wqueue[0], false, &bus->windex);
+                        n = r > 0;
+                } else
+                        /* On sockets, write as many queued messages
+                         * as possible with a single syscall */
+                        r = bus_socket_write_messages(bus, bus->wqueue, bus->wqueue_size, &bus->windex, &n);
                 if (r < 0)
                         return r;
                 else if (r == 0)
                         /* Didn't do anything this time */
                         return ret;
-                else if (bus->is_kernel || bus->windex >= BUS_MESSAGE_SIZE(bus->wqueue[0])) {
-                        /* Fully written. Let's drop the entry from
+                else if (n > 0) {
+                        /* Fully written. Let's drop the entries from
                          * the queue.
                          *
                          * This isn't particularly optimized, but
@@ -1683,10 +1697,15 @@ static int dispatch_wqueue(sd_bus *bus) {
                          * it got full, then all bets are off
                          * anyway. */
 
-                        bus->wqueue_size--;
-                        sd_bus_message_unref(bus->wqueue[0]);
-                        memmove(bus->wqueue, bus->wqueue + 1, sizeof(sd_bus_message*) * bus->wqueue_size);
-                        bus->windex = 0;
+                        for (i = 0; i < n; i++) {
+                                if (!bus->is_kernel)
+                                        log_sent_message(bus->wqueue[i]);
+
+                                sd_bus_message_unref(bus->wqueue[i]);
+                        }
+
+                        bus->wqueue_size -= n;
+                        memmove(bus->wqueue, bus->wqueue + n, sizeof(sd_bus_message*) * bus->wqueue_size);
 
                         ret = 1;
                 }
@@ -1804,7 +1823,7 @@ static int bus_send_internal(sd_bus *bus, sd_bus_message *_m, uint64_t *cookie,
                         return r;
                 }
 
-                if (!bus->is_kernel && idx < BUS_MESSAGE_SIZE(m))  {
+                if (!bus->is_kernel && idx < bus_socket_message_size(m))  {
                         /* Wasn't fully written. So let's remember how
                          * much was written. Note that the first entry
                          * of the wqueue array is always allocated so
@@ -24,13 +24,20 @@
 #include "alloc-util.h"
 #include "bus-internal.h"
 #include "bus-kernel.h"
+#include "bus-match.h"
+#include "bus-message.h"
+#include "bus-slot.h"
 #include "bus-util.h"
 #include "def.h"
 #include "fd-util.h"
+#include "stdio-util.h"
 #include "time-util.h"
 #include "util.h"
 
 #define MAX_SIZE (2*1024*1024)
+#define N_BATCH_SIGNALS 50000
+#define N_MATCH_DISPATCH 20000U
+#define N_CALLS 10000U
 
 static usec_t arg_loop_usec = 100 * USEC_PER_MSEC;
 
@@ -240,10 +247,188 @@ static void client_chart(Type type, const char *address, const char *server_name
         sd_bus_unref(b);
 }
 
+static void client_batch(int fd) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *x = NULL;
+        unsigned i;
+        usec_t t;
+        sd_bus *b;
+
+        assert_se(sd_bus_new(&b) >= 0);
+        assert_se(sd_bus_set_fd(b, fd, fd) >= 0);
+
+        /* Without fd passing the server may read ahead */
+        assert_se(sd_bus_negotiate_fds(b, false) >= 0);
+        assert_se(sd_bus_start(b) >= 0);
+
+        /* We are still authenticating, hence all of these end up in
+         * the write queue, and are written in batches on flush */
+        for (i = 0; i < N_BATCH_SIGNALS; i++)
+                assert_se(sd_bus_emit_signal(b, "/", "benchmark.server", "Changed", "u", i) >= 0);
+
+        assert_se(sd_bus_message_new_method_call(b, &x, NULL, "/", "benchmark.server", "Exit") >= 0);
+        assert_se(sd_bus_message_append(x, "t", (uint64_t) N_BATCH_SIGNALS) >= 0);
+        assert_se(sd_bus_send(b, x, NULL) >= 0);
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(sd_bus_flush(b) >= 0);
+        t = now(CLOCK_MONOTONIC) - t;
+
+        printf("Wrote %" PRIu64 " messages with %" PRIu64 " write calls in " USEC_FMT "us\n",
+               b->n_messages_written, b->n_write_calls, t);
+        fflush(stdout);
+
+        sd_bus_unref(b);
+}
+
+static const sd_bus_vtable calls_vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("NoOperation", NULL, NULL, NULL, 0),
+        SD_BUS_VTABLE_END
+};
+
+static void time_calls(sd_bus *b, const char *path, const char *interface, const char *member) {
+        unsigned i;
+        usec_t t;
+
+        t = now(CLOCK_MONOTONIC);
+        for (i = 0; i < N_CALLS; i++) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+
+                assert_se(sd_bus_call_method(b, NULL, path, interface, member, NULL, &reply, NULL) >= 0);
+        }
+        t = now(CLOCK_MONOTONIC) - t;
+
+        printf("%s\t%s.%s\t%.2f\n", path, interface, member, (double) t / N_CALLS);
+}
+
+static void client_calls(int fd) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *x = NULL;
+        sd_bus *b;
+
+        assert_se(sd_bus_new(&b) >= 0);
+        assert_se(sd_bus_set_fd(b, fd, fd) >= 0);
+        assert_se(sd_bus_start(b) >= 0);
+
+        /* Calls to an object and to a fallback, both of which are
+         * resolved from the method lookup cache after the first one,
+         * and introspection of both */
+        printf("PATH\tMETHOD\tUSEC\n");
+
+        time_calls(b, "/foo", "benchmark.Object", "NoOperation");
+        time_calls(b, "/value/a/x", "benchmark.Fallback", "NoOperation");
+        time_calls(b, "/foo", "org.freedesktop.DBus.Introspectable", "Introspect");
+        time_calls(b, "/value/a", "org.freedesktop.DBus.Introspectable", "Introspect");
+        fflush(stdout);
+
+        assert_se(sd_bus_message_new_method_call(b, &x, NULL, "/", "benchmark.server", "Exit") >= 0);
+        assert_se(sd_bus_message_append(x, "t", (uint64_t) N_CALLS) >= 0);
+        assert_se(sd_bus_send(b, x, NULL) >= 0);
+        assert_se(sd_bus_flush(b) >= 0);
+
+        sd_bus_unref(b);
+}
+
+static int count_filter(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        (*(unsigned*) userdata)++;
+        return 0;
+}
+
+static void match_add(struct bus_match_node *root, sd_bus_slot *s, unsigned *counter, const char *match) {
+        struct bus_match_component *components = NULL;
+        unsigned n_components = 0;
+
+        zero(*s);
+        s->userdata = counter;
+        s->match_callback.callback = count_filter;
+
+        assert_se(bus_match_parse(match, &components, &n_components) >= 0);
+        assert_se(bus_match_add(root, components, n_components, &s->match_callback) >= 0);
+        bus_match_parse_free(components, n_components);
+}
+
+static void match_dispatch(sd_bus *bus, unsigned n) {
+        struct bus_match_node root = {
+                .type = BUS_MATCH_ROOT,
+        };
+
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        _cleanup_free_ sd_bus_slot *slots = NULL;
+        unsigned i, counter = 0;
+        usec_t t;
+
+        /* Installs n matches of each kind that logind or machined
+         * would install per session or machine, and measures how long
+         * dispatching a message against them takes */
+
+        slots = new(sd_bus_slot, n * 5);
+        assert_se(slots);
+
+        for (i = 0; i < n; i++) {
+                char match[LINE_MAX];
+
+                xsprintf(match, "type='signal',interface='org.example.Session',path='/org/example/session/%u'", i);
+                match_add(&root, slots + i*5, &counter, match);
+
+                xsprintf(match, "type='signal',member='NameOwnerChanged',arg0='name%u'", i);
+                match_add(&root, slots + i*5 + 1, &counter, match);
+
+                xsprintf(match, "type='signal',path_namespace='/org/example/%u'", i);
+                match_add(&root, slots + i*5 + 2, &counter, match);
+
+                xsprintf(match, "type='signal',arg2namespace='org.example.n%u'", i);
+                match_add(&root, slots + i*5 + 3, &counter, match);
+
+                xsprintf(match, "type='signal',arg1path='/dev/block/%u/'", i);
+                match_add(&root, slots + i*5 + 4, &counter, match);
+        }
+
+        assert_se(sd_bus_message_new_signal(bus, &m, "/org/example/7/session", "org.freedesktop.DBus", "NameOwnerChanged") >= 0);
+        assert_se(sd_bus_message_append(m, "sss", "name7", "/dev/block/7/sda", "org.example.n7.x") >= 0);
+        assert_se(bus_message_seal(m, 1, 0) >= 0);
+
+        t = now(CLOCK_MONOTONIC);
+        for (i = 0; i < N_MATCH_DISPATCH; i++)
+                assert_se(bus_match_run(NULL, &root, m) == 0);
+        t = now(CLOCK_MONOTONIC) - t;
+
+        /* arg0, path_namespace, arg2namespace and arg1path */
+        assert_se(counter == 4 * N_MATCH_DISPATCH);
+
+        printf("%u\t%.3f\n", n * 5, (double) t / N_MATCH_DISPATCH);
+
+        for (i = 0; i < n * 5; i++)
+                assert_se(bus_match_remove(&root, &slots[i].match_callback) > 0);
+}
+
+static void match_chart(void) {
+        _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
+        _cleanup_close_pair_ int pair[2] = { -1, -1 };
+        unsigned n;
+
+        /* The messages only need a bus object, not a connection
+         * to anything */
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, pair) >= 0);
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, pair[0], pair[0]) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        /* The bus owns the fd now */
+        pair[0] = -1;
+
+        printf("MATCHES\tUSEC\n");
+
+        for (n = 10; n <= 10000; n *= 10)
+                match_dispatch(bus, n);
+}
+
 int main(int argc, char *argv[]) {
         enum {
                 MODE_BISECT,
                 MODE_CHART,
+                MODE_BATCH,
+                MODE_MATCH,
+                MODE_CALLS,
         } mode = MODE_BISECT;
         Type type = TYPE_KDBUS;
         int i, pair[2] = { -1, -1 };
@@ -260,6 +445,17 @@ int main(int argc, char *argv[]) {
                 if (streq(argv[i], "chart")) {
                         mode = MODE_CHART;
                         continue;
+                } else if (streq(argv[i], "batch")) {
+                        mode = MODE_BATCH;
+                        type = TYPE_DIRECT;
+                        continue;
+                } else if (streq(argv[i], "calls")) {
+                        mode = MODE_CALLS;
+                        type = TYPE_DIRECT;
+                        continue;
+                } else if (streq(argv[i], "match")) {
+                        mode = MODE_MATCH;
+                        continue;
                 } else if (streq(argv[i], "legacy")) {
                         type = TYPE_LEGACY;
                         continue;
@@ -273,6 +469,12 @@ int main(int argc, char *argv[]) {
 
         assert_se(!MODE_BISECT || TYPE_KDBUS);
 
+        /* Runs on its own, without a server */
+        if (mode == MODE_MATCH) {
+                match_chart();
+                return 0;
+        }
+
         assert_se(arg_loop_usec > 0);
 
         if (type == TYPE_KDBUS) {
@@ -326,6 +528,14 @@ int main(int argc, char *argv[]) {
                 assert_se(server_name);
         }
 
+        if (mode == MODE_CALLS) {
+                r = sd_bus_add_object_vtable(b, NULL, "/foo", "benchmark.Object", calls_vtable, NULL);
+                assert_se(r >= 0);
+
+                r = sd_bus_add_fallback_vtable(b, NULL, "/value", "benchmark.Fallback", calls_vtable, NULL, NULL);
+                assert_se(r >= 0);
+        }
+
         sync();
         setpriority(PRIO_PROCESS, 0, -19);
 
@@ -348,6 +558,17 @@ int main(int argc, char *argv[]) {
                 case MODE_CHART:
                         client_chart(type, address, server_name, pair[1]);
                         break;
+
+                case MODE_BATCH:
+                        client_batch(pair[1]);
+                        break;
+
+                case MODE_CALLS:
+                        client_calls(pair[1]);
+                        break;
+
+                case MODE_MATCH:
+                        assert_not_reached("Match mode has no client");
                 }
 
                 _exit(0);
@@ -361,6 +582,9 @@ int main(int argc, char *argv[]) {
 
         if (mode == MODE_BISECT)
                 printf("Copying/memfd are equally fast at %zu bytes\n", result);
+        else if (mode == MODE_BATCH)
+                printf("Read %" PRIu64 " messages with %" PRIu64 " read calls\n",
+                       b->n_messages_read, b->n_read_calls);
 
         assert_se(waitpid(pid, NULL, 0) == pid);
 
@@ -17,12 +17,19 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include <limits.h>
+#include <sys/socket.h>
+
+#include "alloc-util.h"
+#include "bus-internal.h"
 #include "bus-match.h"
 #include "bus-message.h"
 #include "bus-slot.h"
 #include "bus-util.h"
+#include "fd-util.h"
 #include "log.h"
 #include "macro.h"
+#include "stdio-util.h"
 
 static bool mask[32];
 
@@ -83,6 +90,87 @@ static void test_match_scope(const char *match, enum bus_match_scope scope) {
         bus_match_parse_free(components, n_components);
 }
 
+static int count_filter(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        (*(unsigned*) userdata)++;
+        return 0;
+}
+
+static void many_match_add(struct bus_match_node *root, sd_bus_slot *s, unsigned *counter, const char *match) {
+        struct bus_match_component *components = NULL;
+        unsigned n_components = 0;
+
+        zero(*s);
+        s->userdata = counter;
+        s->match_callback.callback = count_filter;
+
+        assert_se(bus_match_parse(match, &components, &n_components) >= 0);
+        assert_se(bus_match_add(root, components, n_components, &s->match_callback) >= 0);
+        bus_match_parse_free(components, n_components);
+}
+
+#define N_MANY 10U
+
+static void test_match_many(void) {
+        struct bus_match_node root = {
+                .type = BUS_MATCH_ROOT,
+        };
+
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
+        _cleanup_close_pair_ int pair[2] = { -1, -1 };
+        sd_bus_slot slots[N_MANY * 5];
+        unsigned i, counter = 0;
+
+        /* Installs a few matches of each kind that logind or machined
+         * would install per session or machine, and checks that
+         * dispatching a message against them only invokes the ones
+         * that match. The messages only need a bus object, not a
+         * connection to anything. */
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, pair) >= 0);
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, pair[0], pair[0]) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        /* The bus owns the fd now */
+        pair[0] = -1;
+
+        for (i = 0; i < N_MANY; i++) {
+                char match[LINE_MAX];
+
+                xsprintf(match, "type='signal',interface='org.example.Session',path='/org/example/session/%u'", i);
+                many_match_add(&root, slots + i*5, &counter, match);
+
+                xsprintf(match, "type='signal',member='NameOwnerChanged',arg0='name%u'", i);
+                many_match_add(&root, slots + i*5 + 1, &counter, match);
+
+                xsprintf(match, "type='signal',path_namespace='/org/example/%u'", i);
+                many_match_add(&root, slots + i*5 + 2, &counter, match);
+
+                xsprintf(match, "type='signal',arg2namespace='org.example.n%u'", i);
+                many_match_add(&root, slots + i*5 + 3, &counter, match);
+
+                xsprintf(match, "type='signal',arg1path='/dev/block/%u/'", i);
+                many_match_add(&root, slots + i*5 + 4, &counter, match);
+        }
+
+        assert_se(sd_bus_message_new_signal(bus, &m, "/org/example/7/session", "org.freedesktop.DBus", "NameOwnerChanged") >= 0);
+        assert_se(sd_bus_message_append(m, "sss", "name7", "/dev/block/7/sda", "org.example.n7.x") >= 0);
+        assert_se(bus_message_seal(m, 1, 0) >= 0);
+
+        /* arg0, path_namespace, arg2namespace and arg1path */
+        assert_se(bus_match_run(NULL, &root, m) == 0);
+        assert_se(counter == 4);
+
+        assert_se(bus_match_run(NULL, &root, m) == 0);
+        assert_se(counter == 8);
+
+        for (i = 0; i < N_MANY * 5; i++)
+                assert_se(bus_match_remove(&root, &slots[i].match_callback) > 0);
+
+        assert_se(!root.child);
+}
+
 int main(int argc, char *argv[]) {
         struct bus_match_node root = {
                 .type = BUS_MATCH_ROOT,
@@ -94,6 +182,8 @@ int main(int argc, char *argv[]) {
         sd_bus_slot slots[19];
         int r;
 
+        test_match_many();
+
         r = sd_bus_open_system(&bus);
         if (r < 0)
                 return EXIT_TEST_SKIP;
@@ -26,6 +26,7 @@
 #include "bus-dump.h"
 #include "bus-internal.h"
 #include "bus-message.h"
+#include "bus-objects.h"
 #include "bus-util.h"
 #include "log.h"
 #include "macro.h"
@@ -194,6 +195,25 @@ static int emit_object_removed(sd_bus_message *m, void *userdata, sd_bus_error *
         return 1;
 }
 
+static int get_value_properties(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        sd_bus *bus = sd_bus_message_get_bus(m);
+
+        assert_se(sd_bus_message_new_method_return(m, &reply) >= 0);
+        assert_se(sd_bus_message_open_container(reply, 'a', "{sv}") >= 0);
+
+        assert_se(bus_append_object_properties(bus, reply, "/value/a/x", "org.freedesktop.systemd.ValueTest", STRV_MAKE("Value", "Value3", "DoesNotExist"), error) > 0);
+        assert_se(bus_append_object_properties(bus, reply, "/value/a/x", "org.freedesktop.systemd.DoesNotExist", NULL, error) == 0);
+
+        /* The handler context must survive the nested property getters */
+        assert_se(sd_bus_get_current_userdata(bus) == userdata);
+
+        assert_se(sd_bus_message_close_container(reply) >= 0);
+        assert_se(sd_bus_send(bus, reply, NULL) >= 0);
+
+        return 1;
+}
+
 static const sd_bus_vtable vtable[] = {
         SD_BUS_VTABLE_START(0),
         SD_BUS_METHOD("AlterSomething", "s", "s", something_handler, 0),
@@ -206,6 +226,7 @@ static const sd_bus_vtable vtable[] = {
         SD_BUS_METHOD("EmitInterfacesRemoved", NULL, NULL, emit_interfaces_removed, 0),
         SD_BUS_METHOD("EmitObjectAdded", NULL, NULL, emit_object_added, 0),
         SD_BUS_METHOD("EmitObjectRemoved", NULL, NULL, emit_object_removed, 0),
+        SD_BUS_METHOD("GetValueProperties", NULL, "a{sv}", get_value_properties, 0),
         SD_BUS_VTABLE_END
 };
 
@@ -511,6 +532,19 @@ static int client(struct context *c) {
         sd_bus_message_unref(reply);
         reply = NULL;
 
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "GetValueProperties", &error, &reply, "");
+        assert_se(r >= 0);
+
+        assert_se(sd_bus_message_enter_container(reply, 'a', "{sv}") > 0);
+        assert_se(sd_bus_message_read(reply, "{sv}", &s, "s", &s) > 0);
+        assert_se(streq(s, "object 0x1e, path /value/a/x"));
+        assert_se(sd_bus_message_read(reply, "{sv}", &s, "s", &s) > 0);
+        assert_se(streq(s, "object 0x1e, path /value/a/x"));
+        assert_se(sd_bus_message_read(reply, "{sv}", &s, "s", &s) == 0);
+        assert_se(sd_bus_message_exit_container(reply) >= 0);
+
+        reply = sd_bus_message_unref(reply);
+
         r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "Exit", &error, NULL, "");
         assert_se(r >= 0);
 
@@ -18,11 +18,13 @@
 ***/
 
 #include <sys/mman.h>
+#include <sys/socket.h>
 
 #include "sd-bus.h"
 
 #include "alloc-util.h"
 #include "bus-dump.h"
+#include "bus-internal.h"
 #include "bus-kernel.h"
 #include "bus-message.h"
 #include "fd-util.h"
@@ -36,55 +38,20 @@
 
 #define STRING_SIZE 123
 
-int main(int argc, char *argv[]) {
-        _cleanup_free_ char *name = NULL, *bus_name = NULL, *address = NULL;
-        const char *unique;
+static void test_zero_copy(sd_bus *a, sd_bus *b, const char *destination, bool expect_memfds) {
+        struct bus_body_part *part;
         uint8_t *p;
-        sd_bus *a, *b;
-        int r, bus_ref;
+        int r;
         sd_bus_message *m;
         int f;
         uint64_t sz;
         uint32_t u32;
         size_t i, l;
+        unsigned j, n_memfds = 0;
         char *s;
         _cleanup_close_ int sfd = -1;
 
-        log_set_max_level(LOG_DEBUG);
-
-        assert_se(asprintf(&name, "deine-mutter-%u", (unsigned) getpid()) >= 0);
-
-        bus_ref = bus_kernel_create_bus(name, false, &bus_name);
-        if (bus_ref == -ENOENT)
-                return EXIT_TEST_SKIP;
-
-        assert_se(bus_ref >= 0);
-
-        address = strappend("kernel:path=", bus_name);
-        assert_se(address);
-
-        r = sd_bus_new(&a);
-        assert_se(r >= 0);
-
-        r = sd_bus_new(&b);
-        assert_se(r >= 0);
-
-        r = sd_bus_set_address(a, address);
-        assert_se(r >= 0);
-
-        r = sd_bus_set_address(b, address);
-        assert_se(r >= 0);
-
-        r = sd_bus_start(a);
-        assert_se(r >= 0);
-
-        r = sd_bus_start(b);
-        assert_se(r >= 0);
-
-        r = sd_bus_get_unique_name(a, &unique);
-        assert_se(r >= 0);
-
-        r = sd_bus_message_new_method_call(b, &m, unique, "/a/path", "an.inter.face", "AMethod");
+        r = sd_bus_message_new_method_call(b, &m, destination, "/a/path", "an.inter.face", "AMethod");
         assert_se(r >= 0);
 
         r = sd_bus_message_open_container(m, 'r', "aysay");
@@ -154,12 +121,24 @@ int main(int argc, char *argv[]) {
 
         sd_bus_message_unref(m);
 
-        r = sd_bus_process(a, &m);
-        assert_se(r > 0);
+        for (;;) {
+                r = sd_bus_process(a, &m);
+                assert_se(r >= 0);
+                if (m)
+                        break;
+                if (r == 0)
+                        assert_se(sd_bus_wait(a, (uint64_t) -1) >= 0);
+        }
 
         bus_message_dump(m, stdout, BUS_MESSAGE_DUMP_WITH_HEADER);
         sd_bus_message_rewind(m, true);
 
+        /* Make sure the payload wasn't copied into the stream */
+        MESSAGE_FOREACH_PART(part, j, m)
+                if (part->memfd >= 0)
+                        n_memfds++;
+        assert_se(!expect_memfds || n_memfds == 3);
+
         r = sd_bus_message_enter_container(m, 'r', "aysay");
         assert_se(r > 0);
 
@@ -202,9 +181,98 @@ int main(int argc, char *argv[]) {
         assert_se(streq_ptr(s, "bcd"));
 
         sd_bus_message_unref(m);
+}
+
+static int test_kernel(void) {
+        _cleanup_free_ char *name = NULL, *bus_name = NULL, *address = NULL;
+        const char *unique;
+        sd_bus *a, *b;
+        int r, bus_ref;
+
+        assert_se(asprintf(&name, "deine-mutter-%u", (unsigned) getpid()) >= 0);
+
+        bus_ref = bus_kernel_create_bus(name, false, &bus_name);
+        if (bus_ref == -ENOENT)
+                return -ENOENT;
+
+        assert_se(bus_ref >= 0);
+
+        address = strappend("kernel:path=", bus_name);
+        assert_se(address);
+
+        r = sd_bus_new(&a);
+        assert_se(r >= 0);
+
+        r = sd_bus_new(&b);
+        assert_se(r >= 0);
+
+        r = sd_bus_set_address(a, address);
+        assert_se(r >= 0);
+
+        r = sd_bus_set_address(b, address);
+        assert_se(r >= 0);
+
+        r = sd_bus_start(a);
+        assert_se(r >= 0);
+
+        r = sd_bus_start(b);
+        assert_se(r >= 0);
+
+        r = sd_bus_get_unique_name(a, &unique);
+        assert_se(r >= 0);
+
+        test_zero_copy(a, b, unique, true);
+
+        sd_bus_unref(a);
+        sd_bus_unref(b);
+
+        return 0;
+}
+
+static void test_socket(bool negotiate_fds) {
+        sd_bus *a, *b;
+        sd_id128_t id;
+        int pair[2];
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair) >= 0);
+        assert_se(sd_id128_randomize(&id) >= 0);
+
+        assert_se(sd_bus_new(&a) >= 0);
+        assert_se(sd_bus_set_fd(a, pair[0], pair[0]) >= 0);
+        assert_se(sd_bus_set_server(a, true, id) >= 0);
+        assert_se(sd_bus_start(a) >= 0);
+
+        assert_se(sd_bus_new(&b) >= 0);
+        assert_se(sd_bus_set_fd(b, pair[1], pair[1]) >= 0);
+        assert_se(sd_bus_negotiate_fds(b, negotiate_fds) >= 0);
+        assert_se(sd_bus_start(b) >= 0);
+
+        /* Wait until both sides are done with the authentication, so
+         * that the message is sealed knowing what the peer supports */
+        while (a->state != BUS_RUNNING || b->state != BUS_RUNNING) {
+                assert_se(sd_bus_process(a, NULL) >= 0);
+                assert_se(sd_bus_process(b, NULL) >= 0);
+        }
+
+        assert_se(a->can_memfds == negotiate_fds);
+        assert_se(b->can_memfds == negotiate_fds);
+
+        test_zero_copy(a, b, NULL, negotiate_fds);
 
         sd_bus_unref(a);
         sd_bus_unref(b);
+}
+
+int main(int argc, char *argv[]) {
+
+        log_set_max_level(LOG_DEBUG);
+
+        if (test_kernel() < 0)
+                log_info("kdbus not available, skipping kernel transport.");
+
+        /* A direct connection with and without memfd passing */
+        test_socket(true);
+        test_socket(false);
 
         return 0;
 }
@@ -399,6 +399,15 @@ int bus_append_unit_property_assignment(sd_bus_message *m, const char *assignmen
 
                 r = sd_bus_message_append(m, "v", "u", (uint32_t) u);
 
+        } else if (streq(field, "MaxConcurrentStartJobs")) {
+                unsigned u;
+
+                r = safe_atou(eq, &u);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to parse concurrent start job limit: %s", eq);
+
+                r = sd_bus_message_append(m, "v", "u", (uint32_t) u);
+
         } else if (streq(field, "IOSchedulingClass")) {
                 int c;
 
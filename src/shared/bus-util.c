@@ -1248,6 +1248,115 @@ int bus_map_all_properties(
         return bus_message_map_all_properties(m, map, error, userdata);
 }
 
+/* How many calls bus_get_all_properties_pipelined() keeps in flight at
+ * the same time. dbus-daemon's default limit of pending replies per
+ * connection is 128. */
+#define GET_ALL_PIPELINE_MAX 64U
+
+typedef struct GetAllCall {
+        sd_bus_slot *slot;
+        sd_bus_message **reply;
+        unsigned *n_pending;
+} GetAllCall;
+
+static int get_all_call_handler(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        GetAllCall *c = userdata;
+
+        assert(m);
+        assert(c);
+
+        (*c->n_pending)--;
+
+        /* Errors are left to the caller, who may repeat the call
+         * synchronously to report them */
+        if (!sd_bus_message_is_method_error(m, NULL))
+                *c->reply = sd_bus_message_ref(m);
+
+        return 0;
+}
+
+int bus_get_all_properties_pipelined(
+                sd_bus *bus,
+                const char *destination,
+                char **paths,
+                const char *interface,
+                sd_bus_message **replies) {
+
+        GetAllCall *calls;
+        unsigned n, i, n_sent = 0, n_pending = 0;
+        int r;
+
+        assert(bus);
+        assert(destination);
+        assert(replies);
+
+        /* Issues GetAll for all paths, keeping up to
+         * GET_ALL_PIPELINE_MAX calls in flight instead of waiting for
+         * each reply before sending the next call. replies must have
+         * room for one message per path and be initialized to NULL.
+         * The reply for each path is stored in the same position, or
+         * left NULL if the call failed. */
+
+        n = strv_length(paths);
+        if (n == 0)
+                return 0;
+
+        calls = new0(GetAllCall, n);
+        if (!calls)
+                return -ENOMEM;
+
+        while (n_sent < n || n_pending > 0) {
+
+                while (n_sent < n && n_pending < GET_ALL_PIPELINE_MAX) {
+                        GetAllCall *c = calls + n_sent;
+
+                        c->reply = replies + n_sent;
+                        c->n_pending = &n_pending;
+
+                        r = sd_bus_call_method_async(
+                                        bus,
+                                        &c->slot,
+                                        destination,
+                                        paths[n_sent],
+                                        "org.freedesktop.DBus.Properties",
+                                        "GetAll",
+                                        get_all_call_handler,
+                                        c,
+                                        "s", strempty(interface));
+                        if (r < 0)
+                                goto finish;
+
+                        n_sent++;
+                        n_pending++;
+                }
+
+                r = sd_bus_process(bus, NULL);
+                if (r < 0)
+                        goto finish;
+                if (r > 0)
+                        continue;
+
+                r = sd_bus_wait(bus, (uint64_t) -1);
+                if (r < 0)
+                        goto finish;
+        }
+
+        r = 0;
+
+finish:
+        /* This cancels calls that are still pending if we failed */
+        for (i = 0; i < n_sent; i++)
+                sd_bus_slot_unref(calls[i].slot);
+
+        free(calls);
+
+        if (r < 0)
+                for (i = 0; i < n; i++)
+                        replies[i] = sd_bus_message_unref(replies[i]);
+
+        return r;
+}
+
 int bus_connect_transport(BusTransport transport, const char *host, bool user, sd_bus **ret) {
         _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
         int r;
@@ -53,6 +53,7 @@ int bus_map_id128(sd_bus *bus, const char *member, sd_bus_message *m, sd_bus_err
 int bus_message_map_all_properties(sd_bus_message *m, const struct bus_properties_map *map, sd_bus_error *error, void *userdata);
 int bus_message_map_properties_changed(sd_bus_message *m, const struct bus_properties_map *map, sd_bus_error *error, void *userdata);
 int bus_map_all_properties(sd_bus *bus, const char *destination, const char *path, const struct bus_properties_map *map, sd_bus_error *error, void *userdata);
+int bus_get_all_properties_pipelined(sd_bus *bus, const char *destination, char **paths, const char *interface, sd_bus_message **replies);
 
 int bus_async_unregister_and_exit(sd_event *e, sd_bus *bus, const char *name);
 
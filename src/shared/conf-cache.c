@@ -0,0 +1,438 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "conf-cache.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "path-util.h"
+#include "siphash24.h"
+#include "string-util.h"
+
+#define CONFIG_CACHE_VERSION 1U
+
+/* Refuse to load anything larger than this */
+#define CONFIG_CACHE_SIZE_MAX (64U*1024U*1024U)
+
+/* Files modified this recently might be modified again within the
+ * timestamp granularity of the file system without us noticing, hence
+ * don't serve them from the cache yet. */
+#define CONFIG_CACHE_RACY_NSEC NSEC_PER_SEC
+
+static const uint8_t config_cache_signature[8] = { 'S', 'D', 'C', 'O', 'N', 'F', 'C', 'C' };
+
+/* Key for the checksum, which is not about security but only about
+ * catching truncated or otherwise corrupted files. */
+static const uint8_t config_cache_checksum_key[16] = {
+        0x6c, 0x3e, 0x0d, 0x71, 0x9a, 0x25, 0x4f, 0xb8,
+        0x93, 0x1a, 0xe2, 0x57, 0xc4, 0x08, 0xd6, 0x4b,
+};
+
+/* The on-disk format, in native byte order. The header is followed by
+ * n_entries records, each followed by the NUL-terminated path and the
+ * line data, padded to a multiple of 8. */
+
+typedef struct ConfigCacheHeader {
+        uint8_t signature[8];
+        uint32_t version;
+        uint32_t n_entries;
+        uint64_t size;
+        uint64_t checksum;
+} ConfigCacheHeader;
+
+typedef struct ConfigCacheRecord {
+        uint64_t dev;
+        uint64_t ino;
+        uint64_t size;
+        uint64_t mtime;
+        uint64_t ctime;
+        uint32_t path_size;
+        uint32_t data_size;
+} ConfigCacheRecord;
+
+static ConfigCacheEntry *config_cache_entry_free(ConfigCacheEntry *e) {
+        if (!e)
+                return NULL;
+
+        free(e->path);
+        free(e->data);
+
+        return mfree(e);
+}
+
+static void config_cache_flush(ConfigCache *c) {
+        ConfigCacheEntry *e;
+
+        assert(c);
+
+        while ((e = hashmap_steal_first(c->entries)))
+                config_cache_entry_free(e);
+}
+
+ConfigCache *config_cache_new(void) {
+        ConfigCache *c;
+
+        c = new0(ConfigCache, 1);
+        if (!c)
+                return NULL;
+
+        c->entries = hashmap_new(&string_hash_ops);
+        if (!c->entries)
+                return mfree(c);
+
+        return c;
+}
+
+ConfigCache *config_cache_free(ConfigCache *c) {
+        if (!c)
+                return NULL;
+
+        config_cache_flush(c);
+        hashmap_free(c->entries);
+
+        return mfree(c);
+}
+
+static bool config_cache_entry_matches(const ConfigCacheEntry *e, const struct stat *st) {
+        assert(e);
+        assert(st);
+
+        return e->dev == (uint64_t) st->st_dev &&
+                e->ino == (uint64_t) st->st_ino &&
+                e->size == (uint64_t) st->st_size &&
+                e->mtime == timespec_load_nsec(&st->st_mtim) &&
+                e->ctime == timespec_load_nsec(&st->st_ctim);
+}
+
+const ConfigCacheEntry *config_cache_get(ConfigCache *c, const char *path, const struct stat *st) {
+        ConfigCacheEntry *e;
+
+        assert(c);
+        assert(path);
+        assert(st);
+
+        e = hashmap_get(c->entries, path);
+        if (!e || e->racy || !config_cache_entry_matches(e, st)) {
+                c->n_misses++;
+                return NULL;
+        }
+
+        e->used = true;
+        c->n_hits++;
+
+        return e;
+}
+
+int config_cache_put(ConfigCache *c, const char *path, const struct stat *st, const char *data, size_t data_size) {
+        ConfigCacheEntry *e;
+        bool racy;
+        nsec_t n;
+        int r;
+
+        assert(c);
+        assert(path);
+        assert(st);
+        assert(data || data_size == 0);
+        assert(data_size == 0 || data[data_size-1] == 0);
+
+        if (!S_ISREG(st->st_mode))
+                return 0;
+        if (data_size > UINT32_MAX)
+                return 0;
+
+        n = now_nsec(CLOCK_REALTIME);
+        racy = timespec_load_nsec(&st->st_mtim) + CONFIG_CACHE_RACY_NSEC > n ||
+               timespec_load_nsec(&st->st_ctim) + CONFIG_CACHE_RACY_NSEC > n;
+
+        e = hashmap_get(c->entries, path);
+        if (e) {
+                char *d;
+
+                d = memdup(data, MAX(data_size, 1U));
+                if (!d)
+                        return -ENOMEM;
+
+                free_and_replace(e->data, d);
+        } else {
+                e = new0(ConfigCacheEntry, 1);
+                if (!e)
+                        return -ENOMEM;
+
+                e->path = strdup(path);
+                e->data = memdup(data, MAX(data_size, 1U));
+                if (!e->path || !e->data) {
+                        config_cache_entry_free(e);
+                        return -ENOMEM;
+                }
+
+                r = hashmap_put(c->entries, e->path, e);
+                if (r < 0) {
+                        config_cache_entry_free(e);
+                        return r;
+                }
+        }
+
+        e->dev = (uint64_t) st->st_dev;
+        e->ino = (uint64_t) st->st_ino;
+        e->size = (uint64_t) st->st_size;
+        e->mtime = timespec_load_nsec(&st->st_mtim);
+        e->ctime = timespec_load_nsec(&st->st_ctim);
+        e->data_size = data_size;
+        e->racy = racy;
+        e->used = true;
+
+        c->dirty = true;
+
+        return 1;
+}
+
+void config_cache_vacuum(ConfigCache *c) {
+        ConfigCacheEntry *e;
+        Iterator i;
+
+        assert(c);
+
+        /* Drop everything that wasn't looked up or added since the
+         * last call, so that removed files don't linger forever. */
+
+        HASHMAP_FOREACH(e, c->entries, i) {
+                if (!e->used) {
+                        hashmap_remove(c->entries, e->path);
+                        config_cache_entry_free(e);
+                        c->dirty = true;
+                        continue;
+                }
+
+                e->used = false;
+        }
+}
+
+static int config_cache_parse(ConfigCache *c, const uint8_t *p, size_t size) {
+        const ConfigCacheHeader *h;
+        size_t offset;
+        uint32_t k;
+        int r;
+
+        assert(c);
+        assert(p);
+
+        if (size < sizeof(ConfigCacheHeader))
+                return -EBADMSG;
+
+        h = (const ConfigCacheHeader*) p;
+        if (memcmp(h->signature, config_cache_signature, sizeof(h->signature)) != 0)
+                return -EBADMSG;
+        if (h->version != CONFIG_CACHE_VERSION)
+                return -EPROTONOSUPPORT;
+        if (h->size != size)
+                return -EBADMSG;
+        if (h->checksum != siphash24(p + sizeof(ConfigCacheHeader), size - sizeof(ConfigCacheHeader), config_cache_checksum_key))
+                return -EBADMSG;
+
+        offset = sizeof(ConfigCacheHeader);
+
+        for (k = 0; k < h->n_entries; k++) {
+                const ConfigCacheRecord *rec;
+                const char *path, *data;
+                ConfigCacheEntry *e;
+                size_t l;
+
+                if (size - offset < sizeof(ConfigCacheRecord))
+                        return -EBADMSG;
+
+                rec = (const ConfigCacheRecord*) (p + offset);
+                offset += sizeof(ConfigCacheRecord);
+
+                l = ALIGN8((size_t) rec->path_size + (size_t) rec->data_size);
+                if (size - offset < l)
+                        return -EBADMSG;
+
+                path = (const char*) p + offset;
+                data = path + rec->path_size;
+                offset += l;
+
+                if (rec->path_size < 2 || path[rec->path_size-1] != 0 || strlen(path) != rec->path_size-1)
+                        return -EBADMSG;
+                if (!path_is_absolute(path))
+                        return -EBADMSG;
+                if (rec->data_size > 0 && data[rec->data_size-1] != 0)
+                        return -EBADMSG;
+
+                e = new0(ConfigCacheEntry, 1);
+                if (!e)
+                        return -ENOMEM;
+
+                e->path = strdup(path);
+                e->data = memdup(data, MAX(rec->data_size, 1U));
+                if (!e->path || !e->data) {
+                        config_cache_entry_free(e);
+                        return -ENOMEM;
+                }
+
+                e->dev = rec->dev;
+                e->ino = rec->ino;
+                e->size = rec->size;
+                e->mtime = rec->mtime;
+                e->ctime = rec->ctime;
+                e->data_size = rec->data_size;
+
+                r = hashmap_put(c->entries, e->path, e);
+                if (r < 0) {
+                        config_cache_entry_free(e);
+                        return r == -EEXIST ? -EBADMSG : r;
+                }
+        }
+
+        if (offset != size)
+                return -EBADMSG;
+
+        return 0;
+}
+
+int config_cache_load(ConfigCache *c, const char *path) {
+        _cleanup_close_ int fd = -1;
+        struct stat st;
+        void *p;
+        int r;
+
+        assert(c);
+        assert(path);
+
+        /* Replaces the contents of the cache with what is stored in
+         * the specified file. On failure the cache is left empty. */
+
+        config_cache_flush(c);
+        c->dirty = false;
+
+        fd = open(path, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+        if (!S_ISREG(st.st_mode))
+                return -EBADMSG;
+        if (st.st_size <= 0 || (uint64_t) st.st_size > CONFIG_CACHE_SIZE_MAX)
+                return -EBADMSG;
+
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED)
+                return -errno;
+
+        r = config_cache_parse(c, p, st.st_size);
+        munmap(p, st.st_size);
+
+        if (r < 0) {
+                config_cache_flush(c);
+                return r;
+        }
+
+        return 0;
+}
+
+int config_cache_save(ConfigCache *c, const char *path) {
+        _cleanup_free_ uint8_t *buf = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *t = NULL;
+        ConfigCacheHeader *h;
+        ConfigCacheEntry *e;
+        size_t size = sizeof(ConfigCacheHeader), offset;
+        uint32_t n_entries = 0;
+        Iterator i;
+        int r;
+
+        assert(c);
+        assert(path);
+
+        HASHMAP_FOREACH(e, c->entries, i) {
+                if (e->racy)
+                        continue;
+
+                size += sizeof(ConfigCacheRecord) + ALIGN8(strlen(e->path) + 1 + e->data_size);
+                n_entries++;
+        }
+
+        buf = malloc0(size);
+        if (!buf)
+                return -ENOMEM;
+
+        h = (ConfigCacheHeader*) buf;
+        memcpy(h->signature, config_cache_signature, sizeof(h->signature));
+        h->version = CONFIG_CACHE_VERSION;
+        h->n_entries = n_entries;
+        h->size = size;
+
+        offset = sizeof(ConfigCacheHeader);
+
+        HASHMAP_FOREACH(e, c->entries, i) {
+                ConfigCacheRecord *rec;
+                size_t l;
+
+                if (e->racy)
+                        continue;
+
+                l = strlen(e->path) + 1;
+
+                rec = (ConfigCacheRecord*) (buf + offset);
+                rec->dev = e->dev;
+                rec->ino = e->ino;
+                rec->size = e->size;
+                rec->mtime = e->mtime;
+                rec->ctime = e->ctime;
+                rec->path_size = l;
+                rec->data_size = e->data_size;
+                offset += sizeof(ConfigCacheRecord);
+
+                memcpy(buf + offset, e->path, l);
+                memcpy(buf + offset + l, e->data, e->data_size);
+                offset += ALIGN8(l + e->data_size);
+        }
+
+        assert(offset == size);
+
+        h->checksum = siphash24(buf + sizeof(ConfigCacheHeader), size - sizeof(ConfigCacheHeader), config_cache_checksum_key);
+
+        r = fopen_temporary(path, &f, &t);
+        if (r < 0)
+                return r;
+
+        (void) fchmod(fileno(f), 0600);
+
+        fwrite(buf, 1, size, f);
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                goto fail;
+
+        if (rename(t, path) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        c->dirty = false;
+        return 0;
+
+fail:
+        (void) unlink(t);
+        return r;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include "hashmap.h"
+#include "macro.h"
+#include "time-util.h"
+
+/* A cache of the logical lines of configuration files (i.e. with
+ * continuation lines joined and the byte order mark removed), keyed by
+ * path and validated against the inode, size and timestamps of the
+ * file. It may be stored in a binary file so that it survives the
+ * process. */
+
+typedef struct ConfigCacheEntry {
+        char *path;
+
+        uint64_t dev;
+        uint64_t ino;
+        uint64_t size;
+        nsec_t mtime;
+        nsec_t ctime;
+
+        /* The logical lines, each terminated by NUL */
+        char *data;
+        size_t data_size;
+
+        /* Recently modified, hence not served by config_cache_get() */
+        bool racy;
+        bool used;
+} ConfigCacheEntry;
+
+typedef struct ConfigCache {
+        Hashmap *entries;
+
+        bool dirty;
+
+        uint64_t n_hits;
+        uint64_t n_misses;
+} ConfigCache;
+
+ConfigCache *config_cache_new(void);
+ConfigCache *config_cache_free(ConfigCache *c);
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(ConfigCache*, config_cache_free);
+
+const ConfigCacheEntry *config_cache_get(ConfigCache *c, const char *path, const struct stat *st);
+int config_cache_put(ConfigCache *c, const char *path, const struct stat *st, const char *data, size_t data_size);
+
+void config_cache_vacuum(ConfigCache *c);
+
+int config_cache_load(ConfigCache *c, const char *path);
+int config_cache_save(ConfigCache *c, const char *path);
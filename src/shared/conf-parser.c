@@ -26,6 +26,7 @@
 #include <sys/types.h>
 
 #include "alloc-util.h"
+#include "conf-cache.h"
 #include "conf-files.h"
 #include "conf-parser.h"
 #include "def.h"
@@ -37,6 +38,7 @@
 #include "macro.h"
 #include "parse-util.h"
 #include "path-util.h"
+#include "siphash24.h"
 #include "process-util.h"
 #include "signal-util.h"
 #include "socket-util.h"
@@ -163,8 +165,23 @@ static int next_assignment(const char *unit,
         return 0;
 }
 
+static int config_parse_internal(
+                ConfigCache *cache,
+                const char *unit,
+                const char *filename,
+                FILE *f,
+                const char *sections,
+                ConfigItemLookup lookup,
+                const void *table,
+                bool relaxed,
+                bool allow_include,
+                bool warn,
+                struct siphash *hash,
+                void *userdata);
+
 /* Parse a variable assignment line */
-static int parse_line(const char* unit,
+static int parse_line(ConfigCache *cache,
+                      const char* unit,
                       const char *filename,
                       unsigned line,
                       const char *sections,
@@ -214,7 +231,7 @@ static int parse_line(const char* unit,
                 if (!fn)
                         return -ENOMEM;
 
-                return config_parse(unit, fn, NULL, sections, lookup, table, relaxed, false, false, userdata);
+                return config_parse_internal(cache, unit, fn, NULL, sections, lookup, table, relaxed, false, false, NULL, userdata);
         }
 
         if (*l == '[') {
@@ -282,40 +299,16 @@ static int parse_line(const char* unit,
                                userdata);
 }
 
-/* Go through the file and parse each line */
-int config_parse(const char *unit,
-                 const char *filename,
-                 FILE *f,
-                 const char *sections,
-                 ConfigItemLookup lookup,
-                 const void *table,
-                 bool relaxed,
-                 bool allow_include,
-                 bool warn,
-                 void *userdata) {
-
-        _cleanup_free_ char *section = NULL, *continuation = NULL;
-        _cleanup_fclose_ FILE *ours = NULL;
-        unsigned line = 0, section_line = 0;
-        bool section_ignored = false, allow_bom = true;
+/* Reads the next logical line, i.e. with continuation lines joined
+ * and the byte order mark removed. Returns 0 on EOF. */
+static int read_logical_line(FILE *f, const char *filename, unsigned line, bool warn, bool *allow_bom, char **ret) {
+        _cleanup_free_ char *continuation = NULL;
         int r;
 
+        assert(f);
         assert(filename);
-        assert(lookup);
-
-        if (!f) {
-                f = ours = fopen(filename, "re");
-                if (!f) {
-                        /* Only log on request, except for ENOENT,
-                         * since we return 0 to the caller. */
-                        if (warn || errno == ENOENT)
-                                log_full(errno == ENOENT ? LOG_DEBUG : LOG_ERR,
-                                         "Failed to open configuration file '%s': %m", filename);
-                        return errno == ENOENT ? 0 : -errno;
-                }
-        }
-
-        fd_warn_permissions(filename, fileno(f));
+        assert(allow_bom);
+        assert(ret);
 
         for (;;) {
                 _cleanup_free_ char *buf = NULL;
@@ -323,8 +316,10 @@ int config_parse(const char *unit,
                 bool escaped = false;
 
                 r = read_line(f, LONG_LINE_MAX, &buf);
-                if (r == 0)
-                        break;
+                if (r == 0) {
+                        *ret = NULL;
+                        return 0;
+                }
                 if (r == -ENOBUFS) {
                         if (warn)
                                 log_error_errno(r, "%s:%u: Line too long", filename, line);
@@ -339,13 +334,13 @@ int config_parse(const char *unit,
                 }
 
                 l = buf;
-                if (allow_bom) {
+                if (*allow_bom) {
                         char *q;
 
                         q = startswith(buf, UTF8_BYTE_ORDER_MARK);
                         if (q) {
                                 l = q;
-                                allow_bom = false;
+                                *allow_bom = false;
                         }
                 }
 
@@ -392,7 +387,59 @@ int config_parse(const char *unit,
                         continue;
                 }
 
-                r = parse_line(unit,
+                if (c) {
+                        *ret = c;
+                        return 1;
+                }
+
+                if (l != buf)
+                        memmove(buf, l, strlen(l) + 1);
+
+                *ret = buf;
+                buf = NULL;
+                return 1;
+        }
+}
+
+/* Feed the logical lines of a cache entry to the parser */
+static int config_parse_replay(
+                ConfigCache *cache,
+                const ConfigCacheEntry *e,
+                const char *unit,
+                const char *filename,
+                const char *sections,
+                ConfigItemLookup lookup,
+                const void *table,
+                bool relaxed,
+                bool allow_include,
+                bool warn,
+                struct siphash *hash,
+                void *userdata) {
+
+        _cleanup_free_ char *section = NULL, *data = NULL;
+        unsigned line = 0, section_line = 0;
+        bool section_ignored = false;
+        char *p, *next;
+        int r;
+
+        assert(e);
+
+        if (e->data_size == 0)
+                return 0;
+
+        /* parse_line() modifies the line in place, hence work on a copy */
+        data = memdup(e->data, e->data_size);
+        if (!data)
+                return -ENOMEM;
+
+        for (p = data; p < data + e->data_size; p = next) {
+                next = p + strlen(p) + 1;
+
+                if (hash)
+                        siphash24_compress(p, next - p, hash);
+
+                r = parse_line(cache,
+                               unit,
                                filename,
                                ++line,
                                sections,
@@ -405,8 +452,112 @@ int config_parse(const char *unit,
                                &section_ignored,
                                p,
                                userdata);
-                free(c);
+                if (r < 0) {
+                        if (warn)
+                                log_warning_errno(r, "%s:%u: Failed to parse file: %m", filename, line);
+                        return r;
+                }
+        }
+
+        return 0;
+}
+
+/* Go through the file and parse each line */
+static int config_parse_internal(
+                ConfigCache *cache,
+                const char *unit,
+                const char *filename,
+                FILE *f,
+                const char *sections,
+                ConfigItemLookup lookup,
+                const void *table,
+                bool relaxed,
+                bool allow_include,
+                bool warn,
+                struct siphash *hash,
+                void *userdata) {
+
+        _cleanup_free_ char *section = NULL, *record = NULL;
+        _cleanup_fclose_ FILE *ours = NULL;
+        unsigned line = 0, section_line = 0;
+        bool section_ignored = false, allow_bom = true;
+        size_t record_size = 0, record_allocated = 0;
+        struct stat st;
+        int r;
+
+        assert(filename);
+        assert(lookup);
 
+        if (!f) {
+                f = ours = fopen(filename, "re");
+                if (!f) {
+                        /* Only log on request, except for ENOENT,
+                         * since we return 0 to the caller. */
+                        if (warn || errno == ENOENT)
+                                log_full(errno == ENOENT ? LOG_DEBUG : LOG_ERR,
+                                         "Failed to open configuration file '%s': %m", filename);
+                        return errno == ENOENT ? 0 : -errno;
+                }
+        }
+
+        fd_warn_permissions(filename, fileno(f));
+
+        if (cache) {
+                const ConfigCacheEntry *e;
+
+                /* If the file is known, skip reading it, otherwise
+                 * remember its logical lines as we go */
+
+                if (fstat(fileno(f), &st) < 0)
+                        cache = NULL;
+                else {
+                        e = config_cache_get(cache, filename, &st);
+                        if (e)
+                                return config_parse_replay(cache, e, unit, filename, sections, lookup, table,
+                                                           relaxed, allow_include, warn, hash, userdata);
+                }
+        }
+
+        for (;;) {
+                _cleanup_free_ char *l = NULL;
+
+                r = read_logical_line(f, filename, line, warn, &allow_bom, &l);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        break;
+
+                if (hash)
+                        siphash24_compress(l, strlen(l) + 1, hash);
+
+                if (cache) {
+                        size_t n;
+
+                        n = strlen(l) + 1;
+                        if (!GREEDY_REALLOC(record, record_allocated, record_size + n)) {
+                                if (warn)
+                                        log_oom();
+                                return -ENOMEM;
+                        }
+
+                        memcpy(record + record_size, l, n);
+                        record_size += n;
+                }
+
+                r = parse_line(cache,
+                               unit,
+                               filename,
+                               ++line,
+                               sections,
+                               lookup,
+                               table,
+                               relaxed,
+                               allow_include,
+                               &section,
+                               &section_line,
+                               &section_ignored,
+                               l,
+                               userdata);
                 if (r < 0) {
                         if (warn)
                                 log_warning_errno(r, "%s:%u: Failed to parse file: %m", filename, line);
@@ -414,9 +565,88 @@ int config_parse(const char *unit,
                 }
         }
 
+        if (cache) {
+                r = config_cache_put(cache, filename, &st, record, record_size);
+                if (r < 0 && warn)
+                        log_warning_errno(r, "Failed to cache configuration file '%s', ignoring: %m", filename);
+        }
+
         return 0;
 }
 
+int config_parse(const char *unit,
+                 const char *filename,
+                 FILE *f,
+                 const char *sections,
+                 ConfigItemLookup lookup,
+                 const void *table,
+                 bool relaxed,
+                 bool allow_include,
+                 bool warn,
+                 void *userdata) {
+
+        return config_parse_internal(NULL, unit, filename, f, sections, lookup, table, relaxed, allow_include, warn, NULL, userdata);
+}
+
+int config_parse_cached(
+                ConfigCache *cache,
+                const char *unit,
+                const char *filename,
+                FILE *f,
+                const char *sections,
+                ConfigItemLookup lookup,
+                const void *table,
+                bool relaxed,
+                bool allow_include,
+                bool warn,
+                struct siphash *hash,
+                void *userdata) {
+
+        return config_parse_internal(cache, unit, filename, f, sections, lookup, table, relaxed, allow_include, warn, hash, userdata);
+}
+
+void config_hash_init(struct siphash *state) {
+        /* Not about security, the hashes are only compared with each
+         * other to notice changed files */
+        static const uint8_t key[16] = {
+                0x1f, 0x8b, 0x5d, 0x26, 0xe0, 0x73, 0x4a, 0x9c,
+                0xb2, 0x47, 0x0e, 0xd8, 0x61, 0x3f, 0xa5, 0x19,
+        };
+
+        assert(state);
+
+        siphash24_init(state, key);
+}
+
+int config_hash_file(struct siphash *state, const char *filename) {
+        _cleanup_fclose_ FILE *f = NULL;
+        bool allow_bom = true;
+        int r;
+
+        assert(state);
+        assert(filename);
+
+        /* Adds the logical lines of the file to the hash, the same way
+         * config_parse_cached() does while parsing it. Files included
+         * from it are not followed. */
+
+        f = fopen(filename, "re");
+        if (!f)
+                return errno == ENOENT ? 0 : -errno;
+
+        for (;;) {
+                _cleanup_free_ char *l = NULL;
+
+                r = read_logical_line(f, filename, 0, false, &allow_bom, &l);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        return 0;
+
+                siphash24_compress(l, strlen(l) + 1, state);
+        }
+}
+
 static int config_parse_many_files(
                 const char *conf_file,
                 char **files,
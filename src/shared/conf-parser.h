@@ -26,8 +26,10 @@
 #include <syslog.h>
 
 #include "alloc-util.h"
+#include "conf-cache.h"
 #include "log.h"
 #include "macro.h"
+#include "siphash24.h"
 
 /* An abstract parser for simple, line based, shallow configuration
  * files consisting of variable assignments only. */
@@ -96,6 +98,27 @@ int config_parse(
                 bool warn,
                 void *userdata);
 
+/* Like config_parse(), but skips reading files whose logical lines are
+ * known to the cache, and adds those of the others. The cache may be
+ * NULL. If hash is non-NULL, the logical lines of the file are added to
+ * it, see config_hash_file(). */
+int config_parse_cached(
+                ConfigCache *cache,
+                const char *unit,
+                const char *filename,
+                FILE *f,
+                const char *sections,  /* nulstr */
+                ConfigItemLookup lookup,
+                const void *table,
+                bool relaxed,
+                bool allow_include,
+                bool warn,
+                struct siphash *hash,
+                void *userdata);
+
+void config_hash_init(struct siphash *state);
+int config_hash_file(struct siphash *state, const char *filename);
+
 int config_parse_many_nulstr(
                 const char *conf_file,      /* possibly NULL */
                 const char *conf_file_dirs, /* nulstr */
@@ -0,0 +1,77 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+#include <string.h>
+
+#include "unit-snapshot.h"
+
+const uint8_t unit_snapshot_signature[8] = { 'S', 'D', 'U', 'N', 'I', 'T', 'S', 'S' };
+
+int unit_snapshot_verify(const void *p, size_t size, const UnitSnapshotHeader **ret) {
+        const UnitSnapshotHeader *h = p;
+        uint64_t end;
+
+        assert(p || size == 0);
+        assert(ret);
+
+        if (size < sizeof(UnitSnapshotHeader) || size > UNIT_SNAPSHOT_SIZE_MAX)
+                return -EBADMSG;
+
+        if (memcmp(h->signature, unit_snapshot_signature, sizeof(h->signature)) != 0)
+                return -EBADMSG;
+        if (h->version < UNIT_SNAPSHOT_VERSION)
+                return -EPROTONOSUPPORT;
+
+        if (h->header_size < sizeof(UnitSnapshotHeader) ||
+            h->entry_size < sizeof(UnitSnapshotEntry) ||
+            h->entry_size % 8 != 0)
+                return -EBADMSG;
+
+        /* Both limits are far below the point where the products below could overflow */
+        if (h->header_size > size || h->n_entries > size / h->entry_size)
+                return -EBADMSG;
+
+        end = h->header_size + h->n_entries * h->entry_size;
+        if (h->strings_offset < end ||
+            h->strings_offset > size ||
+            h->strings_size > size - h->strings_offset)
+                return -EBADMSG;
+
+        /* Make sure every offset into the string area yields a terminated string */
+        if (h->strings_size == 0 || ((const char*) p)[h->strings_offset + h->strings_size - 1] != 0)
+                return -EBADMSG;
+
+        *ret = h;
+        return 0;
+}
+
+const UnitSnapshotEntry *unit_snapshot_entry(const UnitSnapshotHeader *h, uint64_t i) {
+        assert(h);
+        assert(i < h->n_entries);
+
+        return (const UnitSnapshotEntry*) ((const uint8_t*) h + h->header_size + i * h->entry_size);
+}
+
+const char *unit_snapshot_string(const UnitSnapshotHeader *h, uint32_t offset) {
+        assert(h);
+
+        if (offset >= h->strings_size)
+                return NULL;
+
+        return (const char*) h + h->strings_offset + offset;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "macro.h"
+
+/* A compact table of the state of all units of the service manager,
+ * as returned in a sealed memfd by the GetUnitsSnapshotFD() bus call,
+ * in native byte order. The header is followed by n_entries records of
+ * entry_size bytes each, and the string area. String fields of the
+ * records are offsets into the string area. Later versions may only
+ * append fields to the header and the records, hence clients should
+ * use header_size and entry_size to find them. */
+
+#define UNIT_SNAPSHOT_VERSION 1U
+
+/* Refuse to map anything larger than this */
+#define UNIT_SNAPSHOT_SIZE_MAX (256U*1024U*1024U)
+
+typedef enum UnitSnapshotFlags {
+        /* In the header: the table lists all units, instead of only
+         * those that changed since the generation asked for */
+        UNIT_SNAPSHOT_COMPLETE = 1U << 0,
+
+        /* In a record: the unit went away */
+        UNIT_SNAPSHOT_REMOVED  = 1U << 1,
+} UnitSnapshotFlags;
+
+typedef struct UnitSnapshotHeader {
+        uint8_t signature[8];
+        uint32_t version;
+        uint32_t flags;
+        uint32_t header_size;
+        uint32_t entry_size;
+        uint64_t n_entries;
+        uint64_t generation;
+        uint64_t since;
+        uint64_t strings_offset;
+        uint64_t strings_size;
+} UnitSnapshotHeader;
+
+typedef struct UnitSnapshotEntry {
+        uint64_t generation;
+        uint32_t flags;
+        uint32_t id;
+        uint32_t load_state;
+        uint32_t active_state;
+        uint32_t sub_state;
+        uint32_t main_pid;
+        uint32_t control_pid;
+        uint32_t reserved;
+        /* UINT64_MAX if not available */
+        uint64_t cpu_usage_nsec;
+        uint64_t memory_current;
+        uint64_t tasks_current;
+        /* CLOCK_REALTIME, 0 if never */
+        uint64_t state_change_timestamp;
+        uint64_t active_enter_timestamp;
+        uint64_t active_exit_timestamp;
+} UnitSnapshotEntry;
+
+extern const uint8_t unit_snapshot_signature[8];
+
+int unit_snapshot_verify(const void *p, size_t size, const UnitSnapshotHeader **ret);
+
+const UnitSnapshotEntry *unit_snapshot_entry(const UnitSnapshotHeader *h, uint64_t i);
+const char *unit_snapshot_string(const UnitSnapshotHeader *h, uint32_t offset);
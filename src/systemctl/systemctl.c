@@ -175,6 +175,7 @@ static OutputMode arg_output = OUTPUT_SHORT;
 static bool arg_plain = false;
 static bool arg_firmware_setup = false;
 static bool arg_now = false;
+static bool arg_incremental = false;
 static bool arg_jobs_before = false;
 static bool arg_jobs_after = false;
 
@@ -4969,6 +4970,7 @@ static int show_one(
                 sd_bus *bus,
                 const char *path,
                 const char *unit,
+                sd_bus_message *prefetched,
                 bool show_properties,
                 bool *new_line,
                 bool *ellipsized) {
@@ -4999,17 +5001,21 @@ static int show_one(
 
         log_debug("Showing one %s", path);
 
-        r = sd_bus_call_method(
-                        bus,
-                        "org.freedesktop.systemd1",
-                        path,
-                        "org.freedesktop.DBus.Properties",
-                        "GetAll",
-                        &error,
-                        &reply,
-                        "s", "");
-        if (r < 0)
-                return log_error_errno(r, "Failed to get properties: %s", bus_error_message(&error, r));
+        if (prefetched)
+                reply = sd_bus_message_ref(prefetched);
+        else {
+                r = sd_bus_call_method(
+                                bus,
+                                "org.freedesktop.systemd1",
+                                path,
+                                "org.freedesktop.DBus.Properties",
+                                "GetAll",
+                                &error,
+                                &reply,
+                                "s", "");
+                if (r < 0)
+                        return log_error_errno(r, "Failed to get properties: %s", bus_error_message(&error, r));
+        }
 
         if (unit) {
                 r = bus_message_map_all_properties(reply, property_map, &error, &info);
@@ -5142,6 +5148,72 @@ static int get_unit_dbus_path_by_pid(
         return 0;
 }
 
+/* How many units show_units() fetches properties for before showing
+ * them, which bounds the number of replies kept in memory */
+#define SHOW_PREFETCH_MAX 256U
+
+static int show_units(
+                const char *verb,
+                sd_bus *bus,
+                char **names,
+                bool show_properties,
+                bool *new_line,
+                bool *ellipsized) {
+
+        _cleanup_strv_free_ char **paths = NULL;
+        unsigned n, i, j;
+        char **name;
+        int r, ret = 0;
+
+        /* Instead of a GetAll round trip per unit, send them out in
+         * batches without waiting for the replies in between. Units
+         * whose call failed are shown with a synchronous call, so
+         * that errors are reported as before. */
+
+        STRV_FOREACH(name, names) {
+                char *p;
+
+                p = unit_dbus_path_from_name(*name);
+                if (!p)
+                        return log_oom();
+
+                r = strv_consume(&paths, p);
+                if (r < 0)
+                        return log_oom();
+        }
+
+        n = strv_length(paths);
+
+        for (i = 0; i < n; i += SHOW_PREFETCH_MAX) {
+                sd_bus_message *replies[SHOW_PREFETCH_MAX] = {};
+                char *chunk[SHOW_PREFETCH_MAX + 1] = {};
+                unsigned k;
+
+                k = MIN(n - i, SHOW_PREFETCH_MAX);
+                memcpy(chunk, paths + i, k * sizeof(char*));
+
+                r = bus_get_all_properties_pipelined(bus, "org.freedesktop.systemd1", chunk, "", replies);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to prefetch unit properties, ignoring: %m");
+
+                for (j = 0; j < k; j++) {
+                        r = show_one(verb, bus, paths[i + j], names[i + j], replies[j], show_properties, new_line, ellipsized);
+                        if (r < 0)
+                                break;
+                        else if (r > 0 && ret == 0)
+                                ret = r;
+                }
+
+                for (j = 0; j < k; j++)
+                        sd_bus_message_unref(replies[j]);
+
+                if (r < 0)
+                        return r;
+        }
+
+        return ret;
+}
+
 static int show_all(
                 const char* verb,
                 sd_bus *bus,
@@ -5151,9 +5223,9 @@ static int show_all(
 
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         _cleanup_free_ UnitInfo *unit_infos = NULL;
-        const UnitInfo *u;
-        unsigned c;
-        int r, ret = 0;
+        _cleanup_free_ char **names = NULL;
+        unsigned c, i;
+        int r;
 
         r = get_unit_list(bus, NULL, NULL, &unit_infos, 0, &reply);
         if (r < 0)
@@ -5165,21 +5237,14 @@ static int show_all(
 
         qsort_safe(unit_infos, c, sizeof(UnitInfo), compare_unit_info);
 
-        for (u = unit_infos; u < unit_infos + c; u++) {
-                _cleanup_free_ char *p = NULL;
-
-                p = unit_dbus_path_from_name(u->id);
-                if (!p)
-                        return log_oom();
+        names = new0(char*, c + 1);
+        if (!names)
+                return log_oom();
 
-                r = show_one(verb, bus, p, u->id, show_properties, new_line, ellipsized);
-                if (r < 0)
-                        return r;
-                else if (r > 0 && ret == 0)
-                        ret = r;
-        }
+        for (i = 0; i < c; i++)
+                names[i] = (char*) unit_infos[i].id;
 
-        return ret;
+        return show_units(verb, bus, names, show_properties, new_line, ellipsized);
 }
 
 static int show_system_status(sd_bus *bus) {
@@ -5269,7 +5334,7 @@ static int show(int argc, char *argv[], void *userdata) {
 
         /* If no argument is specified inspect the manager itself */
         if (show_properties && argc <= 1)
-                return show_one(argv[0], bus, "/org/freedesktop/systemd1", NULL, show_properties, &new_line, &ellipsized);
+                return show_one(argv[0], bus, "/org/freedesktop/systemd1", NULL, NULL, show_properties, &new_line, &ellipsized);
 
         if (show_status && argc <= 1) {
 
@@ -5309,7 +5374,7 @@ static int show(int argc, char *argv[], void *userdata) {
                                         return log_oom();
                         }
 
-                        r = show_one(argv[0], bus, path, unit, show_properties, &new_line, &ellipsized);
+                        r = show_one(argv[0], bus, path, unit, NULL, show_properties, &new_line, &ellipsized);
                         if (r < 0)
                                 return r;
                         else if (r > 0 && ret == 0)
@@ -5323,19 +5388,11 @@ static int show(int argc, char *argv[], void *userdata) {
                         if (r < 0)
                                 return log_error_errno(r, "Failed to expand names: %m");
 
-                        STRV_FOREACH(name, names) {
-                                _cleanup_free_ char *path;
-
-                                path = unit_dbus_path_from_name(*name);
-                                if (!path)
-                                        return log_oom();
-
-                                r = show_one(argv[0], bus, path, *name, show_properties, &new_line, &ellipsized);
-                                if (r < 0)
-                                        return r;
-                                if (r > 0 && ret == 0)
-                                        ret = r;
-                        }
+                        r = show_units(argv[0], bus, names, show_properties, &new_line, &ellipsized);
+                        if (r < 0)
+                                return r;
+                        if (r > 0 && ret == 0)
+                                ret = r;
                 }
         }
 
@@ -5510,6 +5567,7 @@ static int daemon_reload(int argc, char *argv[], void *userdata) {
 
         case ACTION_SYSTEMCTL:
                 method = streq(argv[0], "daemon-reexec") ? "Reexecute" :
+                         arg_incremental ? "ReloadIncremental" :
                                      /* "daemon-reload" */ "Reload";
                 break;
 
@@ -7104,6 +7162,8 @@ static void systemctl_help(void) {
                "     --kill-who=WHO   Who to send signal to\n"
                "  -s --signal=SIGNAL  Which signal to send\n"
                "     --now            Start or stop unit in addition to enabling or disabling it\n"
+               "     --incremental    On daemon-reload, only reload units whose configuration\n"
+               "                      changed\n"
                "  -q --quiet          Suppress output\n"
                "     --wait           For (re)start, wait until service stopped again\n"
                "     --no-block       Do not wait until operation finished\n"
@@ -7378,6 +7438,7 @@ static int systemctl_parse_argv(int argc, char *argv[]) {
                 ARG_PRESET_MODE,
                 ARG_FIRMWARE_SETUP,
                 ARG_NOW,
+                ARG_INCREMENTAL,
                 ARG_MESSAGE,
                 ARG_WAIT,
         };
@@ -7426,6 +7487,7 @@ static int systemctl_parse_argv(int argc, char *argv[]) {
                 { "preset-mode",         required_argument, NULL, ARG_PRESET_MODE         },
                 { "firmware-setup",      no_argument,       NULL, ARG_FIRMWARE_SETUP      },
                 { "now",                 no_argument,       NULL, ARG_NOW                 },
+                { "incremental",         no_argument,       NULL, ARG_INCREMENTAL         },
                 { "message",             required_argument, NULL, ARG_MESSAGE             },
                 {}
         };
@@ -7741,6 +7803,10 @@ static int systemctl_parse_argv(int argc, char *argv[]) {
                         arg_now = true;
                         break;
 
+                case ARG_INCREMENTAL:
+                        arg_incremental = true;
+                        break;
+
                 case ARG_MESSAGE:
                         if (strv_extend(&arg_wall, optarg) < 0)
                                 return log_oom();
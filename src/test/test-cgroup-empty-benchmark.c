@@ -0,0 +1,123 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+
+#include "alloc-util.h"
+#include "cgroup.h"
+#include "manager.h"
+#include "parse-util.h"
+#include "rm-rf.h"
+#include "scope.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "test-helper.h"
+#include "tests.h"
+#include "unit.h"
+
+/* Measures tearing down many scopes at once, each of which reports its
+ * cgroup empty twice, as happens when a whole container host shuts
+ * down. Pass the number of scopes as argument, the default is 5000. */
+
+#define N_SCOPES_DEFAULT 5000U
+
+static char *scope_cgroup(unsigned i) {
+        char *p;
+
+        assert_se(asprintf(&p, "/test-cgroup-empty-benchmark.slice/bench-%u.scope", i) >= 0);
+        return p;
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
+        char dir[] = "/tmp/test-cgroup-empty-benchmark.XXXXXX";
+        char ts[FORMAT_TIMESPAN_MAX];
+        unsigned n = N_SCOPES_DEFAULT, i, dispatches = 0;
+        Unit **scopes;
+        Manager *m = NULL;
+        usec_t t;
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &n) >= 0 && n > 0);
+
+        assert_se(mkdtemp(dir));
+        assert_se(set_unit_path(dir) >= 0);
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+
+        r = manager_new(UNIT_FILE_USER, true, &m);
+        if (MANAGER_SKIP_TEST(r)) {
+                log_notice_errno(r, "Skipping test: manager_new: %m");
+                (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+                return EXIT_TEST_SKIP;
+        }
+        assert_se(r >= 0);
+        assert_se(m->cgroup_empty_event_source);
+
+        assert_se(scopes = new(Unit*, n));
+
+        for (i = 0; i < n; i++) {
+                char name[sizeof("bench-.scope") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(name, "bench-%u.scope", i);
+                assert_se(unit_new_for_name(m, sizeof(Scope), name, &scopes[i]) >= 0);
+                scopes[i]->transient = true;
+                unit_add_to_load_queue(scopes[i]);
+        }
+
+        /* Scopes without processes may only be loaded while reloading */
+        m->n_reloading++;
+        manager_dispatch_load_queue(m);
+        m->n_reloading--;
+
+        for (i = 0; i < n; i++) {
+                _cleanup_free_ char *cgroup = NULL;
+
+                assert_se(scopes[i]->load_state == UNIT_LOADED);
+
+                cgroup = scope_cgroup(i);
+                assert_se(unit_set_cgroup_path(scopes[i], cgroup) >= 0);
+                SCOPE(scopes[i])->state = SCOPE_RUNNING;
+        }
+
+        t = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < 2 * n; i++) {
+                _cleanup_free_ char *cgroup = NULL;
+
+                cgroup = scope_cgroup(i % n);
+                assert_se(manager_notify_cgroup_empty(m, cgroup) >= 0);
+        }
+
+        while (m->cgroup_empty_queue) {
+                assert_se(sd_event_run(m->event, 0) > 0);
+                dispatches++;
+        }
+
+        log_info("%u scopes torn down in %u batches in %s",
+                 n, dispatches,
+                 format_timespan(ts, sizeof(ts), now(CLOCK_MONOTONIC) - t, USEC_PER_MSEC/10));
+
+        free(scopes);
+        manager_free(m);
+        (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+
+        return 0;
+}
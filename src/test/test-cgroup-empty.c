@@ -0,0 +1,126 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+
+#include "alloc-util.h"
+#include "cgroup.h"
+#include "manager.h"
+#include "rm-rf.h"
+#include "scope.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "test-helper.h"
+#include "tests.h"
+#include "unit.h"
+
+/* Tears down a few more scopes at once than are handled in one batch,
+ * each of which reports its cgroup empty twice */
+
+#define N_SCOPES 1025U
+
+static char *scope_cgroup(unsigned i) {
+        char *p;
+
+        assert_se(asprintf(&p, "/test-cgroup-empty.slice/scope-%u.scope", i) >= 0);
+        return p;
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
+        char dir[] = "/tmp/test-cgroup-empty.XXXXXX";
+        unsigned n = N_SCOPES, i, dispatches = 0;
+        Unit **scopes;
+        Manager *m = NULL;
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        assert_se(mkdtemp(dir));
+        assert_se(set_unit_path(dir) >= 0);
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+
+        r = manager_new(UNIT_FILE_USER, true, &m);
+        if (MANAGER_SKIP_TEST(r)) {
+                log_notice_errno(r, "Skipping test: manager_new: %m");
+                (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+                return EXIT_TEST_SKIP;
+        }
+        assert_se(r >= 0);
+        assert_se(m->cgroup_empty_event_source);
+
+        assert_se(scopes = new(Unit*, n));
+
+        for (i = 0; i < n; i++) {
+                char name[sizeof("scope-.scope") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(name, "scope-%u.scope", i);
+                assert_se(unit_new_for_name(m, sizeof(Scope), name, &scopes[i]) >= 0);
+                scopes[i]->transient = true;
+                unit_add_to_load_queue(scopes[i]);
+        }
+
+        /* Scopes without processes may only be loaded while reloading */
+        m->n_reloading++;
+        manager_dispatch_load_queue(m);
+        m->n_reloading--;
+
+        for (i = 0; i < n; i++) {
+                _cleanup_free_ char *cgroup = NULL;
+
+                assert_se(scopes[i]->load_state == UNIT_LOADED);
+
+                cgroup = scope_cgroup(i);
+                assert_se(unit_set_cgroup_path(scopes[i], cgroup) >= 0);
+                SCOPE(scopes[i])->state = SCOPE_RUNNING;
+        }
+
+        /* Every scope is reported twice, but handled once */
+        for (i = 0; i < 2 * n; i++) {
+                _cleanup_free_ char *cgroup = NULL;
+
+                cgroup = scope_cgroup(i % n);
+                assert_se(manager_notify_cgroup_empty(m, cgroup) >= 0);
+        }
+
+        assert_se(m->n_cgroup_empty_events == 2 * n);
+        assert_se(m->n_cgroup_empty_events_coalesced == n);
+
+        for (i = 0; i < n; i++)
+                assert_se(SCOPE(scopes[i])->state == SCOPE_RUNNING);
+
+        /* The queue is processed in batches from the event loop */
+        while (m->cgroup_empty_queue) {
+                assert_se(sd_event_run(m->event, 0) > 0);
+                dispatches++;
+        }
+
+        assert_se(m->n_cgroup_empty_dispatches == dispatches);
+        assert_se(dispatches == 2);
+
+        for (i = 0; i < n; i++) {
+                assert_se(SCOPE(scopes[i])->state == SCOPE_DEAD);
+                assert_se(scopes[i]->in_gc_queue);
+        }
+
+        free(scopes);
+        manager_free(m);
+        (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+
+        return 0;
+}
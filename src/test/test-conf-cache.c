@@ -0,0 +1,174 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "conf-cache.h"
+#include "conf-parser.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "log.h"
+#include "macro.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "strv.h"
+#include "util.h"
+
+static const char config_file[] =
+        "\xef\xbb\xbf[Section]\n"
+        "# comment\n"
+        "setting1=1\\\n"
+        "2\\\n"
+        "3\n"
+        "[Other]\n"
+        "setting1=ignored\n"
+        "[Section]\n"
+        "setting2=foo\n";
+
+static uint64_t hash_one(const char *fn) {
+        struct siphash state;
+
+        config_hash_init(&state);
+        assert_se(config_hash_file(&state, fn) >= 0);
+
+        return siphash24_finalize(&state);
+}
+
+static void parse_one(ConfigCache *c, const char *fn, char **setting1, char **setting2) {
+        const ConfigTableItem items[] = {
+                { "Section", "setting1", config_parse_string, 0, setting1 },
+                { "Section", "setting2", config_parse_string, 0, setting2 },
+                {}
+        };
+
+        struct siphash state;
+
+        *setting1 = mfree(*setting1);
+        *setting2 = mfree(*setting2);
+
+        config_hash_init(&state);
+        assert_se(config_parse_cached(c, NULL, fn, NULL,
+                                      "Section\0",
+                                      config_item_table_lookup, items,
+                                      true, false, true, &state, NULL) == 0);
+
+        /* Whether served from the cache or not, the file hashes the same */
+        assert_se(siphash24_finalize(&state) == hash_one(fn));
+}
+
+static void test_config_cache(const char *dir) {
+        _cleanup_(config_cache_freep) ConfigCache *c = NULL, *d = NULL;
+        _cleanup_free_ char *setting1 = NULL, *setting2 = NULL;
+        const char *fn, *cache;
+        struct stat st;
+        uint64_t h;
+
+        fn = strjoina(dir, "/test.conf");
+        cache = strjoina(dir, "/cache");
+
+        assert_se(c = config_cache_new());
+
+        /* The file was just written, hence must not be served from the
+         * cache yet */
+        assert_se(write_string_file(fn, config_file, WRITE_STRING_FILE_CREATE) >= 0);
+        parse_one(c, fn, &setting1, &setting2);
+        assert_se(streq(setting1, "1 2 3"));
+        assert_se(streq(setting2, "foo"));
+        assert_se(stat(fn, &st) >= 0);
+        assert_se(!config_cache_get(c, fn, &st));
+
+        assert_se(sleep(1) == 0);
+        usleep(100 * USEC_PER_MSEC);
+
+        c->n_hits = c->n_misses = 0;
+        parse_one(c, fn, &setting1, &setting2);
+        assert_se(c->n_misses == 1);
+        assert_se(hashmap_size(c->entries) == 1);
+        assert_se(c->dirty);
+
+        /* Now it is served from the cache, with the same result */
+        parse_one(c, fn, &setting1, &setting2);
+        assert_se(c->n_hits == 1);
+        assert_se(streq(setting1, "1 2 3"));
+        assert_se(streq(setting2, "foo"));
+
+        /* Round trip through the cache file */
+        assert_se(config_cache_save(c, cache) >= 0);
+        assert_se(!c->dirty);
+
+        assert_se(d = config_cache_new());
+        assert_se(config_cache_load(d, cache) >= 0);
+        assert_se(hashmap_size(d->entries) == 1);
+
+        parse_one(d, fn, &setting1, &setting2);
+        assert_se(d->n_hits == 1);
+        assert_se(streq(setting1, "1 2 3"));
+        assert_se(streq(setting2, "foo"));
+
+        /* Unused entries go away */
+        config_cache_vacuum(d);
+        assert_se(hashmap_size(d->entries) == 1);
+        config_cache_vacuum(d);
+        assert_se(hashmap_isempty(d->entries));
+
+        /* A modified file is parsed again */
+        assert_se(write_string_file(fn, "[Section]\nsetting1=4\n", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(stat(fn, &st) >= 0);
+        assert_se(!config_cache_get(c, fn, &st));
+        parse_one(c, fn, &setting1, &setting2);
+        assert_se(streq(setting1, "4"));
+        assert_se(!setting2);
+
+        /* A rewritten file with the same logical lines hashes the
+         * same, one with different contents does not */
+        h = hash_one(fn);
+        assert_se(write_string_file(fn, "\xef\xbb\xbf[Section]\nsetting1=\\\n4\n", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(hash_one(fn) != h);
+        assert_se(write_string_file(fn, "\xef\xbb\xbf[Section]\nsetting1=4\n", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(hash_one(fn) == h);
+        assert_se(write_string_file(fn, "[Section]\nsetting1=5\n", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(hash_one(fn) != h);
+
+        /* Corrupted cache files are refused */
+        assert_se(truncate(cache, 40) >= 0);
+        assert_se(config_cache_load(d, cache) == -EBADMSG);
+        assert_se(hashmap_isempty(d->entries));
+
+        assert_se(write_string_file(cache, "garbage", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(config_cache_load(d, cache) == -EBADMSG);
+
+        assert_se(unlink(cache) >= 0);
+        assert_se(config_cache_load(d, cache) == -ENOENT);
+}
+
+int main(int argc, char *argv[]) {
+        char dir[] = "/tmp/test-conf-cache.XXXXXX";
+
+        log_parse_environment();
+        log_open();
+
+        assert_se(mkdtemp(dir));
+
+        test_config_cache(dir);
+
+        (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+
+        return 0;
+}
@@ -0,0 +1,136 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fileio.h"
+#include "manager.h"
+#include "parse-util.h"
+#include "process-util.h"
+#include "rm-rf.h"
+#include "service.h"
+#include "string-util.h"
+#include "test-helper.h"
+#include "tests.h"
+#include "unit.h"
+
+/* Measures how many processes per second exec_spawn() manages, with a
+ * service manager as small as this test and with one whose memory was
+ * inflated to resemble PID 1 on a big host, as fork() has to copy its
+ * page tables. Pass the number of spawns and the size of the inflation
+ * in MiB as arguments. */
+
+#define N_SPAWNS_DEFAULT 1000U
+#define BALLAST_MB_DEFAULT 64U
+
+static usec_t timed_spawns(Unit *u, unsigned n) {
+        ExecParameters p = {
+                .flags = EXEC_APPLY_PERMISSIONS|EXEC_APPLY_CHROOT,
+                .stdin_fd = -1,
+                .stdout_fd = -1,
+                .stderr_fd = -1,
+        };
+        Service *s = SERVICE(u);
+        unsigned i;
+        usec_t t;
+
+        t = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n; i++) {
+                siginfo_t si;
+                pid_t pid;
+
+                assert_se(exec_spawn(u, s->exec_command[SERVICE_EXEC_START], &s->exec_context, &p, NULL, NULL, &pid) >= 0);
+                assert_se(wait_for_terminate(pid, &si) >= 0);
+                assert_se(si.si_code == CLD_EXITED);
+                assert_se(si.si_status == EXIT_SUCCESS);
+        }
+
+        return now(CLOCK_MONOTONIC) - t;
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
+        char dir[] = "/tmp/test-exec-spawn-benchmark.XXXXXX";
+        unsigned n = N_SPAWNS_DEFAULT, mb = BALLAST_MB_DEFAULT;
+        usec_t small, inflated;
+        void *ballast = NULL;
+        Manager *m = NULL;
+        const char *p;
+        Unit *u;
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &n) >= 0 && n > 0);
+        if (argc > 2)
+                assert_se(safe_atou(argv[2], &mb) >= 0);
+
+        assert_se(mkdtemp(dir));
+
+        p = strjoina(dir, "/bench.service");
+        assert_se(write_string_file(p,
+                                    "[Service]\n"
+                                    "ExecStart=/bin/true\n"
+                                    "StandardOutput=null\n",
+                                    WRITE_STRING_FILE_CREATE) >= 0);
+
+        assert_se(set_unit_path(dir) >= 0);
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+
+        r = manager_new(UNIT_FILE_USER, true, &m);
+        if (MANAGER_SKIP_TEST(r)) {
+                log_notice_errno(r, "Skipping test: manager_new: %m");
+                (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+                return EXIT_TEST_SKIP;
+        }
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        assert_se(manager_load_unit(m, "bench.service", NULL, NULL, &u) >= 0);
+
+        small = timed_spawns(u, n);
+
+        /* Make the page tables worth copying. PID 1's memory is made
+         * of small allocations, hence avoid huge pages. */
+        if (mb > 0) {
+                ballast = mmap(NULL, mb * 1024U * 1024U, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+                assert_se(ballast != MAP_FAILED);
+                (void) madvise(ballast, mb * 1024U * 1024U, MADV_NOHUGEPAGE);
+                memset(ballast, 'x', mb * 1024U * 1024U);
+        }
+
+        inflated = timed_spawns(u, n);
+
+        log_info("%u spawns: %.0f/s, with %u MiB ballast %.0f/s",
+                 n,
+                 (double) n * USEC_PER_SEC / MAX(small, 1U),
+                 mb,
+                 (double) n * USEC_PER_SEC / MAX(inflated, 1U));
+
+        if (ballast)
+                assert_se(munmap(ballast, mb * 1024U * 1024U) >= 0);
+
+        manager_free(m);
+        (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+
+        return 0;
+}
@@ -333,6 +333,63 @@ static void test_environment_gathering(void) {
         assert_se(endswith(strv_env_get(env, "PATH"), ":/no/such/file"));
 }
 
+static void test_execution_timing(void) {
+        char template[] = "/tmp/test-exec-util.XXXXXXX";
+        const char *dirs[] = {template, NULL};
+        const char *name, *name2, *name3;
+        ExecTiming *t = NULL;
+        size_t n = 0, i;
+        bool seen_slow = false, seen_fail = false, seen_ok = false;
+        usec_t start;
+
+        assert_se(mkdtemp(template));
+
+        log_info("/* %s */", __func__);
+
+        name = strjoina(template, "/10-ok");
+        name2 = strjoina(template, "/20-fail");
+        name3 = strjoina(template, "/30-slow");
+
+        assert_se(write_string_file(name, "#!/bin/sh\nexit 0\n", WRITE_STRING_FILE_CREATE) == 0);
+        assert_se(write_string_file(name2, "#!/bin/sh\nexit 3\n", WRITE_STRING_FILE_CREATE) == 0);
+        assert_se(write_string_file(name3, "#!/bin/sh\nexec sleep 20\n", WRITE_STRING_FILE_CREATE) == 0);
+
+        assert_se(chmod(name, 0755) == 0);
+        assert_se(chmod(name2, 0755) == 0);
+        assert_se(chmod(name3, 0755) == 0);
+
+        /* Only one binary at a time, and the slow one is killed long
+         * before it would finish */
+        start = now(CLOCK_MONOTONIC);
+        assert_se(execute_directories_full(dirs, DEFAULT_TIMEOUT_USEC, USEC_PER_SEC, 1,
+                                           NULL, NULL, NULL, &t, &n) >= 0);
+        assert_se(now(CLOCK_MONOTONIC) - start < 10 * USEC_PER_SEC);
+
+        assert_se(n == 3);
+        for (i = 0; i < n; i++) {
+                log_info("%s: " USEC_FMT " " USEC_FMT " %i %i %s",
+                         t[i].name, t[i].realtime, t[i].cputime, t[i].code, t[i].status, yes_no(t[i].timed_out));
+
+                assert_se(t[i].start >= start);
+
+                if (streq(t[i].name, "10-ok")) {
+                        assert_se(t[i].code == CLD_EXITED && t[i].status == 0 && !t[i].timed_out);
+                        seen_ok = true;
+                } else if (streq(t[i].name, "20-fail")) {
+                        assert_se(t[i].code == CLD_EXITED && t[i].status == 3 && !t[i].timed_out);
+                        seen_fail = true;
+                } else if (streq(t[i].name, "30-slow")) {
+                        assert_se(t[i].code == CLD_KILLED && t[i].status == SIGKILL && t[i].timed_out);
+                        assert_se(t[i].realtime >= USEC_PER_SEC);
+                        seen_slow = true;
+                }
+        }
+        assert_se(seen_ok && seen_fail && seen_slow);
+
+        exec_timing_free_many(t, n);
+        (void) rm_rf(template, REMOVE_ROOT|REMOVE_PHYSICAL);
+}
+
 int main(int argc, char *argv[]) {
         log_set_max_level(LOG_DEBUG);
         log_parse_environment();
@@ -343,6 +400,7 @@ int main(int argc, char *argv[]) {
         test_execution_order();
         test_stdout_gathering();
         test_environment_gathering();
+        test_execution_timing();
 
         return 0;
 }
@@ -843,6 +843,23 @@ static void test_hashmap_reserve(void) {
         assert_se(hashmap_reserve(m, UINT_MAX - 1) == -ENOMEM);
 }
 
+static void test_hashmap_memory_usage(void) {
+        _cleanup_hashmap_free_ Hashmap *m = NULL;
+        size_t direct;
+
+        assert_se(hashmap_memory_usage(NULL) == 0);
+
+        m = hashmap_new(&string_hash_ops);
+        direct = hashmap_memory_usage(m);
+        assert_se(direct > 0);
+
+        assert_se(hashmap_put(m, "key 1", (void*) "val 1") == 1);
+        assert_se(hashmap_memory_usage(m) == direct);
+
+        assert_se(hashmap_reserve(m, 1000) == 0);
+        assert_se(hashmap_memory_usage(m) >= direct + 1000 * 2 * sizeof(void*));
+}
+
 void test_hashmap_funcs(void) {
         test_hashmap_copy();
         test_hashmap_get_strv();
@@ -872,4 +889,5 @@ void test_hashmap_funcs(void) {
         test_hashmap_steal_first();
         test_hashmap_clear_free_free();
         test_hashmap_reserve();
+        test_hashmap_memory_usage();
 }
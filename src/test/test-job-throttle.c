@@ -0,0 +1,137 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fileio.h"
+#include "manager.h"
+#include "rm-rf.h"
+#include "service.h"
+#include "slice.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "test-helper.h"
+#include "tests.h"
+#include "unit.h"
+
+/* Starts a target pulling in many short-lived services, some of them
+ * in a slice with a limit of its own, and checks that the limits of
+ * concurrent start jobs hold. */
+
+#define N_SERVICES 24U
+#define N_LIMITED 6U
+#define MAX_CONCURRENT 4U
+#define TIMEOUT_USEC (20 * USEC_PER_SEC)
+
+static void write_service(const char *dir, unsigned i, bool limited) {
+        char name[sizeof("test-.service") + DECIMAL_STR_MAX(unsigned)];
+        _cleanup_free_ char *p = NULL, *link = NULL, *contents = NULL;
+
+        xsprintf(name, "test-%u.service", i);
+
+        assert_se(p = strjoin(dir, "/", name));
+        assert_se(asprintf(&contents,
+                           "[Service]\n"
+                           "Type=oneshot\n"
+                           "ExecStart=/bin/sleep 0.05\n"
+                           "%s",
+                           limited ? "Slice=limited.slice\n" : "") >= 0);
+        assert_se(write_string_file(p, contents, WRITE_STRING_FILE_CREATE) >= 0);
+
+        assert_se(link = strjoin(dir, "/test.target.wants/", name));
+        assert_se(symlink(p, link) >= 0);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
+        char dir[] = "/tmp/test-job-throttle.XXXXXX";
+        unsigned i, max_running = 0, max_limited = 0;
+        Unit *limited;
+        const char *p;
+        Manager *m = NULL;
+        usec_t timeout;
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        assert_se(mkdtemp(dir));
+
+        p = strjoina(dir, "/test.target");
+        assert_se(write_string_file(p, "[Unit]\nDescription=Test\n", WRITE_STRING_FILE_CREATE) >= 0);
+        p = strjoina(dir, "/test.target.wants");
+        assert_se(mkdir(p, 0755) >= 0);
+        p = strjoina(dir, "/limited.slice");
+        assert_se(write_string_file(p, "[Slice]\nMaxConcurrentStartJobs=1\n", WRITE_STRING_FILE_CREATE) >= 0);
+
+        for (i = 0; i < N_SERVICES; i++)
+                write_service(dir, i, i < N_LIMITED);
+
+        assert_se(set_unit_path(dir) >= 0);
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+
+        r = manager_new(UNIT_FILE_USER, true, &m);
+        if (MANAGER_SKIP_TEST(r)) {
+                log_notice_errno(r, "Skipping test: manager_new: %m");
+                (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+                return EXIT_TEST_SKIP;
+        }
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        m->max_concurrent_start_jobs = MAX_CONCURRENT;
+
+        assert_se(manager_load_unit(m, "limited.slice", NULL, NULL, &limited) >= 0);
+        assert_se(SLICE(limited)->max_concurrent_start_jobs == 1);
+
+        assert_se(manager_add_job_by_name(m, JOB_START, "test.target", JOB_REPLACE, NULL, NULL) >= 0);
+
+        timeout = now(CLOCK_MONOTONIC) + TIMEOUT_USEC;
+        while (!hashmap_isempty(m->jobs)) {
+                assert_se(sd_event_run(m->event, 100 * USEC_PER_MSEC) >= 0);
+                assert_se(now(CLOCK_MONOTONIC) < timeout);
+
+                max_running = MAX(max_running, m->n_running_start_jobs);
+                max_limited = MAX(max_limited, SLICE(limited)->n_running_start_jobs);
+        }
+
+        for (i = 0; i < N_SERVICES; i++) {
+                char name[sizeof("test-.service") + DECIMAL_STR_MAX(unsigned)];
+                Unit *u;
+
+                xsprintf(name, "test-%u.service", i);
+                assert_se(u = manager_get_unit(m, name));
+                assert_se(SERVICE(u)->result == SERVICE_SUCCESS);
+                assert_se(SERVICE(u)->main_exec_status.code == CLD_EXITED);
+                assert_se(SERVICE(u)->main_exec_status.status == 0);
+        }
+
+        assert_se(max_running == MAX_CONCURRENT);
+        assert_se(max_limited == 1);
+        assert_se(m->n_running_start_jobs == 0);
+        assert_se(SLICE(limited)->n_running_start_jobs == 0);
+        assert_se(m->n_start_jobs_throttled >= N_SERVICES - MAX_CONCURRENT);
+        assert_se(prioq_isempty(m->throttled_jobs));
+
+        manager_free(m);
+        (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+
+        return 0;
+}
@@ -0,0 +1,147 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "manager.h"
+#include "parse-util.h"
+#include "rm-rf.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "test-helper.h"
+#include "tests.h"
+#include "unit.h"
+
+/* Compares a full and an incremental daemon reload on a tree of many
+ * units, of which only one changed. Pass the number of units as
+ * argument, the default is 10000. */
+
+#define N_UNITS_DEFAULT 10000U
+
+static void write_unit(const char *dir, unsigned i, const char *description) {
+        char name[sizeof("bench-.service") + DECIMAL_STR_MAX(unsigned)];
+        _cleanup_free_ char *p = NULL, *link = NULL, *contents = NULL;
+
+        xsprintf(name, "bench-%u.service", i);
+
+        assert_se(p = strjoin(dir, "/", name));
+        assert_se(asprintf(&contents,
+                           "[Unit]\n"
+                           "Description=%s %u\n"
+                           "[Service]\n"
+                           "ExecStart=/bin/true\n",
+                           description, i) >= 0);
+        assert_se(write_string_file(p, contents, WRITE_STRING_FILE_CREATE) >= 0);
+
+        assert_se(link = strjoin(dir, "/bench.target.wants/", name));
+        (void) symlink(p, link);
+}
+
+static usec_t timed_reload(Manager *m, bool incremental) {
+        usec_t t;
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se((incremental ? manager_reload_incremental(m) : manager_reload(m)) >= 0);
+        return now(CLOCK_MONOTONIC) - t;
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
+        char dir[] = "/tmp/test-manager-reload.XXXXXX";
+        char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX];
+        Unit *target, *first, *other, *u;
+        usec_t full, incremental;
+        unsigned n = N_UNITS_DEFAULT, i;
+        const char *p;
+        Manager *m = NULL;
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &n) >= 0 && n >= 2);
+
+        assert_se(mkdtemp(dir));
+
+        p = strjoina(dir, "/bench.target");
+        assert_se(write_string_file(p, "[Unit]\nDescription=Benchmark\n", WRITE_STRING_FILE_CREATE) >= 0);
+        p = strjoina(dir, "/bench.target.wants");
+        assert_se(mkdir(p, 0755) >= 0);
+
+        for (i = 0; i < n; i++)
+                write_unit(dir, i, "Benchmark unit");
+
+        assert_se(set_unit_path(dir) >= 0);
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+
+        r = manager_new(UNIT_FILE_USER, true, &m);
+        if (MANAGER_SKIP_TEST(r)) {
+                log_notice_errno(r, "Skipping test: manager_new: %m");
+                (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+                return EXIT_TEST_SKIP;
+        }
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        assert_se(manager_load_unit(m, "bench.target", NULL, NULL, &target) >= 0);
+        assert_se(unit_dependency_count(target, UNIT_WANTS) == n);
+
+        full = timed_reload(m, false);
+
+        /* Nothing changed, hence nothing is loaded again */
+        target = manager_get_unit(m, "bench.target");
+        first = manager_get_unit(m, "bench-0.service");
+        other = manager_get_unit(m, "bench-1.service");
+        assert_se(target && first && other);
+
+        assert_se(manager_reload_incremental(m) >= 0);
+        assert_se(manager_get_unit(m, "bench.target") == target);
+        assert_se(manager_get_unit(m, "bench-0.service") == first);
+
+        /* Change one unit */
+        write_unit(dir, 0, "Changed unit");
+        incremental = timed_reload(m, true);
+
+        u = manager_get_unit(m, "bench-0.service");
+        assert_se(u);
+        assert_se(streq(u->description, "Changed unit 0"));
+        assert_se(manager_get_unit(m, "bench-1.service") == other);
+
+        /* The target configured a dependency on the changed unit,
+         * hence was loaded again as well, and the dependencies
+         * survived */
+        assert_se(target = manager_get_unit(m, "bench.target"));
+        assert_se(unit_has_dependency(target, UNIT_WANTS, u));
+        assert_se(unit_has_dependency(u, UNIT_WANTED_BY, target));
+        assert_se(unit_dependency_count(target, UNIT_WANTS) == n);
+
+        log_info("%u units: full reload %s, incremental reload %s",
+                 n,
+                 format_timespan(a, sizeof(a), full, USEC_PER_MSEC),
+                 format_timespan(b, sizeof(b), incremental, USEC_PER_MSEC));
+
+        manager_free(m);
+        (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+
+        return 0;
+}
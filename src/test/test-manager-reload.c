@@ -0,0 +1,112 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "fileio.h"
+#include "manager.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "test-helper.h"
+#include "tests.h"
+#include "unit.h"
+
+static void write_unit(const char *dir, const char *name, const char *contents) {
+        const char *p;
+
+        p = strjoina(dir, "/", name);
+        assert_se(write_string_file(p, contents, WRITE_STRING_FILE_CREATE) >= 0);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
+        char dir[] = "/tmp/test-manager-reload.XXXXXX";
+        Unit *a, *b, *target, *baz, *u;
+        Manager *m = NULL;
+        size_t n_removals;
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        assert_se(mkdtemp(dir));
+
+        write_unit(dir, "foo@.service", "[Unit]\nDescription=Old\nDefaultDependencies=no\n[Service]\nExecStart=/bin/true\n");
+        write_unit(dir, "bar.target", "[Unit]\nDescription=Bar\nDefaultDependencies=no\nWants=baz.service\n");
+        write_unit(dir, "baz.service", "[Unit]\nDescription=Baz\nDefaultDependencies=no\n[Service]\nExecStart=/bin/true\n");
+
+        assert_se(set_unit_path(dir) >= 0);
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+
+        r = manager_new(UNIT_FILE_USER, true, &m);
+        if (MANAGER_SKIP_TEST(r)) {
+                log_notice_errno(r, "Skipping test: manager_new: %m");
+                (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+                return EXIT_TEST_SKIP;
+        }
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        assert_se(manager_load_unit(m, "foo@a.service", NULL, NULL, &a) >= 0);
+        assert_se(manager_load_unit(m, "bar.target", NULL, NULL, &target) >= 0);
+        assert_se(baz = manager_get_unit(m, "baz.service"));
+        assert_se(streq(a->description, "Old"));
+
+        /* Nothing changed, hence nothing is loaded again */
+        n_removals = m->n_unit_removals;
+        assert_se(manager_reload_incremental(m) >= 0);
+        assert_se(manager_get_unit(m, "foo@a.service") == a);
+        assert_se(manager_get_unit(m, "bar.target") == target);
+        assert_se(manager_get_unit(m, "baz.service") == baz);
+
+        /* A file rewritten with the same contents is not either, and
+         * not considered changed on disk anymore afterwards */
+        write_unit(dir, "foo@.service", "[Unit]\nDescription=Old\nDefaultDependencies=no\n[Service]\nExecStart=/bin/true\n");
+        assert_se(unit_need_daemon_reload(a));
+        assert_se(manager_reload_incremental(m) >= 0);
+        assert_se(manager_get_unit(m, "foo@a.service") == a);
+        assert_se(!unit_need_daemon_reload(a));
+
+        /* An instance loaded after the template changed doesn't hide
+         * that the one loaded before is out of date */
+        write_unit(dir, "foo@.service", "[Unit]\nDescription=New\nDefaultDependencies=no\n[Service]\nExecStart=/bin/true\n");
+        assert_se(manager_load_unit(m, "foo@b.service", NULL, NULL, &b) >= 0);
+        assert_se(streq(b->description, "New"));
+        assert_se(manager_reload_incremental(m) >= 0);
+        assert_se(u = manager_get_unit(m, "foo@a.service"));
+        assert_se(streq(u->description, "New"));
+        assert_se(manager_get_unit(m, "foo@b.service") == b);
+
+        /* The target configured a dependency on the changed unit,
+         * hence is loaded again as well, and the dependencies survive */
+        write_unit(dir, "baz.service", "[Unit]\nDescription=Changed\nDefaultDependencies=no\n[Service]\nExecStart=/bin/true\n");
+        assert_se(manager_reload_incremental(m) >= 0);
+        assert_se(u = manager_get_unit(m, "baz.service"));
+        assert_se(streq(u->description, "Changed"));
+        assert_se(target = manager_get_unit(m, "bar.target"));
+        assert_se(unit_has_dependency(target, UNIT_WANTS, u));
+        assert_se(unit_has_dependency(u, UNIT_WANTED_BY, target));
+
+        /* Units loaded again in place are not reported as removed */
+        assert_se(m->n_unit_removals == n_removals);
+
+        manager_free(m);
+        (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+
+        return 0;
+}
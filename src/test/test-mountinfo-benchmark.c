@@ -0,0 +1,117 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "log.h"
+#include "macro.h"
+#include "mountinfo.h"
+#include "parse-util.h"
+#include "stdio-util.h"
+#include "time-util.h"
+#include "util.h"
+
+/* Compares a scan of a mount table with many entries against the same
+ * scan with a few entries changed. Pass the number of entries as
+ * argument, the default is 10000. */
+
+#define N_ENTRIES_DEFAULT 10000U
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(struct libmnt_table*, mnt_free_table);
+
+static void write_entry(FILE *f, int id, const char *source, const char *target, const char *options) {
+        fprintf(f, "%i 1 0:%i / %s %s shared:%i - tmpfs %s rw\n", id, id, target, options, id, source);
+}
+
+static usec_t timed_update(MountInfo *mi, const char *path, MountInfoChanges *changes) {
+        _cleanup_(mnt_free_tablep) struct libmnt_table *t = NULL;
+        usec_t ts;
+
+        mount_info_changes_done(changes);
+
+        ts = now(CLOCK_MONOTONIC);
+        assert_se(t = mnt_new_table());
+        assert_se(mnt_table_parse_file(t, path) >= 0);
+        assert_se(mount_info_update(mi, t, changes) >= 0);
+        return now(CLOCK_MONOTONIC) - ts;
+}
+
+static void write_table(const char *path, unsigned n, bool changed) {
+        _cleanup_fclose_ FILE *f = NULL;
+        unsigned i;
+
+        assert_se(f = fopen(path, "we"));
+
+        write_entry(f, 1, "/dev/root", "/", "rw");
+
+        for (i = 2; i < n; i++) {
+                char source[sizeof("tmpfs-") + DECIMAL_STR_MAX(unsigned)];
+                char target[sizeof("/mnt/") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(source, "tmpfs-%u", i);
+                xsprintf(target, "/mnt/%u", i);
+
+                /* A few entries remounted read-only */
+                write_entry(f, i, source, target, changed && i % (n / 5) == 0 ? "ro" : "rw");
+        }
+
+        assert_se(fflush_and_check(f) >= 0);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(mount_info_freep) MountInfo *mi = NULL;
+        _cleanup_(mount_info_changes_done) MountInfoChanges changes = {};
+        char path[] = "/tmp/test-mountinfo-benchmark.XXXXXX";
+        char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX];
+        unsigned n = N_ENTRIES_DEFAULT;
+        usec_t full, incremental;
+        _cleanup_close_ int fd = -1;
+
+        log_parse_environment();
+        log_open();
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &n) >= 0 && n >= 10);
+
+        fd = mkostemp_safe(path);
+        assert_se(fd >= 0);
+
+        assert_se(mi = mount_info_new());
+
+        write_table(path, n, false);
+        full = timed_update(mi, path, &changes);
+        assert_se(set_size(changes.where) == n - 1);
+
+        write_table(path, n, true);
+        incremental = timed_update(mi, path, &changes);
+        assert_se(set_size(changes.where) > 0);
+
+        log_info("%u entries: first scan %s, scan with %u changes %s (%" PRIu64 " scans, %" PRIu64 " entries, %" PRIu64 " changed)",
+                 n,
+                 format_timespan(a, sizeof(a), full, USEC_PER_MSEC),
+                 set_size(changes.where),
+                 format_timespan(b, sizeof(b), incremental, USEC_PER_MSEC),
+                 mi->n_scans, mi->n_entries_scanned, mi->n_entries_changed);
+
+        (void) unlink(path);
+
+        return 0;
+}
@@ -0,0 +1,208 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "log.h"
+#include "macro.h"
+#include "mountinfo.h"
+#include "set.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "util.h"
+
+/* Checks the changes reported between two scans of a mount table */
+
+#define N_ENTRIES 10U
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(struct libmnt_table*, mnt_free_table);
+
+static void write_entry(FILE *f, int id, const char *source, const char *target, const char *options) {
+        fprintf(f, "%i 1 0:%i / %s %s shared:%i - tmpfs %s rw\n", id, id, target, options, id, source);
+}
+
+static struct libmnt_table *parse_table(const char *path) {
+        struct libmnt_table *t;
+
+        assert_se(t = mnt_new_table());
+        assert_se(mnt_table_parse_file(t, path) >= 0);
+
+        return t;
+}
+
+static void update(MountInfo *mi, const char *path, MountInfoChanges *changes) {
+        _cleanup_(mnt_free_tablep) struct libmnt_table *t = NULL;
+
+        mount_info_changes_done(changes);
+
+        t = parse_table(path);
+        assert_se(mount_info_update(mi, t, changes) >= 0);
+}
+
+static void write_table(const char *path, unsigned n, unsigned variant) {
+        _cleanup_fclose_ FILE *f = NULL;
+        unsigned i;
+
+        assert_se(f = fopen(path, "we"));
+
+        write_entry(f, 1, "/dev/root", "/", "rw");
+
+        for (i = 2; i < n; i++) {
+                char source[sizeof("tmpfs-") + DECIMAL_STR_MAX(unsigned)];
+                char target[sizeof("/mnt/") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(source, "tmpfs-%u", i);
+                xsprintf(target, "/mnt/%u", i);
+
+                switch (variant) {
+
+                case 1:
+                        /* Remounted read-only */
+                        if (i == 2) {
+                                write_entry(f, i, source, target, "ro");
+                                continue;
+                        }
+
+                        /* Unmounted */
+                        if (i == 3)
+                                continue;
+
+                        /* Moved */
+                        if (i == 4) {
+                                write_entry(f, i, source, "/mnt/moved", "rw");
+                                continue;
+                        }
+
+                        break;
+
+                case 2:
+                        /* The same mount point and source mounted again */
+                        if (i == 3) {
+                                write_entry(f, n + 1, source, target, "rw");
+                                continue;
+                        }
+
+                        break;
+                }
+
+                write_entry(f, i, source, target, "rw");
+        }
+
+        /* A second file system stacked on top of the first one */
+        if (variant == 1)
+                write_entry(f, n, "tmpfs-over", "/mnt/5", "rw");
+
+        assert_se(fflush_and_check(f) >= 0);
+}
+
+static void assert_changes(Set *s, const char *first, ...) {
+        unsigned n = 0;
+        const char *p;
+        va_list ap;
+
+        va_start(ap, first);
+        for (p = first; p; p = va_arg(ap, const char*)) {
+                assert_se(set_contains(s, p));
+                n++;
+        }
+        va_end(ap);
+
+        assert_se(set_size(s) == n);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(mount_info_freep) MountInfo *mi = NULL;
+        _cleanup_(mount_info_changes_done) MountInfoChanges changes = {};
+        char path[] = "/tmp/test-mountinfo.XXXXXX";
+        unsigned n = N_ENTRIES;
+        MountInfoEntry *e;
+        _cleanup_close_ int fd = -1;
+
+        log_parse_environment();
+        log_open();
+
+        fd = mkostemp_safe(path);
+        assert_se(fd >= 0);
+
+        assert_se(mi = mount_info_new());
+
+        /* Everything is new at first */
+        write_table(path, n, 0);
+        update(mi, path, &changes);
+        assert_se(set_size(changes.where) == n - 1);
+        assert_se(set_size(changes.what_new) == n - 1);
+        assert_se(set_isempty(changes.what_gone));
+        assert_se(hashmap_size(mi->entries) == n - 1);
+
+        /* Nothing changed */
+        update(mi, path, &changes);
+        assert_se(set_isempty(changes.where));
+        assert_se(set_isempty(changes.what_new));
+        assert_se(set_isempty(changes.what_gone));
+
+        /* A few changes */
+        write_table(path, n, 1);
+        update(mi, path, &changes);
+        assert_changes(changes.where, "/mnt/2", "/mnt/3", "/mnt/4", "/mnt/moved", "/mnt/5", NULL);
+        assert_changes(changes.what_new, "tmpfs-2", "tmpfs-4", "tmpfs-over", NULL);
+        assert_changes(changes.what_gone, "tmpfs-3", NULL);
+
+        assert_se(e = mount_info_get_where(mi, "/mnt/2"));
+        assert_se(streq(e->options, "ro"));
+        assert_se(!mount_info_get_where(mi, "/mnt/3"));
+        assert_se(!mount_info_get_where(mi, "/mnt/4"));
+        assert_se(e = mount_info_get_where(mi, "/mnt/moved"));
+        assert_se(streq(e->what, "tmpfs-4"));
+        assert_se(e = mount_info_get_where(mi, "/mnt/5"));
+        assert_se(streq(e->what, "tmpfs-over"));
+        assert_se(mount_info_has_what(mi, "tmpfs-5"));
+        assert_se(!mount_info_has_what(mi, "tmpfs-3"));
+
+        /* Changed back, and a mount point that got its source
+         * mounted again, under a new ID. The source never was gone
+         * in between as far as we can tell. */
+        write_table(path, n, 2);
+        update(mi, path, &changes);
+        assert_changes(changes.where, "/mnt/2", "/mnt/3", "/mnt/4", "/mnt/moved", "/mnt/5", NULL);
+        assert_changes(changes.what_new, "tmpfs-2", "tmpfs-3", "tmpfs-4", NULL);
+        assert_changes(changes.what_gone, "tmpfs-over", NULL);
+        assert_se(e = mount_info_get_where(mi, "/mnt/5"));
+        assert_se(streq(e->what, "tmpfs-5"));
+
+        /* A forgotten mount point is reported again */
+        mount_info_forget(mi, "/mnt/7");
+        assert_se(!mount_info_get_where(mi, "/mnt/7"));
+        update(mi, path, &changes);
+        assert_changes(changes.where, "/mnt/7", NULL);
+        assert_changes(changes.what_new, "tmpfs-7", NULL);
+        assert_se(set_isempty(changes.what_gone));
+
+        /* A flushed table reports everything as new */
+        mount_info_flush(mi);
+        update(mi, path, &changes);
+        assert_se(set_size(changes.where) == n - 1);
+
+        assert_se(mi->n_scans == 6);
+
+        (void) unlink(path);
+
+        return 0;
+}
@@ -0,0 +1,168 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fdset.h"
+#include "fileio.h"
+#include "manager.h"
+#include "parse-util.h"
+#include "rm-rf.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "test-helper.h"
+#include "tests.h"
+#include "unit.h"
+
+/* Compares how long serializing and deserializing the state of many
+ * units takes in each serialization format. Pass the number of units
+ * as argument, the default is 10000. */
+
+#define N_UNITS_DEFAULT 10000U
+
+static void write_unit(const char *dir, unsigned i) {
+        char name[sizeof("bench-.service") + DECIMAL_STR_MAX(unsigned)];
+        _cleanup_free_ char *p = NULL, *link = NULL;
+
+        xsprintf(name, "bench-%u.service", i);
+
+        assert_se(p = strjoin(dir, "/", name));
+        assert_se(write_string_file(p, "[Service]\nExecStart=/bin/true\n", WRITE_STRING_FILE_CREATE) >= 0);
+
+        assert_se(link = strjoin(dir, "/bench.target.wants/", name));
+        (void) symlink(p, link);
+}
+
+static Manager *start_manager(void) {
+        Manager *m = NULL;
+        Unit *target;
+
+        assert_se(manager_new(UNIT_FILE_USER, true, &m) >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+        assert_se(manager_load_unit(m, "bench.target", NULL, NULL, &target) >= 0);
+
+        return m;
+}
+
+static void timed_round_trip(Manager *m, SerializationFormat format, unsigned n) {
+        char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX];
+        _cleanup_fdset_free_ FDSet *fds = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        usec_t t, serialized, deserialized;
+        Manager *copy;
+        Unit *u, *v;
+        off_t size;
+
+        m->serialization_format = format;
+
+        assert_se(manager_open_serialization(m, &f) >= 0);
+        assert_se(fds = fdset_new());
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(manager_serialize(m, f, fds, false) >= 0);
+        assert_se(fflush_and_check(f) >= 0);
+        serialized = now(CLOCK_MONOTONIC) - t;
+
+        size = ftello(f);
+        rewind(f);
+
+        copy = start_manager();
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(manager_deserialize(copy, f, fds) >= 0);
+        deserialized = now(CLOCK_MONOTONIC) - t;
+
+        assert_se(copy->deserialization_format == format);
+        assert_se(copy->units_generation >= m->units_generation);
+
+        u = manager_get_unit(m, "bench-0.service");
+        v = manager_get_unit(copy, "bench-0.service");
+        assert_se(u && v);
+        assert_se(sd_id128_equal(u->invocation_id, v->invocation_id));
+        assert_se(u->inactive_exit_timestamp.monotonic == v->inactive_exit_timestamp.monotonic);
+
+        log_info("%u units, %s format: %" PRIu64 " bytes, serialized in %s, deserialized in %s",
+                 n, serialization_format_to_string(format), (uint64_t) size,
+                 format_timespan(a, sizeof(a), serialized, USEC_PER_MSEC),
+                 format_timespan(b, sizeof(b), deserialized, USEC_PER_MSEC));
+
+        manager_free(copy);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
+        char dir[] = "/tmp/test-serialize.XXXXXX";
+        unsigned n = N_UNITS_DEFAULT, i;
+        Manager *m = NULL;
+        const char *p;
+        Iterator j;
+        Unit *u;
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &n) >= 0 && n > 0);
+
+        assert_se(mkdtemp(dir));
+
+        p = strjoina(dir, "/bench.target");
+        assert_se(write_string_file(p, "[Unit]\nDescription=Benchmark\n", WRITE_STRING_FILE_CREATE) >= 0);
+        p = strjoina(dir, "/bench.target.wants");
+        assert_se(mkdir(p, 0755) >= 0);
+
+        for (i = 0; i < n; i++)
+                write_unit(dir, i);
+
+        assert_se(set_unit_path(dir) >= 0);
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+
+        r = manager_new(UNIT_FILE_USER, true, &m);
+        if (MANAGER_SKIP_TEST(r)) {
+                log_notice_errno(r, "Skipping test: manager_new: %m");
+                (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+                return EXIT_TEST_SKIP;
+        }
+        assert_se(r >= 0);
+        manager_free(m);
+
+        m = start_manager();
+
+        /* Give the units some state worth carrying over */
+        HASHMAP_FOREACH(u, m->units, j) {
+                sd_id128_t id;
+
+                if (u->type != UNIT_SERVICE)
+                        continue;
+
+                assert_se(sd_id128_randomize(&id) >= 0);
+                assert_se(unit_set_invocation_id(u, id) >= 0);
+                dual_timestamp_get(&u->inactive_exit_timestamp);
+        }
+
+        timed_round_trip(m, SERIALIZATION_TEXT, n);
+        timed_round_trip(m, SERIALIZATION_BINARY, n);
+
+        manager_free(m);
+        (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+
+        return 0;
+}
@@ -0,0 +1,255 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fdset.h"
+#include "fileio.h"
+#include "manager.h"
+#include "rm-rf.h"
+#include "serialize.h"
+#include "string-util.h"
+#include "test-helper.h"
+#include "tests.h"
+#include "unit.h"
+
+static void test_items(SerializationFormat format) {
+        _cleanup_free_ char *buffer = NULL, *large = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        dual_timestamp t = { 1, 2 };
+        SerializationFormat detected;
+        size_t allocated = 0;
+        char *k, *v;
+
+        log_info("/* %s(%s) */", __func__, serialization_format_to_string(format));
+
+        assert_se(large = malloc(LINE_MAX * 2));
+        memset(large, 'x', LINE_MAX * 2 - 1);
+        large[LINE_MAX * 2 - 1] = 0;
+
+        assert_se(f = tmpfile());
+
+        assert_se(serialize_header(f, format) >= 0);
+        assert_se(serialize_item(f, format, "a", "1") == 1);
+        assert_se(serialize_item(f, format, "b", NULL) == 0);
+        assert_se(serialize_item_format(f, format, "c", "%i %s", 2, "3") == 1);
+        assert_se(serialize_item_escaped(f, format, "d", "x\ny") == 1);
+        serialize_dual_timestamp(f, format, "e", &t);
+        serialize_end_marker(f, format);
+        serialize_start_marker(f, format, "foo.service");
+        if (format == SERIALIZATION_BINARY)
+                assert_se(serialize_item_format(f, format, "large", "%s", large) == 1);
+        serialize_end_marker(f, format);
+
+        assert_se(fflush_and_check(f) >= 0);
+        rewind(f);
+
+        assert_se(deserialize_header(f, &detected) >= 0);
+        assert_se(detected == format);
+
+        assert_se(deserialize_item(f, format, &buffer, &allocated, &k, &v) == 1);
+        assert_se(streq(k, "a") && streq(v, "1"));
+        assert_se(deserialize_item(f, format, &buffer, &allocated, &k, &v) == 1);
+        assert_se(streq(k, "c") && streq(v, "2 3"));
+        assert_se(deserialize_item(f, format, &buffer, &allocated, &k, &v) == 1);
+        assert_se(streq(k, "d") && streq(v, "x\\ny"));
+        assert_se(deserialize_item(f, format, &buffer, &allocated, &k, &v) == 1);
+        assert_se(streq(k, "e") && streq(v, "1 2"));
+        assert_se(deserialize_item(f, format, &buffer, &allocated, &k, &v) == 0);
+        assert_se(deserialize_item(f, format, &buffer, &allocated, &k, &v) == 1);
+        assert_se(streq(k, "foo.service") && isempty(v));
+        if (format == SERIALIZATION_BINARY) {
+                assert_se(deserialize_item(f, format, &buffer, &allocated, &k, &v) == 1);
+                assert_se(streq(k, "large") && streq(v, large));
+        }
+        assert_se(deserialize_item(f, format, &buffer, &allocated, &k, &v) == 0);
+        assert_se(deserialize_item(f, format, &buffer, &allocated, &k, &v) == -ENODATA);
+}
+
+static void test_header(const void *data, size_t size, int expected) {
+        _cleanup_fclose_ FILE *f = NULL;
+        SerializationFormat detected;
+
+        assert_se(f = tmpfile());
+        if (size > 0)
+                assert_se(fwrite(data, size, 1, f) == 1);
+        assert_se(fflush_and_check(f) >= 0);
+        rewind(f);
+
+        if (expected < 0)
+                assert_se(deserialize_header(f, &detected) == expected);
+        else {
+                assert_se(deserialize_header(f, &detected) >= 0);
+                assert_se(detected == (SerializationFormat) expected);
+        }
+}
+
+static void test_headers(void) {
+        log_info("/* %s */", __func__);
+
+        /* Streams without signature, even empty ones, are text */
+        test_header(NULL, 0, SERIALIZATION_TEXT);
+        test_header("current-job-id=1\n", 17, SERIALIZATION_TEXT);
+
+        test_header("\0SDSTATE\x01\0\0\0\0\0\0\0", 16, SERIALIZATION_BINARY);
+        test_header("\0SDSTATE\x02\0\0\0\0\0\0\0", 16, -EPROTONOSUPPORT);
+        test_header("\0SDSTATE\0\0\0\0\0\0\0\0", 16, -EPROTONOSUPPORT);
+        test_header("\0SDSTAT", 7, -EBADMSG);
+        test_header("\0XXXXXXX\x01\0\0\0\0\0\0\0", 16, -EBADMSG);
+}
+
+static void write_unit(const char *dir, const char *name) {
+        _cleanup_free_ char *p = NULL, *link = NULL;
+
+        assert_se(p = strjoin(dir, "/", name));
+        assert_se(write_string_file(p, "[Unit]\nDefaultDependencies=no\n[Service]\nExecStart=/bin/true\n", WRITE_STRING_FILE_CREATE) >= 0);
+
+        assert_se(link = strjoin(dir, "/test.target.wants/", name));
+        assert_se(symlink(p, link) >= 0);
+}
+
+static Manager *start_manager(void) {
+        Manager *m = NULL;
+        Unit *target;
+
+        assert_se(manager_new(UNIT_FILE_USER, true, &m) >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+        assert_se(manager_load_unit(m, "test.target", NULL, NULL, &target) >= 0);
+
+        return m;
+}
+
+static Manager *round_trip(Manager *m, SerializationFormat format) {
+        _cleanup_fdset_free_ FDSet *fds = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        Manager *copy;
+
+        m->serialization_format = format;
+
+        assert_se(manager_open_serialization(m, &f) >= 0);
+        assert_se(fds = fdset_new());
+        assert_se(manager_serialize(m, f, fds, false) >= 0);
+        assert_se(fflush_and_check(f) >= 0);
+        rewind(f);
+
+        copy = start_manager();
+        assert_se(manager_deserialize(copy, f, fds) >= 0);
+        assert_se(copy->deserialization_format == format);
+
+        return copy;
+}
+
+static void check_units(Manager *m, Manager *copy) {
+        Iterator i;
+        Unit *u, *v;
+
+        HASHMAP_FOREACH(u, m->units, i) {
+                if (u->type != UNIT_SERVICE)
+                        continue;
+
+                assert_se(v = manager_get_unit(copy, u->id));
+                assert_se(sd_id128_equal(u->invocation_id, v->invocation_id));
+                assert_se(u->inactive_exit_timestamp.realtime == v->inactive_exit_timestamp.realtime);
+                assert_se(u->inactive_exit_timestamp.monotonic == v->inactive_exit_timestamp.monotonic);
+        }
+}
+
+static void test_round_trip(SerializationFormat first, SerializationFormat second) {
+        Manager *m, *a, *b;
+        Iterator i;
+        Unit *u;
+
+        log_info("/* %s(%s, %s) */", __func__,
+                 serialization_format_to_string(first),
+                 serialization_format_to_string(second));
+
+        m = start_manager();
+
+        /* Give the units some state worth carrying over */
+        HASHMAP_FOREACH(u, m->units, i) {
+                sd_id128_t id;
+
+                if (u->type != UNIT_SERVICE)
+                        continue;
+
+                assert_se(sd_id128_randomize(&id) >= 0);
+                assert_se(unit_set_invocation_id(u, id) >= 0);
+                dual_timestamp_get(&u->inactive_exit_timestamp);
+        }
+
+        /* State written in one format and passed on in the other, as
+         * on reexecution into a version with a different default,
+         * arrives unchanged */
+        a = round_trip(m, first);
+        check_units(m, a);
+
+        b = round_trip(a, second);
+        check_units(m, b);
+        assert_se(b->units_generation >= m->units_generation);
+
+        manager_free(b);
+        manager_free(a);
+        manager_free(m);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
+        char dir[] = "/tmp/test-serialize.XXXXXX";
+        Manager *m = NULL;
+        const char *p;
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        test_items(SERIALIZATION_TEXT);
+        test_items(SERIALIZATION_BINARY);
+        test_headers();
+
+        assert_se(mkdtemp(dir));
+
+        p = strjoina(dir, "/test.target");
+        assert_se(write_string_file(p, "[Unit]\nDefaultDependencies=no\n", WRITE_STRING_FILE_CREATE) >= 0);
+        p = strjoina(dir, "/test.target.wants");
+        assert_se(mkdir(p, 0755) >= 0);
+
+        write_unit(dir, "a.service");
+        write_unit(dir, "b.service");
+        write_unit(dir, "c.service");
+
+        assert_se(set_unit_path(dir) >= 0);
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+
+        r = manager_new(UNIT_FILE_USER, true, &m);
+        if (MANAGER_SKIP_TEST(r)) {
+                log_notice_errno(r, "Skipping test: manager_new: %m");
+                (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+                return EXIT_TEST_SKIP;
+        }
+        assert_se(r >= 0);
+        manager_free(m);
+
+        test_round_trip(SERIALIZATION_TEXT, SERIALIZATION_BINARY);
+        test_round_trip(SERIALIZATION_BINARY, SERIALIZATION_TEXT);
+
+        (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+
+        return 0;
+}
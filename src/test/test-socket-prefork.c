@@ -0,0 +1,172 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "fd-util.h"
+#include "fileio.h"
+#include "manager.h"
+#include "rm-rf.h"
+#include "socket.h"
+#include "string-util.h"
+#include "test-helper.h"
+#include "tests.h"
+#include "unit.h"
+
+/* Starts an Accept=yes socket with a prefork pool, hands a connection to
+ * one of the workers and checks that the pool does not use up the
+ * trigger limit of the socket. The workers report being idle once and
+ * exit as soon as they receive anything. */
+
+#define TIMEOUT_USEC (20 * USEC_PER_SEC)
+
+static unsigned count_workers(Socket *s, SocketPreforkState state) {
+        SocketPreforkWorker *w;
+        unsigned n = 0;
+
+        LIST_FOREACH(prefork, w, s->prefork_workers)
+                if (w->state == state)
+                        n++;
+
+        return n;
+}
+
+static bool socket_has_idle_workers(Manager *m, Socket *s) {
+        return count_workers(s, SOCKET_PREFORK_IDLE) == s->prefork_min_spare;
+}
+
+static bool socket_has_accepted(Manager *m, Socket *s) {
+        return s->n_accepted > 0;
+}
+
+static bool all_stopped(Manager *m, Socket *s) {
+        Unit *u;
+        Iterator i;
+        const char *k;
+
+        if (!hashmap_isempty(m->jobs))
+                return false;
+
+        HASHMAP_FOREACH_KEY(u, k, m->units, i)
+                if (startswith(k, "pf@") && !UNIT_IS_INACTIVE_OR_FAILED(unit_active_state(u)))
+                        return false;
+
+        return true;
+}
+
+static void run_until(Manager *m, Socket *s, bool (*done)(Manager *m, Socket *s)) {
+        usec_t timeout;
+
+        timeout = now(CLOCK_MONOTONIC) + TIMEOUT_USEC;
+        while (!done(m, s)) {
+                assert_se(sd_event_run(m->event, 100 * USEC_PER_MSEC) >= 0);
+                assert_se(now(CLOCK_MONOTONIC) < timeout);
+        }
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
+        _cleanup_close_ int fd = -1;
+        char dir[] = "/tmp/test-socket-prefork.XXXXXX";
+        union sockaddr_union sa = {
+                .un.sun_family = AF_UNIX,
+        };
+        Manager *m = NULL;
+        const char *p;
+        Socket *s;
+        Unit *u;
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        assert_se(mkdtemp(dir));
+
+        p = strjoina(dir, "/pf.socket");
+        assert_se(write_string_file(p,
+                                    strjoina("[Unit]\n"
+                                             "DefaultDependencies=no\n"
+                                             "[Socket]\n"
+                                             "ListenStream=", dir, "/pf.sock\n"
+                                             "Accept=yes\n"
+                                             "PreforkMinSpare=2\n"
+                                             "TriggerLimitBurst=2\n"
+                                             "TriggerLimitIntervalSec=1h\n"),
+                                    WRITE_STRING_FILE_CREATE) >= 0);
+
+        p = strjoina(dir, "/pf@.service");
+        assert_se(write_string_file(p,
+                                    "[Unit]\n"
+                                    "DefaultDependencies=no\n"
+                                    "[Service]\n"
+                                    "ExecStart=/bin/sh -c 'printf READY=1 >&3; read x <&3; exit 0'\n",
+                                    WRITE_STRING_FILE_CREATE) >= 0);
+
+        assert_se(set_unit_path(dir) >= 0);
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+
+        r = manager_new(UNIT_FILE_USER, true, &m);
+        if (MANAGER_SKIP_TEST(r)) {
+                log_notice_errno(r, "Skipping test: manager_new: %m");
+                (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+                return EXIT_TEST_SKIP;
+        }
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        assert_se(manager_load_unit(m, "pf.socket", NULL, NULL, &u) >= 0);
+        s = SOCKET(u);
+        assert_se(s->prefork_max_spare == 2);
+
+        assert_se(manager_add_job(m, JOB_START, u, JOB_REPLACE, NULL, NULL) >= 0);
+        run_until(m, s, socket_has_idle_workers);
+
+        /* Filling the pool took from its own budget only */
+        assert_se(s->prefork_limit.num == 2);
+        assert_se(s->trigger_limit.num == 0);
+        assert_se(s->n_connections == 2);
+        assert_se(manager_get_unit(m, "pf@prefork-0.service"));
+        assert_se(manager_get_unit(m, "pf@prefork-1.service"));
+
+        /* A connection goes to an idle worker rather than a new instance */
+        strncpy(sa.un.sun_path, strjoina(dir, "/pf.sock"), sizeof(sa.un.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+        assert_se(fd >= 0);
+        assert_se(connect(fd, &sa.sa, SOCKADDR_UN_LEN(sa.un)) >= 0);
+
+        run_until(m, s, socket_has_accepted);
+
+        assert_se(s->n_accepted == 1);
+        assert_se(s->trigger_limit.num == 1);
+        assert_se(IN_SET(s->state, SOCKET_LISTENING, SOCKET_RUNNING));
+        assert_se(s->result == SOCKET_SUCCESS);
+        assert_se(count_workers(s, SOCKET_PREFORK_BUSY) == 1);
+
+        /* Stopping the socket closes the channels, which makes the workers exit */
+        assert_se(manager_add_job(m, JOB_STOP, u, JOB_REPLACE, NULL, NULL) >= 0);
+        run_until(m, s, all_stopped);
+
+        assert_se(!s->prefork_workers);
+        assert_se(s->result == SOCKET_SUCCESS);
+
+        manager_free(m);
+        (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+
+        return 0;
+}
@@ -0,0 +1,146 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <unistd.h>
+
+#include "fileio.h"
+#include "manager.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "test-helper.h"
+#include "tests.h"
+#include "trace.h"
+#include "unit.h"
+
+static void test_trace_buffer(void) {
+        TraceBuffer *t;
+        const TraceEvent *e;
+        TracePhase p;
+
+        assert_se(!trace_buffer_get(NULL, 0));
+        assert_se(trace_begin(NULL) == 0);
+        trace_end(NULL, TRACE_SPAWN, "foo.service", 1);
+
+        assert_se(t = trace_buffer_new(3));
+
+        trace_buffer_add(t, TRACE_UNIT_LOAD, "a.service", 10, 20);
+        trace_buffer_add(t, TRACE_TRANSACTION, NULL, 30, 25);
+        assert_se(t->n_events == 2);
+        assert_se(t->n_dropped == 0);
+
+        assert_se(e = trace_buffer_get(t, 0));
+        assert_se(e->phase == TRACE_UNIT_LOAD);
+        assert_se(streq(e->name, "a.service"));
+        assert_se(e->begin == 10 && e->end == 20);
+
+        /* The end is never before the beginning */
+        assert_se(e = trace_buffer_get(t, 1));
+        assert_se(!e->name);
+        assert_se(e->begin == 30 && e->end == 30);
+        assert_se(!trace_buffer_get(t, 2));
+
+        /* Once full, the oldest events are overwritten */
+        trace_buffer_add(t, TRACE_SPAWN, "b.service", 40, 50);
+        trace_buffer_add(t, TRACE_JOB_RUN, "c.service", 60, 70);
+        trace_buffer_add(t, TRACE_JOB_WAIT, "d.service", 80, 90);
+        assert_se(t->n_events == 3);
+        assert_se(t->n_dropped == 2);
+
+        assert_se(e = trace_buffer_get(t, 0));
+        assert_se(streq(e->name, "b.service"));
+        assert_se(e = trace_buffer_get(t, 2));
+        assert_se(streq(e->name, "d.service"));
+        assert_se(!trace_buffer_get(t, 3));
+
+        trace_end(t, TRACE_CGROUP_REALIZE, "e.service", trace_begin(t));
+        assert_se(e = trace_buffer_get(t, 2));
+        assert_se(e->phase == TRACE_CGROUP_REALIZE);
+        assert_se(e->begin > 0 && e->end >= e->begin);
+
+        trace_buffer_free(t);
+
+        for (p = 0; p < _TRACE_PHASE_MAX; p++)
+                assert_se(trace_phase_from_string(trace_phase_to_string(p)) == p);
+}
+
+static void test_trace_manager(const char *dir) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
+        Manager *m = NULL;
+        TraceBuffer *t;
+        const TraceEvent *e;
+        bool unit_load = false, units_load = false;
+        const char *p;
+        Unit *u;
+        size_t i;
+        int r;
+
+        p = strjoina(dir, "/trace.service");
+        assert_se(write_string_file(p, "[Service]\nExecStart=/bin/true\n", WRITE_STRING_FILE_CREATE) >= 0);
+
+        assert_se(set_unit_path(dir) >= 0);
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+
+        r = manager_new(UNIT_FILE_USER, true, &m);
+        if (MANAGER_SKIP_TEST(r)) {
+                log_notice_errno(r, "Skipping test: manager_new: %m");
+                return;
+        }
+        assert_se(r >= 0);
+
+        assert_se(manager_set_trace_buffer_size(m, 1024) >= 0);
+        t = m->trace;
+        assert_se(t);
+
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+        assert_se(manager_load_unit(m, "trace.service", NULL, NULL, &u) >= 0);
+
+        for (i = 0; (e = trace_buffer_get(m->trace, i)); i++) {
+                assert_se(e->end >= e->begin);
+
+                if (e->phase == TRACE_UNITS_LOAD)
+                        units_load = true;
+                if (e->phase == TRACE_UNIT_LOAD && streq_ptr(e->name, "trace.service"))
+                        unit_load = true;
+        }
+        assert_se(units_load);
+        assert_se(unit_load);
+
+        /* Setting the same size again, as on reload, keeps the events */
+        assert_se(manager_set_trace_buffer_size(m, 1024) >= 0);
+        assert_se(m->trace == t);
+        assert_se(m->trace->n_events == i);
+
+        assert_se(manager_set_trace_buffer_size(m, 0) >= 0);
+        assert_se(!m->trace);
+
+        manager_free(m);
+}
+
+int main(int argc, char *argv[]) {
+        char dir[] = "/tmp/test-trace.XXXXXX";
+
+        log_parse_environment();
+        log_open();
+
+        test_trace_buffer();
+
+        assert_se(mkdtemp(dir));
+        test_trace_manager(dir);
+        (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+
+        return 0;
+}
@@ -0,0 +1,140 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fileio.h"
+#include "manager.h"
+#include "parse-util.h"
+#include "rm-rf.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "test-helper.h"
+#include "tests.h"
+#include "unit.h"
+
+/* Measures how long it takes to build and activate the transaction
+ * for a target pulling in a long After= chain of units, once while
+ * all of them are inactive, and once again when they are all active
+ * and hence all their jobs are redundant. Pass the number of units as
+ * argument, the default is 5000. */
+
+#define N_UNITS_DEFAULT 5000U
+
+static void write_unit(const char *dir, unsigned i) {
+        char name[sizeof("bench-.target") + DECIMAL_STR_MAX(unsigned)];
+        _cleanup_free_ char *p = NULL, *link = NULL, *contents = NULL;
+
+        xsprintf(name, "bench-%u.target", i);
+
+        assert_se(p = strjoin(dir, "/", name));
+        if (i > 0)
+                assert_se(asprintf(&contents, "[Unit]\nAfter=bench-%u.target\n", i - 1) >= 0);
+        else
+                assert_se(contents = strdup("[Unit]\n"));
+        assert_se(write_string_file(p, contents, WRITE_STRING_FILE_CREATE) >= 0);
+
+        assert_se(link = strjoin(dir, "/bench.target.wants/", name));
+        assert_se(symlink(p, link) >= 0);
+}
+
+static usec_t timed_start(Manager *m, Unit *u) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        usec_t t;
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(manager_add_job(m, JOB_START, u, JOB_REPLACE, &error, NULL) >= 0);
+        return now(CLOCK_MONOTONIC) - t;
+}
+
+static void run_jobs(Manager *m) {
+        usec_t timeout;
+
+        timeout = now(CLOCK_MONOTONIC) + 30 * USEC_PER_SEC;
+
+        while (!hashmap_isempty(m->jobs)) {
+                assert_se(now(CLOCK_MONOTONIC) < timeout);
+                assert_se(sd_event_run(m->event, 100 * USEC_PER_MSEC) >= 0);
+        }
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
+        char dir[] = "/tmp/test-transaction.XXXXXX";
+        char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX];
+        unsigned n = N_UNITS_DEFAULT, i;
+        usec_t inactive, active;
+        Manager *m = NULL;
+        const char *p;
+        Unit *target;
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &n) >= 0 && n > 0);
+
+        assert_se(mkdtemp(dir));
+
+        p = strjoina(dir, "/bench.target");
+        assert_se(write_string_file(p, "[Unit]\nDescription=Benchmark\n", WRITE_STRING_FILE_CREATE) >= 0);
+        p = strjoina(dir, "/bench.target.wants");
+        assert_se(mkdir(p, 0755) >= 0);
+
+        for (i = 0; i < n; i++)
+                write_unit(dir, i);
+
+        assert_se(set_unit_path(dir) >= 0);
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+
+        r = manager_new(UNIT_FILE_USER, true, &m);
+        if (MANAGER_SKIP_TEST(r)) {
+                log_notice_errno(r, "Skipping test: manager_new: %m");
+                (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+                return EXIT_TEST_SKIP;
+        }
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        assert_se(manager_load_unit(m, "bench.target", NULL, NULL, &target) >= 0);
+
+        inactive = timed_start(m, target);
+        assert_se(hashmap_size(m->jobs) >= n + 1);
+        run_jobs(m);
+        assert_se(unit_active_state(target) == UNIT_ACTIVE);
+        assert_se(unit_active_state(manager_get_unit(m, "bench-0.target")) == UNIT_ACTIVE);
+
+        /* Everything is up already, only the anchor job is left */
+        active = timed_start(m, target);
+        assert_se(target->job);
+        assert_se(!manager_get_unit(m, "bench-0.target")->job);
+        run_jobs(m);
+
+        log_info("%u units: transaction with inactive units %s, with active units %s",
+                 n,
+                 format_timespan(a, sizeof(a), inactive, USEC_PER_MSEC),
+                 format_timespan(b, sizeof(b), active, USEC_PER_MSEC));
+
+        manager_free(m);
+        (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+
+        return 0;
+}
@@ -0,0 +1,175 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "bus-common-errors.h"
+#include "bus-error.h"
+#include "fileio.h"
+#include "manager.h"
+#include "rm-rf.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "test-helper.h"
+#include "tests.h"
+#include "unit.h"
+
+#define N_CHAIN 1000U
+
+static void write_unit(const char *dir, const char *name, const char *contents) {
+        const char *p;
+
+        p = strjoina(dir, "/", name);
+        assert_se(write_string_file(p, contents, WRITE_STRING_FILE_CREATE) >= 0);
+}
+
+static void write_chain(const char *dir) {
+        _cleanup_free_ char *contents = NULL;
+        unsigned i;
+
+        for (i = 0; i < N_CHAIN; i++) {
+                char name[sizeof("chain-.target") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(name, "chain-%u.target", i);
+                contents = mfree(contents);
+                if (i > 0)
+                        assert_se(asprintf(&contents, "[Unit]\nDefaultDependencies=no\nRequires=chain-%u.target\n", i - 1) >= 0);
+                else
+                        assert_se(contents = strdup("[Unit]\nDefaultDependencies=no\n"));
+                write_unit(dir, name, contents);
+        }
+
+        contents = mfree(contents);
+        assert_se(asprintf(&contents, "[Unit]\nDefaultDependencies=no\nRequires=chain-%u.target\n", N_CHAIN - 1) >= 0);
+        write_unit(dir, "chain.target", contents);
+}
+
+static void run_jobs(Manager *m) {
+        usec_t timeout;
+
+        timeout = now(CLOCK_MONOTONIC) + 30 * USEC_PER_SEC;
+
+        while (!hashmap_isempty(m->jobs)) {
+                assert_se(now(CLOCK_MONOTONIC) < timeout);
+                assert_se(sd_event_run(m->event, 100 * USEC_PER_MSEC) >= 0);
+        }
+}
+
+static Unit *load_unit(Manager *m, const char *name) {
+        Unit *u;
+
+        assert_se(manager_load_unit(m, name, NULL, NULL, &u) >= 0);
+        return u;
+}
+
+static void test_cycle(Manager *m) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        Unit *a, *b, *c, *x, *y;
+
+        /* An ordering cycle between units that are only wanted is
+         * broken by dropping one of their jobs */
+        a = load_unit(m, "a.target");
+        b = load_unit(m, "b.target");
+        c = load_unit(m, "c.target");
+
+        assert_se(manager_add_job(m, JOB_START, a, JOB_REPLACE, &error, NULL) >= 0);
+        assert_se(a->job);
+        assert_se(!!b->job != !!c->job);
+        run_jobs(m);
+        assert_se(unit_active_state(a) == UNIT_ACTIVE);
+
+        /* One between units that are required can't be */
+        x = load_unit(m, "x.target");
+        y = load_unit(m, "y.target");
+
+        assert_se(manager_add_job(m, JOB_START, x, JOB_REPLACE, &error, NULL) < 0);
+        assert_se(sd_bus_error_has_name(&error, BUS_ERROR_TRANSACTION_ORDER_IS_CYCLIC));
+        assert_se(!x->job && !y->job);
+}
+
+static void test_requirements(Manager *m) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        Unit *p, *q, *u;
+
+        /* A unit requiring a masked one can't be started, but a unit
+         * merely wanting it can */
+        p = load_unit(m, "p.target");
+        q = load_unit(m, "q.target");
+
+        assert_se(manager_add_job(m, JOB_START, q, JOB_REPLACE, &error, NULL) < 0);
+        assert_se(!q->job);
+        sd_bus_error_free(&error);
+
+        assert_se(manager_add_job(m, JOB_START, p, JOB_REPLACE, &error, NULL) >= 0);
+        assert_se(p->job);
+        run_jobs(m);
+        assert_se(unit_active_state(p) == UNIT_ACTIVE);
+
+        /* A long requirement chain is pulled in completely */
+        u = load_unit(m, "chain.target");
+        assert_se(manager_add_job(m, JOB_START, u, JOB_REPLACE, &error, NULL) >= 0);
+        assert_se(hashmap_size(m->jobs) == N_CHAIN + 1);
+        run_jobs(m);
+        assert_se(unit_active_state(manager_get_unit(m, "chain-0.target")) == UNIT_ACTIVE);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
+        char dir[] = "/tmp/test-transaction.XXXXXX";
+        Manager *m = NULL;
+        const char *p;
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        assert_se(mkdtemp(dir));
+
+        write_unit(dir, "a.target", "[Unit]\nDefaultDependencies=no\nWants=b.target c.target\n");
+        write_unit(dir, "b.target", "[Unit]\nDefaultDependencies=no\nAfter=c.target\n");
+        write_unit(dir, "c.target", "[Unit]\nDefaultDependencies=no\nAfter=b.target\n");
+        write_unit(dir, "x.target", "[Unit]\nDefaultDependencies=no\nRequires=y.target\nAfter=y.target\n");
+        write_unit(dir, "y.target", "[Unit]\nDefaultDependencies=no\nRequires=x.target\nAfter=x.target\n");
+        write_unit(dir, "p.target", "[Unit]\nDefaultDependencies=no\nWants=q.target\n");
+        write_unit(dir, "q.target", "[Unit]\nDefaultDependencies=no\nRequires=masked.target\n");
+        p = strjoina(dir, "/masked.target");
+        assert_se(symlink("/dev/null", p) >= 0);
+
+        write_chain(dir);
+
+        assert_se(set_unit_path(dir) >= 0);
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+
+        r = manager_new(UNIT_FILE_USER, true, &m);
+        if (MANAGER_SKIP_TEST(r)) {
+                log_notice_errno(r, "Skipping test: manager_new: %m");
+                (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+                return EXIT_TEST_SKIP;
+        }
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        test_cycle(m);
+        test_requirements(m);
+
+        manager_free(m);
+        (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+
+        return 0;
+}
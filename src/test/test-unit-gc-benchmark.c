@@ -0,0 +1,144 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fileio.h"
+#include "manager.h"
+#include "parse-util.h"
+#include "rm-rf.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "test-helper.h"
+#include "tests.h"
+#include "unit.h"
+
+/* Measures running the garbage collector once for each of many units
+ * wanted by the same target, as happens when units stop one by one,
+ * and then once for as many units nothing references. Pass the number
+ * of units as argument, the default is 10000. */
+
+#define N_UNITS_DEFAULT 10000U
+
+static void write_unit(const char *dir, const char *prefix, unsigned i, bool wanted) {
+        char name[sizeof("orphan-.service") + DECIMAL_STR_MAX(unsigned)];
+        _cleanup_free_ char *p = NULL, *link = NULL;
+
+        xsprintf(name, "%s-%u.service", prefix, i);
+
+        assert_se(p = strjoin(dir, "/", name));
+        assert_se(write_string_file(p,
+                                    "[Service]\n"
+                                    "ExecStart=/bin/true\n",
+                                    WRITE_STRING_FILE_CREATE) >= 0);
+
+        if (wanted) {
+                assert_se(link = strjoin(dir, "/bench.target.wants/", name));
+                assert_se(symlink(p, link) >= 0);
+        }
+}
+
+static Unit *load_unit(Manager *m, const char *prefix, unsigned i) {
+        char name[sizeof("orphan-.service") + DECIMAL_STR_MAX(unsigned)];
+        Unit *u;
+
+        xsprintf(name, "%s-%u.service", prefix, i);
+        assert_se(manager_load_unit(m, name, NULL, NULL, &u) >= 0);
+
+        return u;
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
+        char dir[] = "/tmp/test-unit-gc-benchmark.XXXXXX";
+        char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX];
+        unsigned n = N_UNITS_DEFAULT, i;
+        usec_t t, leaves, orphans;
+        Unit *target, *u;
+        const char *p;
+        Manager *m = NULL;
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &n) >= 0 && n > 0);
+
+        assert_se(mkdtemp(dir));
+
+        p = strjoina(dir, "/bench.target");
+        assert_se(write_string_file(p, "[Unit]\nDescription=Benchmark\n", WRITE_STRING_FILE_CREATE) >= 0);
+        p = strjoina(dir, "/bench.target.wants");
+        assert_se(mkdir(p, 0755) >= 0);
+
+        for (i = 0; i < n; i++) {
+                write_unit(dir, "bench", i, true);
+                write_unit(dir, "orphan", i, false);
+        }
+
+        assert_se(set_unit_path(dir) >= 0);
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+
+        r = manager_new(UNIT_FILE_USER, true, &m);
+        if (MANAGER_SKIP_TEST(r)) {
+                log_notice_errno(r, "Skipping test: manager_new: %m");
+                (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+                return EXIT_TEST_SKIP;
+        }
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        assert_se(manager_load_unit(m, "bench.target", NULL, NULL, &target) >= 0);
+        assert_se(unit_dependency_count(target, UNIT_WANTS) == n);
+
+        /* Keep the target, and hence everything it wants, around */
+        target->perpetual = true;
+
+        /* Start from a clean slate, loading might have queued units */
+        while (manager_dispatch_gc_unit_queue(m) > 0)
+                ;
+
+        t = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n; i++) {
+                u = load_unit(m, "bench", i);
+                unit_add_to_gc_queue(u);
+                assert_se(manager_dispatch_gc_unit_queue(m) == 1);
+                assert_se(!u->in_cleanup_queue);
+        }
+        leaves = now(CLOCK_MONOTONIC) - t;
+
+        for (i = 0; i < n; i++)
+                unit_add_to_gc_queue(load_unit(m, "orphan", i));
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(manager_dispatch_gc_unit_queue(m) == n);
+        orphans = now(CLOCK_MONOTONIC) - t;
+
+        log_info("%u units: %u runs for wanted units %s, one run for unreferenced units %s",
+                 n, n,
+                 format_timespan(a, sizeof(a), leaves, USEC_PER_MSEC),
+                 format_timespan(b, sizeof(b), orphans, USEC_PER_MSEC));
+
+        manager_free(m);
+        (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+
+        return 0;
+}
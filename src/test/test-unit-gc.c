@@ -0,0 +1,144 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fileio.h"
+#include "manager.h"
+#include "rm-rf.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "test-helper.h"
+#include "tests.h"
+#include "unit.h"
+
+/* Runs the garbage collector once for each of a few units wanted by
+ * the same target, as happens when units stop one by one, and then
+ * once for as many units nothing references */
+
+#define N_UNITS 16U
+
+static void write_unit(const char *dir, const char *prefix, unsigned i, bool wanted) {
+        char name[sizeof("orphan-.service") + DECIMAL_STR_MAX(unsigned)];
+        _cleanup_free_ char *p = NULL, *link = NULL;
+
+        xsprintf(name, "%s-%u.service", prefix, i);
+
+        assert_se(p = strjoin(dir, "/", name));
+        assert_se(write_string_file(p,
+                                    "[Service]\n"
+                                    "ExecStart=/bin/true\n",
+                                    WRITE_STRING_FILE_CREATE) >= 0);
+
+        if (wanted) {
+                assert_se(link = strjoin(dir, "/test.target.wants/", name));
+                assert_se(symlink(p, link) >= 0);
+        }
+}
+
+static Unit *load_unit(Manager *m, const char *prefix, unsigned i) {
+        char name[sizeof("orphan-.service") + DECIMAL_STR_MAX(unsigned)];
+        Unit *u;
+
+        xsprintf(name, "%s-%u.service", prefix, i);
+        assert_se(manager_load_unit(m, name, NULL, NULL, &u) >= 0);
+
+        return u;
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
+        char dir[] = "/tmp/test-unit-gc.XXXXXX";
+        unsigned n = N_UNITS, i;
+        Unit *target, *u;
+        const char *p;
+        Manager *m = NULL;
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        assert_se(mkdtemp(dir));
+
+        p = strjoina(dir, "/test.target");
+        assert_se(write_string_file(p, "[Unit]\nDescription=Test\n", WRITE_STRING_FILE_CREATE) >= 0);
+        p = strjoina(dir, "/test.target.wants");
+        assert_se(mkdir(p, 0755) >= 0);
+
+        for (i = 0; i < n; i++) {
+                write_unit(dir, "test", i, true);
+                write_unit(dir, "orphan", i, false);
+        }
+
+        assert_se(set_unit_path(dir) >= 0);
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+
+        r = manager_new(UNIT_FILE_USER, true, &m);
+        if (MANAGER_SKIP_TEST(r)) {
+                log_notice_errno(r, "Skipping test: manager_new: %m");
+                (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+                return EXIT_TEST_SKIP;
+        }
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        assert_se(manager_load_unit(m, "test.target", NULL, NULL, &target) >= 0);
+        assert_se(unit_dependency_count(target, UNIT_WANTS) == n);
+
+        /* Keep the target, and hence everything it wants, around */
+        target->perpetual = true;
+
+        /* Start from a clean slate, loading might have queued units */
+        while (manager_dispatch_gc_unit_queue(m) > 0)
+                ;
+
+        m->n_gc_runs = m->n_gc_units_visited = m->n_gc_units_collected = 0;
+
+        for (i = 0; i < n; i++) {
+                u = load_unit(m, "test", i);
+                unit_add_to_gc_queue(u);
+                assert_se(manager_dispatch_gc_unit_queue(m) == 1);
+                assert_se(!u->in_cleanup_queue);
+        }
+
+        /* Each run looked at the unit and the target wanting it, and
+         * nothing else */
+        assert_se(m->n_gc_runs == n);
+        assert_se(m->n_gc_units_visited == 2 * n);
+        assert_se(m->n_gc_units_collected == 0);
+
+        m->n_gc_runs = m->n_gc_units_visited = 0;
+
+        for (i = 0; i < n; i++)
+                unit_add_to_gc_queue(load_unit(m, "orphan", i));
+
+        assert_se(manager_dispatch_gc_unit_queue(m) == n);
+
+        assert_se(m->n_gc_runs == 1);
+        assert_se(m->n_gc_units_visited == n);
+        assert_se(m->n_gc_units_collected == n);
+        for (i = 0; i < n; i++)
+                assert_se(load_unit(m, "orphan", i)->in_cleanup_queue);
+
+        manager_free(m);
+        (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+
+        return 0;
+}
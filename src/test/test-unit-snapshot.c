@@ -0,0 +1,163 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <sys/mman.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "manager-snapshot.h"
+#include "manager.h"
+#include "memfd-util.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "test-helper.h"
+#include "tests.h"
+#include "unit-snapshot.h"
+#include "unit.h"
+
+static const UnitSnapshotEntry *find_entry(const UnitSnapshotHeader *h, const char *id) {
+        uint64_t i;
+
+        for (i = 0; i < h->n_entries; i++) {
+                const UnitSnapshotEntry *e = unit_snapshot_entry(h, i);
+
+                if (streq_ptr(unit_snapshot_string(h, e->id), id))
+                        return e;
+        }
+
+        return NULL;
+}
+
+static void *snapshot(Manager *m, uint64_t since, const UnitSnapshotHeader **h) {
+        void *p;
+        size_t size;
+
+        assert_se(manager_build_units_snapshot(m, since, &p, &size) >= 0);
+        assert_se(unit_snapshot_verify(p, size, h) >= 0);
+
+        return p;
+}
+
+static void test_snapshot(Manager *m) {
+        const UnitSnapshotHeader *h;
+        const UnitSnapshotEntry *e;
+        _cleanup_free_ void *p = NULL, *q = NULL, *t = NULL;
+        _cleanup_close_ int fd = -1;
+        uint64_t generation, size;
+        Unit *a, *b;
+        void *map;
+
+        assert_se(manager_load_unit(m, "a.service", NULL, NULL, &a) >= 0);
+        assert_se(manager_load_unit(m, "b.service", NULL, NULL, &b) >= 0);
+
+        /* Everything */
+        p = snapshot(m, 0, &h);
+        assert_se(h->flags & UNIT_SNAPSHOT_COMPLETE);
+        assert_se(h->generation == m->units_generation);
+        assert_se(e = find_entry(h, "a.service"));
+        assert_se(!(e->flags & UNIT_SNAPSHOT_REMOVED));
+        assert_se(streq(unit_snapshot_string(h, e->load_state), "loaded"));
+        assert_se(streq(unit_snapshot_string(h, e->active_state), "inactive"));
+        assert_se(streq(unit_snapshot_string(h, e->sub_state), "dead"));
+        assert_se(e->main_pid == 0);
+        assert_se(find_entry(h, "b.service"));
+        generation = h->generation;
+
+        /* Nothing changed since */
+        q = snapshot(m, generation, &h);
+        assert_se(!(h->flags & UNIT_SNAPSHOT_COMPLETE));
+        assert_se(h->n_entries == 0);
+        q = mfree(q);
+
+        /* One unit changed */
+        unit_add_to_dbus_queue(a);
+        q = snapshot(m, generation, &h);
+        assert_se(!(h->flags & UNIT_SNAPSHOT_COMPLETE));
+        assert_se(h->n_entries == 1);
+        assert_se(e = find_entry(h, "a.service"));
+        assert_se(e->generation > generation);
+        generation = h->generation;
+        q = mfree(q);
+
+        /* One unit went away */
+        unit_free(b);
+        q = snapshot(m, generation, &h);
+        assert_se(h->n_entries == 1);
+        assert_se(e = find_entry(h, "b.service"));
+        assert_se(e->flags & UNIT_SNAPSHOT_REMOVED);
+        q = mfree(q);
+
+        /* A generation we never handed out */
+        q = snapshot(m, m->units_generation + 1, &h);
+        assert_se(h->flags & UNIT_SNAPSHOT_COMPLETE);
+        assert_se(find_entry(h, "a.service"));
+        assert_se(!find_entry(h, "b.service"));
+
+        /* The same as sealed memfd */
+        assert_se(manager_units_snapshot_memfd(m, 0, &fd) >= 0);
+        assert_se(memfd_get_sealed(fd) > 0);
+        assert_se(memfd_get_size(fd, &size) >= 0);
+        assert_se(memfd_map(fd, 0, size, &map) >= 0);
+        assert_se(unit_snapshot_verify(map, size, &h) >= 0);
+        assert_se(find_entry(h, "a.service"));
+        assert_se(munmap(map, size) >= 0);
+
+        /* Truncated and corrupted tables are refused */
+        assert_se(t = memdup(p, sizeof(UnitSnapshotHeader) + 8));
+        assert_se(unit_snapshot_verify(t, sizeof(UnitSnapshotHeader) + 8, &h) == -EBADMSG);
+        ((UnitSnapshotHeader*) t)->signature[0] = 'X';
+        assert_se(unit_snapshot_verify(t, sizeof(UnitSnapshotHeader) + 8, &h) == -EBADMSG);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
+        char dir[] = "/tmp/test-unit-snapshot.XXXXXX";
+        Manager *m = NULL;
+        const char *p;
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        assert_se(mkdtemp(dir));
+
+        p = strjoina(dir, "/a.service");
+        assert_se(write_string_file(p, "[Service]\nExecStart=/bin/true\n", WRITE_STRING_FILE_CREATE) >= 0);
+        p = strjoina(dir, "/b.service");
+        assert_se(write_string_file(p, "[Service]\nExecStart=/bin/true\n", WRITE_STRING_FILE_CREATE) >= 0);
+
+        assert_se(set_unit_path(dir) >= 0);
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+
+        r = manager_new(UNIT_FILE_USER, true, &m);
+        if (MANAGER_SKIP_TEST(r)) {
+                log_notice_errno(r, "Skipping test: manager_new: %m");
+                (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+                return EXIT_TEST_SKIP;
+        }
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        test_snapshot(m);
+
+        manager_free(m);
+        (void) rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+
+        return 0;
+}